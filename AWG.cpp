@@ -0,0 +1,330 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include "AWG.h"
+#include "Debug.h"
+#define DEBUG_OUTPUT 0
+
+// Samples are unsigned, 128 is mid scale
+/// Rising ramp, 0 to full scale
+const uint8_t awgRampTable[AWG_TABLE_LENGTH] PROGMEM =
+{
+      0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,
+     16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,
+     32,  33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,
+     48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,
+     64,  65,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,  77,  78,  79,
+     80,  81,  82,  83,  84,  85,  86,  87,  88,  89,  90,  91,  92,  93,  94,  95,
+     96,  97,  98,  99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111,
+    112, 113, 114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124, 125, 126, 127,
+    128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143,
+    144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
+    160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
+    176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+    192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207,
+    208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223,
+    224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
+    240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255,
+};
+
+/// Exponential decay, five time constants per period
+const uint8_t awgExponentialTable[AWG_TABLE_LENGTH] PROGMEM =
+{
+    255, 250, 245, 240, 236, 231, 227, 222, 218, 214, 210, 206, 202, 198, 194, 190,
+    186, 183, 179, 176, 172, 169, 166, 162, 159, 156, 153, 150, 147, 144, 142, 139,
+    136, 134, 131, 128, 126, 123, 121, 119, 116, 114, 112, 110, 108, 106, 103, 101,
+     99,  98,  96,  94,  92,  90,  88,  87,  85,  83,  82,  80,  79,  77,  76,  74,
+     73,  71,  70,  69,  67,  66,  65,  63,  62,  61,  60,  59,  57,  56,  55,  54,
+     53,  52,  51,  50,  49,  48,  47,  46,  45,  45,  44,  43,  42,  41,  40,  40,
+     39,  38,  37,  37,  36,  35,  35,  34,  33,  33,  32,  31,  31,  30,  30,  29,
+     28,  28,  27,  27,  26,  26,  25,  25,  24,  24,  23,  23,  22,  22,  22,  21,
+     21,  20,  20,  20,  19,  19,  18,  18,  18,  17,  17,  17,  16,  16,  16,  15,
+     15,  15,  15,  14,  14,  14,  13,  13,  13,  13,  12,  12,  12,  12,  12,  11,
+     11,  11,  11,  10,  10,  10,  10,  10,   9,   9,   9,   9,   9,   9,   8,   8,
+      8,   8,   8,   8,   7,   7,   7,   7,   7,   7,   7,   7,   6,   6,   6,   6,
+      6,   6,   6,   6,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5,   4,   4,
+      4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   3,   3,   3,   3,   3,
+      3,   3,   3,   3,   3,   3,   3,   3,   3,   3,   3,   3,   2,   2,   2,   2,
+      2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   2,
+};
+
+/// P wave, QRS complex and T wave of one heartbeat
+const uint8_t awgCardiacTable[AWG_TABLE_LENGTH] PROGMEM =
+{
+     51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,
+     51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  52,  52,  53,
+     53,  54,  55,  56,  58,  60,  62,  64,  67,  69,  71,  73,  74,  75,  75,  75,
+     74,  73,  71,  69,  67,  65,  62,  60,  58,  57,  55,  54,  53,  53,  52,  52,
+     51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,
+     51,  51,  51,  51,  51,  51,  51,  51,  50,  49,  45,  40,  36,  38,  51,  79,
+    120, 168, 213, 245, 252, 232, 190, 137,  85,  44,  19,  10,  14,  24,  34,  42,
+     47,  49,  50,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,
+     51,  51,  51,  51,  51,  52,  52,  52,  53,  53,  54,  54,  55,  56,  57,  59,
+     60,  62,  64,  67,  69,  72,  76,  79,  82,  86,  90,  93,  97, 100, 103, 106,
+    108, 110, 111, 112, 112, 112, 111, 109, 107, 105, 102,  99,  96,  92,  88,  85,
+     81,  78,  75,  71,  69,  66,  64,  62,  60,  58,  57,  56,  55,  54,  53,  53,
+     52,  52,  52,  52,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,
+     51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,
+     51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,
+     51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,  51,
+};
+
+const uint8_t* const awgTables[] PROGMEM =
+{
+    awgRampTable,
+    awgExponentialTable,
+    awgCardiacTable,
+};
+
+AWGClass AWG;
+
+/// Working table read by the interrupt, a copy of a built-in table or the last upload
+static uint8_t awgSamples[AWG_TABLE_LENGTH];
+static volatile uint32_t awgPhase;
+static volatile uint32_t awgStep;
+
+/** Runs once per PWM period.  Only the accumulator add and one SRAM load, the new compare value takes effect at the
+ *  next BOTTOM so the jitter of this handler never reaches the output.
+ */
+ISR(TIMER2_OVF_vect)
+{
+    if (!AWG_ENABLED)
+    {
+        return;
+    }
+
+    uint32_t phase = awgPhase + awgStep;
+    awgPhase = phase;
+    OCR2B = awgSamples[(uint8_t) (phase >> 24)];
+}
+
+AWGClass::AWGClass()
+{
+    table = AWG_TABLE_RAMP;
+    userTableValid = false;
+    running = false;
+    uploadIndex = 0;
+    uploadSum = 0;
+    uploading = false;
+    uploadLastByteMs = 0;
+    phaseOffset = 0;
+}
+
+void AWGClass::init()
+{
+    stop();
+    selectTable(AWG_TABLE_RAMP);
+}
+
+void AWGClass::start()
+{
+    if (!AWG_ENABLED)
+    {
+        return;
+    }
+
+    uint8_t oldSREG = SREG;
+    cli();
+    awgPhase = phaseOffset;
+    OCR2B = awgSamples[(uint8_t) (phaseOffset >> 24)];
+    SREG = oldSREG;
+
+    pinMode(AWG_OUTPUT_PIN, OUTPUT);
+
+    // Fast PWM, TOP = 0xFF, clear OC2B on compare match, no prescaler
+    TCCR2A = _BV(COM2B1) | _BV(WGM21) | _BV(WGM20);
+    TCNT2 = 0;
+    TIFR2 = _BV(TOV2);
+    // An upload in progress holds the output until it ends, see endUpload()
+    TIMSK2 = uploading ? 0 : _BV(TOIE2);
+    TCCR2B = _BV(CS20);
+
+    running = true;
+    DEBUGLN(F("AWG started"));
+}
+
+void AWGClass::stop()
+{
+    // Timer2 belongs to the amplitude dither while the AWG is not running
+    if (running)
+    {
+        TCCR2B = 0;
+        TIMSK2 = 0;
+        TCCR2A = 0;
+    }
+
+    // Park the output low so the filter discharges
+    pinMode(AWG_OUTPUT_PIN, OUTPUT);
+    digitalWrite(AWG_OUTPUT_PIN, LOW);
+
+    running = false;
+}
+
+bool AWGClass::isRunning()
+{
+    return running;
+}
+
+/** @brief Sets the accumulator step, 2^32 * f / sample rate
+ *
+ *  @details Resolution is 62500 / 2^32 = 15 uHz, so the error is the truncation of the step alone.
+ */
+void AWGClass::setFrequency(uint32_t frequencyHz)
+{
+    uint32_t step;
+
+    if (frequencyHz > AWG_MAX_FREQUENCY_HZ)
+    {
+        frequencyHz = AWG_MAX_FREQUENCY_HZ;
+    }
+
+    // 2^32 * f / 62500 = 2^30 * f / 15625, done as two 32-bit divides: f < 2^14 so f << 16 fits, and the
+    // remainder is below 2^14 so remainder << 14 fits
+    const uint32_t divisor = AWG_SAMPLE_RATE_HZ / 4;
+    uint32_t scaled = frequencyHz << 16;
+    step = ((scaled / divisor) << 14) + (((scaled % divisor) << 14) / divisor);
+
+    uint8_t oldSREG = SREG;
+    cli();
+    awgStep = step;
+    SREG = oldSREG;
+}
+
+void AWGClass::setPhase(uint16_t phaseDegrees)
+{
+    // 2^32 / 360 = 11930464.7
+    uint32_t newOffset = (uint32_t) phaseDegrees * 11930465UL;
+
+    uint8_t oldSREG = SREG;
+    cli();
+    // Shift the running accumulator by the change so the phase moves without restarting the waveform
+    awgPhase += newOffset - phaseOffset;
+    SREG = oldSREG;
+
+    phaseOffset = newOffset;
+}
+
+/// @returns 0 if successful, 1 if the table does not exist or nothing was uploaded yet
+uint8_t AWGClass::selectTable(AWG_TABLE_T newTable)
+{
+    if (!AWG_ENABLED)
+    {
+        return 1;
+    }
+
+    if (newTable == AWG_TABLE_USER)
+    {
+        if (!userTableValid)
+        {
+            return 1;
+        }
+    }
+    else if (newTable < AWG_TABLE_USER)
+    {
+        // The interrupt keeps reading while the copy runs, the output shows a mix of both for one period at most
+        memcpy_P(awgSamples, (const uint8_t*) pgm_read_ptr(&awgTables[newTable]), AWG_TABLE_LENGTH);
+        userTableValid = false;
+    }
+    else
+    {
+        return 1;
+    }
+
+    table = newTable;
+    return 0;
+}
+
+AWG_TABLE_T AWGClass::getTable()
+{
+    return table;
+}
+
+void AWGClass::beginUpload()
+{
+    uploadIndex = 0;
+    uploadSum = 0;
+    uploading = true;
+    uploadLastByteMs = millis();
+
+    // The upload is written over the playing table, the output holds the last sample until it ends
+    if (running)
+    {
+        TIMSK2 = 0;
+    }
+}
+
+bool AWGClass::isUploading()
+{
+    return uploading;
+}
+
+AWG_UPLOAD_T AWGClass::uploadByte(uint8_t data)
+{
+    if (!AWG_ENABLED || !uploading)
+    {
+        return AWG_UPLOAD_IDLE;
+    }
+
+    uploadLastByteMs = millis();
+
+    if (uploadIndex < AWG_TABLE_LENGTH)
+    {
+        awgSamples[uploadIndex++] = data;
+        uploadSum += data;
+        return AWG_UPLOAD_BUSY;
+    }
+
+    endUpload(data == uploadSum);
+    return (data == uploadSum) ? AWG_UPLOAD_DONE : AWG_UPLOAD_CHECKSUM_ERROR;
+}
+
+AWG_UPLOAD_T AWGClass::checkUploadTimeout()
+{
+    if (uploading && (millis() - uploadLastByteMs > AWG_UPLOAD_TIMEOUT_MS))
+    {
+        endUpload(false);
+        return AWG_UPLOAD_TIMEOUT;
+    }
+
+    return uploading ? AWG_UPLOAD_BUSY : AWG_UPLOAD_IDLE;
+}
+
+/// Selects a good upload, after a bad or stalled one the table selected before is loaded again.  An earlier upload
+/// was overwritten and can not come back, the ramp takes its place.
+void AWGClass::endUpload(bool valid)
+{
+    uploading = false;
+
+    if (valid)
+    {
+        userTableValid = true;
+        table = AWG_TABLE_USER;
+    }
+    else
+    {
+        userTableValid = false;
+        selectTable((table == AWG_TABLE_USER) ? AWG_TABLE_RAMP : table);
+    }
+
+    if (running)
+    {
+        TIMSK2 = _BV(TOIE2);
+    }
+}
@@ -0,0 +1,108 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Software arbitrary waveform generator for shapes the DDS cannot make.
+ *
+ *  Timer2 runs in 8-bit fast PWM on OC2B (pin 3, OC2A is the SPI MOSI pin) at F_CPU / 256 = 62.5 kHz.  Its overflow
+ *  interrupt advances a 32-bit phase accumulator and loads the next sample into OCR2B.  OCR2B is double buffered and
+ *  only takes the new value at BOTTOM, so the samples come out at exactly the PWM rate no matter how late the
+ *  interrupt runs, as long as it finishes within one 256 cycle period.
+ *
+ *  Samples come from a 256 byte table in SRAM, loaded from one of the built-in tables in flash or uploaded over the
+ *  serial port.  Loading a built-in table overwrites an upload.  An upload is written into the same table while the
+ *  output holds its last sample.  A bad or stalled one reloads the built-in table selected before it, or the ramp if
+ *  that was an earlier upload, which there is no room in SRAM to keep a second copy of.
+ *
+ *  Outside the arbitrary waveform Timer2 paces the amplitude dither (see Amplifier.h), stop() leaves it alone then.
+ *
+ *  Hardware: pin 3 needs an RC low-pass (e.g. 1k / 10nF, 16 kHz) into the amplifier input in place of the DDS output.
+ *  The DDS is held in reset while the AWG runs.
+ */
+#ifndef AWG_h
+#define AWG_h
+
+#include "Arduino.h"
+
+/// Set to 1 (or build with -DAWG_ENABLED=1) for the arbitrary waveforms.  Left out by default, the table does not fit
+/// the Uno's SRAM next to the other engines (see Memory in the README).  selectTable() then fails, so the arbitrary
+/// waveforms are refused, and U is an unknown command.
+#ifndef AWG_ENABLED
+#define AWG_ENABLED 0
+#endif
+
+#define AWG_TABLE_LENGTH        256
+#define AWG_SAMPLE_RATE_HZ      (F_CPU / 256)
+#define AWG_MAX_FREQUENCY_HZ    10000
+#define AWG_OUTPUT_PIN          3
+#define AWG_UPLOAD_TIMEOUT_MS   1000
+
+typedef enum
+{
+    AWG_TABLE_RAMP = 0,
+    AWG_TABLE_EXPONENTIAL,
+    AWG_TABLE_CARDIAC,
+    AWG_TABLE_USER,                 ///< last upload
+    AWG_TABLE_COUNT
+} AWG_TABLE_T;
+
+typedef enum
+{
+    AWG_UPLOAD_IDLE = 0,
+    AWG_UPLOAD_BUSY,                ///< more bytes expected
+    AWG_UPLOAD_DONE,                ///< table and checksum received, user table selected
+    AWG_UPLOAD_CHECKSUM_ERROR,
+    AWG_UPLOAD_TIMEOUT
+} AWG_UPLOAD_T;
+
+class AWGClass
+{
+  public:
+    AWGClass();
+    void init();
+    void start();
+    void stop();
+    bool isRunning();
+    void setFrequency(uint32_t frequencyHz);
+    void setPhase(uint16_t phaseDegrees);
+    uint8_t selectTable(AWG_TABLE_T table);
+    AWG_TABLE_T getTable();
+
+    /// Upload is AWG_TABLE_LENGTH samples followed by their 8-bit sum
+    void beginUpload();
+    bool isUploading();
+    AWG_UPLOAD_T uploadByte(uint8_t data);
+    /// Abandons an upload that has stalled for AWG_UPLOAD_TIMEOUT_MS
+    AWG_UPLOAD_T checkUploadTimeout();
+
+  private:
+    AWG_TABLE_T table;
+    bool userTableValid;
+    bool running;
+    uint16_t uploadIndex;
+    uint8_t uploadSum;
+    bool uploading;
+    unsigned long uploadLastByteMs;
+    uint32_t phaseOffset;
+
+    void endUpload(bool valid);
+};
+
+extern AWGClass AWG;
+
+#endif
@@ -23,9 +23,12 @@
  *  -I2C command byte format is A3A2A1A0C1C0D9D8 where <A3-A0> is the I2C address, <C1-C0> is the command byte, <D9-D8> are the MSB of the data
  */
 
+#include <avr/interrupt.h>
 #include <Wire.h>
 #include "Amplifier.h"
 #include "OutputChannel.h"
+#include "Profiler.h"
+#include "Trace.h"
 #include "Debug.h"
 #define DEBUG_OUTPUT 0
 
@@ -52,10 +55,174 @@ typedef int32_t q23_8_t; ///< resolution is 0.00390625
 #define I2C_WRITE 0
 #define I2C_READ  1
 
+// Wire status codes, 6 is ours for a read that returned fewer bytes than requested
+#define I2C_STATUS_SUCCESS      0
+#define I2C_STATUS_ADDRESS_NACK 2
+#define I2C_STATUS_DATA_NACK    3
+#define I2C_STATUS_TIMEOUT      5
+#define I2C_STATUS_SHORT_READ   6
+
+// TWI master transmitter status codes, TWSR with the prescaler bits masked
+#define TWI_STATUS_MASK     0xF8
+#define TWI_START           0x08
+#define TWI_MT_SLA_ACK      0x18
+#define TWI_MT_DATA_ACK     0x28
+
+// Timer2 at clk/128 counts 8 us
+#define DITHER_COUNTS_PER_TICK  (AMPLIFIER_DITHER_TICK_US / 8)
+
+// The TWI operation of the step on the bus
+#define DITHER_STEP_IDLE        0
+#define DITHER_STEP_START       1
+#define DITHER_STEP_ADDRESS     2
+#define DITHER_STEP_COMMAND     3
+
+// Shared with the compare interrupt
+static uint8_t ditherUp;                // command bytes, increment and decrement of the dithered wiper
+static uint8_t ditherDown;
+static uint8_t ditherFrameMask;         // ticks in a frame less one
+static uint8_t ditherHighTicks;
+static uint8_t ditherPosition;          // tick in the frame
+static uint8_t ditherInterval;          // ticks to the next interrupt
+static uint8_t ditherWaited;            // ticks the operation on the bus has taken
+static bool ditherHigh;                 // the wiper is on the upper tap
+static volatile uint8_t ditherStep;
+static volatile bool ditherRunning;     // owns Timer2
+static volatile bool ditherHeld;        // a Wire transaction has the bus
+static volatile bool ditherFault;
+
+// Instrumentation, written by the handler only
+static volatile uint32_t ditherTicks;
+static volatile uint32_t ditherInterrupts;
+static volatile uint32_t ditherSteps;
+static volatile uint32_t ditherHeldTicks;
+static volatile uint16_t ditherErrors;
+static volatile uint16_t ditherTimeouts;
+
+/// Stop condition, TWCR left the way Wire leaves it.  The stop takes one bit time, the next start waits for it.
+static inline void ditherSendStop()
+{
+    TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN) | _BV(TWIE) | _BV(TWEA);
+    ditherStep = DITHER_STEP_IDLE;
+}
+
+/// Moves the step on the bus on by one operation once the TWI has finished the last one
+static inline void ditherAdvance()
+{
+    if (TWCR & _BV(TWINT))
+    {
+        uint8_t status = TWSR & TWI_STATUS_MASK;
+        ditherWaited = 0;
+
+        if ((ditherStep == DITHER_STEP_START) && (status == TWI_START))
+        {
+            TWDR = (RPOT_ADDRESS << 1) | I2C_WRITE;
+            TWCR = _BV(TWINT) | _BV(TWEN);
+            ditherStep = DITHER_STEP_ADDRESS;
+            return;
+        }
+        if ((ditherStep == DITHER_STEP_ADDRESS) && (status == TWI_MT_SLA_ACK))
+        {
+            TWDR = ditherHigh ? ditherDown : ditherUp;
+            TWCR = _BV(TWINT) | _BV(TWEN);
+            ditherStep = DITHER_STEP_COMMAND;
+            return;
+        }
+        if ((ditherStep == DITHER_STEP_COMMAND) && (status == TWI_MT_DATA_ACK))
+        {
+            ditherHigh = !ditherHigh;
+            ditherSteps++;
+            ditherSendStop();
+            return;
+        }
+
+        // Not acknowledged or lost the bus, the wiper is where it was
+        ditherErrors++;
+        ditherFault = true;
+        ditherSendStop();
+        return;
+    }
+
+    if (++ditherWaited > AMPLIFIER_DITHER_TIMEOUT_TICKS)
+    {
+        // A slave holds the bus, let go of it.  Wire clears it at the next transaction.
+        TWCR = 0;
+        ditherTimeouts++;
+        ditherFault = true;
+        ditherStep = DITHER_STEP_IDLE;
+    }
+}
+
+/** One tick of the dither.  The step on the bus moves on, then an idle bus gets the step that puts the wiper where
+ *  the frame wants it, or the compare moves to the next edge of the frame.
+ */
+ISR(TIMER2_COMPA_vect)
+{
+    uint8_t interval = 1;
+
+    ditherPosition = (ditherPosition + ditherInterval) & ditherFrameMask;
+    ditherTicks += ditherInterval;
+    ditherInterrupts++;
+
+    if (ditherStep != DITHER_STEP_IDLE)
+    {
+        ditherAdvance();
+    }
+
+    if (ditherStep == DITHER_STEP_IDLE)
+    {
+        bool high = (ditherPosition < ditherHighTicks);
+
+        if (ditherFault)
+        {
+            TIMSK2 = 0;
+            TCCR2B = 0;
+            ditherRunning = false;
+            return;
+        }
+        else if (high == ditherHigh)
+        {
+            interval = (high ? ditherHighTicks : ditherFrameMask + 1) - ditherPosition;
+        }
+        else if (ditherHeld)
+        {
+            // Wire has the bus, the step goes out on a later tick
+            ditherHeldTicks++;
+        }
+        else if ((TWCR & _BV(TWSTO)) == 0)
+        {
+            TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN);
+            ditherStep = DITHER_STEP_START;
+        }
+    }
+
+    ditherInterval = interval;
+    OCR2A += interval * DITHER_COUNTS_PER_TICK;
+}
+
+/// Keeps the dither off the bus for a Wire transaction, the step it has on the bus goes out first
+static void ditherHold()
+{
+    ditherHeld = true;
+    while (ditherRunning && ((ditherStep != DITHER_STEP_IDLE) || (TWCR & _BV(TWSTO))))
+    {
+        delayMicroseconds(AMPLIFIER_DITHER_TICK_US);
+    }
+}
+
+static inline void ditherRelease()
+{
+    ditherHeld = false;
+}
+
 AmplifierClass Amplifier;
 
 AmplifierClass::AmplifierClass()
 {
+    ditherBits = 0;
+    ditherWiper = RPOT_MEMORY_MAP_VOLATILE_WIPER_1;
+    ditherTaps = 0;
+    ditherFraction = 0;
 }
 
 AmplifierClass::~AmplifierClass()
@@ -64,9 +231,21 @@ AmplifierClass::~AmplifierClass()
 
 void AmplifierClass::init()
 {
-    uint16_t Data;
-    // Start I2C module as a master device
-    Wire.begin();
+    ditherStop();
+    ditherBits = 0;
+    resetBusStats();
+    resetDitherStats();
+
+    // A reset in the middle of a transfer (the watchdog) can leave the RPOT holding SDA low
+    pinMode(SDA, INPUT_PULLUP);
+    if (digitalRead(SDA) == LOW)
+    {
+        busClear();
+    }
+    else
+    {
+        busBegin();
+    }
 
     // P0 is a rheostat, disconnect P0B <b0> in TCON register using read modify write
     DEBUGLN(F("Amplifier: Rheostate mode: disconnecting R0B"));
@@ -96,6 +275,14 @@ uint8_t AmplifierClass::set(uint16_t VoltageInMvRms, WAVEFORM_T waveform)
     q23_8_t ResistanceInOhmsQ23_8;
     uint16_t R0ResistanceInTaps = 0;
     uint16_t R1ResistanceInTaps = 0;
+    RPOT_MEMORY_MAP_T DitherWiper = RPOT_MEMORY_MAP_VOLATILE_WIPER_1;
+    uint16_t DitherRemainder = 0;  // what the division into whole taps drops, in 1/10000 of a tap
+    uint8_t DitherFraction = 0;
+
+    TRACE(TRACE_CATEGORY_AMPLIFIER, TRACE_EVENT_AMPLIFIER_SET, VoltageInMvRms);
+
+    // The wipers get their whole taps before the dither starts again on the new value
+    ditherStop();
 
     DEBUG(F("Amplifier: Input value is: "));
     DEBUG(VoltageInMvRms);
@@ -116,6 +303,7 @@ uint8_t AmplifierClass::set(uint16_t VoltageInMvRms, WAVEFORM_T waveform)
             DEBUGLN(ResistanceInOhmsQ23_8);
 
             R1ResistanceInTaps = ResistanceInOhmsQ23_8 / ResistanceInTapsConversionConstantQ23_8;
+            DitherRemainder = ResistanceInOhmsQ23_8 % ResistanceInTapsConversionConstantQ23_8;
 
             DEBUG(F("Amplifier <= 350: R0ResistanceInTaps calculated is: 0x"));
             DEBUGLN(R0ResistanceInTaps, HEX);
@@ -126,13 +314,17 @@ uint8_t AmplifierClass::set(uint16_t VoltageInMvRms, WAVEFORM_T waveform)
             if (R1ResistanceInTaps > RPOT_MAX_DATA_VALUE)
             {
                 DEBUGLN(F("Amplifer <= 350: Upper limit reached"));
+                TRACE(TRACE_CATEGORY_AMPLIFIER, TRACE_EVENT_AMPLIFIER_LIMIT, R1ResistanceInTaps);
                 R1ResistanceInTaps = RPOT_MAX_DATA_VALUE;
+                DitherRemainder = 0;
             }
             else if (R1ResistanceInTaps < 0x10)
             {
                 // Below this value, the waveform looks pretty ugly
                 DEBUGLN(F("Amplifer <= 350: Lower limit reached"));
+                TRACE(TRACE_CATEGORY_AMPLIFIER, TRACE_EVENT_AMPLIFIER_LIMIT, R1ResistanceInTaps);
                 R1ResistanceInTaps = 0x10;
+                DitherRemainder = 0;
             }
 
             if (write(RPOT_MEMORY_MAP_VOLATILE_WIPER_0, RPOT_CMD_WRITE_DATA, R0ResistanceInTaps))
@@ -165,6 +357,8 @@ uint8_t AmplifierClass::set(uint16_t VoltageInMvRms, WAVEFORM_T waveform)
             }
 
             R0ResistanceInTaps = ResistanceInOhmsQ23_8 / ResistanceInTapsConversionConstantQ23_8;
+            DitherWiper = RPOT_MEMORY_MAP_VOLATILE_WIPER_0;
+            DitherRemainder = ResistanceInOhmsQ23_8 % ResistanceInTapsConversionConstantQ23_8;
 
             DEBUG(F("Amplifier > 350: R0ResistanceInTaps calculated is: 0x"));
             DEBUGLN(R0ResistanceInTaps, HEX);
@@ -175,20 +369,17 @@ uint8_t AmplifierClass::set(uint16_t VoltageInMvRms, WAVEFORM_T waveform)
             if (R0ResistanceInTaps > RPOT_MAX_DATA_VALUE)
             {
                 DEBUGLN(F("Amplifer > 350: Upper limit reached"));
+                TRACE(TRACE_CATEGORY_AMPLIFIER, TRACE_EVENT_AMPLIFIER_LIMIT, R0ResistanceInTaps);
                 R0ResistanceInTaps = RPOT_MAX_DATA_VALUE;
-            }
-            else if (R0ResistanceInTaps < 0x0) // MJL: Was 0x65
-            {
-                // Below this value, the waveform looks pretty ugly
-                DEBUGLN(F("Amplifer > 350: Lower limit reached"));
-                R0ResistanceInTaps = 0x0;
+                DitherRemainder = 0;
             }
         }
 
     }
-    else if (waveform == WAVEFORM_SQUARE || waveform == WAVEFORM_SQUARE_DIV_2)
+    else if (waveform == WAVEFORM_SQUARE || waveform == WAVEFORM_SQUARE_DIV_2 || waveform == WAVEFORM_ARBITRARY ||
+             waveform == WAVEFORM_PULSE)
     {
-        // Then it is a square wave
+        // Then it is a square wave, or the AWG PWM output or the pulses, which swing rail to rail like one
 
         // The equation is ResistanceInOhms = 2.3046875x + 23.25; Converted to ResistanceInOhmsQ23_8 = 590x + 5952
 
@@ -199,6 +390,7 @@ uint8_t AmplifierClass::set(uint16_t VoltageInMvRms, WAVEFORM_T waveform)
         ResistanceInOhmsQ23_8 = (590 * (q23_8_t) VoltageInMvRms) + 5952;
 
         R1ResistanceInTaps = ResistanceInOhmsQ23_8 / ResistanceInTapsConversionConstantQ23_8;
+        DitherRemainder = ResistanceInOhmsQ23_8 % ResistanceInTapsConversionConstantQ23_8;
 
         // Do not amplify the square wave as it causes distortion on the output, see to the lowest value
         R0ResistanceInTaps = RPOT_MAX_DATA_VALUE;
@@ -213,6 +405,7 @@ uint8_t AmplifierClass::set(uint16_t VoltageInMvRms, WAVEFORM_T waveform)
         {
             // Protect against a value larger than the maximum allowed
             R1ResistanceInTaps =RPOT_MAX_DATA_VALUE;
+            DitherRemainder = 0;
         }
     }
     else
@@ -221,6 +414,29 @@ uint8_t AmplifierClass::set(uint16_t VoltageInMvRms, WAVEFORM_T waveform)
         ErrorCounter++;
     }
 
+    // The AWG has Timer2, the arbitrary waveform gets whole taps
+    if (ditherBits && DitherRemainder && (waveform != WAVEFORM_ARBITRARY))
+    {
+        uint16_t* pTaps = (DitherWiper == RPOT_MEMORY_MAP_VOLATILE_WIPER_0) ? &R0ResistanceInTaps : &R1ResistanceInTaps;
+
+        // Rounded to 1/2^ditherBits of a tap, a fraction that rounds up to a whole tap is the next tap
+        DitherFraction = (((uint32_t) DitherRemainder << ditherBits) + (ResistanceInTapsConversionConstantQ23_8 / 2)) /
+                         ResistanceInTapsConversionConstantQ23_8;
+
+        if (*pTaps >= RPOT_MAX_DATA_VALUE)
+        {
+            DitherFraction = 0;
+        }
+        else if (DitherFraction >> ditherBits)
+        {
+            (*pTaps)++;
+            DitherFraction = 0;
+        }
+    }
+
+    TRACE(TRACE_CATEGORY_AMPLIFIER, TRACE_EVENT_AMPLIFIER_R0_TAPS, R0ResistanceInTaps);
+    TRACE(TRACE_CATEGORY_AMPLIFIER, TRACE_EVENT_AMPLIFIER_R1_TAPS, R1ResistanceInTaps);
+
     // Write the value of the POTs
     if (write(RPOT_MEMORY_MAP_VOLATILE_WIPER_0, RPOT_CMD_WRITE_DATA, R0ResistanceInTaps))
     {
@@ -232,49 +448,204 @@ uint8_t AmplifierClass::set(uint16_t VoltageInMvRms, WAVEFORM_T waveform)
         ErrorCounter++;
     }
 
+    ditherWiper = DitherWiper;
+    ditherTaps = (DitherWiper == RPOT_MEMORY_MAP_VOLATILE_WIPER_0) ? R0ResistanceInTaps : R1ResistanceInTaps;
+    ditherFraction = DitherFraction;
+
+    if (DitherFraction && (ErrorCounter == 0))
+    {
+        ditherStart(DitherWiper, DitherFraction);
+    }
+
     return ErrorCounter;
 }
 void AmplifierClass::printStatus()
 {
-    uint16_t Data;
-    read(RPOT_MEMORY_MAP_STATUS_REGISTER, &Data);
-
-    Serial.println(Data, HEX);
+    printRegister(RPOT_MEMORY_MAP_STATUS_REGISTER);
 }
 
 void AmplifierClass::printTcon()
 {
-    uint16_t Data;
-    read(RPOT_MEMORY_MAP_VOLATILE_TCON, &Data);
-
-    Serial.println(Data, HEX);
+    printRegister(RPOT_MEMORY_MAP_VOLATILE_TCON);
 }
 
 void AmplifierClass::printPotValue(uint8_t PotNumber)
 {
-    uint16_t Data;
-
     switch (PotNumber)
     {
         case 0:
-            read(RPOT_MEMORY_MAP_VOLATILE_WIPER_0, &Data);
+            printRegister(RPOT_MEMORY_MAP_VOLATILE_WIPER_0);
         break;
         case 1:
-            read(RPOT_MEMORY_MAP_VOLATILE_WIPER_1, &Data);
+            printRegister(RPOT_MEMORY_MAP_VOLATILE_WIPER_1);
         break;
         default:
             Serial.println(F("Amplifier invalid value"));
         break;
     }
+}
+
+void AmplifierClass::printRegister(RPOT_MEMORY_MAP_T MemoryAddress)
+{
+    uint16_t Data;
 
-    Serial.println(Data, HEX);
+    if (read(MemoryAddress, &Data) == 0)
+    {
+        Serial.println(Data, HEX);
+    }
+    else
+    {
+        Serial.println(F("Amplifier read failed"));
+    }
 }
+
+void AmplifierClass::printBusStats()
+{
+    Serial.println(F("transactions,retries,nacks,timeouts,short_reads,bus_clears,failures"));
+    Serial.print(busStats.transactions);
+    Serial.write(',');
+    Serial.print(busStats.retries);
+    Serial.write(',');
+    Serial.print(busStats.nacks);
+    Serial.write(',');
+    Serial.print(busStats.timeouts);
+    Serial.write(',');
+    Serial.print(busStats.shortReads);
+    Serial.write(',');
+    Serial.print(busStats.busClears);
+    Serial.write(',');
+    Serial.println(busStats.failures);
+}
+
+void AmplifierClass::resetBusStats()
+{
+    memset(&busStats, 0, sizeof(busStats));
+}
+
+uint8_t AmplifierClass::setDitherBits(uint8_t bits)
+{
+    if (bits > AMPLIFIER_DITHER_MAX_BITS)
+    {
+        return 1;
+    }
+
+    ditherStop();
+    ditherBits = bits;
+    Wire.setClock(bits ? AMPLIFIER_DITHER_I2C_HZ : AMPLIFIER_I2C_HZ);
+    return 0;
+}
+
+void AmplifierClass::printDitherStats()
+{
+    AMPLIFIER_DITHER_STATS_T stats;
+
+    uint8_t oldSREG = SREG;
+    cli();
+    stats.ticks = ditherTicks;
+    stats.interrupts = ditherInterrupts;
+    stats.steps = ditherSteps;
+    stats.heldTicks = ditherHeldTicks;
+    stats.errors = ditherErrors;
+    stats.timeouts = ditherTimeouts;
+    SREG = oldSREG;
+
+    Serial.print(F("Amplitude dither "));
+    Serial.print(ditherBits);
+    if (ditherFault)
+    {
+        Serial.println(F(" bits, stopped by a bus error"));
+    }
+    else
+    {
+        ditherRunning ? Serial.println(F(" bits, running")) : Serial.println(F(" bits, idle"));
+    }
+
+    Serial.println(F("wiper,taps,fraction,frame_us"));
+    Serial.print(ditherWiper);
+    Serial.write(',');
+    Serial.print(ditherTaps);
+    Serial.write(',');
+    Serial.print(ditherFraction);
+    Serial.write('/');
+    Serial.print(1 << ditherBits);
+    Serial.write(',');
+    Serial.println((uint16_t) (AMPLIFIER_DITHER_SLOT_TICKS << ditherBits) * AMPLIFIER_DITHER_TICK_US);
+
+    // The I2C load is the bus time of the steps over the time counted
+    Serial.println(F("ms,interrupts,steps,bus_pct,held_ticks,errors,timeouts"));
+    Serial.print((stats.ticks * AMPLIFIER_DITHER_TICK_US) / 1000);
+    Serial.write(',');
+    Serial.print(stats.interrupts);
+    Serial.write(',');
+    Serial.print(stats.steps);
+    Serial.write(',');
+    Serial.print(stats.ticks ? (100.0 * AMPLIFIER_DITHER_STEP_US / AMPLIFIER_DITHER_TICK_US) * stats.steps / stats.ticks
+                             : 0.0, 1);
+    Serial.write(',');
+    Serial.print(stats.heldTicks);
+    Serial.write(',');
+    Serial.print(stats.errors);
+    Serial.write(',');
+    Serial.println(stats.timeouts);
+}
+
+void AmplifierClass::resetDitherStats()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    ditherTicks = 0;
+    ditherInterrupts = 0;
+    ditherSteps = 0;
+    ditherHeldTicks = 0;
+    ditherErrors = 0;
+    ditherTimeouts = 0;
+    SREG = oldSREG;
+}
+
+/// Starts the frame with the wiper on its lower tap, where set() left it
+void AmplifierClass::ditherStart(RPOT_MEMORY_MAP_T wiper, uint8_t fraction)
+{
+    ditherUp = (wiper << 4) | (RPOT_CMD_INCREMENT << 2);
+    ditherDown = (wiper << 4) | (RPOT_CMD_DECREMENT << 2);
+    ditherFrameMask = (AMPLIFIER_DITHER_SLOT_TICKS << ditherBits) - 1;
+    ditherHighTicks = fraction * AMPLIFIER_DITHER_SLOT_TICKS;
+    ditherPosition = ditherFrameMask;
+    ditherInterval = 1;
+    ditherWaited = 0;
+    ditherHigh = false;
+    ditherStep = DITHER_STEP_IDLE;
+    ditherHeld = false;
+    ditherFault = false;
+    ditherRunning = true;
+
+    // Normal mode at clk/128, the handler advances the compare like the Timer1 ones
+    TIMSK2 = 0;
+    TCCR2A = 0;
+    TCCR2B = _BV(CS22) | _BV(CS20);
+    OCR2A = TCNT2 + DITHER_COUNTS_PER_TICK;
+    TIFR2 = _BV(OCF2A);
+    TIMSK2 = _BV(OCIE2A);
+}
+
+/// Lets the step on the bus finish and hands Timer2 back, the wiper stays where the last step left it
+void AmplifierClass::ditherStop()
+{
+    if (ditherRunning)
+    {
+        ditherHold();
+        TIMSK2 = 0;
+        TCCR2B = 0;
+        ditherRunning = false;
+    }
+    ditherRelease();
+}
+
 /** @brief Sends an I2C command to the RPOT
  *
  *  @details 
  *  1. First byte is the I2C address <b7-b1> and <b0> is the read/write bit
  *  2. Second byte is the command byte in the format A3A2A1A0C1C0D9D8 where <a3-a0> is the I2C address, <c1-c0> is the command byte, <d9-d8> are the MSB of the data
- *  3. Third byte is the LSB of the data <d7-d0> (only for read and write commands)
+ *  3. Third byte is the LSB of the data <d7-d0> (only for write commands, also when it is zero)
  *
  *  @param MemoryAddress Memory address to be written to
  *  @param Data Data to be send to the RPOT
@@ -286,18 +657,21 @@ uint8_t AmplifierClass::write(RPOT_MEMORY_MAP_T MemoryAddress, RPOT_CMD_T Comman
     uint8_t Byte2 = 0;  // Contains the 4 bits of the address, a two bit command, and two data bits
     uint8_t Byte3 = 0;  // Contains all data (optional based on command used)
     uint16_t DataMSB = 0; // Contains the upper 2 bits of the data and is sent in Byte2
+    uint8_t Error;
 
     // Check inputs
     if (MemoryAddress > RPOT_MEMORY_MAP_INVALID_VALUE)
     {
         // Invalid address
         DEBUGLN(F("Amplifier: Invalid Address"));
+        TRACE(TRACE_CATEGORY_AMPLIFIER, TRACE_EVENT_AMPLIFIER_INVALID, MemoryAddress);
         return 1;
     }
     else if (Command >= RPOT_CMD_INVALID)
     {
         // Invalid command
         DEBUGLN(F("Amplifier: Invalid Command"));
+        TRACE(TRACE_CATEGORY_AMPLIFIER, TRACE_EVENT_AMPLIFIER_INVALID, Command);
         return 1;
     }
     else if (Data > RPOT_MAX_DATA_VALUE)
@@ -310,10 +684,10 @@ uint8_t AmplifierClass::write(RPOT_MEMORY_MAP_T MemoryAddress, RPOT_CMD_T Comman
     Byte2 = (MemoryAddress << 4);    // <b7:b4>
     Byte2 |= (Command << 2);         // <b3:b2>
 
-    // Send data if it's passed in and the command isn't a read command
-    if (Data && (Command != RPOT_CMD_READ_DATA))
+    // Only the write command carries data, increment, decrement and the read setup are a single byte
+    if (Command == RPOT_CMD_WRITE_DATA)
     {
-        // Finish off Byte2 with the upper two bits if data is available
+        // Finish off Byte2 with the upper two bits of the data
         DataMSB = (Data & DATA_MSB_MASK);      // Only getting bits 9 and 10 of the data
         Byte2 |= (DataMSB >> 8);               // <b1:b0>
 
@@ -321,17 +695,13 @@ uint8_t AmplifierClass::write(RPOT_MEMORY_MAP_T MemoryAddress, RPOT_CMD_T Comman
         Byte3 = (uint8_t) Data & 0xFF;
     }
 
-    Wire.beginTransmission(RPOT_ADDRESS);
-    Wire.write(Byte2);
-
-    if (Data)
-    {
-        Wire.write(Byte3);
-    }
-
-    Wire.endTransmission(true);  // Send the stop bit
+    PROFILE_BEGIN();
+    ditherHold();
+    Error = transfer(Byte2, Byte3, (Command == RPOT_CMD_WRITE_DATA), NULL);
+    ditherRelease();
+    PROFILE_END(PROFILE_AMPLIFIER_WRITE);
 
-    return 0;
+    return Error;
 }
 
 /** @brief Read two bytes of data from the RPOT
@@ -343,9 +713,7 @@ uint8_t AmplifierClass::write(RPOT_MEMORY_MAP_T MemoryAddress, RPOT_CMD_T Comman
  */
 uint8_t AmplifierClass::read(RPOT_MEMORY_MAP_T MemoryAddress, uint16_t* pData)
 {
-    uint8_t NumberOfBytesRead;
-    uint8_t Byte2;
-    uint8_t Byte3;
+    uint8_t Error;
 
     // Check inputs
     if (MemoryAddress > RPOT_MEMORY_MAP_INVALID_VALUE)
@@ -360,23 +728,139 @@ uint8_t AmplifierClass::read(RPOT_MEMORY_MAP_T MemoryAddress, uint16_t* pData)
         return 1;
     }
 
-    // First, setup the read by writing a read command to the memory register
-    if (write(MemoryAddress, RPOT_CMD_READ_DATA, 0))
+    PROFILE_BEGIN();
+
+    // The read command sets up the memory address, then 2 bytes are requested
+    ditherHold();
+    Error = transfer((MemoryAddress << 4) | (RPOT_CMD_READ_DATA << 2), 0, false, pData);
+    ditherRelease();
+
+    PROFILE_END(PROFILE_AMPLIFIER_READ);
+
+    if (Error)
     {
-        // unable to command the device to read
         DEBUGLN(F("Amplifier: Unable to read"));
-        return 1;
     }
 
-    // Request 2 bytes from the RPOT and send a stop command
-    Wire.requestFrom(RPOT_ADDRESS, 2, true);
+    return Error;
+}
 
-    Byte2 = Wire.read();
-    Byte3 = Wire.read();
+/** @brief One RPOT transaction with bounded retries
+ *
+ *  @details Every attempt is limited by the Wire timeout.  A NACK is retried as is, a timeout or bus error clears the
+ *  bus first.  Failing every one of the AMPLIFIER_I2C_ATTEMPTS takes at most a few milliseconds.
+ *
+ *  @param pData NULL for a write, otherwise two bytes are read back into it after the command byte
+ *
+ *  @returns 0 if successful, 1 if every attempt failed
+ */
+uint8_t AmplifierClass::transfer(uint8_t Byte2, uint8_t Byte3, bool SendByte3, uint16_t* pData)
+{
+    for (uint8_t Attempt = 0; Attempt < AMPLIFIER_I2C_ATTEMPTS; Attempt++)
+    {
+        if (Attempt > 0)
+        {
+            busStats.retries++;
+        }
+        busStats.transactions++;
+        Wire.clearWireTimeoutFlag();
 
-    *pData = (Byte2 << 8);  //MSB
-    *pData |= (Byte3);      //LSB
+        Wire.beginTransmission(RPOT_ADDRESS);
+        Wire.write(Byte2);
 
-    return 0;
+        if (SendByte3)
+        {
+            Wire.write(Byte3);
+        }
+
+        uint8_t Status = Wire.endTransmission(true);  // Send the stop bit
+        PROFILE_COUNT(PROFILE_COUNTER_I2C_BYTES, SendByte3 ? 3 : 2);    // Address byte plus the command and data bytes
+
+        if ((Status == I2C_STATUS_SUCCESS) && (pData != NULL))
+        {
+            // Request 2 bytes from the RPOT and send a stop command
+            uint8_t NumberOfBytesRead = Wire.requestFrom(RPOT_ADDRESS, 2, true);
+            PROFILE_COUNT(PROFILE_COUNTER_I2C_BYTES, 3);    // Address byte plus two data bytes
+
+            if (NumberOfBytesRead == 2)
+            {
+                *pData = (Wire.read() << 8);  //MSB
+                *pData |= Wire.read();        //LSB
+            }
+            else
+            {
+                busStats.shortReads++;
+                Status = Wire.getWireTimeoutFlag() ? I2C_STATUS_TIMEOUT : I2C_STATUS_SHORT_READ;
+            }
+        }
+
+        if (Status == I2C_STATUS_SUCCESS)
+        {
+            return 0;
+        }
+
+        TRACE(TRACE_CATEGORY_AMPLIFIER, TRACE_EVENT_AMPLIFIER_BUS_ERROR, Status);
+
+        switch (Status)
+        {
+            case I2C_STATUS_ADDRESS_NACK:
+            case I2C_STATUS_DATA_NACK:
+                busStats.nacks++;
+            break;
+            case I2C_STATUS_SHORT_READ:
+            break;
+            case I2C_STATUS_TIMEOUT:
+                busStats.timeouts++;
+                busClear();
+            break;
+            default:
+                // Bus error or lost arbitration, a glitch may have left the RPOT mid byte
+                busClear();
+            break;
+        }
+    }
+
+    DEBUGLN(F("Amplifier: I2C transaction failed"));
+    busStats.failures++;
+    return 1;
+}
+
+void AmplifierClass::busBegin()
+{
+    // Start I2C module as a master device, a stuck bus resets the TWI instead of hanging the firmware
+    Wire.begin();
+    Wire.setClock(ditherBits ? AMPLIFIER_DITHER_I2C_HZ : AMPLIFIER_I2C_HZ);
+    Wire.setWireTimeout(AMPLIFIER_I2C_TIMEOUT_US, true);
 }
 
+/** @brief Frees a bus held by the RPOT and restarts the TWI
+ *
+ *  @details A slave that lost a clock part way through a byte keeps SDA low waiting for the rest.  Up to 9 clocks on
+ *  SCL let it finish, then a stop puts it back to idle.  The pins are driven open drain: low, or released to the pull-up.
+ */
+void AmplifierClass::busClear()
+{
+    busStats.busClears++;
+    Wire.end();
+
+    pinMode(SDA, INPUT_PULLUP);
+    pinMode(SCL, INPUT_PULLUP);
+
+    for (uint8_t Pulse = 0; (Pulse < 9) && (digitalRead(SDA) == LOW); Pulse++)
+    {
+        digitalWrite(SCL, LOW);
+        pinMode(SCL, OUTPUT);
+        delayMicroseconds(5);
+        pinMode(SCL, INPUT_PULLUP);
+        delayMicroseconds(5);
+    }
+
+    // Stop condition, SDA rises while SCL is high
+    digitalWrite(SDA, LOW);
+    pinMode(SDA, OUTPUT);
+    delayMicroseconds(5);
+    pinMode(SDA, INPUT_PULLUP);
+    delayMicroseconds(5);
+
+    busBegin();
+}
@@ -37,6 +37,55 @@ typedef enum
   RPOT_MEMORY_MAP_INVALID_VALUE,               ///< Invalid value
 } RPOT_MEMORY_MAP_T;
 
+#define AMPLIFIER_I2C_TIMEOUT_US  1000  ///< a three byte write takes 300 us at 100 kHz
+#define AMPLIFIER_I2C_ATTEMPTS    3     ///< tries per transaction, bounds a command to a few ms on a dead bus
+#define AMPLIFIER_I2C_HZ          100000
+
+/** Sub-tap amplitude: rd# keeps # bits of the tap fraction set() otherwise drops and moves the wiper between the two
+ *  taps around it.  A frame of AMPLIFIER_DITHER_SLOT_TICKS << # ticks starts with an increment and ends its high part
+ *  with a decrement, fraction slots later, so the average wiper is the fractional tap.  Both steps take the same time
+ *  on the bus, the duty is exact.
+ *
+ *  Timer2 compare A paces it and the handler drives the TWI itself, one operation per tick without waiting: start,
+ *  address, command byte, stop.  Between steps the compare moves straight to the next edge, a frame takes eight
+ *  interrupts: 3900/s at 4 bits, a tick each at 1 bit.  The bus runs at 400 kHz while # is not 0.  A Wire transaction (any other command that talks to the
+ *  RPOT) holds the dither off the bus and waits for the step on it, a step that comes due meanwhile goes out late.
+ *  A NACK or a bus that stays busy for AMPLIFIER_DITHER_TIMEOUT_TICKS stops the dither until the next set().
+ *
+ *  Not with the AWG, which has Timer2: the arbitrary waveform gets whole taps.  The output carries the frame rate as
+ *  amplitude modulation, 488 Hz at 4 bits and 3.9 kHz at 1, so the level is a time average: fine for meters and
+ *  loads that integrate over many frames, visible on a scope.
+ */
+#define AMPLIFIER_DITHER_I2C_HZ         400000
+#define AMPLIFIER_DITHER_MAX_BITS       4       ///< 1/16 tap, the longest frame is one turn of Timer2
+#define AMPLIFIER_DITHER_TICK_US        32      ///< one TWI operation, a byte takes 22.5 us at 400 kHz
+#define AMPLIFIER_DITHER_SLOT_TICKS     4       ///< start, address, command and stop of a step
+#define AMPLIFIER_DITHER_STEP_US        50      ///< bus time of a step, 20 bit times
+#define AMPLIFIER_DITHER_TIMEOUT_TICKS  32      ///< a TWI operation that takes longer than ~1 ms failed
+
+/// @brief Bus errors and recoveries since the last resetBusStats()
+typedef struct
+{
+  uint16_t transactions;
+  uint16_t retries;
+  uint16_t nacks;        ///< address or data byte not acknowledged
+  uint16_t timeouts;     ///< SCL or SDA held past AMPLIFIER_I2C_TIMEOUT_US
+  uint16_t shortReads;   ///< fewer bytes than requested
+  uint16_t busClears;
+  uint16_t failures;     ///< transactions that failed every attempt
+} AMPLIFIER_BUS_STATS_T;
+
+/// @brief Dither counts since the last resetDitherStats()
+typedef struct
+{
+  uint32_t ticks;        ///< AMPLIFIER_DITHER_TICK_US each
+  uint32_t interrupts;
+  uint32_t steps;        ///< increments and decrements the RPOT acknowledged
+  uint32_t heldTicks;    ///< ticks a step waited for a Wire transaction
+  uint16_t errors;       ///< NACKs and bus errors
+  uint16_t timeouts;
+} AMPLIFIER_DITHER_STATS_T;
+
 typedef enum
 {
   RPOT_CMD_WRITE_DATA = 0,
@@ -57,9 +106,26 @@ class AmplifierClass
     void printStatus();
     void printTcon();
     void printPotValue(uint8_t RpotNumber);
+    void printBusStats();
+    void resetBusStats();
+    /// 0 turns the dither off, takes effect at the next set()
+    uint8_t setDitherBits(uint8_t bits);
+    void printDitherStats();
+    void resetDitherStats();
   private:
     uint8_t write(RPOT_MEMORY_MAP_T MemoryAddress, RPOT_CMD_T Command, uint16_t Data);
     uint8_t read(RPOT_MEMORY_MAP_T MemoryAddress, uint16_t* pData);
+    void printRegister(RPOT_MEMORY_MAP_T MemoryAddress);
+    uint8_t transfer(uint8_t Byte2, uint8_t Byte3, bool SendByte3, uint16_t* pData);
+    void busBegin();
+    void busClear();
+    void ditherStart(RPOT_MEMORY_MAP_T wiper, uint8_t fraction);
+    void ditherStop();
+    AMPLIFIER_BUS_STATS_T busStats;
+    uint8_t ditherBits;
+    RPOT_MEMORY_MAP_T ditherWiper;
+    uint16_t ditherTaps;
+    uint8_t ditherFraction;      ///< in 1/2^ditherBits of a tap
 };
 
 extern AmplifierClass Amplifier;
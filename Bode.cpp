@@ -0,0 +1,373 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <avr/interrupt.h>
+#include <math.h>
+#include "Bode.h"
+#include "DDS.h"
+#include "AWG.h"
+#include "Trigger.h"
+#include "Schedule.h"
+#include "Sync.h"
+#include "Clock.h"
+#include "Debug.h"
+#define DEBUG_OUTPUT 0
+
+// AVCC reference, clk/32
+#define BODE_ADMUX          (_BV(REFS0) | BODE_INPUT_CHANNEL)
+#define BODE_ADC_PRESCALE   (_BV(ADPS2) | _BV(ADPS0))
+
+BodeClass Bode;
+
+// Shared with the ADC interrupt
+static volatile uint16_t bodeRemaining;
+static volatile uint32_t bodeSum;
+static volatile uint32_t bodeSumSquares;   // of the samples less midscale
+static volatile uint16_t bodeMin;
+static volatile uint16_t bodeMax;
+
+/// Runs at the end of every conversion while a capture is open
+ISR(ADC_vect)
+{
+    uint16_t sample = ADC;
+    int16_t centered = (int16_t) sample - 512;
+
+    bodeSum += sample;
+    bodeSumSquares += (uint32_t) ((int32_t) centered * centered);
+    if (sample < bodeMin) bodeMin = sample;
+    if (sample > bodeMax) bodeMax = sample;
+
+    if (--bodeRemaining == 0)
+    {
+        // The conversion already running finishes without an interrupt
+        ADCSRA = _BV(ADEN) | BODE_ADC_PRESCALE;
+    }
+}
+
+BodeClass::BodeClass()
+{
+    startHz = 100;
+    stopHz = 100000;
+    points = BODE_DEFAULT_POINTS;
+    logarithmic = true;
+    settleMs = BODE_DEFAULT_SETTLE_MS;
+    samples = BODE_DEFAULT_SAMPLES;
+    state = STATE_IDLE;
+    channel = NULL;
+    previousOutput = OFF;
+    logStep = 0.0;
+    point = 0;
+    frequencyHz = 0;
+    count = 0;
+    flags = 0;
+    settleStart = 0;
+}
+
+uint8_t BodeClass::setStartHz(uint32_t newStartHz)
+{
+    if ((newStartHz > 8000000) || isRunning())
+    {
+        return 1;
+    }
+
+    startHz = newStartHz;
+    return 0;
+}
+
+uint8_t BodeClass::setStopHz(uint32_t newStopHz)
+{
+    if ((newStopHz > 8000000) || isRunning())
+    {
+        return 1;
+    }
+
+    stopHz = newStopHz;
+    return 0;
+}
+
+uint8_t BodeClass::setPoints(uint16_t newPoints)
+{
+    if ((newPoints < 2) || (newPoints > BODE_MAX_POINTS) || isRunning())
+    {
+        return 1;
+    }
+
+    points = newPoints;
+    return 0;
+}
+
+void BodeClass::setLogarithmic(bool newLogarithmic)
+{
+    if (!isRunning())
+    {
+        logarithmic = newLogarithmic;
+    }
+}
+
+uint8_t BodeClass::setSettleMs(uint16_t newSettleMs)
+{
+    if ((newSettleMs > BODE_MAX_SETTLE_MS) || isRunning())
+    {
+        return 1;
+    }
+
+    settleMs = newSettleMs;
+    return 0;
+}
+
+uint8_t BodeClass::setSamples(uint16_t newSamples)
+{
+    if ((newSamples < BODE_MIN_SAMPLES) || (newSamples > BODE_MAX_SAMPLES) || isRunning())
+    {
+        return 1;
+    }
+
+    samples = newSamples;
+    return 0;
+}
+
+uint8_t BodeClass::start(OutputChannelClass& newChannel)
+{
+    // The AWG and the pulses hold the DDS in reset, the trigger owns FSEL and queued or staged commands would change
+    // the frequency under the sweep.  A log sweep cannot start at 0 Hz.
+    if ((newChannel.getWaveformType() >= WAVEFORM_ARBITRARY) || Trigger.isArmed() || Schedule.pending() ||
+        Sync.pending() || (logarithmic && (startHz == 0)))
+    {
+        return 1;
+    }
+
+    stop();
+
+    channel = &newChannel;
+    previousOutput = channel->getOutputStatus();
+    logStep = logarithmic ? log((float) stopHz / (float) startHz) / (points - 1) : 0.0;
+    point = 0;
+
+    // Power.init() switched the ADC off, the digital input buffer on A0 only adds noise
+    PRR &= (uint8_t) ~_BV(PRADC);
+    DIDR0 |= _BV(BODE_INPUT_CHANNEL);
+    ADMUX = BODE_ADMUX;
+    ADCSRA = _BV(ADEN) | BODE_ADC_PRESCALE;
+
+    channel->setOutputStatus(ON);
+    beginPoint();
+
+    DEBUGLN(F("Bode started"));
+    return 0;
+}
+
+void BodeClass::stop()
+{
+    if (state == STATE_IDLE)
+    {
+        return;
+    }
+
+    ADCSRA = 0;
+    PRR |= _BV(PRADC);
+    state = STATE_IDLE;
+
+    DDS.sendFrequency(channel->getFrequencyHz());
+    channel->setOutputStatus(previousOutput);
+}
+
+bool BodeClass::isRunning()
+{
+    return state != STATE_IDLE;
+}
+
+BODE_STATUS_T BodeClass::poll()
+{
+    switch (state)
+    {
+        case STATE_SETTLING:
+            if (Clock.cycles() - settleStart >= (uint32_t) settleMs * (F_CPU / 1000UL))
+            {
+                beginCapture();
+            }
+        break;
+        case STATE_CAPTURING:
+        {
+            uint8_t oldSREG = SREG;
+            cli();
+            uint16_t remaining = bodeRemaining;
+            SREG = oldSREG;
+
+            if (remaining == 0)
+            {
+                sendRecord();
+
+                if (++point == points)
+                {
+                    stop();
+                    return BODE_DONE;
+                }
+
+                beginPoint();
+            }
+        }
+        break;
+        default:
+            return BODE_IDLE;
+    }
+
+    return BODE_BUSY;
+}
+
+void BodeClass::printStatus()
+{
+    isRunning() ? Serial.print(F("Bode running, point ")) : Serial.print(F("Bode idle, point "));
+    Serial.print(point);
+    Serial.print(F(" of "));
+    Serial.println(points);
+
+    Serial.println(F("start_hz,stop_hz,points,log,samples,settle_ms,record_bytes"));
+    Serial.print(startHz);
+    Serial.write(',');
+    Serial.print(stopHz);
+    Serial.write(',');
+    Serial.print(points);
+    Serial.write(',');
+    Serial.print(logarithmic ? 1 : 0);
+    Serial.write(',');
+    Serial.print(samples);
+    Serial.write(',');
+    Serial.print(settleMs);
+    Serial.write(',');
+    Serial.println(BODE_RECORD_SIZE);
+}
+
+// Private Functions_________________________________________________________________
+
+uint32_t BodeClass::pointFrequencyHz(uint16_t index)
+{
+    if (index == points - 1)
+    {
+        return stopHz;
+    }
+
+    if (logarithmic)
+    {
+        return (uint32_t) (startHz * exp(logStep * index) + 0.5);
+    }
+
+    return (uint32_t) (startHz + ((float) stopHz - (float) startHz) * index / (points - 1) + 0.5);
+}
+
+/** Stretches the capture to whole periods of the tone as the ADC sees it.  Everything is in CPU cycles: a sample is
+ *  BODE_SAMPLE_CYCLES long and the tone advances by r / F_CPU of a period between two samples.
+ */
+uint16_t BodeClass::captureSamples(uint32_t toneHz, uint8_t* captureFlags)
+{
+    uint32_t r = (toneHz * (uint32_t) BODE_SAMPLE_CYCLES) % F_CPU;
+    uint32_t alias = (r < F_CPU / 2) ? r : F_CPU - r;
+    // The square of the tone, which the RMS averages, runs at twice the alias and is the slower one near half the
+    // sample rate
+    uint32_t r2 = (2 * r) % F_CPU;
+    uint32_t alias2 = (r2 < F_CPU / 2) ? r2 : F_CPU - r2;
+    uint32_t slowest = (alias2 < alias) ? alias2 : alias;
+
+    *captureFlags = 0;
+
+    // Samples per period in 24.8 fixed point
+    uint32_t periodQ8 = slowest ? (F_CPU * 256UL) / slowest : 0;
+
+    if ((slowest == 0) || (periodQ8 > (uint32_t) BODE_MAX_SAMPLES * 256))
+    {
+        // Not even one period fits
+        *captureFlags |= BODE_FLAG_ALIASED;
+        return samples;
+    }
+
+    uint32_t periods = ((uint32_t) samples * 256 + periodQ8 - 1) / periodQ8;
+    if (periods * periodQ8 > (uint32_t) BODE_MAX_SAMPLES * 256)
+    {
+        periods = ((uint32_t) BODE_MAX_SAMPLES * 256) / periodQ8;
+    }
+
+    return (uint16_t) ((periods * periodQ8 + 128) >> 8);
+}
+
+void BodeClass::beginPoint()
+{
+    frequencyHz = pointFrequencyHz(point);
+    count = captureSamples(frequencyHz, &flags);
+
+    DDS.sendFrequency(frequencyHz);
+    settleStart = Clock.cycles();
+    state = STATE_SETTLING;
+}
+
+void BodeClass::beginCapture()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    bodeRemaining = count;
+    bodeSum = 0;
+    bodeSumSquares = 0;
+    bodeMin = 0xFFFF;
+    bodeMax = 0;
+    SREG = oldSREG;
+
+    // Free running from here, a flag left by the last capture is cleared on the way
+    ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIF) | _BV(ADIE) | BODE_ADC_PRESCALE;
+    state = STATE_CAPTURING;
+}
+
+void BodeClass::sendRecord()
+{
+    // The capture is closed, the interrupt no longer touches the sums
+    float mean = (float) bodeSum / count - 512.0;
+    float variance = (float) bodeSumSquares / count - mean * mean;
+    float rmsCounts = (variance > 0.0) ? sqrt(variance) : 0.0;
+    uint32_t rmsTenthMv = (uint32_t) (rmsCounts * (BODE_AREF_MV * 10.0 / 1024.0) + 0.5);
+    uint16_t peakToPeakMv = (uint16_t) (((uint32_t) (bodeMax - bodeMin) * BODE_AREF_MV) >> 10);
+
+    if ((bodeMin == 0) || (bodeMax == 1023))
+    {
+        flags |= BODE_FLAG_CLIPPED;
+    }
+
+    if (rmsTenthMv > 0xFFFF)
+    {
+        rmsTenthMv = 0xFFFF;
+    }
+
+    uint8_t record[BODE_RECORD_SIZE] =
+    {
+        BODE_RECORD_SYNC,
+        (uint8_t) point, (uint8_t) (point >> 8),
+        (uint8_t) frequencyHz, (uint8_t) (frequencyHz >> 8), (uint8_t) (frequencyHz >> 16), (uint8_t) (frequencyHz >> 24),
+        (uint8_t) rmsTenthMv, (uint8_t) (rmsTenthMv >> 8),
+        (uint8_t) peakToPeakMv, (uint8_t) (peakToPeakMv >> 8),
+        flags,
+        0
+    };
+
+    for (uint8_t i = 0; i < BODE_RECORD_SIZE - 1; i++)
+    {
+        record[BODE_RECORD_SIZE - 1] += record[i];
+    }
+
+    Serial.write(record, BODE_RECORD_SIZE);
+
+    DEBUG(F("Bode "));
+    DEBUG(frequencyHz);
+    DEBUG(F(" Hz, samples "));
+    DEBUGLN(count);
+}
@@ -0,0 +1,128 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Magnitude response sweep, the output drives the device under test and its response comes back on A0.
+ *
+ *  Each point sets the frequency with DDSClass, waits the settle time and lets the ADC run free at clk/32 (38.5 kS/s)
+ *  while its interrupt accumulates the sum, the sum of squares, the minimum and the maximum.  The amplitude stays
+ *  where AmplifierClass has it.  The main loop turns the sums into RMS and peak to peak and sends a binary record,
+ *  then moves on while the record drains, so the sweep runs at the settle plus capture time per point.
+ *
+ *  The input must sit at mid supply (e.g. a capacitor into a 2 x 10k divider), the range is 0 to AVCC.  Above half
+ *  the sample rate the ADC undersamples: the RMS of a tone is still right as long as the capture covers whole periods
+ *  of the alias and of its square, so the sample count is stretched to the nearest whole number of the slower one (up to
+ *  BODE_MAX_SAMPLES).  Tones that alias to near DC or to near half the sample rate cannot be measured this way and are
+ *  flagged.  The sample and hold limits the useful range to a few hundred kHz.
+ *
+ *  Record, BODE_RECORD_SIZE bytes, multi-byte fields little endian:
+ *
+ *    0     BODE_RECORD_SYNC, never part of the text around it
+ *    1-2   point index
+ *    3-6   frequency in Hz
+ *    7-8   RMS in 0.1 mV, DC removed
+ *    9-10  peak to peak in mV
+ *    11    BODE_FLAG_* bits
+ *    12    8-bit sum of bytes 0 to 11
+ */
+#ifndef Bode_h
+#define Bode_h
+
+#include "Arduino.h"
+#include "OutputChannel.h"
+
+#define BODE_INPUT_CHANNEL      0       ///< ADC0, pin A0
+#define BODE_AREF_MV            5000    ///< AVCC
+#define BODE_SAMPLE_CYCLES      (32 * 13)
+#define BODE_DEFAULT_POINTS     200
+#define BODE_MAX_POINTS         1000
+#define BODE_DEFAULT_SAMPLES    256
+#define BODE_MIN_SAMPLES        16
+#define BODE_MAX_SAMPLES        8192    ///< keeps the sum of squares within 32 bits
+#define BODE_DEFAULT_SETTLE_MS  2
+#define BODE_MAX_SETTLE_MS      1000
+#define BODE_RECORD_SYNC        0xA5
+#define BODE_RECORD_SIZE        13
+
+#define BODE_FLAG_ALIASED       0x01    ///< the tone aliases too close to DC or half the sample rate
+#define BODE_FLAG_CLIPPED       0x02    ///< the input reached 0 or AVCC
+
+typedef enum
+{
+    BODE_IDLE = 0,
+    BODE_BUSY,
+    BODE_DONE
+} BODE_STATUS_T;
+
+class BodeClass
+{
+  public:
+    BodeClass();
+
+    uint8_t setStartHz(uint32_t newStartHz);
+    uint8_t setStopHz(uint32_t newStopHz);
+    uint8_t setPoints(uint16_t newPoints);
+    void setLogarithmic(bool logarithmic);
+    uint8_t setSettleMs(uint16_t newSettleMs);
+    uint8_t setSamples(uint16_t newSamples);
+
+    /// Turns the channel output on and starts the sweep, fails for the AWG and while the trigger is armed
+    uint8_t start(OutputChannelClass& channel);
+    /// Ends the sweep and gives the channel its frequency and output state back
+    void stop();
+    bool isRunning();
+
+    /// Moves the sweep on, called from every pass of the main loop.  Returns BODE_DONE once after the last record.
+    BODE_STATUS_T poll();
+    void printStatus();
+
+  private:
+    typedef enum
+    {
+        STATE_IDLE = 0,
+        STATE_SETTLING,
+        STATE_CAPTURING
+    } STATE_T;
+
+    uint32_t pointFrequencyHz(uint16_t point);
+    uint16_t captureSamples(uint32_t frequencyHz, uint8_t* flags);
+    void beginPoint();
+    void beginCapture();
+    void sendRecord();
+
+    uint32_t startHz;
+    uint32_t stopHz;
+    uint16_t points;
+    bool logarithmic;
+    uint16_t settleMs;
+    uint16_t samples;
+
+    STATE_T state;
+    OutputChannelClass* channel;
+    OUTPUT_STATUS_T previousOutput;
+    float logStep;
+    uint16_t point;
+    uint32_t frequencyHz;
+    uint16_t count;
+    uint8_t flags;
+    uint32_t settleStart;
+};
+
+extern BodeClass Bode;
+
+#endif
@@ -24,6 +24,22 @@
 #include "DDS.h" // used by OutputChannel.cpp; TODO move this into output channel only
 #include "Amplifier.h" // used by OutputChannel.cpp
 #include "Filter.h"
+#include "AWG.h"
+#include "FrequencyCounter.h"
+#include "Trigger.h"
+#include "Power.h"
+#include "Watchdog.h"
+#include "Memory.h"
+#include "Bode.h"
+#include "Hop.h"
+#include "Schedule.h"
+#include "Sync.h"
+#include "Feed.h"
+#include "Pulse.h"
+#include "Response.h"
+#include "Clock.h"
+#include "Profiler.h"
+#include "Trace.h"
 #include "Debug.h"
 
 #define DEBUG_OUTPUT 0
@@ -60,6 +76,9 @@ typedef enum
 void printVerboseStatus(void);
 void printStatusLine(void);
 MENU_RESULT_T setWaveformMenu(char* waveformToSet);
+MENU_RESULT_T setArbitraryWaveform(AWG_TABLE_T table);
+void printUploadResult(AWG_UPLOAD_T result);
+void printCounterResult(FREQUENCY_COUNTER_STATUS_T status);
 
 MENU_STATE_T menuState;
 
@@ -73,20 +92,34 @@ OutputChannelClass outputChannel4(4);
 OutputChannelClass outputChannel5(5);
 #endif // MULTICHANNEL
 
-char inputString[MAX_STRING_LENGTH];
+// One more than the longest line so it is always terminated, ct with a ten digit tick fills it
+char inputString[MAX_STRING_LENGTH + 1];
 byte stringLength = 0;
 boolean stringComplete = false;
+uint32_t lineEndCycles = 0;     // Clock.cycles() when serialEvent() read the end of the line, for clock sync
+AWG_UPLOAD_T awgUploadResult = AWG_UPLOAD_IDLE;  // Set by serialEvent() when a wavetable upload ends
 
+#if DISPLAY_ENABLED
 // TODO rename this variable?
 boolean useQuickCommandsOnly = false;   // This suppresses the menu after an invalid selection and does not allow for sub-menus.. Mainly used for advanced users and to simplify the GUI application
+#else
+// Only a host talks to a headless build, so it is quick from boot and every menu path below is dead code
+const boolean useQuickCommandsOnly = true;
+#endif
 
-// TODO move this into flash
-const char* errorSelectionInMenuString = "An error has occurred, please try again";
+const char errorSelectionInMenuString[] PROGMEM = "An error has occurred, please try again";
+#define ERROR_SELECTION_IN_MENU     ((const __FlashStringHelper*) errorSelectionInMenuString)
 
 OutputChannelClass* p_currentChannel;
 
 void setup()
 {
+    // A watchdog that caused the reset is still running with its shortest time-out
+    Watchdog.init();
+
+    // Paints the free SRAM, the stack has not been deep yet
+    Memory.init();
+
     // put your setup code here, to run once:
     Serial.begin(57600);
     while (!Serial)
@@ -94,6 +127,11 @@ void setup()
         // Wait here if something else is already using the serial connection
     }
 
+    // Timer1 is the cycle counter used by the profiler, the frequency counter timestamps its edges with it
+    Clock.init();
+    FrequencyCounter.init();
+    Power.init();
+
     // Start with channel1 as the default channel
     p_currentChannel = &outputChannel1;
 
@@ -105,18 +143,79 @@ void setup()
 
     // This only needs to be called once, even if there are more than one output channel
     p_currentChannel->init();
+
+    // The trigger writes to the DDS, so it comes after the channel has set it up
+    Trigger.init();
+    Sync.init();
+
+    if (Watchdog.restoreState(*p_currentChannel))
+    {
+        Serial.println(F("Watchdog reset, settings restored"));
+    }
+    Watchdog.start();
 }
 
 void loop()
 {
     static char firstCharacter[2];
     char* remainingCharacters;
+    FEED_STATUS_T feedStatus;
+
+    Watchdog.kick();
+    Trigger.service();
+
+    // A scheduled command changed the DDS, the channel and the watchdog copy catch up
+    if (Schedule.service(*p_currentChannel))
+    {
+        Watchdog.saveState(*p_currentChannel);
+    }
+
+    // The same for a commit strobe
+    if (Sync.service(*p_currentChannel))
+    {
+        Watchdog.saveState(*p_currentChannel);
+    }
 
     if (stringComplete == true)
     {
         // Only executes this when a new string is received from the terminal
+        PROFILE_BEGIN();
+        TRACE(TRACE_CATEGORY_COMMAND, TRACE_EVENT_COMMAND, (uint8_t) inputString[0] | (menuState << 8));
+
+        // What the stack depth of this command is noted against, a sub-menu entry counts for the command that opened it
+        char command = inputString[0];
+        switch (menuState)
+        {
+            case MENU_SUB_FREQUENCY:
+                command = 'f';
+            break;
+            case MENU_SUB_AMPLITUDE:
+                command = 'a';
+            break;
+            case MENU_SUB_PHASE:
+                command = 'p';
+            break;
+            case MENU_SUB_WAVEFORM:
+                command = 'w';
+            break;
+            default:
+            break;
+        }
+
+        // Any command but the settings query ends a sweep, the channel gets its settings back before the command
+        // changes them
+        if (strcmp(inputString, "b") != 0)
+        {
+            Bode.stop();
+        }
+
+        // The same for hopping, but the status query leaves it running
+        if (strcmp(inputString, "h") != 0)
+        {
+            Hop.stop();
+        }
 
-        if (menuState == MENU_MAIN)
+        if (!DISPLAY_ENABLED || (menuState == MENU_MAIN))
         {
             // Initialize new input string
             remainingCharacters = NULL;
@@ -127,13 +226,41 @@ void loop()
             // TODO look into only executing this if the string length is over a certain limit ?2?
             remainingCharacters = strtok(inputString, firstCharacter);
 
-            if ((strcmp(firstCharacter, "?") == 0) || (strstr(inputString, "help") != NULL))
+            if (DISPLAY_ENABLED && ((strcmp(firstCharacter, "?") == 0) || (strstr(inputString, "help") != NULL)))
             {
                 Display.mainMenu();
             }
             else if (strcmp(firstCharacter, "%") == 0)
             {
+#if DISPLAY_ENABLED
                 useQuickCommandsOnly = !useQuickCommandsOnly;
+#endif
+            }
+            else if (strcmp(firstCharacter, "k") == 0)
+            {
+                // k0 full prompt, k1 compact, k2 none, k3 dashboard
+                if ((remainingCharacters == NULL) ||
+                    (!DISPLAY_ENABLED && (atoi(remainingCharacters) == PROMPT_FORMAT_DASHBOARD)) ||
+                    Response.setPromptFormat((PROMPT_FORMAT_T) atoi(remainingCharacters)))
+                {
+                    if (useQuickCommandsOnly == false)
+                    {
+                        Serial.println(ERROR_SELECTION_IN_MENU);
+                    }
+                }
+                else if (!DISPLAY_ENABLED)
+                {
+                    // No dashboard to begin or end
+                }
+                else if (Response.getPromptFormat() == PROMPT_FORMAT_DASHBOARD)
+                {
+                    // Also redraws a dashboard that is already up, e.g. after the terminal was cleared
+                    Display.dashboardBegin();
+                }
+                else
+                {
+                    Display.dashboardEnd();
+                }
             }
             else if (strcmp(firstCharacter, "@") == 0)
             {
@@ -141,6 +268,10 @@ void loop()
             }
             else if (strcmp(firstCharacter, "#") == 0)
             {
+                // A reset leaves nothing for the scheduled commands to change
+                Schedule.clear();
+                Sync.drop();
+
                 Display.resetDevice();
                 // TODO update DDS.reset to take a reference to OutputChannelClass* to the reset to clear out the console status
                 // or issue a reset to the output channel directly via p_currentChannel->reset())
@@ -161,7 +292,7 @@ void loop()
                     if (p_currentChannel->setFrequencyHz(frequency))
                     {
                         //indicate ERROR and display retry message
-                        Serial.println(errorSelectionInMenuString);
+                        Serial.println(ERROR_SELECTION_IN_MENU);
                     }
                 }
                 else if (useQuickCommandsOnly)
@@ -185,7 +316,7 @@ void loop()
                     if (p_currentChannel->setAmplitudeMV(amplitude))
                     {
                         //indicate ERROR and display retry message
-                        Serial.println(errorSelectionInMenuString);
+                        Serial.println(ERROR_SELECTION_IN_MENU);
                     }
                 }
                 else if (useQuickCommandsOnly)
@@ -208,7 +339,7 @@ void loop()
                     if (p_currentChannel->setPhaseDegrees(phase))
                     {
                         //indicate ERROR and display retry message
-                        Serial.println(errorSelectionInMenuString);
+                        Serial.println(ERROR_SELECTION_IN_MENU);
                     }
                 }
                 else if (useQuickCommandsOnly)
@@ -227,9 +358,17 @@ void loop()
                 {
                     if (setWaveformMenu(remainingCharacters) != MENU_RESULT_SUCCESS)
                     {
-                        // If there was an error with the quick command, then bring up the waveform menu
-                        Display.waveformMenu();
-                        menuState = MENU_SUB_WAVEFORM;
+                        if (useQuickCommandsOnly)
+                        {
+                            // No sub-menu in quick mode, the next line is a command again
+                            Serial.println(ERROR_SELECTION_IN_MENU);
+                        }
+                        else
+                        {
+                            // If there was an error with the quick command, then bring up the waveform menu
+                            Display.waveformMenu();
+                            menuState = MENU_SUB_WAVEFORM;
+                        }
                     }
                 }
                 else if (useQuickCommandsOnly)
@@ -251,6 +390,451 @@ void loop()
             {
                 p_currentChannel->setOutputStatus(ON);
             }
+            else if (strcmp(firstCharacter, "s") == 0)
+            {
+                Profiler.print();
+            }
+            else if (strcmp(firstCharacter, "S") == 0)
+            {
+                Serial.println(F("Profiler cleared"));
+                Profiler.reset();
+            }
+            else if (strcmp(firstCharacter, "t") == 0)
+            {
+                if (remainingCharacters == NULL)
+                {
+                    // Drain everything that was recorded, as fast as the TX buffer empties
+                    Trace.requestDrain();
+                }
+                else if (remainingCharacters[0] == 'm')
+                {
+                    // Select the categories to record, e.g. tm255 for all of them
+                    Trace.setCategories((uint8_t) atoi(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'i')
+                {
+                    // Toggle draining while the command loop is idle
+                    Trace.setIdleDrain(!Trace.getIdleDrain());
+                }
+                else if (useQuickCommandsOnly == false)
+                {
+                    Serial.println(ERROR_SELECTION_IN_MENU);
+                }
+            }
+            else if (AWG_ENABLED && (strcmp(firstCharacter, "U") == 0))
+            {
+                // The next 256 bytes are wavetable samples followed by their 8-bit sum, they bypass the line editor
+                if (useQuickCommandsOnly == false)
+                {
+                    Serial.println(F("Send 256 samples and their 8-bit sum"));
+                }
+                AWG.beginUpload();
+            }
+            else if (strcmp(firstCharacter, "m") == 0)
+            {
+                uint8_t counterError = 0;
+
+                if (remainingCharacters == NULL)
+                {
+                    // The result is printed by loop() when the gate closes
+                    FrequencyCounter.start();
+                }
+                else if (remainingCharacters[0] == 'g')
+                {
+                    // Gate time, e.g. mg1000 for one second
+                    counterError = FrequencyCounter.setGateMs((uint16_t) atol(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'i')
+                {
+                    // Input, mi0 for pin 8 or mi1 for the comparator on pins 6 and 7
+                    counterError = FrequencyCounter.setSource((FREQUENCY_COUNTER_SOURCE_T) atoi(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'd')
+                {
+                    // Ratio of an external divider in front of the input
+                    counterError = FrequencyCounter.setPrescaler((uint16_t) atol(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'c')
+                {
+                    // Verify every frequency change within this many ms, mc0 turns the self-check off
+                    counterError = FrequencyCounter.setSelfCheckMs((uint16_t) atol(&remainingCharacters[1]));
+                }
+                else
+                {
+                    counterError = 1;
+                }
+
+                if (counterError && (useQuickCommandsOnly == false))
+                {
+                    Serial.println(ERROR_SELECTION_IN_MENU);
+                }
+            }
+            else if (strcmp(firstCharacter, "g") == 0)
+            {
+                uint8_t triggerError = 0;
+
+                if (remainingCharacters == NULL)
+                {
+                    Trigger.printStatus();
+                }
+                else if (remainingCharacters[0] == '0')
+                {
+                    // The DDS followed the trigger while armed, give it the channel settings back
+                    Trigger.disarm();
+                    p_currentChannel->setFrequencyHz(p_currentChannel->getFrequencyHz());
+                    p_currentChannel->setOutputStatus(p_currentChannel->getOutputStatus());
+                }
+                else if ((remainingCharacters[0] == '1') || (remainingCharacters[0] == '2'))
+                {
+                    // g1 arms until disarmed, g2 for a single trigger
+                    triggerError = Trigger.arm(remainingCharacters[0] == '2');
+                }
+                else if (remainingCharacters[0] == 'a')
+                {
+                    // 0 output on, 1 output off, 2 FSEL flip, 3 next step
+                    triggerError = Trigger.setAction((TRIGGER_ACTION_T) atoi(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'e')
+                {
+                    // 0 falling, 1 rising
+                    triggerError = Trigger.setEdge((TRIGGER_EDGE_T) atoi(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'h')
+                {
+                    triggerError = Trigger.setHoldoffUs((uint32_t) atol(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'f')
+                {
+                    // Frequency the FSEL flip switches to
+                    Trigger.setAlternateFrequency((uint32_t) atol(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 's')
+                {
+                    triggerError = Trigger.addStep((uint32_t) atol(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'c')
+                {
+                    Trigger.clearSteps();
+                }
+                else
+                {
+                    triggerError = 1;
+                }
+
+                if (triggerError && (useQuickCommandsOnly == false))
+                {
+                    Serial.println(ERROR_SELECTION_IN_MENU);
+                }
+            }
+            else if (strcmp(firstCharacter, "b") == 0)
+            {
+                uint8_t bodeError = 0;
+
+                if (remainingCharacters == NULL)
+                {
+                    Bode.printStatus();
+                }
+                else if (remainingCharacters[0] == '0')
+                {
+                    // Already stopped above
+                }
+                else if (remainingCharacters[0] == '1')
+                {
+                    // Records follow the prompt, "Bode done" and a prompt end the sweep
+                    bodeError = Bode.start(*p_currentChannel);
+                }
+                else if (remainingCharacters[0] == 's')
+                {
+                    bodeError = Bode.setStartHz((uint32_t) atol(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'e')
+                {
+                    bodeError = Bode.setStopHz((uint32_t) atol(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'n')
+                {
+                    bodeError = Bode.setPoints((uint16_t) atoi(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'l')
+                {
+                    // bl1 logarithmic, bl0 linear steps
+                    Bode.setLogarithmic(atoi(&remainingCharacters[1]) != 0);
+                }
+                else if (remainingCharacters[0] == 't')
+                {
+                    bodeError = Bode.setSettleMs((uint16_t) atoi(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'c')
+                {
+                    // Samples per point, stretched to whole periods of the tone
+                    bodeError = Bode.setSamples((uint16_t) atoi(&remainingCharacters[1]));
+                }
+                else
+                {
+                    bodeError = 1;
+                }
+
+                if (bodeError && (useQuickCommandsOnly == false))
+                {
+                    Serial.println(ERROR_SELECTION_IN_MENU);
+                }
+            }
+            else if (strcmp(firstCharacter, "h") == 0)
+            {
+                uint8_t hopError = 0;
+
+                if (remainingCharacters == NULL)
+                {
+                    Hop.printStatus();
+                }
+                else if (remainingCharacters[0] == '0')
+                {
+                    // Already stopped above
+                }
+                else if (remainingCharacters[0] == '1')
+                {
+                    hopError = Hop.start(*p_currentChannel);
+                }
+                else if (remainingCharacters[0] == 'b')
+                {
+                    // Frequency of channel 0
+                    hopError = Hop.setBaseHz((uint32_t) atol(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'w')
+                {
+                    hopError = Hop.setSpacingHz((uint32_t) atol(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'n')
+                {
+                    hopError = Hop.setChannels((uint8_t) atoi(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'd')
+                {
+                    hopError = Hop.setDwellUs((uint32_t) atol(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'r')
+                {
+                    hopError = Hop.setSeed((uint16_t) atol(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'q')
+                {
+                    // Channels in the order to visit them, the LFSR picks them while the sequence is empty
+                    hopError = Hop.addSequenceChannel((uint8_t) atoi(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'c')
+                {
+                    Hop.clearSequence();
+                }
+                else
+                {
+                    hopError = 1;
+                }
+
+                if (hopError && (useQuickCommandsOnly == false))
+                {
+                    Serial.println(ERROR_SELECTION_IN_MENU);
+                }
+            }
+            else if (strcmp(firstCharacter, "c") == 0)
+            {
+                uint8_t scheduleError = 0;
+
+                if (remainingCharacters == NULL)
+                {
+                    Schedule.printStatus();
+                }
+                else if (remainingCharacters[0] == 's')
+                {
+                    // The host pairs this with its own clock, it is the tick of the line end of this command
+                    Serial.print(F("Sync "));
+                    Serial.println(lineEndCycles);
+                }
+                else if (remainingCharacters[0] == 't')
+                {
+                    // Ticks use all 32 bits, atol() would stop at 2^31
+                    Schedule.setTick(strtoul(&remainingCharacters[1], NULL, 10));
+                }
+                else if (remainingCharacters[0] == 'd')
+                {
+                    Schedule.setDelayUs(strtoul(&remainingCharacters[1], NULL, 10));
+                }
+                else if (remainingCharacters[0] == 'q')
+                {
+                    scheduleError = Schedule.add(&remainingCharacters[1], *p_currentChannel);
+                }
+                else if (remainingCharacters[0] == '0')
+                {
+                    Schedule.clear();
+                }
+                else
+                {
+                    scheduleError = 1;
+                }
+
+                // Also in quick mode, a host has to know that a command will not happen
+                if (scheduleError)
+                {
+                    Serial.println(ERROR_SELECTION_IN_MENU);
+                }
+            }
+            else if (strcmp(firstCharacter, "y") == 0)
+            {
+                uint8_t syncError = 0;
+
+                if (remainingCharacters == NULL)
+                {
+                    Sync.printStatus();
+                }
+                else if ((remainingCharacters[0] >= '0') && (remainingCharacters[0] <= '2'))
+                {
+                    // 0 off, 1 slave, 2 master
+                    syncError = Sync.setRole((SYNC_ROLE_T) (remainingCharacters[0] - '0'));
+                }
+                else if (remainingCharacters[0] == 'g')
+                {
+                    syncError = Sync.setGroup((uint8_t) atoi(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'a')
+                {
+                    syncError = Sync.setAddress((uint8_t) atoi(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'c')
+                {
+                    syncError = Sync.commit();
+                }
+                else if (remainingCharacters[0] == 'd')
+                {
+                    Sync.drop();
+                }
+                else
+                {
+                    syncError = Sync.stage(remainingCharacters, *p_currentChannel);
+                }
+
+                // Also in quick mode, the boards would not change together
+                if (syncError)
+                {
+                    Serial.println(ERROR_SELECTION_IN_MENU);
+                }
+            }
+            else if (strcmp(firstCharacter, "e") == 0)
+            {
+                uint8_t feedError = 0;
+
+                if (remainingCharacters == NULL)
+                {
+                    Feed.printStatus();
+                }
+                else if (remainingCharacters[0] == 'r')
+                {
+                    feedError = Feed.setRateHz((uint32_t) atol(&remainingCharacters[1]));
+                }
+                else if ((remainingCharacters[0] == '1') || (remainingCharacters[0] == '2'))
+                {
+                    // The packets after this line bypass the line editor until the end packet
+                    feedError = Feed.start((FEED_MODE_T) (remainingCharacters[0] - '0'), *p_currentChannel);
+                }
+                else
+                {
+                    feedError = 1;
+                }
+
+                // Also in quick mode, a host must not send packets to the line editor
+                if (feedError)
+                {
+                    Serial.println(ERROR_SELECTION_IN_MENU);
+                }
+            }
+            else if (strcmp(firstCharacter, "j") == 0)
+            {
+                if (remainingCharacters == NULL)
+                {
+                    Memory.printStatus();
+                }
+                else if ((remainingCharacters[0] == '0') || (remainingCharacters[0] == '1'))
+                {
+                    // Per-command stack depths, a walk of the free SRAM after every command
+                    Memory.setTracking(remainingCharacters[0] == '1');
+                }
+                else if (remainingCharacters[0] == 'r')
+                {
+                    Memory.reset();
+                }
+                else if (useQuickCommandsOnly == false)
+                {
+                    Serial.println(ERROR_SELECTION_IN_MENU);
+                }
+            }
+            else if (strcmp(firstCharacter, "u") == 0)
+            {
+                uint8_t pulseError = 0;
+
+                if (remainingCharacters == NULL)
+                {
+                    Pulse.printStatus();
+                }
+                else if (remainingCharacters[0] == '1')
+                {
+                    // Turning the output on again restarts the train, or fires the next burst
+                    if (p_currentChannel->getWaveformType() == WAVEFORM_PULSE)
+                    {
+                        p_currentChannel->setOutputStatus(ON);
+                    }
+                    else
+                    {
+                        pulseError = 1;
+                    }
+                }
+                else if (remainingCharacters[0] == 'p')
+                {
+                    // Overrides the period from the frequency until the next f
+                    pulseError = Pulse.setPeriodNs((uint32_t) atol(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'w')
+                {
+                    pulseError = Pulse.setWidthNs((uint32_t) atol(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'd')
+                {
+                    pulseError = Pulse.setDutyPercent((uint8_t) atoi(&remainingCharacters[1]));
+                }
+                else if (remainingCharacters[0] == 'n')
+                {
+                    pulseError = Pulse.setCount((uint16_t) atol(&remainingCharacters[1]));
+                }
+                else
+                {
+                    pulseError = 1;
+                }
+
+                if (pulseError && (useQuickCommandsOnly == false))
+                {
+                    Serial.println(ERROR_SELECTION_IN_MENU);
+                }
+            }
+            else if (strcmp(firstCharacter, "P") == 0)
+            {
+                if (remainingCharacters == NULL)
+                {
+                    Power.printStatus();
+                    Power.resetStats();
+                }
+                else if ((remainingCharacters[0] == 'd') && (remainingCharacters[1] >= '0') &&
+                         (remainingCharacters[1] < '0' + DDS_POWER_COUNT) && (remainingCharacters[2] == ASCII_NUL))
+                {
+                    // What the DDS powers down while the output is off: 0 reset only, 1 DAC, 2 MCLK, 3 both
+                    DDS.setOffPowerMode((ddsPower_t) (remainingCharacters[1] - '0'));
+                }
+                else if (remainingCharacters[0] == 's')
+                {
+                    // Ps0 keeps the CPU running between commands
+                    Power.setIdleSleep(atoi(&remainingCharacters[1]) != 0);
+                }
+                else if (useQuickCommandsOnly == false)
+                {
+                    Serial.println(ERROR_SELECTION_IN_MENU);
+                }
+            }
             else if (strcmp(firstCharacter, "d") == 0)
             {
                 Serial.println(F("DAC filter disabled"));
@@ -261,6 +845,23 @@ void loop()
                 Serial.println(F("DAC filter enabled"));
                 Filter.on();
             }
+            else if ((strcmp(firstCharacter, "r") == 0) && (remainingCharacters != NULL) && (remainingCharacters[0] == 'd'))
+            {
+                if (remainingCharacters[1] == ASCII_NUL)
+                {
+                    Amplifier.printDitherStats();
+                    Amplifier.resetDitherStats();
+                }
+                else if (Amplifier.setDitherBits(atoi(&remainingCharacters[1])) == 0)
+                {
+                    // Sets the amplitude again, with or without the fraction
+                    p_currentChannel->setAmplitudeMV();
+                }
+                else if (useQuickCommandsOnly == false)
+                {
+                    Serial.println(ERROR_SELECTION_IN_MENU);
+                }
+            }
             else if (strcmp(inputString, "rs") == 0)
             {
                 Serial.println(F("Amplifier Status:"));
@@ -271,6 +872,12 @@ void loop()
                 Serial.println(F("Amplifier Tcon Status:"));
                 Amplifier.printTcon();
             }
+            else if (strcmp(inputString, "re") == 0)
+            {
+                Amplifier.printBusStats();
+                Amplifier.resetBusStats();
+                Watchdog.printStatus();
+            }
             else if (strcmp(inputString, "r0") == 0)
             {
                 Serial.println(F("Amplifier1 Value:"));
@@ -289,8 +896,8 @@ void loop()
 
                 if (useQuickCommandsOnly == false)
                 {
-                    // Only display the mainmenu after an invalid selection if use quick commands is off
-                    Display.mainMenu();
+                    // Only display the mainmenu after an invalid selection if use quick commands is off, and not over the dashboard
+                    Display.returnToMainMenu();
                 }
             }
         }
@@ -299,7 +906,7 @@ void loop()
             if (strcmp(inputString, "x") == 0 || strcmp(inputString, "") == 0)
             {
                 // Exit menu if an 'x' is sent or enter key only
-                Display.mainMenu();
+                Display.returnToMainMenu();
                 menuState = MENU_MAIN;
             }
             else
@@ -311,7 +918,7 @@ void loop()
                 if (p_currentChannel->setFrequencyHz(userInputUL))
                 {
                     //indicate ERROR and display retry message
-                    Serial.println(errorSelectionInMenuString);
+                    Serial.println(ERROR_SELECTION_IN_MENU);
                 }
                 else
                 {
@@ -325,7 +932,7 @@ void loop()
             if (strcmp(inputString, "x") == 0 || strcmp(inputString, "") == 0)
             {
                 // Exit menu if an 'x' is sent or enter key only
-                Display.mainMenu();
+                Display.returnToMainMenu();
                 menuState = MENU_MAIN;
             }
             else
@@ -337,7 +944,7 @@ void loop()
                 if (p_currentChannel->setAmplitudeMV(userInputUL))
                 {
                     //indicate ERROR and display retry message
-                    Serial.println(errorSelectionInMenuString);
+                    Serial.println(ERROR_SELECTION_IN_MENU);
                 }
                 else
                 {
@@ -351,7 +958,7 @@ void loop()
             if (strcmp(inputString, "x") == 0 || strcmp(inputString, "") == 0)
             {
                 // Exit menu if an 'x' is sent or enter key only
-                Display.mainMenu();
+                Display.returnToMainMenu();
                 menuState = MENU_MAIN;
             }
             else
@@ -363,7 +970,7 @@ void loop()
                 if (p_currentChannel->setPhaseDegrees(userInputUL))
                 {
                     //indicate ERROR and display retry message
-                    Serial.println(errorSelectionInMenuString);
+                    Serial.println(ERROR_SELECTION_IN_MENU);
                 }
                 else
                 {
@@ -391,7 +998,7 @@ void loop()
                     menuState = MENU_MAIN;
                 break;
                 case MENU_RESULT_ERROR:
-                    Serial.println(errorSelectionInMenuString);
+                    Serial.println(ERROR_SELECTION_IN_MENU);
                     Display.waveformMenu();
                     menuState = MENU_SUB_WAVEFORM;
                 break;
@@ -405,53 +1012,188 @@ void loop()
             // No item found
         }
 
+        PROFILE_END(PROFILE_COMMAND_DISPATCH);
+        Memory.endCommand(command);
+
+        // The command completed, this is what the watchdog restores
+        Watchdog.saveState(*p_currentChannel);
+
         // Print the command prompt
         printStatusLine();
 
         // Clear the string and reset the counters
-        memset(&inputString, ASCII_NUL, MAX_STRING_LENGTH);
+        memset(&inputString, ASCII_NUL, sizeof(inputString));
         stringLength = 0;
         stringComplete = false;
     }
+    else if (awgUploadResult != AWG_UPLOAD_IDLE)
+    {
+        printUploadResult(awgUploadResult);
+        awgUploadResult = AWG_UPLOAD_IDLE;
+        printStatusLine();
+    }
+    else if (AWG.checkUploadTimeout() == AWG_UPLOAD_TIMEOUT)
+    {
+        printUploadResult(AWG_UPLOAD_TIMEOUT);
+        printStatusLine();
+    }
+    else if ((feedStatus = Feed.poll()) >= FEED_DONE)
+    {
+        (feedStatus == FEED_DONE) ? Serial.println(F("Feed done")) : Serial.println(F("Feed timed out"));
+        Feed.printStatus();
+        printStatusLine();
+    }
+    else if (Bode.poll() == BODE_DONE)
+    {
+        Serial.println(F("Bode done"));
+        printStatusLine();
+    }
+    else
+    {
+        FREQUENCY_COUNTER_STATUS_T counterStatus = FrequencyCounter.poll();
+
+        if ((counterStatus != FREQUENCY_COUNTER_IDLE) && (counterStatus != FREQUENCY_COUNTER_BUSY))
+        {
+            printCounterResult(counterStatus);
+            printStatusLine();
+        }
+        else
+        {
+            // Counter results and other changes nobody asked for with a command
+            if (DISPLAY_ENABLED)
+            {
+                Display.dashboardPoll(*p_currentChannel);
+            }
+            Trace.idle();
+            Power.idle();
+        }
+    }
+}
+
+// Prints Measured <Hz> for the m command, Check PASS/FAIL <Hz> for the self-check
+void printCounterResult(FREQUENCY_COUNTER_STATUS_T status)
+{
+    if (FrequencyCounter.isVerifying())
+    {
+        FrequencyCounter.verifyPassed(status) ? Serial.print(F("Check PASS ")) : Serial.print(F("Check FAIL "));
+    }
+    else
+    {
+        Serial.print(F("Measured "));
+    }
+
+    switch (status)
+    {
+        case FREQUENCY_COUNTER_DONE:
+            Serial.print(FrequencyCounter.getFrequencyHz(), 3);
+            Serial.print(F(" Hz"));
+        break;
+        case FREQUENCY_COUNTER_NO_SIGNAL:
+            Serial.print(F("no signal"));
+        break;
+        case FREQUENCY_COUNTER_OVER_RANGE:
+            Serial.print(F("over range"));
+        break;
+        default:
+        break;
+    }
+
+    if (FrequencyCounter.isVerifying())
+    {
+        Serial.print(F(", expected "));
+        Serial.print(FrequencyCounter.getExpectedHz());
+        Serial.print(F(" Hz"));
+    }
+
+    Serial.println();
+}
+
+void printUploadResult(AWG_UPLOAD_T result)
+{
+    switch (result)
+    {
+        case AWG_UPLOAD_DONE:
+            Serial.println(F("Upload complete"));
+        break;
+        case AWG_UPLOAD_CHECKSUM_ERROR:
+            Serial.println(F("Upload checksum error"));
+        break;
+        case AWG_UPLOAD_TIMEOUT:
+            Serial.println(F("Upload timed out"));
+        break;
+        default:
+        break;
+    }
 }
 
 void printVerboseStatus(void)
 {
-    Serial.print(F("Quick Commands Only: "));
-    useQuickCommandsOnly == true ? Serial.println(F("Yes")) : Serial.println(F("No"));
-    Serial.print(F("Frequency: "));
-    Serial.println(p_currentChannel->getFrequencyHz());
-    Serial.print(F("Amplitude: "));
-    Serial.println(p_currentChannel->getAmplitudeMV());
-    Serial.print(F("Phase: "));
-    Serial.println(p_currentChannel->getPhaseDegrees());
-    Serial.print(F("Output: "));
-    (p_currentChannel->getOutputStatus() == ON) ? Serial.println(F("On")) : Serial.println(F("Off"));
+    uint32_t values[3] =
+    {
+        p_currentChannel->getFrequencyHz(),
+        p_currentChannel->getAmplitudeMV(),
+        p_currentChannel->getPhaseDegrees()
+    };
+
+    Response.add(F("Quick Commands Only: "));
+    useQuickCommandsOnly == true ? Response.add(F("Yes\r\n")) : Response.add(F("No\r\n"));
+    Response.format(F("Frequency: %\r\nAmplitude: %\r\nPhase: %\r\nOutput: "), values);
+    (p_currentChannel->getOutputStatus() == ON) ? Response.add(F("On\r\n")) : Response.add(F("Off\r\n"));
+    Response.commit();
 }
 
-// Print the command prompt in the form WAVEFORM:F#A#P#_OUTPUT>
+// Print the command prompt in the form WAVEFORM:F#A#P#_OUTPUT>, or the compact form, or nothing
 void printStatusLine(void)
 {
-    if (useQuickCommandsOnly)
+    PROFILE_BEGIN();
+
+    switch (Response.getPromptFormat())
     {
-        // Write a ! first if quick commands only is set
-        Serial.write('Q');
-        Serial.write('_');
+        case PROMPT_FORMAT_FULL:
+            if (useQuickCommandsOnly)
+            {
+                // Write a Q_ first if quick commands only is set
+                Response.add(F("Q_"));
+            }
+
+            Response.add(p_currentChannel->getWaveform());
+            Response.add(F("_F"));
+            Response.addNumber(p_currentChannel->getFrequencyHz());
+            Response.add(F("_A"));
+            Response.addNumber(p_currentChannel->getAmplitudeMV());
+            Response.add(F("_P"));
+            Response.addNumber(p_currentChannel->getPhaseDegrees());
+            (p_currentChannel->getOutputStatus() == ON) ? Response.add(F("_ON>")) : Response.add(F("_OFF>"));
+        break;
+        case PROMPT_FORMAT_COMPACT:
+        {
+            uint32_t values[5] =
+            {
+                p_currentChannel->getWaveformType(),
+                p_currentChannel->getFrequencyHz(),
+                p_currentChannel->getAmplitudeMV(),
+                p_currentChannel->getPhaseDegrees(),
+                p_currentChannel->getOutputStatus()
+            };
+
+            Response.format(F("%,%,%,%,%>"), values);
+        }
+        break;
+        case PROMPT_FORMAT_DASHBOARD:
+            // The dashboard shows the settings, only what changed goes out
+            if (DISPLAY_ENABLED)
+            {
+                Display.dashboardUpdate(*p_currentChannel);
+            }
+            Response.add(F("> "));
+        break;
+        default:
+        break;
     }
 
-    Serial.print(p_currentChannel->getWaveform());
-    Serial.write('_');
-    Serial.write('F');
-    Serial.print(p_currentChannel->getFrequencyHz());
-    Serial.write('_');
-    Serial.write('A');
-    Serial.print(p_currentChannel->getAmplitudeMV());
-    Serial.write('_');
-    Serial.write('P');
-    Serial.print(p_currentChannel->getPhaseDegrees());
-    Serial.write('_');
-    (p_currentChannel->getOutputStatus() == ON) ? Serial.print("ON") : Serial.print("OFF");
-    Serial.write('>');
+    Response.commit();
+
+    PROFILE_END(PROFILE_STATUS_LINE);
 }
 
 MENU_RESULT_T setWaveformMenu(char* waveformToSet)
@@ -491,22 +1233,90 @@ MENU_RESULT_T setWaveformMenu(char* waveformToSet)
         p_currentChannel->setWaveform(WAVEFORM_SQUARE);
         wasAbleToSetWaveform = MENU_RESULT_SUCCESS;
     }
+    else if (strstr(waveformToSet, "pul") != NULL)
+    {
+        // Pulses from Timer1 on pin 9, width set with u
+        DEBUGLN(F("Chirp pulse"));
+        p_currentChannel->setWaveform(WAVEFORM_PULSE);
+        wasAbleToSetWaveform = MENU_RESULT_SUCCESS;
+    }
+    else if (strstr(waveformToSet, "ramp") != NULL)
+    {
+        wasAbleToSetWaveform = setArbitraryWaveform(AWG_TABLE_RAMP);
+    }
+    else if (strstr(waveformToSet, "exp") != NULL)
+    {
+        wasAbleToSetWaveform = setArbitraryWaveform(AWG_TABLE_EXPONENTIAL);
+    }
+    else if (strstr(waveformToSet, "ecg") != NULL)
+    {
+        wasAbleToSetWaveform = setArbitraryWaveform(AWG_TABLE_CARDIAC);
+    }
+    else if (strstr(waveformToSet, "user") != NULL)
+    {
+        wasAbleToSetWaveform = setArbitraryWaveform(AWG_TABLE_USER);
+    }
     else
     {
         wasAbleToSetWaveform = MENU_RESULT_ERROR;
     }
 
+    if (wasAbleToSetWaveform == MENU_RESULT_SUCCESS)
+    {
+        // A new waveform leaves nothing for the scheduled commands to change
+        Schedule.clear();
+        Sync.drop();
+    }
+
     return wasAbleToSetWaveform;
 }
+MENU_RESULT_T setArbitraryWaveform(AWG_TABLE_T table)
+{
+    // Fails for the user table until an upload has succeeded
+    if (AWG.selectTable(table))
+    {
+        return MENU_RESULT_ERROR;
+    }
+
+    DEBUGLN(F("Chirp arbitrary"));
+    p_currentChannel->setWaveform(WAVEFORM_ARBITRARY);
+    return MENU_RESULT_SUCCESS;
+}
+
 void serialEvent()
 {
-    while (Serial.available())
+    // A line waiting for loop() ends the read, the next one stays in the RX buffer so a host can send ahead
+    while (!stringComplete && Serial.available())
     {
+        if (Feed.isStreaming())
+        {
+            // Stream packets are binary too, and wait in the RX buffer until the FIFO has room after the last one
+            if (!Feed.canReceive())
+            {
+                break;
+            }
+            Feed.receiveByte((uint8_t) Serial.read());
+            continue;
+        }
+
         // get the new char:
         char incomingChar = (char) Serial.read();
 
+        if (AWG.isUploading())
+        {
+            // Wavetable bytes are binary, keep them away from the line editor and do not echo them
+            AWG_UPLOAD_T result = AWG.uploadByte((uint8_t) incomingChar);
+
+            if (result != AWG_UPLOAD_BUSY)
+            {
+                awgUploadResult = result;
+            }
+            continue;
+        }
+
         if ((incomingChar == ASCII_CR) || (incomingChar == ASCII_LF))
         {
+            lineEndCycles = Clock.cycles();
             stringComplete = true;
             Serial.print("\n\r");
         }
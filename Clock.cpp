@@ -0,0 +1,81 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include "Clock.h"
+
+ClockClass Clock;
+
+/// Upper 16 bits of the cycle counter, incremented on every Timer1 overflow
+static volatile uint16_t timer1Overflows = 0;
+
+ClockClass::ClockClass()
+{
+}
+
+ClockClass::~ClockClass()
+{
+}
+
+/// @brief Takes over Timer1 (the Arduino core only uses it for analogWrite on pins 9 and 10) as a free running cycle counter
+void ClockClass::init()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+
+    TCCR1A = 0;             // Normal mode, OC1A/OC1B disconnected
+    TCCR1B = _BV(CS10);     // clk/1
+    TCNT1 = 0;
+    TIFR1 = _BV(TOV1);      // Clear a pending overflow left over from the core's PWM setup
+    TIMSK1 = _BV(TOIE1);
+    timer1Overflows = 0;
+
+    SREG = oldSREG;
+}
+
+/// @brief Returns the number of CPU cycles since init(), safe to call with interrupts enabled or disabled
+uint32_t ClockClass::cycles()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+
+    uint32_t now = extend(TCNT1);
+
+    SREG = oldSREG;
+
+    return now;
+}
+
+/// @brief Extends a Timer1 count read with interrupts disabled (TCNT1, or ICR1 in the capture interrupt) to 32 bits
+uint32_t ClockClass::extend(uint16_t count)
+{
+    uint16_t overflows = timer1Overflows;
+
+    // An overflow that happened after interrupts were disabled has not been counted yet.  Only account for it
+    // when the count was read after the wrap, otherwise it belongs to the next period.
+    if ((TIFR1 & _BV(TOV1)) && (count < 0x8000))
+    {
+        overflows++;
+    }
+
+    return ((uint32_t) overflows << 16) | count;
+}
+
+ISR(TIMER1_OVF_vect)
+{
+    timer1Overflows++;
+}
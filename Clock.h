@@ -0,0 +1,61 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#ifndef Clock_h
+#define Clock_h
+
+#include "Arduino.h"
+
+/// The longest compare step, half of Timer1 so a late interrupt still sees its next compare ahead
+#define CLOCK_MAX_STEP_CYCLES   0x8000U
+
+/// @brief Cycle accurate time base built on a free running Timer1
+///
+/// @details Timer1 counts every CPU cycle (no prescaler) and the overflow interrupt extends the 16-bit
+/// counter to 32 bits, so cycles() wraps every 2^32 / F_CPU seconds (268 s at 16 MHz).
+class ClockClass
+{
+  public:
+    ClockClass();
+    ~ClockClass();
+    void init();
+    uint32_t cycles();
+    uint32_t extend(uint16_t count);
+};
+
+extern ClockClass Clock;
+
+/// @brief Next piece of a Timer1 compare interval that may be longer than the timer spans
+///
+/// @details Pieces are CLOCK_MAX_STEP_CYCLES until the last two, which share what is left, so no piece is too short
+/// for the handler to set up before it is due.  Inline, it runs in the compare interrupts.
+/// @returns the cycles to add to the compare register, all of remaining once it fits
+static inline uint16_t clockCompareStep(uint32_t remaining)
+{
+    if (remaining > 2 * (uint32_t) CLOCK_MAX_STEP_CYCLES)
+    {
+        return CLOCK_MAX_STEP_CYCLES;
+    }
+    if (remaining > CLOCK_MAX_STEP_CYCLES)
+    {
+        return (uint16_t) (remaining / 2);
+    }
+    return (uint16_t) remaining;
+}
+
+#endif
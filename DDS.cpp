@@ -19,217 +19,335 @@
 
 #include <SPI.h>
 #include "DDS.h"
+#include "Power.h"
+#include "Profiler.h"
+#include "Trace.h"
 #include "Debug.h"
 #define DEBUG_OUTPUT 0
 
-#define CLOCK_FREQUENCY 16000000
-#define DDS_28BITS      0x10000000
+#define DDS_TEMPLATE    template <ddsChip_t chip, uint32_t mclkHz, class ChipSelect, uint8_t spiMode>
+#define DDS_DRIVER      AD983xClass<chip, mclkHz, ChipSelect, spiMode>
 
 DDSClass DDS;
 
-const uint8_t slaveSelectPin = 10;
-
-// Defines that allows for easy bit shifting when writing to dds chip using single write
-/// @todo Are using the defines for DDS every used?
-#define D15        15
-#define D14        14
-#define B28        13
-#define HLB        12
-#define FSEL       11
-#define PSEL       10
-#define RESET      8
-#define SLEEP1     7
-#define SLEEP2     6
-#define OPBITEN    5
-#define DIV2       3
-#define MODE       1
-
-/// Control Register used on several common Analog Devices DDS chips such as AD9834 and AD9837
-/// @todo did not compile when resv bits declared const
-typedef struct __attribute__ ((packed)) __attribute__ ((aligned))
-{
-  uint8_t resv0       :1;
-  uint8_t mode        :1;    //!< selects between sine (MODE=0) and triangle wave (MODE=1)
-  uint8_t resv2       :1;
-  uint8_t div2        :1;    //!< when OPBITEN is set, this corresponds to the square wave frequency.  DIV2=0 is MSB/2
-  uint8_t resv4       :1;
-  uint8_t opbiten     :1;    //!< selects square wave, OPBITEN=0 allows for sine or triangle
-  uint8_t sleep12     :1;    //!< powers down the on-chip DAC, useful when the DDS is used to output the MSB of the DAC data
-  uint8_t sleep1      :1;    //!< disables the internal MCLK, but DAC output remains at present value
-  uint8_t reset       :1;    //!< corresponds to an analog output of midscale
-  uint8_t resv9       :1;
-  uint8_t psel        :1;    //!< phase select bit. PSEL=0 selects PHASE0
-  uint8_t fsel        :1;    //!< frequency select bit.  FSEL=0 selects FREQ0
-  uint8_t hlb         :1;    //!< determines if a write to frequency register is LSB or MSB when B28=0. HLB=1 is MSB
-  uint8_t b28         :1;    //!< loads frequency register is two consecutive writes, LSB first. B28=0 is individual
-  uint8_t d14         :1;
-  uint8_t d15         :1;    //!< D15 and D14 functions are handled in the sendFrequency and sendPhase functions, do not manually change them!
-} ddsControlRegisterBits_t;
-
-/// Provides the option to access the DDS control register directly or through individual bits
-union
-{
-  uint16_t controlRegister;
-  ddsControlRegisterBits_t bits;
-} dds;
-
-DDSClass::DDSClass()
-{
-}
-
-DDSClass::~DDSClass()
+DDS_TEMPLATE
+DDS_DRIVER::AD983xClass()
+{
+  dds.controlRegister = 0;
+  offPowerMode = DDS_POWER_RESET;
+}
+
+DDS_TEMPLATE
+DDS_DRIVER::~AD983xClass()
 {
   SPI.end();
 }
 
 /// @brief Resets the DDS chip by setting the RESET register to 1
-void DDSClass::init()
+DDS_TEMPLATE
+void DDS_DRIVER::init()
 {
-    // Set SS as an output and setup SPI modes
-  pinMode (slaveSelectPin, OUTPUT);
-  
+  // Set FSYNC as an output and setup SPI modes
+  ChipSelect::init();
+
   SPI.begin();
   SPI.setClockDivider(SPI_CLOCK_DIV32);
   SPI.setBitOrder(MSBFIRST);   // MSbit first
-  SPI.setDataMode(SPI_MODE2);  // SCLK idle high, sample on clock falling edge is SPI_MODE2
+  SPI.setDataMode(spiMode);
   reset();
 }
-void DDSClass::reset()
+
+DDS_TEMPLATE
+void DDS_DRIVER::reset()
 {
   // Frequency write function in this file performs its set operation in two consecutive (b28).  Also start the DDS in reset mode.
   // Clear all parameters, set the output to a sine wave and turn off the output (reset = 1)
   dds.controlRegister = 0;
   dds.bits.b28=1;
-  
+
   sendFrequency(0);
   sendPhase(0);
-  setOutputMode(DDS_MODE_SINE);
+  setOutputMode(WAVEFORM_SINE);
   setOutput(DDS_OFF);
-  
+
+  TRACE(TRACE_CATEGORY_DDS, TRACE_EVENT_DDS_RESET, 0);
   DEBUGLN(F("DDS reset complete"));
 }
 
-void DDSClass::sendFrequency(uint32_t newFrequency)
+/// @param frequencyRegister 0 for FREQ0, 1 for FREQ1
+DDS_TEMPLATE
+void DDS_DRIVER::sendFrequency(uint32_t newFrequency, uint8_t frequencyRegister)
 {
-  uint32_t frequencyTuningWord = 0; /// 
+  uint32_t frequencyTuningWord = 0; ///
   uint16_t LSB = 0;                 /// Lower 16-bits of the 28-bit register
   uint16_t MSB = 0;                 /// Upper 16-bits of the 28-bit register
-  float calculatedFrequency = 0.0;  /// 28-bit register for storing the frequency
-    
-  // Calculation is 2^28/F_MCLK * FREQ = FREQ_REG
-  calculatedFrequency = (((float)(newFrequency)))/(CLOCK_FREQUENCY);
-  frequencyTuningWord = (uint32_t)(calculatedFrequency*DDS_28BITS);
-  
+
+  PROFILE_BEGIN();
+
+  frequencyTuningWord = tuningWord(newFrequency);
+
   // Modify the frequencyTuningWord into two 14-bit registers to be sent
-  MSB = (uint16_t)((frequencyTuningWord & 0xFFFC000)>>14);  
+  MSB = (uint16_t)((frequencyTuningWord & 0xFFFC000)>>14);
   LSB = (uint16_t)(frequencyTuningWord & 0x3FFF);
-  
-  // We're always writing to the FREQ0 register to keep this nice and simple (0b01XXXXXX)
-  MSB |= 0x4000;
-  LSB |= 0x4000;
-  
-  // Write it to the DDS chip
+
+  // FREQ0 is 0b01XXXXXX, FREQ1 is 0b10XXXXXX
+  MSB |= frequencyRegister ? 0x8000 : 0x4000;
+  LSB |= frequencyRegister ? 0x8000 : 0x4000;
+
+  // Write it to the DDS chip, a trigger must not flip FSEL onto a half written register
+  uint8_t held = ddsHold();
   writeDDS(LSB);
   writeDDS(MSB);
-  
+  ddsRelease(held);
+
+  PROFILE_END(PROFILE_SEND_FREQUENCY);
+
+  TRACE(TRACE_CATEGORY_DDS, TRACE_EVENT_DDS_FREQUENCY_LSB, LSB);
+  TRACE(TRACE_CATEGORY_DDS, TRACE_EVENT_DDS_FREQUENCY_MSB, MSB);
+
   DEBUG(F("LSB: 0x"));
   DEBUGLN(LSB,HEX);
   DEBUG(F("MSB: 0x"));
   DEBUGLN(MSB,HEX);
-  
+
   DEBUGLN("DDS freq set");
 }
 
-void DDSClass::sendPhase(uint16_t newPhase)
+DDS_TEMPLATE
+uint32_t DDS_DRIVER::tuningWord(uint32_t frequencyHz)
 {
-  uint32_t phaseCalculation = 0;
+  // Calculation is 2^28/F_MCLK * FREQ = FREQ_REG, the ratio is folded by the compiler so this is one multiply
+  return (uint32_t)(frequencyHz * (float)(268435456.0 / mclkHz));
+}
+
+DDS_TEMPLATE
+uint16_t DDS_DRIVER::phaseWord(uint16_t degrees)
+{
+  const uint16_t phaseMask = (1 << ddsChipTraits<chip>::phaseBits) - 1;
   uint16_t phaseRegister = 0;
-  
-  // Calculation is 4096/360 * PHASE = PHASE_REG
-  // 4096/360 = 11.37777, but we'll use 11378 and divide by 1000 for an error of 0.002%
-  phaseCalculation = (11378 * newPhase) / 1000;
-  
+
+  // Calculation is 2^phaseBits/360 * PHASE = PHASE_REG, 360 degrees wraps to 0
+  phaseRegister = (uint16_t)((((uint32_t) degrees << ddsChipTraits<chip>::phaseBits) / 360) & phaseMask);
+
   // Phase0 register has 0b110X for bits <15:12> in control register
   // Phase1 register has 0b111X
-  // We're always writing to the PHASE0 register to keep this nice and simple 
+  // We're always writing to the PHASE0 register to keep this nice and simple
   /// @todo Enhance this function to allow for writes to either PHASE0 or PHASE1
-  phaseRegister = phaseCalculation; 
   phaseRegister |= ((1<<15) | (1<<14));
   phaseRegister &= ~(1<<13);
-    
+
+  return phaseRegister;
+}
+
+DDS_TEMPLATE
+void DDS_DRIVER::sendPhase(uint16_t newPhase)
+{
+  uint16_t phaseRegister = phaseWord(newPhase);
+
   writeDDS(phaseRegister);
-    
+
+  TRACE(TRACE_CATEGORY_DDS, TRACE_EVENT_DDS_PHASE, phaseRegister);
   DEBUGLN(F("DDS phase set"));
 }
 
-void DDSClass::setOutputMode(ddsMode_t newOutputWave)
+DDS_TEMPLATE
+void DDS_DRIVER::setOutputMode(WAVEFORM_T newOutputWave)
 {
+  uint8_t held = ddsHold();
+
   switch (newOutputWave)
   {
-    case DDS_MODE_SINE:
+    case WAVEFORM_SINE:
       dds.bits.opbiten = 0;
       dds.bits.mode = 0;
       DEBUGLN(F("DDS sine"));
     break;
-    case DDS_MODE_TRIANGLE:
+    case WAVEFORM_TRIANGLE:
       dds.bits.opbiten = 0;
       dds.bits.mode = 1;
       DEBUGLN(F("DDS triangle"));
     break;
-    case DDS_MODE_SQUARE:
+    case WAVEFORM_SQUARE:
       dds.bits.opbiten = 1;
-      dds.bits.div2 = 0;
+      dds.bits.mode = 0;
+      // DIV2=1 puts the MSB itself on the output, the set frequency
+      dds.bits.div2 = 1;
       DEBUGLN(F("DDS square"));
     break;
-    case DDS_MODE_SQUARE_DIV2:
+    case WAVEFORM_SQUARE_DIV_2:
       dds.bits.opbiten = 1;
-      dds.bits.div2 = 1;
+      dds.bits.mode = 0;
+      dds.bits.div2 = 0;
       DEBUGLN(F("DDS square div2"));
     break;
     default:
       // This could be debug
       DEBUG(F("Invalid output mode"));
-    break;
+      ddsRelease(held);
+    return;
   }
-  
+
+  // The MSB rather than the comparator on SIGN BIT OUT, the bit is reserved on the voltage output parts
+  dds.bits.signPib = ddsChipTraits<chip>::signBitOut && dds.bits.opbiten;
+
   writeDDS(dds.controlRegister);
+  ddsRelease(held);
+
+  TRACE(TRACE_CATEGORY_DDS, TRACE_EVENT_DDS_MODE, newOutputWave);
 }
 
-void DDSClass::setOutput(ddsOutput_t output)
+DDS_TEMPLATE
+void DDS_DRIVER::setOutput(ddsOutput_t output)
 {
+  uint8_t held = ddsHold();
+
   switch (output)
   {
     case DDS_OFF:
-      dds.bits.reset = 1;
+      dds.controlRegister |= getOffBits();
       DEBUGLN(F("DDS off"));
     break;
     case DDS_ON:
-      dds.bits.reset = 0;
+      dds.controlRegister &= ~DDS_CONTROL_POWER;
       DEBUGLN(F("DDS on"));
     break;
     default:
       DEBUGLN(F("DDS output mode invalid"));
     break;
   }
-  
+
+  writeDDS(dds.controlRegister);
+  ddsRelease(held);
+
+  if (output == DDS_ON)
+  {
+    Power.outputOn();
+  }
+
+  TRACE(TRACE_CATEGORY_DDS, TRACE_EVENT_DDS_OUTPUT, output);
+}
+
+/// @brief Selects what setOutput(DDS_OFF) powers down, an output that is already off is updated right away
+DDS_TEMPLATE
+void DDS_DRIVER::setOffPowerMode(ddsPower_t mode)
+{
+  if (mode >= DDS_POWER_COUNT)
+  {
+    return;
+  }
+
+  offPowerMode = mode;
+
+  if (dds.bits.reset)
+  {
+    uint8_t held = ddsHold();
+    dds.controlRegister = (dds.controlRegister & ~DDS_CONTROL_POWER) | getOffBits();
+    writeDDS(dds.controlRegister);
+    ddsRelease(held);
+  }
+}
+
+DDS_TEMPLATE
+ddsPower_t DDS_DRIVER::getOffPowerMode()
+{
+  return offPowerMode;
+}
+
+/// @brief Control register bits that turn the output off in the selected power mode
+DDS_TEMPLATE
+uint16_t DDS_DRIVER::getOffBits()
+{
+  static const uint16_t offBits[DDS_POWER_COUNT] =
+  {
+    DDS_CONTROL_RESET,
+    DDS_CONTROL_RESET | DDS_CONTROL_SLEEP12,
+    DDS_CONTROL_RESET | DDS_CONTROL_SLEEP1,
+    DDS_CONTROL_RESET | DDS_CONTROL_SLEEP1 | DDS_CONTROL_SLEEP12
+  };
+
+  return offBits[offPowerMode];
+}
+
+/// @brief Selects FREQ0 (0) or FREQ1 (1) as the active frequency register
+DDS_TEMPLATE
+void DDS_DRIVER::selectFrequencyRegister(uint8_t frequencyRegister)
+{
+  uint8_t held = ddsHold();
+  dds.bits.fsel = frequencyRegister ? 1 : 0;
   writeDDS(dds.controlRegister);
+  ddsRelease(held);
+}
+
+/// @brief Streamed LSB words change a frequency one write each, sendFrequency() needs B28 back on
+DDS_TEMPLATE
+void DDS_DRIVER::setLsbWrites(bool lsbOnly)
+{
+  uint8_t held = ddsHold();
+  dds.bits.b28 = lsbOnly ? 0 : 1;
+  dds.bits.hlb = 0;
+  writeDDS(dds.controlRegister);
+  ddsRelease(held);
+}
+
+DDS_TEMPLATE
+uint16_t DDS_DRIVER::getControlRegister()
+{
+  return dds.controlRegister;
+}
+
+/// @brief Writes a control word and keeps it as the control register, for interrupt handlers only
+/// @details Bypasses the SPI library so the frame always takes the same number of cycles.  The SPI settings are the
+/// ones init() made.
+DDS_TEMPLATE
+void DDS_DRIVER::writeControlFromInterrupt(uint16_t control)
+{
+  writeFromInterrupt(control);
+  dds.controlRegister = control;
+}
+
+/// @brief Writes any word, frequency and phase writes from an interrupt handler go through here
+DDS_TEMPLATE
+void DDS_DRIVER::writeFromInterrupt(uint16_t data)
+{
+  ChipSelect::select();
+  SPDR = (uint8_t) (data >> 8);
+  while (!(SPSR & _BV(SPIF)))
+  {
+  }
+  SPDR = (uint8_t) data;
+  while (!(SPSR & _BV(SPIF)))
+  {
+  }
+  ChipSelect::deselect();
 }
 
 // Private Functions_________________________________________________________________
 
-/// @brief Sends the control register to the DDS chip 
-void DDSClass::writeDDS(uint16_t data)
+/// @brief Sends the control register to the DDS chip
+DDS_TEMPLATE
+void DDS_DRIVER::writeDDS(uint16_t data)
 {
-  digitalWrite(slaveSelectPin, LOW);
+  PROFILE_BEGIN();
+
+  // An interrupt writing in the middle of this frame would interleave its own, it is latched and runs after chip select
+  // rises
+  uint8_t held = ddsHold();
+  ChipSelect::select();
   // Datasheet shows LSB with MSb in examples
   SPI.transfer((data>>8));  //MSB
   SPI.transfer(data);       //LSB
-    
-  digitalWrite(slaveSelectPin, HIGH);
-  
+
+  ChipSelect::deselect();
+  ddsRelease(held);
+
+  PROFILE_END(PROFILE_WRITE_DDS);
+  PROFILE_COUNT(PROFILE_COUNTER_SPI_FRAMES, 1);
+
   DEBUG(F("DDS write: "));
-  DEBUGLN(data, BIN); 
-  
+  DEBUGLN(data, BIN);
+
   /// @todo Add a delay in writeDDS?
 }
 
+// Only the part on the board is instantiated, the others generate no code
+template class AD983xClass<DDS_CHIP, DDS_MCLK_HZ, ddsChipSelectPB2, SPI_MODE2>;
@@ -16,40 +16,219 @@
 
     Copyright 2016 Mike Lemberger
 */
+
+/** Driver for the AD9833/AD9834/AD9837/AD9838 DDS family.
+ *
+ *  The chip, its MCLK, the chip select pin and the SPI mode are template parameters, so every difference between the
+ *  parts is settled by the compiler and the code for one board has no branches on them.  The board is picked with the
+ *  defines below, the sketch has a single DDS and DDS.cpp instantiates only that one driver.
+ *
+ *  The parts share the 28-bit frequency and 12-bit phase registers, the control register layout and the SLEEP1 and
+ *  SLEEP12 bits.  They differ in:
+ *
+ *    AD9833  25 MHz MCLK, square wave (MSB) on VOUT in place of the DAC
+ *    AD9837  16 MHz MCLK, otherwise an AD9833
+ *    AD9834  75 MHz MCLK, current output, square wave on the separate SIGN BIT OUT pin while IOUT keeps the sine
+ *    AD9838  16 MHz MCLK, otherwise an AD9834
+ *
+ *  On the AD9834 and AD9838 the square waveforms only reach the output stage if SIGN BIT OUT is wired to it.  Their
+ *  FSELECT, PSELECT, SLEEP and RESET pins are not used, PIN/SW stays 0.
+ */
 #ifndef DDS_h
 #define DDS_h
 
-// TODO ddsMode_t is the same was WAVEFORM_T, consolidate these
+#include <SPI.h>
+#include "OutputChannel.h"
+
+typedef enum
+{
+  DDS_CHIP_AD9833 = 0,
+  DDS_CHIP_AD9834,
+  DDS_CHIP_AD9837,
+  DDS_CHIP_AD9838
+} ddsChip_t;
+
+// Board configuration, may also come from the compiler command line
+#ifndef DDS_CHIP
+#define DDS_CHIP        DDS_CHIP_AD9833
+#endif
+#ifndef DDS_MCLK_HZ
+#define DDS_MCLK_HZ     16000000UL
+#endif
+
+/// Control register bits the trigger interrupt changes
+#define DDS_CONTROL_FSEL     (1 << 11)
+#define DDS_CONTROL_RESET    (1 << 8)
+#define DDS_CONTROL_SLEEP1   (1 << 7)
+#define DDS_CONTROL_SLEEP12  (1 << 6)
+#define DDS_CONTROL_POWER    (DDS_CONTROL_RESET | DDS_CONTROL_SLEEP1 | DDS_CONTROL_SLEEP12)
+
+/// What is powered down while the output is off.  Turning the output on clears all of it in one control write.
 typedef enum
 {
-  DDS_MODE_SINE = 0,
-  DDS_MODE_TRIANGLE,
-  DDS_MODE_SQUARE,
-  DDS_MODE_SQUARE_DIV2
-} ddsMode_t;
+  DDS_POWER_RESET = 0,    //!< RESET only, DAC at midscale and MCLK running
+  DDS_POWER_DAC_OFF,      //!< RESET + SLEEP12, DAC powered down
+  DDS_POWER_MCLK_OFF,     //!< RESET + SLEEP1, internal MCLK stopped
+  DDS_POWER_ALL_OFF,      //!< RESET + SLEEP1 + SLEEP12
+  DDS_POWER_COUNT
+} ddsPower_t;
 
 typedef enum
 {
   DDS_OFF  = 0,
-  DDS_ON   = 1  
+  DDS_ON   = 1
 } ddsOutput_t;
 
-class DDSClass
+/// What the driver needs to know about each part
+template <ddsChip_t chip> struct ddsChipTraits;
+
+template <> struct ddsChipTraits<DDS_CHIP_AD9833>
 {
+  static const uint32_t maxMclkHz = 25000000UL;
+  static const uint8_t phaseBits = 12;
+  static const bool signBitOut = false;
+};
+
+template <> struct ddsChipTraits<DDS_CHIP_AD9834>
+{
+  static const uint32_t maxMclkHz = 75000000UL;
+  static const uint8_t phaseBits = 12;
+  static const bool signBitOut = true;
+};
+
+template <> struct ddsChipTraits<DDS_CHIP_AD9837>
+{
+  static const uint32_t maxMclkHz = 16000000UL;
+  static const uint8_t phaseBits = 12;
+  static const bool signBitOut = false;
+};
+
+template <> struct ddsChipTraits<DDS_CHIP_AD9838>
+{
+  static const uint32_t maxMclkHz = 16000000UL;
+  static const uint8_t phaseBits = 12;
+  static const bool signBitOut = true;
+};
+
+/// Chip select on a port bit, written directly so a frame does not pay for digitalWrite()
+#define DDS_CHIP_SELECT(name, port, ddr, bit) \
+  struct name \
+  { \
+    static inline void init() { port |= _BV(bit); ddr |= _BV(bit); } \
+    static inline void select() { port &= (uint8_t) ~_BV(bit); } \
+    static inline void deselect() { port |= _BV(bit); } \
+  }
+
+/// Pin 10, the SPI SS pin
+DDS_CHIP_SELECT(ddsChipSelectPB2, PORTB, DDRB, PB2);
+
+/// Control Register of the AD983x family
+/// @todo did not compile when resv bits declared const
+typedef struct __attribute__ ((packed)) __attribute__ ((aligned))
+{
+  uint8_t resv0       :1;
+  uint8_t mode        :1;    //!< selects between sine (MODE=0) and triangle wave (MODE=1), must be 0 when OPBITEN=1
+  uint8_t resv2       :1;
+  uint8_t div2        :1;    //!< when OPBITEN is set, this corresponds to the square wave frequency.  DIV2=0 is MSB/2
+  uint8_t signPib     :1;    //!< AD9834/AD9838 only, SIGN BIT OUT is the DAC MSB (1) or the comparator (0)
+  uint8_t opbiten     :1;    //!< selects square wave, OPBITEN=0 allows for sine or triangle
+  uint8_t sleep12     :1;    //!< powers down the on-chip DAC, useful when the DDS is used to output the MSB of the DAC data
+  uint8_t sleep1      :1;    //!< disables the internal MCLK, but DAC output remains at present value
+  uint8_t reset       :1;    //!< corresponds to an analog output of midscale
+  uint8_t pinSw       :1;    //!< AD9834/AD9838 only, 1 hands FSEL, PSEL, SLEEP and RESET to the pins
+  uint8_t psel        :1;    //!< phase select bit. PSEL=0 selects PHASE0
+  uint8_t fsel        :1;    //!< frequency select bit.  FSEL=0 selects FREQ0
+  uint8_t hlb         :1;    //!< determines if a write to frequency register is LSB or MSB when B28=0. HLB=1 is MSB
+  uint8_t b28         :1;    //!< loads frequency register is two consecutive writes, LSB first. B28=0 is individual
+  uint8_t d14         :1;
+  uint8_t d15         :1;    //!< D15 and D14 functions are handled in the sendFrequency and sendPhase functions, do not manually change them!
+} ddsControlRegisterBits_t;
+
+/// @tparam chip the AD983x part on the board
+/// @tparam mclkHz the MCLK frequency
+/// @tparam ChipSelect a DDS_CHIP_SELECT() struct for the FSYNC pin
+/// @tparam spiMode SPI_MODE2 for every part of the family, SCLK idles high and data is taken on the falling edge
+template <ddsChip_t chip, uint32_t mclkHz, class ChipSelect, uint8_t spiMode>
+class AD983xClass
+{
+  static_assert(mclkHz <= ddsChipTraits<chip>::maxMclkHz, "MCLK is above the rating of the DDS");
+  static_assert(mclkHz > 0, "MCLK is not set");
+
   public:
-    DDSClass();
-    ~DDSClass();
+    AD983xClass();
+    ~AD983xClass();
     void init();
     void reset();
-    void sendFrequency(uint32_t);
+    void sendFrequency(uint32_t, uint8_t frequencyRegister = 0);
+    /// The 28-bit word sendFrequency() writes for a frequency
+    static uint32_t tuningWord(uint32_t frequencyHz);
+    /// The PHASE0 write sendPhase() makes for an angle
+    static uint16_t phaseWord(uint16_t degrees);
     void sendPhase(uint16_t);
-    void setOutputMode(ddsMode_t);
+    /// WAVEFORM_ARBITRARY is not a DDS mode and is ignored
+    void setOutputMode(WAVEFORM_T);
     void setOutput(ddsOutput_t);
+    void setOffPowerMode(ddsPower_t);
+    ddsPower_t getOffPowerMode();
+    uint16_t getOffBits();
+    void selectFrequencyRegister(uint8_t);
+    /// Single 14-bit writes to the LSBs of a frequency register (B28 and HLB off) instead of LSB and MSB pairs
+    void setLsbWrites(bool);
+    uint16_t getControlRegister();
+    void writeControlFromInterrupt(uint16_t);
+    void writeFromInterrupt(uint16_t);
   private:
     void writeDDS(uint16_t data);
+
+    /// Provides the option to access the DDS control register directly or through individual bits
+    union
+    {
+      uint16_t controlRegister;
+      ddsControlRegisterBits_t bits;
+    } dds;
+    ddsPower_t offPowerMode;  //!< applied by setOutput(DDS_OFF)
 };
 
+typedef AD983xClass<DDS_CHIP, DDS_MCLK_HZ, ddsChipSelectPB2, SPI_MODE2> DDSClass;
+
 extern DDSClass DDS;
 
-#endif DDS_h
+#define DDS_HELD_TRIGGER    0x01
+#define DDS_HELD_COMPARE    0x02
+#define DDS_HELD_STROBE     0x04
+
+/// Holds off the interrupts that write to the DDS while the main loop owns it: the trigger (pin change 2), the
+/// multi-board commit strobe (pin change 1) and the Timer1 compare B of hopping and scheduled commands.  Their flags stay set, so they run as soon as ddsRelease()
+/// gets the result back.  TIMSK1 is also changed by the frequency counter interrupt, hence the cli.
+static inline uint8_t ddsHold()
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  uint8_t held = ((PCICR & _BV(PCIE2)) ? DDS_HELD_TRIGGER : 0) | ((PCICR & _BV(PCIE1)) ? DDS_HELD_STROBE : 0) |
+                 ((TIMSK1 & _BV(OCIE1B)) ? DDS_HELD_COMPARE : 0);
+  PCICR &= ~(_BV(PCIE2) | _BV(PCIE1));
+  TIMSK1 &= ~_BV(OCIE1B);
+  SREG = oldSREG;
+  return held;
+}
+
+static inline void ddsRelease(uint8_t held)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  if (held & DDS_HELD_TRIGGER)
+  {
+    PCICR |= _BV(PCIE2);
+  }
+  if (held & DDS_HELD_STROBE)
+  {
+    PCICR |= _BV(PCIE1);
+  }
+  if (held & DDS_HELD_COMPARE)
+  {
+    TIMSK1 |= _BV(OCIE1B);
+  }
+  SREG = oldSREG;
+}
 
+#endif // DDS_h
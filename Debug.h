@@ -16,6 +16,8 @@
 
     Copyright 2016 Mike Lemberger
 */
+
+// These block on the serial port, use TRACE() from Trace.h for anything on a hot path
 #define DEBUGLN(msg, ...)  \
       do { if (DEBUG_OUTPUT) Serial.println(msg, ##__VA_ARGS__); } while (0)
 #define DEBUG(msg, ...)  \
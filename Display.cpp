@@ -19,10 +19,13 @@
 #include "Display.h"
 #include "Arduino.h"
 #include <avr/pgmspace.h>
+#include "Response.h"
+#include "Filter.h"
+#include "FrequencyCounter.h"
 
 DisplayClass Display;
 
-#define HELP_MENU_ROW_MAX  12
+#define HELP_MENU_ROW_MAX  41
 
 const char stringHelpMenu_1[] PROGMEM   = "Chirp - A lightweight function generator";
 const char stringHelpMenu_2[] PROGMEM   = "------------------------------";
@@ -36,6 +39,35 @@ const char stringHelpMenu_9[] PROGMEM  = "p   Set Phase";
 const char stringHelpMenu_10[] PROGMEM  = "w   Set Waveform";
 const char stringHelpMenu_11[] PROGMEM  = "o/O Turn output (o)ff or (O)n";
 const char stringHelpMenu_12[] PROGMEM  = "d/D Turn DAC filter off or on (dep)";
+const char stringHelpMenu_13[] PROGMEM  = "s/S Print or (S) clear profiler stats";
+const char stringHelpMenu_14[] PROGMEM  = "t   Drain trace, tm# categories, ti idle";
+const char stringHelpMenu_15[] PROGMEM  = "U   Upload a 256 sample user waveform";
+const char stringHelpMenu_16[] PROGMEM  = "m   Measure frequency, mg# gate ms";
+const char stringHelpMenu_17[] PROGMEM  = "    mi# input, md# divider, mc# check ms";
+const char stringHelpMenu_18[] PROGMEM  = "g   Trigger stats, g0/g1/g2 off/arm/once";
+const char stringHelpMenu_19[] PROGMEM  = "    ga# action, ge# edge, gh# holdoff us";
+const char stringHelpMenu_20[] PROGMEM  = "    gf# alt freq, gs# add step, gc clear";
+const char stringHelpMenu_21[] PROGMEM  = "P   Power stats, Pd# DDS off mode, Ps# sleep";
+const char stringHelpMenu_22[] PROGMEM  = "re  I2C errors and watchdog resets";
+const char stringHelpMenu_23[] PROGMEM  = "k#  Prompt 0 full 1 compact 2 none 3 dashboard";
+const char stringHelpMenu_24[] PROGMEM  = "b   Bode settings, b1/b0 start/stop sweep";
+const char stringHelpMenu_25[] PROGMEM  = "    bs# start Hz, be# end Hz, bn# points";
+const char stringHelpMenu_26[] PROGMEM  = "    bl# log, bt# settle ms, bc# samples";
+const char stringHelpMenu_27[] PROGMEM  = "h   Hop stats, h1/h0 start/stop hopping";
+const char stringHelpMenu_28[] PROGMEM  = "    hb# base Hz, hw# spacing Hz, hn# channels";
+const char stringHelpMenu_29[] PROGMEM  = "    hd# dwell us, hr# seed, hq# seq, hc clear";
+const char stringHelpMenu_30[] PROGMEM  = "u   Pulse stats, u1 fire (w pulse mode)";
+const char stringHelpMenu_31[] PROGMEM  = "    up# period ns, uw# width ns, ud# duty %";
+const char stringHelpMenu_32[] PROGMEM  = "    un# pulses per fire, 0 continuous";
+const char stringHelpMenu_33[] PROGMEM  = "c   Schedule stats, cs sync, c0 clear";
+const char stringHelpMenu_34[] PROGMEM  = "    ct# tick, cd# in us, cq f#/p#/o/O queue";
+const char stringHelpMenu_35[] PROGMEM  = "y   Sync stats, y0/y1/y2 off/slave/master";
+const char stringHelpMenu_36[] PROGMEM  = "    yf#/yp#/yo/yO stage, yc commit, yd drop";
+const char stringHelpMenu_37[] PROGMEM  = "    yg# group, ya# address, ya0 all boards";
+const char stringHelpMenu_38[] PROGMEM  = "j   Memory stats, j1/j0 per command, jr reset";
+const char stringHelpMenu_39[] PROGMEM  = "e   Feed stats, er# words per second";
+const char stringHelpMenu_40[] PROGMEM  = "    e1/e2 stream 28-bit/LSB words (binary)";
+const char stringHelpMenu_41[] PROGMEM  = "rd  Dither stats, rd# sub-tap bits 0-4";
 
 //const char stringHelpMenu_7[] PROGMEM   = "c#  Select an output channel {1..5}";
 PGM_P const helpMenu[] PROGMEM = 
@@ -52,12 +84,97 @@ PGM_P const helpMenu[] PROGMEM =
   stringHelpMenu_10,
   stringHelpMenu_11,
   stringHelpMenu_12,
+  stringHelpMenu_13,
+  stringHelpMenu_14,
+  stringHelpMenu_15,
+  stringHelpMenu_16,
+  stringHelpMenu_17,
+  stringHelpMenu_18,
+  stringHelpMenu_19,
+  stringHelpMenu_20,
+  stringHelpMenu_21,
+  stringHelpMenu_22,
+  stringHelpMenu_23,
+  stringHelpMenu_24,
+  stringHelpMenu_25,
+  stringHelpMenu_26,
+  stringHelpMenu_27,
+  stringHelpMenu_28,
+  stringHelpMenu_29,
+  stringHelpMenu_30,
+  stringHelpMenu_31,
+  stringHelpMenu_32,
+  stringHelpMenu_33,
+  stringHelpMenu_34,
+  stringHelpMenu_35,
+  stringHelpMenu_36,
+  stringHelpMenu_37,
+  stringHelpMenu_38,
+  stringHelpMenu_39,
+  stringHelpMenu_40,
+  stringHelpMenu_41,
 };
 
 char buffer[48];
 
+/** Dashboard fields, one per row from DASHBOARD_FIRST_ROW with the value at DASHBOARD_VALUE_COLUMN.  The shadow holds
+ *  what the terminal shows, so an update only sends the rows whose value changed: save the cursor, then per row a
+ *  cursor address, the value and an erase to the end of the line, then restore the cursor.  A new frequency costs
+ *  about 20 bytes instead of the prompt or a redraw.
+ */
+typedef enum
+{
+  DASHBOARD_WAVEFORM = 0,
+  DASHBOARD_FREQUENCY,
+  DASHBOARD_AMPLITUDE,
+  DASHBOARD_PHASE,
+  DASHBOARD_OUTPUT,
+  DASHBOARD_FILTER,
+  DASHBOARD_MEASURED,
+  DASHBOARD_FIELD_COUNT
+} DASHBOARD_FIELD_T;
+
+#define DASHBOARD_FIRST_ROW     3
+#define DASHBOARD_VALUE_COLUMN  15
+// Commands and their output scroll between here and the bottom of the screen
+#define DASHBOARD_SCROLL_ROW    (DASHBOARD_FIRST_ROW + DASHBOARD_FIELD_COUNT + 1)
+
+const char dashboardLabel_1[] PROGMEM = "Waveform";
+const char dashboardLabel_2[] PROGMEM = "Frequency Hz";
+const char dashboardLabel_3[] PROGMEM = "Amplitude mV";
+const char dashboardLabel_4[] PROGMEM = "Phase deg";
+const char dashboardLabel_5[] PROGMEM = "Output";
+const char dashboardLabel_6[] PROGMEM = "Filter";
+const char dashboardLabel_7[] PROGMEM = "Measured Hz";
+
+PGM_P const dashboardLabels[DASHBOARD_FIELD_COUNT] PROGMEM =
+{
+  dashboardLabel_1,
+  dashboardLabel_2,
+  dashboardLabel_3,
+  dashboardLabel_4,
+  dashboardLabel_5,
+  dashboardLabel_6,
+  dashboardLabel_7,
+};
+
+static uint32_t dashboardShadow[DASHBOARD_FIELD_COUNT];
+static bool dashboardStale;     // the screen was cleared, every field has to be sent
+
+/// ESC [ row ; column H
+static void dashboardMoveTo(uint8_t row, uint8_t column)
+{
+  Response.add(F("\033["));
+  Response.addNumber(row);
+  Response.add(';');
+  Response.addNumber(column);
+  Response.add('H');
+}
+
 DisplayClass::DisplayClass(void)
-{ 
+{
+  dashboard = false;
+  dashboardPolledMs = 0;
 }
 
 DisplayClass::~DisplayClass()
@@ -93,7 +210,7 @@ void DisplayClass::phaseMenu()
 }
 void DisplayClass::waveformMenu()
 {
-	print_P(PSTR("Enter a waveform {sine, triangle, square, squarediv2}"));
+	print_P(PSTR("Enter a waveform {sine, triangle, square, squarediv2, ramp, exp, ecg, user, pulse}"));
 }
 void DisplayClass::outputOff()
 {
@@ -112,6 +229,126 @@ void DisplayClass::invalidSelection()
   print_P(PSTR("Invalid Selection"));
 }
 
+void DisplayClass::returnToMainMenu()
+{
+  if (!dashboard)
+  {
+    mainMenu();
+  }
+}
+
+void DisplayClass::dashboardBegin()
+{
+  // Clear the screen and draw the labels
+  Response.add(F("\033[2J"));
+  Response.add(F("\033[HChirp"));
+  for (uint8_t field = 0; field < DASHBOARD_FIELD_COUNT; field++)
+  {
+    dashboardMoveTo(DASHBOARD_FIRST_ROW + field, 1);
+    Response.add((const __FlashStringHelper*) pgm_read_word(&dashboardLabels[field]));
+  }
+
+  // Keep the fields out of the scrolling region and put the cursor at its bottom
+  Response.add(F("\033["));
+  Response.addNumber(DASHBOARD_SCROLL_ROW);
+  Response.add(';');
+  Response.addNumber(DASHBOARD_SCREEN_ROWS);
+  Response.add('r');
+  dashboardMoveTo(DASHBOARD_SCREEN_ROWS, 1);
+  Response.commit();
+
+  dashboard = true;
+  dashboardStale = true;
+}
+
+void DisplayClass::dashboardEnd()
+{
+  if (dashboard)
+  {
+    // Whole screen scrolls again
+    Response.add(F("\033[r\033[2J\033[H"));
+    Response.commit();
+    dashboard = false;
+  }
+}
+
+bool DisplayClass::isDashboard()
+{
+  return dashboard;
+}
+
+void DisplayClass::dashboardUpdate(OutputChannelClass& channel)
+{
+  if (!dashboard)
+  {
+    return;
+  }
+
+  float measuredHz = FrequencyCounter.getFrequencyHz();
+  uint32_t values[DASHBOARD_FIELD_COUNT] =
+  {
+    channel.getWaveformType(),
+    channel.getFrequencyHz(),
+    channel.getAmplitudeMV(),
+    channel.getPhaseDegrees(),
+    channel.getOutputStatus(),
+    Filter.isOn(),
+    (uint32_t) (measuredHz + 0.5f),
+  };
+  bool changed = false;
+
+  for (uint8_t field = 0; field < DASHBOARD_FIELD_COUNT; field++)
+  {
+    if (!dashboardStale && (values[field] == dashboardShadow[field]))
+    {
+      continue;
+    }
+
+    if (!changed)
+    {
+      // DECSC, the cursor is on the command line in the scrolling region
+      Response.add(F("\0337"));
+      changed = true;
+    }
+
+    dashboardMoveTo(DASHBOARD_FIRST_ROW + field, DASHBOARD_VALUE_COLUMN);
+    switch (field)
+    {
+      case DASHBOARD_WAVEFORM:
+        Response.add(channel.getWaveform());
+      break;
+      case DASHBOARD_OUTPUT:
+      case DASHBOARD_FILTER:
+        values[field] ? Response.add(F("On")) : Response.add(F("Off"));
+      break;
+      default:
+        Response.addNumber(values[field]);
+      break;
+    }
+    Response.add(F("\033[K"));
+
+    dashboardShadow[field] = values[field];
+  }
+
+  if (changed)
+  {
+    // DECRC
+    Response.add(F("\0338"));
+  }
+
+  dashboardStale = false;
+}
+
+void DisplayClass::dashboardPoll(OutputChannelClass& channel)
+{
+  if (dashboard && (millis() - dashboardPolledMs >= DASHBOARD_POLL_MS))
+  {
+    dashboardPolledMs = millis();
+    dashboardUpdate(channel);
+    Response.commit();
+  }
+}
+
 void DisplayClass::print_P(const char* pstr)
 {
   uint8_t val;
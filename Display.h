@@ -19,6 +19,18 @@
 #ifndef Display_h
 #define Display_h
 
+#include "OutputChannel.h"
+
+/// Set to 0 (or build with -DDISPLAY_ENABLED=0) for a headless unit that only a host drives: no help, sub-menus or
+/// dashboard, and quick mode from boot.  Commands, prompts and errors are the same, the menu code is left unreferenced
+/// and the linker drops it with its strings.
+#ifndef DISPLAY_ENABLED
+#define DISPLAY_ENABLED 1
+#endif
+
+#define DASHBOARD_POLL_MS       250     ///< how often the idle loop looks for changes nobody typed a command for
+#define DASHBOARD_SCREEN_ROWS   24      ///< the VT100 screen, commands scroll in the rows below the fields
+
 class DisplayClass
 {
   public:
@@ -35,9 +47,23 @@ class DisplayClass
     void outputOn();
     void displayVersionInfo();
     void invalidSelection();
+    /// Back from a submenu, the help menu is printed again unless the dashboard is up
+    void returnToMainMenu();
+
+    /// Full screen status for a VT100 terminal, commands scroll below it
+    void dashboardBegin();
+    void dashboardEnd();
+    bool isDashboard();
+    /// Appends the fields that changed since the last update to the response, without committing it
+    void dashboardUpdate(OutputChannelClass& channel);
+    /// Called while idle, sends the changes at most every DASHBOARD_POLL_MS
+    void dashboardPoll(OutputChannelClass& channel);
 
   private:
     void print_P(const char*);
+
+    bool dashboard;
+    unsigned long dashboardPolledMs;
 };
 
 extern DisplayClass Display;
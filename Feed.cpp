@@ -0,0 +1,421 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <avr/interrupt.h>
+#include "Feed.h"
+#include "DDS.h"
+#include "Schedule.h"
+#include "Sync.h"
+#include "Trigger.h"
+#include "Debug.h"
+#define DEBUG_OUTPUT 0
+
+// FREQ0 address bits, the channel is always on FREQ0
+#define FEED_FREQ0              0x4000
+#define FEED_FIFO_MASK          (FEED_FIFO_FRAMES - 1)
+#define FEED_PACKET_BYTES       (2 + FEED_PACKET_WORDS * 4)
+
+FeedClass Feed;
+
+typedef enum
+{
+    FEED_STATE_IDLE = 0,
+    FEED_STATE_RECEIVING,
+    FEED_STATE_ENDING               // the end packet came, the FIFO plays out
+} FEED_STATE_T;
+
+static FEED_STATE_T feedState;
+
+// The packet being received, checked whole before poll() copies it into the FIFO
+static uint8_t feedPacket[FEED_PACKET_BYTES];
+static uint8_t feedPacketLength;
+static uint8_t feedPacketSize;      // bytes before the sum
+static uint8_t feedPacketSum;
+static bool feedPacketReady;
+static bool feedReplyDue;           // the last packet is in the FIFO, its answer waits for room for the next one
+
+// SPI frames, written by the main loop at the head and by the handler at the tail.  The indices run free, their
+// difference is the fill.
+static uint16_t feedFifo[FEED_FIFO_FRAMES];
+static volatile uint8_t feedHead;
+static volatile uint8_t feedTail;
+
+// Shared with the compare interrupt
+static uint16_t feedPeriodCycles;
+static uint8_t feedFramesPerWord;
+static volatile bool feedRunning;   // owns compare B
+static volatile bool feedUnderrun;  // since the last answer
+
+// Instrumentation, the counts of the handler are written by it only
+static volatile uint32_t feedWords;
+static volatile uint16_t feedUnderruns;
+static volatile uint16_t feedOverruns;
+static volatile uint16_t feedMinCycles;
+static volatile uint16_t feedMaxCycles;
+static volatile uint32_t feedTotalCycles;
+static uint16_t feedPackets;
+static uint16_t feedRejected;
+static uint16_t feedSkipped;
+
+bool feedCompareMatch(uint16_t entry)
+{
+    if (!FEED_ENABLED || !feedRunning)
+    {
+        return false;
+    }
+
+    OCR1B += feedPeriodCycles;
+
+    uint8_t tail = feedTail;
+    if (tail == feedHead)
+    {
+        if (feedState == FEED_STATE_ENDING)
+        {
+            // Played out, poll() gives the channel its settings back
+            TIMSK1 &= ~_BV(OCIE1B);
+            feedRunning = false;
+        }
+        else
+        {
+            feedUnderruns++;
+            feedUnderrun = true;
+        }
+        return true;
+    }
+
+    DDS.writeFromInterrupt(feedFifo[tail++ & FEED_FIFO_MASK]);
+    if (feedFramesPerWord == 2)
+    {
+        DDS.writeFromInterrupt(feedFifo[tail++ & FEED_FIFO_MASK]);
+    }
+    feedTail = tail;
+
+    uint16_t cycles = TCNT1 - entry;
+
+    // The handler ran past its own next compare, Timer1 has to wrap before the next word
+    if ((int16_t) (OCR1B - TCNT1) <= 0)
+    {
+        feedOverruns++;
+    }
+
+    feedWords++;
+    feedTotalCycles += cycles;
+    if (cycles < feedMinCycles) feedMinCycles = cycles;
+    if (cycles > feedMaxCycles) feedMaxCycles = cycles;
+    return true;
+}
+
+/// Room in the FIFO in words
+static uint8_t feedFreeWords()
+{
+    return (uint8_t) (FEED_FIFO_FRAMES - (uint8_t) (feedHead - feedTail)) / feedFramesPerWord;
+}
+
+/// Starts the compare one period from now
+static void feedStartTimer()
+{
+    // TIMSK1 is also changed by the frequency counter interrupt
+    uint8_t oldSREG = SREG;
+    cli();
+    feedRunning = true;
+    OCR1B = TCNT1 + feedPeriodCycles;
+    TIFR1 = _BV(OCF1B);
+    TIMSK1 |= _BV(OCIE1B);
+    SREG = oldSREG;
+}
+
+FeedClass::FeedClass()
+{
+    rateHz = FEED_DEFAULT_RATE_HZ;
+    mode = FEED_MODE_WORD;
+    channel = NULL;
+    previousOutput = OFF;
+    lastByteMs = 0;
+}
+
+uint8_t FeedClass::setRateHz(uint32_t newRateHz)
+{
+    if ((newRateHz < FEED_MIN_RATE_HZ) || (newRateHz > F_CPU / FEED_FRAME_CYCLES) || isStreaming())
+    {
+        return 1;
+    }
+
+    rateHz = newRateHz;
+    return 0;
+}
+
+uint8_t FeedClass::start(FEED_MODE_T newMode, OutputChannelClass& newChannel)
+{
+    uint8_t framesPerWord = (newMode == FEED_MODE_LSB) ? 1 : 2;
+
+    // The AWG and the pulses hold the DDS in reset, the trigger owns FSEL, queued and staged commands would write over
+    // the stream
+    if (!FEED_ENABLED || ((newMode != FEED_MODE_WORD) && (newMode != FEED_MODE_LSB)) ||
+        (newChannel.getWaveformType() >= WAVEFORM_ARBITRARY) || Trigger.isArmed() || Schedule.pending() ||
+        Sync.pending() || (F_CPU / rateHz < (uint32_t) framesPerWord * FEED_FRAME_CYCLES) || isStreaming())
+    {
+        return 1;
+    }
+
+    mode = newMode;
+    feedFramesPerWord = framesPerWord;
+    feedPeriodCycles = (uint16_t) (F_CPU / rateHz);
+    feedHead = 0;
+    feedTail = 0;
+    feedPacketLength = 0;
+    feedPacketReady = false;
+    feedReplyDue = false;
+    feedUnderrun = false;
+    feedWords = 0;
+    feedUnderruns = 0;
+    feedOverruns = 0;
+    feedMinCycles = 0xFFFF;
+    feedMaxCycles = 0;
+    feedTotalCycles = 0;
+    feedPackets = 0;
+    feedRejected = 0;
+    feedSkipped = 0;
+
+    channel = &newChannel;
+    previousOutput = channel->getOutputStatus();
+
+    // Single writes change only the 14 LSBs, the MSBs stay those of the channel frequency
+    DDS.selectFrequencyRegister(0);
+    DDS.setLsbWrites(mode == FEED_MODE_LSB);
+    channel->setOutputStatus(ON);
+
+    feedState = FEED_STATE_RECEIVING;
+    lastByteMs = millis();
+
+    DEBUGLN(F("Feed started"));
+    return 0;
+}
+
+bool FeedClass::isStreaming()
+{
+    return FEED_ENABLED && (feedState != FEED_STATE_IDLE);
+}
+
+bool FeedClass::canReceive()
+{
+    return (feedState == FEED_STATE_RECEIVING) && !feedPacketReady && !feedReplyDue;
+}
+
+void FeedClass::receiveByte(uint8_t data)
+{
+    if (!FEED_ENABLED)
+    {
+        return;
+    }
+
+    lastByteMs = millis();
+
+    if (feedPacketLength == 0)
+    {
+        if (data == FEED_PACKET_SYNC)
+        {
+            feedPacket[feedPacketLength++] = data;
+            feedPacketSum = data;
+        }
+        else
+        {
+            feedSkipped++;
+        }
+        return;
+    }
+
+    if (feedPacketLength == 1)
+    {
+        if (data > FEED_PACKET_WORDS)
+        {
+            // Not a packet after all, look for the next sync
+            feedPacketLength = 0;
+            feedRejected++;
+            Serial.write(FEED_REPLY_REJECTED);
+            return;
+        }
+        feedPacketSize = 2 + data * feedFramesPerWord * 2;
+    }
+
+    if (feedPacketLength < feedPacketSize)
+    {
+        feedPacket[feedPacketLength++] = data;
+        feedPacketSum += data;
+        return;
+    }
+
+    // The sum, then every word has to fit its register
+    feedPacketLength = 0;
+    bool valid = (data == feedPacketSum);
+
+    for (uint8_t i = 2; valid && (i < feedPacketSize); i += feedFramesPerWord * 2)
+    {
+        valid = (feedFramesPerWord == 2) ? (feedPacket[i + 3] < 0x10) : (feedPacket[i + 1] < 0x40);
+    }
+
+    if (valid)
+    {
+        feedPacketReady = true;
+    }
+    else
+    {
+        feedRejected++;
+        Serial.write(FEED_REPLY_REJECTED);
+    }
+}
+
+FEED_STATUS_T FeedClass::poll()
+{
+    if (!FEED_ENABLED || (feedState == FEED_STATE_IDLE))
+    {
+        return FEED_IDLE;
+    }
+
+    if (feedPacketReady)
+    {
+        uint8_t count = feedPacket[1];
+
+        if (feedFreeWords() >= count)
+        {
+            // Ready made frames, LSB then MSB for e1
+            uint8_t head = feedHead;
+            for (uint8_t i = 0; i < count; i++)
+            {
+                const uint8_t* word = &feedPacket[2 + i * feedFramesPerWord * 2];
+
+                if (feedFramesPerWord == 2)
+                {
+                    uint32_t tuningWord = (uint32_t) word[0] | ((uint32_t) word[1] << 8) | ((uint32_t) word[2] << 16) |
+                                          ((uint32_t) word[3] << 24);
+                    feedFifo[head++ & FEED_FIFO_MASK] = (uint16_t) (tuningWord & 0x3FFF) | FEED_FREQ0;
+                    feedFifo[head++ & FEED_FIFO_MASK] = (uint16_t) ((tuningWord >> 14) & 0x3FFF) | FEED_FREQ0;
+                }
+                else
+                {
+                    feedFifo[head++ & FEED_FIFO_MASK] = ((uint16_t) word[0] | ((uint16_t) word[1] << 8)) | FEED_FREQ0;
+                }
+            }
+            feedHead = head;
+            feedPacketReady = false;
+            feedReplyDue = true;
+            feedPackets++;
+
+            if (count == 0)
+            {
+                feedState = FEED_STATE_ENDING;
+            }
+
+            // The timer starts with half a FIFO in hand, or with all of a shorter stream
+            if (!feedRunning && (feedState == FEED_STATE_RECEIVING) &&
+                ((uint8_t) (feedHead - feedTail) >= FEED_FIFO_FRAMES / 2))
+            {
+                feedStartTimer();
+            }
+            else if (!feedRunning && (feedState == FEED_STATE_ENDING) && (feedHead != feedTail))
+            {
+                feedStartTimer();
+            }
+        }
+    }
+
+    // Held until a full packet fits again, so a host waiting for room always gets an answer
+    uint8_t free = feedFreeWords();
+    if (feedReplyDue && ((free >= FEED_PACKET_WORDS) || (feedState == FEED_STATE_ENDING)))
+    {
+        uint8_t oldSREG = SREG;
+        cli();
+        uint8_t reply = feedUnderrun ? FEED_REPLY_UNDERRUN : 0;
+        feedUnderrun = false;
+        SREG = oldSREG;
+
+        Serial.write(reply | ((free > FEED_REPLY_MAX_FREE) ? FEED_REPLY_MAX_FREE : free));
+        feedReplyDue = false;
+    }
+
+    if ((feedState == FEED_STATE_ENDING) && !feedRunning)
+    {
+        finish();
+        return FEED_DONE;
+    }
+
+    if ((feedState == FEED_STATE_RECEIVING) && (millis() - lastByteMs > FEED_TIMEOUT_MS))
+    {
+        uint8_t oldSREG = SREG;
+        cli();
+        TIMSK1 &= ~_BV(OCIE1B);
+        feedRunning = false;
+        SREG = oldSREG;
+
+        finish();
+        return FEED_TIMEOUT;
+    }
+
+    return FEED_BUSY;
+}
+
+void FeedClass::printStatus()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    uint32_t words = feedWords;
+    uint16_t underruns = feedUnderruns;
+    uint16_t overruns = feedOverruns;
+    uint16_t minCycles = feedMinCycles;
+    uint16_t maxCycles = feedMaxCycles;
+    uint32_t totalCycles = feedTotalCycles;
+    SREG = oldSREG;
+
+    isStreaming() ? Serial.print(F("Feed running, ")) : Serial.print(F("Feed idle, "));
+    Serial.print(rateHz);
+    (mode == FEED_MODE_LSB) ? Serial.println(F(" Hz, LSB words")) : Serial.println(F(" Hz, 28-bit words"));
+
+    // Cycles in the handler of a word, from its first instruction to chip select rising on the last frame
+    Serial.println(F("words,underruns,overruns,packets,rejected,skipped,min,avg,max"));
+    Serial.print(words);
+    Serial.write(',');
+    Serial.print(underruns);
+    Serial.write(',');
+    Serial.print(overruns);
+    Serial.write(',');
+    Serial.print(feedPackets);
+    Serial.write(',');
+    Serial.print(feedRejected);
+    Serial.write(',');
+    Serial.print(feedSkipped);
+    Serial.write(',');
+    Serial.print(words ? minCycles : 0);
+    Serial.write(',');
+    Serial.print(words ? totalCycles / words : 0);
+    Serial.write(',');
+    Serial.println(words ? maxCycles : 0);
+}
+
+/// With the compare stopped: gives the channel its frequency and output state back
+void FeedClass::finish()
+{
+    feedState = FEED_STATE_IDLE;
+    feedPacketReady = false;
+    feedReplyDue = false;
+    feedPacketLength = 0;
+
+    DDS.setLsbWrites(false);
+    DDS.sendFrequency(channel->getFrequencyHz(), 0);
+    channel->setOutputStatus(previousOutput);
+
+    DEBUGLN(F("Feed ended"));
+}
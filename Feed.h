@@ -0,0 +1,123 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Tuning words streamed by the host, written to the DDS at a fixed rate for FM profiles of any length.
+ *
+ *  e1 (28-bit words) or e2 (14-bit LSB words, the MSB stays where it is) hands the serial port to the stream: from
+ *  the end of that line every byte goes to receiveByte() instead of the line editor, like a wavetable upload.  The
+ *  host sends packets, multi-byte fields little endian:
+ *
+ *    0     FEED_PACKET_SYNC
+ *    1     word count, 1 to FEED_PACKET_WORDS, 0 ends the stream
+ *    2-    the words, 4 bytes each for e1 and 2 for e2
+ *    last  8-bit sum of all bytes before it
+ *
+ *  A packet is checked whole before poll() moves it into the FIFO as ready made SPI frames, so a bad packet never
+ *  reaches the DDS.  Every packet is answered with one byte once the FIFO has room for a full packet again: the words
+ *  it has room for (at most FEED_REPLY_MAX_FREE) with FEED_REPLY_UNDERRUN set if it ran dry since the last answer, or
+ *  FEED_REPLY_REJECTED.  A host keeps no more words in flight than the last answer allowed, less the words it sent
+ *  since, and waits for the next answer when that is not a packet.  Until the answer is out, the bytes after the
+ *  packet wait in the RX buffer.  Bytes between packets are skipped.
+ *
+ *  The Timer1 compare B interrupt starts once the FIFO is half full (or the stream ends first) and writes one word
+ *  per period, two frames for e1 and one for e2 with B28 off, no arithmetic and no float.  The compare advances by
+ *  the period from the previous one, so the updates keep their spacing whatever the interrupt latency.  A period
+ *  that finds the FIFO empty is an underrun: the output keeps the last word and the next one comes on the next
+ *  period.  After the end packet the FIFO plays out, the channel gets its frequency and output state back and the
+ *  main loop prints the totals.  A stream that stops sending for FEED_TIMEOUT_MS ends at once.
+ *
+ *  At 57600 baud packets of 10 words carry about 1340 words/s for e1 and 2500 for e2.  Faster rates play the FIFO
+ *  out in bursts.  The compare is shared with hopping and scheduled commands, and the stream writes FREQ0 from its
+ *  interrupt like they do: it does not start with commands queued or staged, the trigger armed or the AWG or pulses.
+ */
+#ifndef Feed_h
+#define Feed_h
+
+#include "Arduino.h"
+#include "OutputChannel.h"
+
+/// Set to 1 (or build with -DFEED_ENABLED=1) for the stream.  Left out by default, the FIFO and the packet buffer do
+/// not fit the Uno's SRAM next to the other engines (see Memory in the README).  start() then fails.
+#ifndef FEED_ENABLED
+#define FEED_ENABLED 0
+#endif
+
+#define FEED_FIFO_FRAMES        64      ///< 32 words of e1, 64 of e2
+#define FEED_PACKET_WORDS       10
+#define FEED_PACKET_SYNC        0xA5
+#define FEED_REPLY_MAX_FREE     0x7E
+#define FEED_REPLY_UNDERRUN     0x80
+#define FEED_REPLY_REJECTED     0xFF
+#define FEED_TIMEOUT_MS         1000
+#define FEED_DEFAULT_RATE_HZ    1000
+#define FEED_MIN_RATE_HZ        500     ///< one compare per period, at most half of Timer1
+#define FEED_FRAME_CYCLES       1024    ///< least period per frame, a frame takes 512 cycles at SPI clk/32
+
+typedef enum
+{
+    FEED_MODE_WORD = 1,             ///< 28-bit tuning words
+    FEED_MODE_LSB                   ///< 14-bit LSB words
+} FEED_MODE_T;
+
+typedef enum
+{
+    FEED_IDLE = 0,
+    FEED_BUSY,
+    FEED_DONE,                      ///< the end packet came and the FIFO played out
+    FEED_TIMEOUT
+} FEED_STATUS_T;
+
+class FeedClass
+{
+  public:
+    FeedClass();
+
+    uint8_t setRateHz(uint32_t newRateHz);
+
+    /// Hands the serial port to the stream.  Fails for the AWG and pulses, while the trigger is armed, with commands
+    /// queued or staged and for a rate too fast for the words of the mode.
+    uint8_t start(FEED_MODE_T newMode, OutputChannelClass& channel);
+    /// @returns true while serialEvent() has to give every byte to receiveByte()
+    bool isStreaming();
+    /// @returns false while a packet waits for room, the next byte has to stay in the RX buffer
+    bool canReceive();
+    void receiveByte(uint8_t data);
+
+    /// Moves packets into the FIFO and ends the stream, called from every pass of the main loop.  Returns
+    /// FEED_DONE or FEED_TIMEOUT once when the stream has ended.
+    FEED_STATUS_T poll();
+    void printStatus();
+
+  private:
+    void finish();
+
+    uint32_t rateHz;
+    FEED_MODE_T mode;
+    OutputChannelClass* channel;
+    OUTPUT_STATUS_T previousOutput;
+    unsigned long lastByteMs;
+};
+
+extern FeedClass Feed;
+
+/// The compare B interrupt while no hop is running.  @returns false if no stream is running, the compare is the
+/// scheduled commands'.
+bool feedCompareMatch(uint16_t entry);
+
+#endif
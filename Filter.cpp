@@ -18,9 +18,10 @@
 */
 #include "Filter.h"
 #include "Arduino.h"
+#include "Trace.h"
 #include "Debug.h"
 
-#define DEBUG_OUTPUT 1
+#define DEBUG_OUTPUT 0
 
 const uint8_t muxSelectLine = 2;
 
@@ -40,9 +41,18 @@ FilterClass::~FilterClass()
 void FilterClass::on()
 {
   digitalWrite(muxSelectLine, LOW);
+  enabled = true;
+  TRACE(TRACE_CATEGORY_FILTER, TRACE_EVENT_FILTER, 1);
+}
+
+bool FilterClass::isOn()
+{
+  return enabled;
 }
 
 void FilterClass::off()
 {
   digitalWrite(muxSelectLine, HIGH);
+  enabled = false;
+  TRACE(TRACE_CATEGORY_FILTER, TRACE_EVENT_FILTER, 0);
 }
@@ -27,7 +27,9 @@ class FilterClass
     ~FilterClass();
     void on();
     void off();
+    bool isOn();
   private:
+    bool enabled;
 };
 
 extern FilterClass Filter;
@@ -0,0 +1,285 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <avr/interrupt.h>
+#include "FrequencyCounter.h"
+#include "Clock.h"
+#include "Debug.h"
+#define DEBUG_OUTPUT 0
+
+typedef enum
+{
+    CAPTURE_IDLE = 0,
+    CAPTURE_RUNNING,
+    CAPTURE_DONE,
+    CAPTURE_OVER_RANGE
+} CAPTURE_STATE_T;
+
+FrequencyCounterClass FrequencyCounter;
+
+// Shared with the capture interrupt
+static volatile uint8_t captureState = CAPTURE_IDLE;
+static volatile uint32_t captureEdges;
+static volatile uint32_t captureFirst;
+static volatile uint32_t captureLast;
+static volatile uint32_t captureGateCycles;
+
+/** Runs on every rising edge.  Timestamps come from ICR1, latched by the hardware at the edge, so the latency of
+ *  this handler does not matter as long as it has finished before the next edge.
+ */
+ISR(TIMER1_CAPT_vect)
+{
+    uint32_t timestamp = Clock.extend(ICR1);
+
+    if (captureEdges == 0)
+    {
+        captureFirst = timestamp;
+    }
+    captureLast = timestamp;
+    captureEdges++;
+
+    if (TIFR1 & _BV(ICF1))
+    {
+        // The next edge is already waiting, one more and ICR1 is overwritten before it is read
+        TIMSK1 &= ~_BV(ICIE1);
+        captureState = CAPTURE_OVER_RANGE;
+    }
+    else if (timestamp - captureFirst >= captureGateCycles)
+    {
+        TIMSK1 &= ~_BV(ICIE1);
+        captureState = CAPTURE_DONE;
+    }
+}
+
+FrequencyCounterClass::FrequencyCounterClass()
+{
+    source = FREQUENCY_COUNTER_SOURCE_PIN;
+    gateMs = FREQUENCY_COUNTER_DEFAULT_GATE_MS;
+    prescaler = 1;
+    selfCheckMs = 0;
+    busy = false;
+    verifying = false;
+    expectedHz = 0;
+    startMs = 0;
+    timeoutMs = 0;
+    frequencyHz = 0.0;
+}
+
+/// @brief Call after Clock.init(), the counter shares its free running Timer1
+void FrequencyCounterClass::init()
+{
+    pinMode(FREQUENCY_COUNTER_INPUT_PIN, INPUT);
+    stop();
+}
+
+uint8_t FrequencyCounterClass::setSource(FREQUENCY_COUNTER_SOURCE_T newSource)
+{
+    if (newSource > FREQUENCY_COUNTER_SOURCE_COMPARATOR)
+    {
+        return 1;
+    }
+
+    stop();
+    source = newSource;
+    return 0;
+}
+
+FREQUENCY_COUNTER_SOURCE_T FrequencyCounterClass::getSource()
+{
+    return source;
+}
+
+uint8_t FrequencyCounterClass::setGateMs(uint16_t newGateMs)
+{
+    if ((newGateMs == 0) || (newGateMs > FREQUENCY_COUNTER_MAX_GATE_MS))
+    {
+        return 1;
+    }
+
+    gateMs = newGateMs;
+    return 0;
+}
+
+uint16_t FrequencyCounterClass::getGateMs()
+{
+    return gateMs;
+}
+
+uint8_t FrequencyCounterClass::setPrescaler(uint16_t newPrescaler)
+{
+    if (newPrescaler == 0)
+    {
+        return 1;
+    }
+
+    prescaler = newPrescaler;
+    return 0;
+}
+
+uint16_t FrequencyCounterClass::getPrescaler()
+{
+    return prescaler;
+}
+
+void FrequencyCounterClass::start()
+{
+    verifying = false;
+    begin(gateMs);
+}
+
+void FrequencyCounterClass::begin(uint16_t measureGateMs)
+{
+    stop();
+
+    if (source == FREQUENCY_COUNTER_SOURCE_COMPARATOR)
+    {
+        // Comparator on, its output routed to the capture unit, digital inputs of AIN0/AIN1 off
+        DIDR1 = _BV(AIN1D) | _BV(AIN0D);
+        ACSR = _BV(ACIC);
+    }
+    else
+    {
+        ACSR = _BV(ACD);
+        DIDR1 = 0;
+    }
+
+    captureEdges = 0;
+    captureGateCycles = (uint32_t) measureGateMs * (F_CPU / 1000UL);
+    captureState = CAPTURE_RUNNING;
+
+    uint8_t oldSREG = SREG;
+    cli();
+
+    // Noise canceler and rising edge, Clock leaves the rest of TCCR1B alone.  Switching the source or edge can
+    // raise ICF1, so it is cleared afterwards.
+    TCCR1B |= _BV(ICNC1) | _BV(ICES1);
+    TIFR1 = _BV(ICF1);
+    TIMSK1 |= _BV(ICIE1);
+
+    SREG = oldSREG;
+
+    frequencyHz = 0.0;
+    startMs = millis();
+    timeoutMs = measureGateMs + FREQUENCY_COUNTER_EDGE_TIMEOUT_MS;
+    busy = true;
+}
+
+void FrequencyCounterClass::stop()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    TIMSK1 &= ~_BV(ICIE1);
+    captureState = CAPTURE_IDLE;
+    SREG = oldSREG;
+
+    busy = false;
+}
+
+/// @brief Returns FREQUENCY_COUNTER_BUSY until the measurement finishes, then its result once, then IDLE
+FREQUENCY_COUNTER_STATUS_T FrequencyCounterClass::poll()
+{
+    if (!busy)
+    {
+        return FREQUENCY_COUNTER_IDLE;
+    }
+
+    uint8_t oldSREG = SREG;
+    cli();
+    uint8_t state = captureState;
+    uint32_t periods = captureEdges - 1;
+    uint32_t elapsed = captureLast - captureFirst;
+    SREG = oldSREG;
+
+    if (state == CAPTURE_DONE)
+    {
+        stop();
+        frequencyHz = (float) periods * prescaler * (float) F_CPU / (float) elapsed;
+        DEBUG(F("Counter "));
+        DEBUG(periods);
+        DEBUG(F(" periods in "));
+        DEBUGLN(elapsed);
+        return FREQUENCY_COUNTER_DONE;
+    }
+    else if (state == CAPTURE_OVER_RANGE)
+    {
+        stop();
+        return FREQUENCY_COUNTER_OVER_RANGE;
+    }
+    else if (millis() - startMs > timeoutMs)
+    {
+        stop();
+        return FREQUENCY_COUNTER_NO_SIGNAL;
+    }
+
+    return FREQUENCY_COUNTER_BUSY;
+}
+
+float FrequencyCounterClass::getFrequencyHz()
+{
+    return frequencyHz;
+}
+
+uint8_t FrequencyCounterClass::setSelfCheckMs(uint16_t windowMs)
+{
+    if ((windowMs != 0) && (windowMs < 2))
+    {
+        return 1;
+    }
+
+    selfCheckMs = windowMs;
+    return 0;
+}
+
+uint16_t FrequencyCounterClass::getSelfCheckMs()
+{
+    return selfCheckMs;
+}
+
+void FrequencyCounterClass::verify(uint32_t newExpectedHz)
+{
+    // Settings the counter cannot measure are not checked
+    if ((selfCheckMs == 0) || (newExpectedHz == 0) || (newExpectedHz / prescaler > FREQUENCY_COUNTER_MAX_INPUT_HZ))
+    {
+        return;
+    }
+
+    uint16_t checkGateMs = (gateMs < selfCheckMs / 2) ? gateMs : selfCheckMs / 2;
+
+    begin(checkGateMs);
+    verifying = true;
+    expectedHz = newExpectedHz;
+    // The check window replaces the edge timeout, a result that is late has failed
+    timeoutMs = selfCheckMs;
+}
+
+bool FrequencyCounterClass::isVerifying()
+{
+    return verifying;
+}
+
+uint32_t FrequencyCounterClass::getExpectedHz()
+{
+    return expectedHz;
+}
+
+bool FrequencyCounterClass::verifyPassed(FREQUENCY_COUNTER_STATUS_T status)
+{
+    float toleranceHz = (float) expectedHz * (FREQUENCY_COUNTER_CHECK_TOLERANCE_PPM / 1000000.0);
+
+    return (status == FREQUENCY_COUNTER_DONE) && (fabs(frequencyHz - (float) expectedHz) <= toleranceHz);
+}
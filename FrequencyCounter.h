@@ -0,0 +1,111 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Reciprocal frequency counter on the Timer1 input capture unit.
+ *
+ *  Timer1 is already the free running cycle counter of Clock, so every rising edge on ICP1 (pin 8) or on the analog
+ *  comparator output (AIN0 pin 6 against AIN1 pin 7) is timestamped to the CPU cycle and extended to 32 bits with the
+ *  Clock overflow count.  The gate opens on the first edge and closes on the first edge after the gate time, the
+ *  result is whole periods / elapsed cycles, so the resolution is one cycle over the gate (0.6 ppm at 100 ms) at any
+ *  input frequency and periods up to the 268 s Clock wrap can be measured.
+ *
+ *  Every edge costs one interrupt, the input is limited to FREQUENCY_COUNTER_MAX_INPUT_HZ.  Faster signals need an
+ *  external divider (e.g. a 74HC4040), set its ratio with setPrescaler() and results are scaled back up.  An edge that
+ *  arrives while the previous one is still being handled ends the measurement as over range.
+ *
+ *  The self-check measures the output after every OutputChannelClass::setFrequencyHz() and compares the result
+ *  against the frequency expected at the output, half the set one for the DIV2 square.  The gate is shortened to
+ *  half the check window so a present signal always finishes in time.
+ */
+#ifndef FrequencyCounter_h
+#define FrequencyCounter_h
+
+#include "Arduino.h"
+
+#define FREQUENCY_COUNTER_INPUT_PIN             8
+#define FREQUENCY_COUNTER_DEFAULT_GATE_MS       100
+#define FREQUENCY_COUNTER_MAX_GATE_MS           10000
+#define FREQUENCY_COUNTER_EDGE_TIMEOUT_MS       2000    ///< extra wait for the closing edge, sets the lowest frequency
+#define FREQUENCY_COUNTER_MAX_INPUT_HZ          100000
+#define FREQUENCY_COUNTER_CHECK_TOLERANCE_PPM   10000   ///< the Uno runs from a +-0.5% ceramic resonator
+
+typedef enum
+{
+    FREQUENCY_COUNTER_SOURCE_PIN = 0,           ///< ICP1, pin 8
+    FREQUENCY_COUNTER_SOURCE_COMPARATOR         ///< AIN0 (pin 6) above AIN1 (pin 7)
+} FREQUENCY_COUNTER_SOURCE_T;
+
+typedef enum
+{
+    FREQUENCY_COUNTER_IDLE = 0,
+    FREQUENCY_COUNTER_BUSY,
+    FREQUENCY_COUNTER_DONE,
+    FREQUENCY_COUNTER_NO_SIGNAL,                ///< fewer than two edges before the timeout
+    FREQUENCY_COUNTER_OVER_RANGE                ///< edges came faster than the interrupt could take them
+} FREQUENCY_COUNTER_STATUS_T;
+
+class FrequencyCounterClass
+{
+  public:
+    FrequencyCounterClass();
+    void init();
+
+    uint8_t setSource(FREQUENCY_COUNTER_SOURCE_T newSource);
+    FREQUENCY_COUNTER_SOURCE_T getSource();
+    uint8_t setGateMs(uint16_t newGateMs);
+    uint16_t getGateMs();
+    /// Ratio of an external divider in front of the input, 1 when the signal is connected directly
+    uint8_t setPrescaler(uint16_t newPrescaler);
+    uint16_t getPrescaler();
+
+    /// Starts a measurement over the gate time, poll() reports when it has finished
+    void start();
+    void stop();
+    FREQUENCY_COUNTER_STATUS_T poll();
+    /// Result of the last measurement that finished with FREQUENCY_COUNTER_DONE
+    float getFrequencyHz();
+
+    /// 0 turns the self-check off, otherwise every frequency change must be confirmed within windowMs
+    uint8_t setSelfCheckMs(uint16_t windowMs);
+    uint16_t getSelfCheckMs();
+    /// Measures the output if the self-check is on, called by the output channel after every frequency change
+    void verify(uint32_t expectedHz);
+    bool isVerifying();
+    uint32_t getExpectedHz();
+    /// True when the last finished measurement was within FREQUENCY_COUNTER_CHECK_TOLERANCE_PPM of the expected value
+    bool verifyPassed(FREQUENCY_COUNTER_STATUS_T status);
+
+  private:
+    void begin(uint16_t measureGateMs);
+
+    FREQUENCY_COUNTER_SOURCE_T source;
+    uint16_t gateMs;
+    uint16_t prescaler;
+    uint16_t selfCheckMs;
+    bool busy;
+    bool verifying;
+    uint32_t expectedHz;
+    unsigned long startMs;
+    unsigned long timeoutMs;
+    float frequencyHz;
+};
+
+extern FrequencyCounterClass FrequencyCounter;
+
+#endif
@@ -0,0 +1,354 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <avr/interrupt.h>
+#include "Hop.h"
+#include "DDS.h"
+#include "AWG.h"
+#include "Trigger.h"
+#include "Schedule.h"
+#include "Feed.h"
+#include "Clock.h"
+#include "Sync.h"
+#include "Debug.h"
+#define DEBUG_OUTPUT 0
+
+// Frequency register address bits, FREQ0 is 0b01, FREQ1 is 0b10
+#define HOP_FREQ0               0x4000
+#define HOP_FREQ1               0x8000
+
+HopClass Hop;
+
+// Filled by start(), the halves of each tuning word without the register address
+static uint16_t hopLsb[HOP_MAX_CHANNELS];
+static uint16_t hopMsb[HOP_MAX_CHANNELS];
+static uint8_t hopSequence[HOP_MAX_SEQUENCE];
+static uint8_t hopSequenceLength;
+
+// Shared with the compare interrupt
+static uint32_t hopDwellCycles;
+static volatile uint32_t hopRemaining;      // dwell left after the compare that is set up
+static uint8_t hopChannels;
+static uint8_t hopMask;                     // next power of two above the channel count, less one
+static uint16_t hopLfsr;
+static uint8_t hopSequenceIndex;
+static uint8_t hopLoaded;                   // the channel in the register the next hop selects
+static bool hopRunning;                     // owns compare B, scheduled commands have it otherwise
+
+// Instrumentation, written by the handler only
+static volatile uint32_t hopCount;
+static volatile uint16_t hopOverruns;
+static volatile uint16_t hopMinCycles;
+static volatile uint16_t hopMaxCycles;
+static volatile uint32_t hopTotalCycles;
+
+/// The channel after hopLoaded
+static uint8_t hopNextChannel()
+{
+    if (hopSequenceLength)
+    {
+        if (++hopSequenceIndex >= hopSequenceLength)
+        {
+            hopSequenceIndex = 0;
+        }
+        return hopSequence[hopSequenceIndex];
+    }
+
+    uint8_t next;
+
+    do
+    {
+        // Galois LFSR x^16 + x^14 + x^13 + x^11 + 1, every nonzero state once per 65535 steps
+        hopLfsr = (hopLfsr >> 1) ^ (-(hopLfsr & 1) & 0xB400);
+        next = hopLfsr & hopMask;
+    } while ((next >= hopChannels) || (next == hopLoaded));
+
+    return next;
+}
+
+/// Sets up the compare for the next piece of the dwell
+static inline void hopScheduleStep()
+{
+    uint32_t remaining = hopRemaining;
+    uint16_t step = clockCompareStep(remaining);
+
+    OCR1B += step;
+    hopRemaining -= step;
+}
+
+ISR(TIMER1_COMPB_vect)
+{
+    uint16_t entry = TCNT1;
+
+    if (!HOP_ENABLED || !hopRunning)
+    {
+        // A stream and scheduled commands do not run together either
+        if (!feedCompareMatch(entry))
+        {
+            scheduleCompareMatch(entry);
+        }
+        return;
+    }
+
+    if (hopRemaining)
+    {
+        // Part way through a long dwell
+        hopScheduleStep();
+        return;
+    }
+
+    // Select the register loaded during the dwell, then load the one just left
+    uint16_t control = DDS.getControlRegister() ^ DDS_CONTROL_FSEL;
+    uint16_t address = (control & DDS_CONTROL_FSEL) ? HOP_FREQ0 : HOP_FREQ1;
+
+    DDS.writeControlFromInterrupt(control);
+    hopLoaded = hopNextChannel();
+    DDS.writeFromInterrupt(hopLsb[hopLoaded] | address);
+    DDS.writeFromInterrupt(hopMsb[hopLoaded] | address);
+
+    hopRemaining = hopDwellCycles;
+    hopScheduleStep();
+
+    uint16_t cycles = TCNT1 - entry;
+
+    // The handler ran past its own next compare, Timer1 has to wrap before the next hop
+    if ((int16_t) (OCR1B - TCNT1) <= 0)
+    {
+        hopOverruns++;
+    }
+
+    hopCount++;
+    hopTotalCycles += cycles;
+    if (cycles < hopMinCycles) hopMinCycles = cycles;
+    if (cycles > hopMaxCycles) hopMaxCycles = cycles;
+}
+
+HopClass::HopClass()
+{
+    baseHz = 1000000;
+    spacingHz = 100000;
+    channels = 16;
+    dwellUs = 1000;
+    seed = HOP_DEFAULT_SEED;
+    channel = NULL;
+    previousOutput = OFF;
+}
+
+uint8_t HopClass::setBaseHz(uint32_t newBaseHz)
+{
+    if ((newBaseHz > 8000000) || isRunning())
+    {
+        return 1;
+    }
+
+    baseHz = newBaseHz;
+    return 0;
+}
+
+uint8_t HopClass::setSpacingHz(uint32_t newSpacingHz)
+{
+    if ((newSpacingHz == 0) || (newSpacingHz > 8000000) || isRunning())
+    {
+        return 1;
+    }
+
+    spacingHz = newSpacingHz;
+    return 0;
+}
+
+uint8_t HopClass::setChannels(uint8_t newChannels)
+{
+    if ((newChannels < 2) || (newChannels > HOP_MAX_CHANNELS) || isRunning())
+    {
+        return 1;
+    }
+
+    channels = newChannels;
+    return 0;
+}
+
+uint8_t HopClass::setDwellUs(uint32_t newDwellUs)
+{
+    if ((newDwellUs < HOP_MIN_DWELL_US) || (newDwellUs > HOP_MAX_DWELL_US) || isRunning())
+    {
+        return 1;
+    }
+
+    dwellUs = newDwellUs;
+    return 0;
+}
+
+uint8_t HopClass::setSeed(uint16_t newSeed)
+{
+    if ((newSeed == 0) || isRunning())
+    {
+        return 1;
+    }
+
+    seed = newSeed;
+    return 0;
+}
+
+uint8_t HopClass::addSequenceChannel(uint8_t sequenceChannel)
+{
+    if (!HOP_ENABLED || (sequenceChannel >= HOP_MAX_CHANNELS) || (hopSequenceLength >= HOP_MAX_SEQUENCE) ||
+        isRunning())
+    {
+        return 1;
+    }
+
+    hopSequence[hopSequenceLength++] = sequenceChannel;
+    return 0;
+}
+
+void HopClass::clearSequence()
+{
+    if (!isRunning())
+    {
+        hopSequenceLength = 0;
+    }
+}
+
+uint8_t HopClass::start(OutputChannelClass& newChannel)
+{
+    // The AWG and the pulses hold the DDS in reset, the trigger owns FSEL, queued commands need compare B and staged
+    // ones would undo the hops.  A sequence entry past the plan has no table entry.
+    if (!HOP_ENABLED || (newChannel.getWaveformType() >= WAVEFORM_ARBITRARY) || Trigger.isArmed() ||
+        Schedule.pending() || Sync.pending() || (baseHz + (uint32_t) (channels - 1) * spacingHz > 8000000))
+    {
+        return 1;
+    }
+
+    for (uint8_t i = 0; i < hopSequenceLength; i++)
+    {
+        if (hopSequence[i] >= channels)
+        {
+            return 1;
+        }
+    }
+
+    stop();
+
+    for (uint8_t i = 0; i < channels; i++)
+    {
+        uint32_t word = DDSClass::tuningWord(baseHz + (uint32_t) i * spacingHz);
+        hopLsb[i] = (uint16_t) (word & 0x3FFF);
+        hopMsb[i] = (uint16_t) ((word >> 14) & 0x3FFF);
+    }
+
+    hopChannels = channels;
+    for (hopMask = 1; hopMask < channels - 1; hopMask = (hopMask << 1) | 1)
+    {
+    }
+    hopLfsr = seed;
+    hopSequenceIndex = hopSequenceLength ? hopSequenceLength - 1 : 0;
+    hopDwellCycles = dwellUs * (F_CPU / 1000000UL);
+    hopCount = 0;
+    hopOverruns = 0;
+    hopMinCycles = 0xFFFF;
+    hopMaxCycles = 0;
+    hopTotalCycles = 0;
+
+    // First channel on FREQ0, the second waits on FREQ1 for the first hop
+    hopLoaded = 0xFF;
+    uint8_t first = hopNextChannel();
+    hopLoaded = first;
+    uint8_t second = hopNextChannel();
+
+    channel = &newChannel;
+    previousOutput = channel->getOutputStatus();
+
+    DDS.selectFrequencyRegister(0);
+    DDS.sendFrequency(baseHz + (uint32_t) first * spacingHz, 0);
+    DDS.sendFrequency(baseHz + (uint32_t) second * spacingHz, 1);
+    hopLoaded = second;
+    channel->setOutputStatus(ON);
+
+    // TIMSK1 is also changed by the frequency counter interrupt
+    uint8_t oldSREG = SREG;
+    cli();
+    hopRunning = true;
+    hopRemaining = hopDwellCycles;
+    OCR1B = TCNT1;
+    hopScheduleStep();
+    TIFR1 = _BV(OCF1B);
+    TIMSK1 |= _BV(OCIE1B);
+    SREG = oldSREG;
+
+    DEBUGLN(F("Hop started"));
+    return 0;
+}
+
+void HopClass::stop()
+{
+    if (!isRunning())
+    {
+        return;
+    }
+
+    uint8_t oldSREG = SREG;
+    cli();
+    TIMSK1 &= ~_BV(OCIE1B);
+    hopRunning = false;
+    SREG = oldSREG;
+
+    DDS.sendFrequency(channel->getFrequencyHz(), 0);
+    DDS.selectFrequencyRegister(0);
+    channel->setOutputStatus(previousOutput);
+}
+
+bool HopClass::isRunning()
+{
+    return hopRunning;
+}
+
+void HopClass::printStatus()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    uint32_t hops = hopCount;
+    uint16_t overruns = hopOverruns;
+    uint16_t minCycles = hopMinCycles;
+    uint16_t maxCycles = hopMaxCycles;
+    uint32_t totalCycles = hopTotalCycles;
+    SREG = oldSREG;
+
+    isRunning() ? Serial.print(F("Hop running, ")) : Serial.print(F("Hop idle, "));
+    Serial.print(channels);
+    Serial.print(F(" channels from "));
+    Serial.print(baseHz);
+    Serial.print(F(" Hz every "));
+    Serial.print(spacingHz);
+    Serial.print(F(" Hz, dwell "));
+    Serial.print(dwellUs);
+    Serial.print(F(" us, "));
+    hopSequenceLength ? Serial.print(F("sequence ")) : Serial.print(F("LFSR seed "));
+    Serial.println(hopSequenceLength ? hopSequenceLength : seed);
+
+    // Cycles in the handler of a hop, from its first instruction to the compare set up for the next one
+    Serial.println(F("hops,overruns,min,avg,max"));
+    Serial.print(hops);
+    Serial.write(',');
+    Serial.print(overruns);
+    Serial.write(',');
+    Serial.print(hops ? minCycles : 0);
+    Serial.write(',');
+    Serial.print(hops ? totalCycles / hops : 0);
+    Serial.write(',');
+    Serial.println(hops ? maxCycles : 0);
+}
@@ -0,0 +1,92 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Frequency hopping over a channel plan of evenly spaced channels, timed by the Timer1 compare B interrupt.
+ *
+ *  start() turns every channel into the two 14-bit halves of its tuning word once.  Each hop then flips FSEL to the
+ *  register loaded during the last dwell and writes the channel after that into the register just left, three SPI
+ *  frames from the interrupt and no arithmetic.  FSEL keeps the phase accumulator running, so the output is phase
+ *  continuous across hops.  The next channel comes from the user sequence if it has entries, otherwise from a 16-bit
+ *  LFSR that never picks the same channel twice in a row.  A given seed and plan always give the same sequence.
+ *
+ *  The compare point advances by the dwell from the previous one rather than from the interrupt, so hops keep exact
+ *  spacing whatever the interrupt latency.  Dwells longer than Timer1 wraps are split into several compares.  Compare
+ *  B only raises the interrupt: its pin (OC1B, pin 10) is the DDS chip select and stays a port pin.  The compare is
+ *  shared with scheduled commands (Schedule.h) and the tuning word stream (Feed.h), hopping only starts with none
+ *  queued.
+ *
+ *  Hopping owns the DDS, so any command other than the status query stops it and gives the channel its frequency
+ *  and output state back.
+ */
+#ifndef Hop_h
+#define Hop_h
+
+#include "Arduino.h"
+#include "OutputChannel.h"
+
+/// Set to 1 (or build with -DHOP_ENABLED=1) for hopping.  Left out by default, the channel tables do not fit the
+/// Uno's SRAM next to the other engines (see Memory in the README).  start() then fails, the plan setters still work.
+#ifndef HOP_ENABLED
+#define HOP_ENABLED 0
+#endif
+
+#define HOP_MAX_CHANNELS        32
+#define HOP_MAX_SEQUENCE        16
+#define HOP_MIN_DWELL_US        150     ///< a hop takes 1536 cycles (96 us), three frames at SPI clk/32
+#define HOP_MAX_DWELL_US        10000000
+#define HOP_DEFAULT_SEED        0xACE1
+
+class HopClass
+{
+  public:
+    HopClass();
+
+    uint8_t setBaseHz(uint32_t newBaseHz);
+    uint8_t setSpacingHz(uint32_t newSpacingHz);
+    uint8_t setChannels(uint8_t newChannels);
+    uint8_t setDwellUs(uint32_t newDwellUs);
+    /// Seeds the LFSR, 0 would lock it up
+    uint8_t setSeed(uint16_t newSeed);
+    /// Appends a channel to the user sequence, which then replaces the LFSR
+    uint8_t addSequenceChannel(uint8_t channel);
+    void clearSequence();
+
+    /// Fills the table, loads both frequency registers and starts the timer.  Fails for the AWG, while the trigger
+    /// is armed and for a plan above the DDS range.
+    uint8_t start(OutputChannelClass& channel);
+    /// Ends hopping and gives the channel its frequency and output state back
+    void stop();
+    bool isRunning();
+
+    void printStatus();
+
+  private:
+    uint32_t baseHz;
+    uint32_t spacingHz;
+    uint8_t channels;
+    uint32_t dwellUs;
+    uint16_t seed;
+
+    OutputChannelClass* channel;
+    OUTPUT_STATUS_T previousOutput;
+};
+
+extern HopClass Hop;
+
+#endif
@@ -0,0 +1,205 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include "Memory.h"
+#include "Debug.h"
+#define DEBUG_OUTPUT 0
+
+// From avr-libc: the heap starts at the end of .bss, the break is 0 until the first malloc()
+extern char* __malloc_heap_start;
+extern char* __brkval;
+
+MemoryClass Memory;
+
+// Commands with a depth of their own, a sub-menu entry counts for the letter that opened it.  Others are not noted.
+static const char memoryCommands[] PROGMEM = "?%k@#vfapwoOsStUmgPrbhucdDyje";
+#define MEMORY_COMMAND_COUNT    (sizeof(memoryCommands) - 1)
+
+// Deepest stack in bytes per command, 0 for one that has not run with tracking on
+static uint16_t memoryCommandStack[MEMORY_COMMAND_COUNT];
+
+static inline uint16_t memoryHeapEnd()
+{
+    return (uint16_t) (uintptr_t) (__brkval ? __brkval : __malloc_heap_start);
+}
+
+/// Paints from address up to the stack pointer.  A chunk at a time with interrupts disabled, nothing below the stack
+/// pointer is in use then.
+static void memoryPaint(uint16_t address)
+{
+    while (true)
+    {
+        uint8_t oldSREG = SREG;
+        cli();
+        uint16_t top = SP;
+
+        if (address >= top)
+        {
+            SREG = oldSREG;
+            return;
+        }
+
+        uint16_t end = (top - address > MEMORY_PAINT_CHUNK) ? address + MEMORY_PAINT_CHUNK : top;
+        while (address < end)
+        {
+            _SFR_MEM8(address) = MEMORY_PAINT;
+            address++;
+        }
+        SREG = oldSREG;
+    }
+}
+
+MemoryClass::MemoryClass()
+{
+    deepestAddress = RAMEND + 1;
+    tracking = false;
+}
+
+void MemoryClass::init()
+{
+    memoryPaint(memoryHeapEnd());
+}
+
+uint16_t MemoryClass::getStaticBytes()
+{
+    return (uint16_t) (uintptr_t) __malloc_heap_start - RAMSTART;
+}
+
+uint16_t MemoryClass::getHeapBytes()
+{
+    return memoryHeapEnd() - (uint16_t) (uintptr_t) __malloc_heap_start;
+}
+
+uint16_t MemoryClass::getStackBytes()
+{
+    return RAMEND - SP;
+}
+
+uint16_t MemoryClass::getFreeBytes()
+{
+    return SP - memoryHeapEnd();
+}
+
+uint16_t MemoryClass::getStackMaxBytes()
+{
+    deepest();
+    return RAMEND + 1 - deepestAddress;
+}
+
+uint16_t MemoryClass::getFreeMinBytes()
+{
+    deepest();
+    return deepestAddress - memoryHeapEnd();
+}
+
+void MemoryClass::setTracking(bool on)
+{
+    // Starts from clean paint, not from whatever ran before
+    if (on && !tracking)
+    {
+        memoryPaint(deepest());
+    }
+    tracking = on;
+}
+
+bool MemoryClass::getTracking()
+{
+    return tracking;
+}
+
+void MemoryClass::endCommand(char command)
+{
+    if (!tracking)
+    {
+        return;
+    }
+
+    uint16_t address = deepest();
+    const char* entry = command ? strchr_P(memoryCommands, command) : NULL;
+
+    if (entry)
+    {
+        uint16_t stack = RAMEND + 1 - address;
+        uint8_t index = entry - memoryCommands;
+
+        if (stack > memoryCommandStack[index])
+        {
+            memoryCommandStack[index] = stack;
+        }
+    }
+
+    memoryPaint(address);
+}
+
+void MemoryClass::reset()
+{
+    memoryPaint(deepest());
+    deepestAddress = RAMEND + 1;
+    memset(memoryCommandStack, 0, sizeof(memoryCommandStack));
+}
+
+void MemoryClass::printStatus()
+{
+    uint16_t stackMax = getStackMaxBytes();
+
+    tracking ? Serial.println(F("Memory, tracking on")) : Serial.println(F("Memory, tracking off"));
+
+    // Bytes
+    Serial.println(F("static,heap,stack,stack_max,free,free_min"));
+    Serial.print(getStaticBytes());
+    Serial.write(',');
+    Serial.print(getHeapBytes());
+    Serial.write(',');
+    Serial.print(getStackBytes());
+    Serial.write(',');
+    Serial.print(stackMax);
+    Serial.write(',');
+    Serial.print(getFreeBytes());
+    Serial.write(',');
+    Serial.println(getFreeMinBytes());
+
+    Serial.println(F("command,stack_max"));
+    for (uint8_t i = 0; i < MEMORY_COMMAND_COUNT; i++)
+    {
+        if (memoryCommandStack[i])
+        {
+            Serial.write(pgm_read_byte(&memoryCommands[i]));
+            Serial.write(',');
+            Serial.println(memoryCommandStack[i]);
+        }
+    }
+}
+
+/// Walks the free SRAM up from the heap to the first byte that is not paint
+uint16_t MemoryClass::deepest()
+{
+    uint16_t address = memoryHeapEnd();
+
+    while ((address <= RAMEND) && (_SFR_MEM8(address) == MEMORY_PAINT))
+    {
+        address++;
+    }
+
+    if (address < deepestAddress)
+    {
+        deepestAddress = address;
+    }
+    return address;
+}
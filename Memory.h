@@ -0,0 +1,73 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** SRAM use: the statics, the heap and how deep the stack has been.
+ *
+ *  init() paints the free SRAM between the heap and the stack with MEMORY_PAINT.  Whatever the stack (or a handler
+ *  running on top of it) writes is no longer paint, so the first unpainted byte above the heap is the deepest the
+ *  stack has been since, and the bytes from there to the heap are the least free SRAM there has been.  Reading
+ *  that walks the free SRAM, about 5 cycles a byte, so it only happens when asked for (j).
+ *
+ *  With per-command tracking on (j1) the main loop does that walk after every command, notes the depth against the
+ *  command letter and paints the SRAM down there again, so the next command starts clean.  Handlers that ran during
+ *  the command count for it.  That costs some hundred us per command, off by default.  Painting is done in chunks
+ *  with interrupts disabled, the bytes below the stack pointer belong to whatever handler comes next.
+ */
+#ifndef Memory_h
+#define Memory_h
+
+#include "Arduino.h"
+
+#define MEMORY_PAINT        0xC5
+#define MEMORY_PAINT_CHUNK  32      ///< bytes painted per interrupts off, about 160 cycles
+
+class MemoryClass
+{
+  public:
+    MemoryClass();
+    /// First thing in setup(), before anything has been deep
+    void init();
+
+    /// Bytes of .data and .bss
+    uint16_t getStaticBytes();
+    uint16_t getHeapBytes();
+    uint16_t getStackBytes();
+    uint16_t getFreeBytes();
+    /// The deepest the stack has been since init() or reset(), handlers included
+    uint16_t getStackMaxBytes();
+    uint16_t getFreeMinBytes();
+
+    void setTracking(bool on);
+    bool getTracking();
+    /// Called by the main loop after every command, with its letter
+    void endCommand(char command);
+    /// Forgets the depths and paints the free SRAM again
+    void reset();
+    void printStatus();
+
+  private:
+    uint16_t deepest();
+
+    uint16_t deepestAddress;    //!< lowest address the stack has written, as of the last walk
+    bool tracking;
+};
+
+extern MemoryClass Memory;
+
+#endif
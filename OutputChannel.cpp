@@ -20,15 +20,21 @@
 #include "OutputChannel.h"
 #include "DDS.h" // used by OutputChannel.cpp
 #include "Amplifier.h" // used by OutputChannel.cpp
+#include "AWG.h"
+#include "Pulse.h"
+#include "FrequencyCounter.h"
 
+#include "Trace.h"
 #include "Debug.h"
-#define DEBUG_OUTPUT 1
+#define DEBUG_OUTPUT 0
 
 const char waveformOffString[] = "OFF";
 const char waveformSineString[] = "SIN";
 const char waveformTriangleString[] = "TRI";
 const char waveformSquareString[] = "SQ";
 const char waveformSquare2String[] = "SQ2";
+const char waveformArbitraryString[] = "ARB";
+const char waveformPulseString[] = "PUL";
 
 OutputChannelClass::OutputChannelClass(unsigned char cNumber)
 {
@@ -47,6 +53,8 @@ void OutputChannelClass::init(void)
 {
     DDS.init();
     Amplifier.init();
+    AWG.init();
+    Pulse.init();
 }
 
 uint8_t OutputChannelClass::getChannelNumber(void)
@@ -84,10 +92,20 @@ const char* OutputChannelClass::getWaveform(void)
         case WAVEFORM_SQUARE_DIV_2:
             waveformName = waveformSquare2String;
         break;
+        case WAVEFORM_ARBITRARY:
+            waveformName = waveformArbitraryString;
+        break;
+        case WAVEFORM_PULSE:
+            waveformName = waveformPulseString;
+        break;
     }
 
     return waveformName;
 }
+WAVEFORM_T OutputChannelClass::getWaveformType(void)
+{
+    return waveform;
+}
 OUTPUT_STATUS_T OutputChannelClass::getOutputStatus(void)
 {
     return outputStatus;
@@ -96,22 +114,35 @@ OUTPUT_STATUS_T OutputChannelClass::getOutputStatus(void)
 ERROR_MESSAGE_T OutputChannelClass::setFrequencyHz(uint32_t newFrequencyHz)
 {
     ERROR_MESSAGE_T error = ERROR_MESSAGE_UNKNOWN;
+    uint32_t maxFrequencyHz = (waveform == WAVEFORM_ARBITRARY) ? AWG_MAX_FREQUENCY_HZ :
+                              (waveform == WAVEFORM_PULSE) ? PULSE_MAX_FREQUENCY_HZ : 8000000;
 
-    if (newFrequencyHz <= 8000000)
+    if (newFrequencyHz <= maxFrequencyHz)
     {
         frequencyHz = newFrequencyHz;
         // @todo Turn output off while changing phase or frequency register
         //DDS.setOutput(DDS_OFF);
 
-        // Set the new frequency
+        // Set the new frequency, the DDS keeps it too so leaving arbitrary mode needs no resync
         DDS.sendFrequency(newFrequencyHz);
+        AWG.setFrequency(newFrequencyHz);
+        Pulse.setFrequency(newFrequencyHz);
+        TRACE(TRACE_CATEGORY_CHANNEL, TRACE_EVENT_CHANNEL_FREQUENCY, newFrequencyHz >> 8);
+
+        if (outputStatus == ON)
+        {
+            // Measures the output when the self-check is on, the result is reported by the main loop.  The DIV2
+            // square is the DAC MSB over two, half the set frequency.
+            FrequencyCounter.verify((waveform == WAVEFORM_SQUARE_DIV_2) ? (newFrequencyHz / 2) : newFrequencyHz);
+        }
 
         // Turn the output back on if it was previous enabled
         //outputStatus == ON ? DDS.setOutput(DDS_ON) : DDS.setOutput(DDS_OFF);
         error = SUCCESS;
     }
-    else if (newFrequencyHz > 8000000)
+    else if (newFrequencyHz > maxFrequencyHz)
     {
+        TRACE(TRACE_CATEGORY_CHANNEL, TRACE_EVENT_CHANNEL_RANGE_ERROR, newFrequencyHz >> 8);
         error = ERROR_MESSAGE_VALUE_TOO_LARGE;
     }
     else
@@ -150,12 +181,14 @@ ERROR_MESSAGE_T OutputChannelClass::setAmplitudeMV(uint16_t newAmplitudeMV)
         if (Amplifier.set(newAmplitudeMV, waveform) == 0)
         {
             amplitudeMV = newAmplitudeMV;
+            TRACE(TRACE_CATEGORY_CHANNEL, TRACE_EVENT_CHANNEL_AMPLITUDE, newAmplitudeMV);
             error = SUCCESS;
         }
     }
     else
     {
         DEBUGLN(F("Value exceeded 4000"));
+        TRACE(TRACE_CATEGORY_CHANNEL, TRACE_EVENT_CHANNEL_RANGE_ERROR, newAmplitudeMV);
         error = ERROR_MESSAGE_OTHER;
     }
 
@@ -173,6 +206,8 @@ ERROR_MESSAGE_T OutputChannelClass::setPhaseDegrees(uint16_t newPhaseDegrees)
 
         // Set the phase
         DDS.sendPhase(newPhaseDegrees);
+        AWG.setPhase(newPhaseDegrees);
+        TRACE(TRACE_CATEGORY_CHANNEL, TRACE_EVENT_CHANNEL_PHASE, newPhaseDegrees);
 
         // Turn the output back on if it was previous enabled
         //outputStatus == ON ? DDS.setOutput(DDS_ON) : DDS.setOutput(DDS_OFF);
@@ -181,6 +216,7 @@ ERROR_MESSAGE_T OutputChannelClass::setPhaseDegrees(uint16_t newPhaseDegrees)
     }
     else if (newPhaseDegrees > 360)
     {
+        TRACE(TRACE_CATEGORY_CHANNEL, TRACE_EVENT_CHANNEL_RANGE_ERROR, newPhaseDegrees);
         error = ERROR_MESSAGE_VALUE_TOO_LARGE;
     }
     else
@@ -194,6 +230,10 @@ ERROR_MESSAGE_T OutputChannelClass::setWaveform(WAVEFORM_T newWaveform)
     ERROR_MESSAGE_T error = ERROR_MESSAGE_UNKNOWN;
     OUTPUT_STATUS_T previousOutputStatus = getOutputStatus();
 
+    // The AWG only runs in arbitrary mode and the pulses in pulse mode, stop them before another waveform takes over
+    AWG.stop();
+    Pulse.stop();
+
     // Toggle the waveform off, then set the amplitude, then
     switch (newWaveform)
     {
@@ -201,7 +241,7 @@ ERROR_MESSAGE_T OutputChannelClass::setWaveform(WAVEFORM_T newWaveform)
             error = SUCCESS;
             waveform = WAVEFORM_SINE;
             setOutputStatus(OFF);
-            DDS.setOutputMode(DDS_MODE_SINE);
+            DDS.setOutputMode(WAVEFORM_SINE);
             setAmplitudeMV();
             setOutputStatus(previousOutputStatus);
         break;
@@ -209,7 +249,7 @@ ERROR_MESSAGE_T OutputChannelClass::setWaveform(WAVEFORM_T newWaveform)
             error = SUCCESS;
             waveform = WAVEFORM_TRIANGLE;
             setOutputStatus(OFF);
-            DDS.setOutputMode(DDS_MODE_TRIANGLE);
+            DDS.setOutputMode(WAVEFORM_TRIANGLE);
             setAmplitudeMV();
             setOutputStatus(previousOutputStatus);
         break;
@@ -217,7 +257,7 @@ ERROR_MESSAGE_T OutputChannelClass::setWaveform(WAVEFORM_T newWaveform)
             error = SUCCESS;
             waveform = WAVEFORM_SQUARE;
             setOutputStatus(OFF);
-            DDS.setOutputMode(DDS_MODE_SQUARE);
+            DDS.setOutputMode(WAVEFORM_SQUARE);
             setAmplitudeMV();
             setOutputStatus(previousOutputStatus);
         break;
@@ -225,11 +265,35 @@ ERROR_MESSAGE_T OutputChannelClass::setWaveform(WAVEFORM_T newWaveform)
             error = SUCCESS;
             waveform = WAVEFORM_SQUARE_DIV_2;
             setOutputStatus(OFF);
-            DDS.setOutputMode(DDS_MODE_SQUARE_DIV2);
+            DDS.setOutputMode(WAVEFORM_SQUARE_DIV_2);
+            setAmplitudeMV();
+            setOutputStatus(previousOutputStatus);
+        break;
+        case WAVEFORM_ARBITRARY:
+            error = SUCCESS;
+            waveform = WAVEFORM_ARBITRARY;
+            setOutputStatus(OFF);
+            if (frequencyHz > AWG_MAX_FREQUENCY_HZ)
+            {
+                setFrequencyHz(AWG_MAX_FREQUENCY_HZ);
+            }
+            setAmplitudeMV();
+            setOutputStatus(previousOutputStatus);
+        break;
+        case WAVEFORM_PULSE:
+            error = SUCCESS;
+            waveform = WAVEFORM_PULSE;
+            setOutputStatus(OFF);
+            if (frequencyHz > PULSE_MAX_FREQUENCY_HZ)
+            {
+                setFrequencyHz(PULSE_MAX_FREQUENCY_HZ);
+            }
             setAmplitudeMV();
             setOutputStatus(previousOutputStatus);
         break;
     }
+
+    TRACE(TRACE_CATEGORY_CHANNEL, TRACE_EVENT_CHANNEL_WAVEFORM, newWaveform);
     return error;
 }
 ERROR_MESSAGE_T OutputChannelClass::setOutputStatus(OUTPUT_STATUS_T newOutputStatus)
@@ -239,12 +303,28 @@ ERROR_MESSAGE_T OutputChannelClass::setOutputStatus(OUTPUT_STATUS_T newOutputSta
     if (newOutputStatus == ON)
     {
         outputStatus = ON;
-        DDS.setOutput(DDS_ON);
+
+        if (waveform == WAVEFORM_ARBITRARY)
+        {
+            // The DDS stays in reset so only the AWG drives the amplifier
+            AWG.start();
+        }
+        else if (waveform == WAVEFORM_PULSE)
+        {
+            // The DDS stays in reset too, pin 9 drives the amplifier
+            Pulse.start();
+        }
+        else
+        {
+            DDS.setOutput(DDS_ON);
+        }
         error = SUCCESS;
     }
     else if (newOutputStatus == OFF)
     {
         outputStatus = OFF;
+        AWG.stop();
+        Pulse.stop();
         DDS.setOutput(DDS_OFF);
         error = SUCCESS;
     }
@@ -253,6 +333,7 @@ ERROR_MESSAGE_T OutputChannelClass::setOutputStatus(OUTPUT_STATUS_T newOutputSta
         error = ERROR_MESSAGE_OTHER;
     }
 
+    TRACE(TRACE_CATEGORY_CHANNEL, TRACE_EVENT_CHANNEL_OUTPUT, newOutputStatus);
     return error;
 }
 
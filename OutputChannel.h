@@ -41,7 +41,9 @@ typedef enum
   WAVEFORM_SINE=0,
   WAVEFORM_TRIANGLE,
   WAVEFORM_SQUARE,
-  WAVEFORM_SQUARE_DIV_2
+  WAVEFORM_SQUARE_DIV_2,
+  WAVEFORM_ARBITRARY,       ///< wavetable played by AWGClass instead of the DDS
+  WAVEFORM_PULSE            ///< pulses from PulseClass on Timer1 instead of the DDS
 } WAVEFORM_T;
 
 /// @brief Class for storing information about an output channel
@@ -56,6 +58,7 @@ class OutputChannelClass
     uint16_t getAmplitudeMV(void);
     uint16_t getPhaseDegrees(void);
     const char* getWaveform(void);
+    WAVEFORM_T getWaveformType(void);
     OUTPUT_STATUS_T getOutputStatus(void);
     ERROR_MESSAGE_T setFrequencyHz(uint32_t);
     ERROR_MESSAGE_T setAmplitudeMV();
@@ -0,0 +1,123 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "Power.h"
+#include "Clock.h"
+#include "DDS.h"
+#include "Debug.h"
+#define DEBUG_OUTPUT 0
+
+PowerClass Power;
+
+PowerClass::PowerClass()
+{
+    idleSleep = true;
+    resetStats();
+}
+
+/// @brief Call after Clock.init(), sleep time is measured with it
+void PowerClass::init()
+{
+    // The core enables the ADC for analogRead(), only a Bode sweep uses it.  It has to be off before its clock is gated.
+    ADCSRA &= (uint8_t) ~_BV(ADEN);
+    PRR |= _BV(PRADC);
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    resetStats();
+}
+
+void PowerClass::setIdleSleep(bool enabled)
+{
+    idleSleep = enabled;
+}
+
+bool PowerClass::getIdleSleep()
+{
+    return idleSleep;
+}
+
+void PowerClass::idle()
+{
+    if (!idleSleep)
+    {
+        return;
+    }
+
+    // A byte that arrived after serialEvent() ran would otherwise wait for the next Timer0 tick.  sei() lets one
+    // more instruction run before any handler, so an interrupt between the check and sleep_cpu() still wakes it.
+    cli();
+
+    if (Serial.available())
+    {
+        sei();
+        return;
+    }
+
+    uint32_t before = Clock.cycles();
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+
+    lastWakeCycles = Clock.cycles();
+    sleepUs += (lastWakeCycles - before) / (F_CPU / 1000000UL);
+    sleeps++;
+    wokeSinceOutputOn = true;
+}
+
+void PowerClass::outputOn()
+{
+    if (wokeSinceOutputOn)
+    {
+        wakeToOutputCycles = Clock.cycles() - lastWakeCycles;
+        wokeSinceOutputOn = false;
+    }
+}
+
+void PowerClass::printStatus()
+{
+    unsigned long elapsedMs = millis() - statsStartMs;
+
+    Serial.print(F("Idle sleep "));
+    idleSleep ? Serial.print(F("on")) : Serial.print(F("off"));
+    Serial.print(F(", DDS off mode "));
+    Serial.println(DDS.getOffPowerMode());
+
+    Serial.println(F("sleeps,asleep_us,elapsed_ms,asleep_pct,wake_to_output_cycles"));
+    Serial.print(sleeps);
+    Serial.write(',');
+    Serial.print(sleepUs);
+    Serial.write(',');
+    Serial.print(elapsedMs);
+    Serial.write(',');
+    Serial.print(elapsedMs ? sleepUs / (elapsedMs * 10) : 0);
+    Serial.write(',');
+    Serial.println(wakeToOutputCycles);
+}
+
+void PowerClass::resetStats()
+{
+    sleeps = 0;
+    sleepUs = 0;
+    statsStartMs = millis();
+    lastWakeCycles = 0;
+    wokeSinceOutputOn = false;
+    wakeToOutputCycles = 0;
+}
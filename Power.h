@@ -0,0 +1,66 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** MCU power management.
+ *
+ *  When the main loop has nothing to do the CPU goes into idle sleep.  Idle stops only the CPU clock: Timer0 (millis),
+ *  Timer1 (Clock, frequency counter), Timer2 (AWG), the UART, SPI and TWI keep running and any of their interrupts,
+ *  or a trigger edge, wakes it within a few cycles.  Timer0 wakes it at least once per 1.024 ms.  The deeper modes
+ *  would stop the Timer1 cycle counter and are not used.  The ADC is powered down except during a Bode sweep.
+ *
+ *  Wake-to-output latency is the time from the wake up before the last byte of a command (the CR) to the DDS control
+ *  word that turns the output on, so it covers the line editor, the dispatch and the SPI frame.  It does not include
+ *  what the DDS adds after that write: 7 or 8 MCLK cycles after RESET or SLEEP1, plus the DAC power-up after SLEEP12,
+ *  which the datasheets do not specify (see the README table per DDS power mode).
+ */
+#ifndef Power_h
+#define Power_h
+
+#include "Arduino.h"
+
+class PowerClass
+{
+  public:
+    PowerClass();
+    void init();
+
+    void setIdleSleep(bool enabled);
+    bool getIdleSleep();
+
+    /// Sleeps until the next interrupt if idle sleep is on and no serial byte is waiting
+    void idle();
+    /// Called by the DDS driver after the control word that turns the output on
+    void outputOn();
+
+    void printStatus();
+    void resetStats();
+
+  private:
+    bool idleSleep;
+    uint32_t sleeps;
+    uint32_t sleepUs;
+    unsigned long statsStartMs;
+    uint32_t lastWakeCycles;
+    bool wokeSinceOutputOn;
+    uint32_t wakeToOutputCycles;
+};
+
+extern PowerClass Power;
+
+#endif
@@ -0,0 +1,186 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <avr/pgmspace.h>
+#include "Profiler.h"
+
+ProfilerClass Profiler;
+
+const char probeNameWriteDDS[] PROGMEM       = "writeDDS";
+const char probeNameSendFrequency[] PROGMEM  = "sendFrequency";
+const char probeNameAmplifierWrite[] PROGMEM = "Amplifier.write";
+const char probeNameAmplifierRead[] PROGMEM  = "Amplifier.read";
+const char probeNameDispatch[] PROGMEM       = "dispatch";
+const char probeNameStatusLine[] PROGMEM     = "printStatusLine";
+
+PGM_P const probeNames[PROFILE_PROBE_COUNT] PROGMEM =
+{
+    probeNameWriteDDS,
+    probeNameSendFrequency,
+    probeNameAmplifierWrite,
+    probeNameAmplifierRead,
+    probeNameDispatch,
+    probeNameStatusLine,
+};
+
+ProfilerClass::ProfilerClass()
+{
+    reset();
+}
+
+ProfilerClass::~ProfilerClass()
+{
+}
+
+void ProfilerClass::reset()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+
+    memset(stats, 0, sizeof(stats));
+    memset(counters, 0, sizeof(counters));
+
+    for (uint8_t probe = 0; probe < PROFILE_PROBE_COUNT; probe++)
+    {
+        stats[probe].minCycles = 0xFFFFFFFF;
+    }
+
+    SREG = oldSREG;
+}
+
+/** @brief Records one sample of a timed section
+ *
+ *  @param probe Section being timed
+ *  @param startCycles Value of Clock.cycles() when the section was entered
+ */
+void ProfilerClass::end(PROFILE_PROBE_T probe, uint32_t startCycles)
+{
+    uint32_t elapsedCycles = Clock.cycles() - startCycles;
+    uint8_t bucket = 0;
+
+    if (probe >= PROFILE_PROBE_COUNT)
+    {
+        return;
+    }
+
+    // Buckets grow by a factor of 4 starting at 64 cycles (4us at 16MHz)
+    while ((bucket < (PROFILE_HISTOGRAM_BUCKETS - 1)) && (elapsedCycles >= (64UL << (2 * bucket))))
+    {
+        bucket++;
+    }
+
+    uint8_t oldSREG = SREG;
+    cli();
+
+    PROFILE_STATS_T* pStats = &stats[probe];
+
+    if (elapsedCycles < pStats->minCycles)
+    {
+        pStats->minCycles = elapsedCycles;
+    }
+
+    if (elapsedCycles > pStats->maxCycles)
+    {
+        pStats->maxCycles = elapsedCycles;
+    }
+
+    if ((pStats->count == 0xFFFF) || ((pStats->totalCycles + elapsedCycles) < pStats->totalCycles))
+    {
+        pStats->count >>= 1;
+        pStats->totalCycles >>= 1;
+    }
+
+    pStats->count++;
+    pStats->totalCycles += elapsedCycles;
+
+    if (pStats->histogram[bucket] < 0xFFFF)
+    {
+        pStats->histogram[bucket]++;
+    }
+
+    SREG = oldSREG;
+}
+
+void ProfilerClass::count(PROFILE_COUNTER_T counter, uint16_t amount)
+{
+    if (counter < PROFILE_COUNTER_COUNT)
+    {
+        uint8_t oldSREG = SREG;
+        cli();
+        counters[counter] += amount;
+        SREG = oldSREG;
+    }
+}
+
+uint32_t ProfilerClass::getCounter(PROFILE_COUNTER_T counter)
+{
+    uint32_t value = 0;
+
+    if (counter < PROFILE_COUNTER_COUNT)
+    {
+        uint8_t oldSREG = SREG;
+        cli();
+        value = counters[counter];
+        SREG = oldSREG;
+    }
+
+    return value;
+}
+
+/// @brief Dumps the statistics in cycles, one line per probe: name,count,min,avg,max,histogram...
+void ProfilerClass::print()
+{
+    PROFILE_STATS_T snapshot;
+    char name[20];
+
+    Serial.println(F("probe,count,min,avg,max,<64,<256,<1k,<4k,<16k,<64k,<256k,>=256k"));
+
+    for (uint8_t probe = 0; probe < PROFILE_PROBE_COUNT; probe++)
+    {
+        uint8_t oldSREG = SREG;
+        cli();
+        snapshot = stats[probe];
+        SREG = oldSREG;
+
+        strncpy_P(name, (PGM_P) pgm_read_word(&(probeNames[probe])), sizeof(name) - 1);
+        name[sizeof(name) - 1] = '\0';
+
+        Serial.print(name);
+        Serial.write(',');
+        Serial.print(snapshot.count);
+        Serial.write(',');
+        Serial.print(snapshot.count ? snapshot.minCycles : 0);
+        Serial.write(',');
+        Serial.print(snapshot.count ? (snapshot.totalCycles / snapshot.count) : 0);
+        Serial.write(',');
+        Serial.print(snapshot.maxCycles);
+
+        for (uint8_t bucket = 0; bucket < PROFILE_HISTOGRAM_BUCKETS; bucket++)
+        {
+            Serial.write(',');
+            Serial.print(snapshot.histogram[bucket]);
+        }
+
+        Serial.println();
+    }
+
+    Serial.print(F("SPI frames: "));
+    Serial.println(getCounter(PROFILE_COUNTER_SPI_FRAMES));
+    Serial.print(F("I2C bytes: "));
+    Serial.println(getCounter(PROFILE_COUNTER_I2C_BYTES));
+}
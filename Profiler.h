@@ -0,0 +1,87 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#ifndef Profiler_h
+#define Profiler_h
+
+#include "Arduino.h"
+#include "Clock.h"
+
+/// Set to 0 to compile all PROFILE_BEGIN/PROFILE_END/PROFILE_COUNT probes out of the firmware
+#define PROFILER_ENABLED 1
+
+#define PROFILE_HISTOGRAM_BUCKETS  8
+
+/// @brief Timed sections of the firmware, each keeps its own min/avg/max and histogram
+typedef enum
+{
+    PROFILE_WRITE_DDS = 0,
+    PROFILE_SEND_FREQUENCY,
+    PROFILE_AMPLIFIER_WRITE,
+    PROFILE_AMPLIFIER_READ,
+    PROFILE_COMMAND_DISPATCH,
+    PROFILE_STATUS_LINE,
+    PROFILE_PROBE_COUNT
+} PROFILE_PROBE_T;
+
+/// @brief Bus operation counters
+typedef enum
+{
+    PROFILE_COUNTER_SPI_FRAMES = 0,
+    PROFILE_COUNTER_I2C_BYTES,
+    PROFILE_COUNTER_COUNT
+} PROFILE_COUNTER_T;
+
+typedef struct
+{
+    uint16_t count;          //!< number of samples included in totalCycles
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint32_t totalCycles;    //!< halved together with count when it would overflow so the average stays valid
+    uint16_t histogram[PROFILE_HISTOGRAM_BUCKETS];  //!< bucket n counts samples below 2^(6+2n) cycles, the last bucket is open ended
+} PROFILE_STATS_T;
+
+/// @brief Collects timing statistics of the hot paths using the Timer1 cycle counter
+class ProfilerClass
+{
+  public:
+    ProfilerClass();
+    ~ProfilerClass();
+    void reset();
+    void end(PROFILE_PROBE_T probe, uint32_t startCycles);
+    void count(PROFILE_COUNTER_T counter, uint16_t amount);
+    uint32_t getCounter(PROFILE_COUNTER_T counter);
+    void print();
+  private:
+    PROFILE_STATS_T stats[PROFILE_PROBE_COUNT];
+    uint32_t counters[PROFILE_COUNTER_COUNT];
+};
+
+extern ProfilerClass Profiler;
+
+#if PROFILER_ENABLED
+#define PROFILE_BEGIN()             uint32_t profileStartCycles = Clock.cycles()
+#define PROFILE_END(probe)          Profiler.end((probe), profileStartCycles)
+#define PROFILE_COUNT(counter, n)   Profiler.count((counter), (n))
+#else
+#define PROFILE_BEGIN()             do {} while (0)
+#define PROFILE_END(probe)          do {} while (0)
+#define PROFILE_COUNT(counter, n)   do {} while (0)
+#endif // PROFILER_ENABLED
+
+#endif
@@ -0,0 +1,272 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <avr/interrupt.h>
+#include "Pulse.h"
+#include "Clock.h"
+#include "Debug.h"
+#define DEBUG_OUTPUT 0
+
+#define PULSE_COM_MASK          (_BV(COM1A1) | _BV(COM1A0))
+#define PULSE_COM_CLEAR         _BV(COM1A1)
+#define PULSE_COM_SET           (_BV(COM1A1) | _BV(COM1A0))
+
+PulseClass Pulse;
+
+// Shared with the compare interrupt
+static uint32_t pulseHighCycles;
+static uint32_t pulseLowCycles;
+static volatile uint32_t pulseRemaining;    // interval left after the compare that is set up
+static uint8_t pulseLevel;                  // level of the pin until the next edge
+static uint16_t pulseLeft;                  // pulses left in the burst, 0 for a train
+
+// Instrumentation, written by the handler only
+static volatile uint32_t pulseCount;
+static volatile uint16_t pulseOverruns;
+
+/// Sets up the compare for the next piece of the interval.  Only the compare that ends the interval moves the pin,
+/// the ones before it set the level it has.
+static inline void pulseScheduleStep()
+{
+    uint32_t remaining = pulseRemaining;
+    uint16_t step = clockCompareStep(remaining);
+
+    OCR1A += step;
+    pulseRemaining = remaining - step;
+
+    uint8_t level = pulseRemaining ? pulseLevel : !pulseLevel;
+    TCCR1A = (TCCR1A & ~PULSE_COM_MASK) | (level ? PULSE_COM_SET : PULSE_COM_CLEAR);
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+    if (pulseRemaining)
+    {
+        // Part way through a long level
+        pulseScheduleStep();
+        return;
+    }
+
+    // The compare just moved the pin
+    pulseLevel = !pulseLevel;
+
+    if (pulseLevel)
+    {
+        pulseRemaining = pulseHighCycles;
+    }
+    else
+    {
+        pulseCount++;
+
+        if (pulseLeft && (--pulseLeft == 0))
+        {
+            // End of the burst, COM1A still clears so the pin stays low
+            TIMSK1 &= ~_BV(OCIE1A);
+            return;
+        }
+
+        pulseRemaining = pulseLowCycles;
+    }
+
+    pulseScheduleStep();
+
+    // The handler ran past the edge it set up, Timer1 has to wrap before the pin moves
+    if ((int16_t) (OCR1A - TCNT1) <= 0)
+    {
+        pulseOverruns++;
+    }
+}
+
+/// Whole cycles in a time, without the 32-bit overflow of ns * F_CPU
+static uint32_t pulseNsToCycles(uint32_t ns)
+{
+    const uint32_t cyclesPerUs = F_CPU / 1000000UL;
+    return (ns / 1000) * cyclesPerUs + ((ns % 1000) * cyclesPerUs) / 1000;
+}
+
+PulseClass::PulseClass()
+{
+    // 1 kHz at 10%
+    periodCycles = F_CPU / 1000;
+    widthCycles = F_CPU / 10000;
+    dutyPercent = 0;
+    count = 0;
+}
+
+void PulseClass::init()
+{
+    stop();
+}
+
+void PulseClass::start()
+{
+    stop();
+
+    pinMode(PULSE_OUTPUT_PIN, OUTPUT);
+
+    // TIMSK1 is also changed by the frequency counter interrupt
+    uint8_t oldSREG = SREG;
+    cli();
+    pulseHighCycles = widthCycles;
+    pulseLowCycles = periodCycles - widthCycles;
+    pulseLevel = 0;
+    pulseLeft = count;
+    pulseCount = 0;
+    pulseOverruns = 0;
+
+    // The first rising edge is one short level away, far enough for the compare to be set up in time
+    pulseRemaining = PULSE_MIN_LEVEL_CYCLES;
+    OCR1A = TCNT1;
+    pulseScheduleStep();
+    TIFR1 = _BV(OCF1A);
+    TIMSK1 |= _BV(OCIE1A);
+    SREG = oldSREG;
+
+    DEBUGLN(F("Pulse started"));
+}
+
+void PulseClass::stop()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    TIMSK1 &= ~_BV(OCIE1A);
+
+    // Force OC1A low before handing the pin back to PORTB, so the next start does not begin with a stale high
+    TCCR1A = (TCCR1A & ~PULSE_COM_MASK) | PULSE_COM_CLEAR;
+    TCCR1C = _BV(FOC1A);
+    TCCR1A = TCCR1A & ~PULSE_COM_MASK;
+    SREG = oldSREG;
+
+    pinMode(PULSE_OUTPUT_PIN, OUTPUT);
+    digitalWrite(PULSE_OUTPUT_PIN, LOW);
+}
+
+bool PulseClass::isRunning()
+{
+    return (TIMSK1 & _BV(OCIE1A)) != 0;
+}
+
+/// @returns 0 if both levels are at least PULSE_MIN_LEVEL_CYCLES long.  A running train takes the new timing at its
+/// next edge.
+uint8_t PulseClass::fit(uint32_t newPeriodCycles, uint32_t newWidthCycles)
+{
+    if ((newWidthCycles < PULSE_MIN_LEVEL_CYCLES) || (newPeriodCycles < newWidthCycles) ||
+        (newPeriodCycles - newWidthCycles < PULSE_MIN_LEVEL_CYCLES))
+    {
+        return 1;
+    }
+
+    periodCycles = newPeriodCycles;
+    widthCycles = newWidthCycles;
+
+    uint8_t oldSREG = SREG;
+    cli();
+    pulseHighCycles = widthCycles;
+    pulseLowCycles = periodCycles - widthCycles;
+    SREG = oldSREG;
+
+    return 0;
+}
+
+void PulseClass::setFrequency(uint32_t frequencyHz)
+{
+    if ((frequencyHz == 0) || (frequencyHz > PULSE_MAX_FREQUENCY_HZ))
+    {
+        return;
+    }
+
+    uint32_t newPeriodCycles = F_CPU / frequencyHz;
+    uint32_t newWidthCycles = dutyPercent ? (newPeriodCycles / 100) * dutyPercent : widthCycles;
+
+    if (newWidthCycles > newPeriodCycles - PULSE_MIN_LEVEL_CYCLES)
+    {
+        newWidthCycles = newPeriodCycles - PULSE_MIN_LEVEL_CYCLES;
+    }
+    if (newWidthCycles < PULSE_MIN_LEVEL_CYCLES)
+    {
+        newWidthCycles = PULSE_MIN_LEVEL_CYCLES;
+    }
+
+    fit(newPeriodCycles, newWidthCycles);
+}
+
+uint8_t PulseClass::setPeriodNs(uint32_t periodNs)
+{
+    uint32_t newPeriodCycles = pulseNsToCycles(periodNs);
+    uint32_t newWidthCycles = dutyPercent ? (newPeriodCycles / 100) * dutyPercent : widthCycles;
+
+    return fit(newPeriodCycles, newWidthCycles);
+}
+
+uint8_t PulseClass::setWidthNs(uint32_t widthNs)
+{
+    if (fit(periodCycles, pulseNsToCycles(widthNs)))
+    {
+        return 1;
+    }
+
+    dutyPercent = 0;
+    return 0;
+}
+
+uint8_t PulseClass::setDutyPercent(uint8_t newDutyPercent)
+{
+    if ((newDutyPercent == 0) || (newDutyPercent >= 100) || fit(periodCycles, (periodCycles / 100) * newDutyPercent))
+    {
+        return 1;
+    }
+
+    dutyPercent = newDutyPercent;
+    return 0;
+}
+
+uint8_t PulseClass::setCount(uint16_t newCount)
+{
+    count = newCount;
+    return 0;
+}
+
+void PulseClass::printStatus()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    uint32_t pulses = pulseCount;
+    uint16_t overruns = pulseOverruns;
+    SREG = oldSREG;
+
+    // Cycles are 62.5 ns at 16 MHz
+    isRunning() ? Serial.print(F("Pulse running, period ")) : Serial.print(F("Pulse idle, period "));
+    Serial.print(periodCycles);
+    Serial.print(F(" cycles, width "));
+    Serial.print(widthCycles);
+    Serial.print(F(" cycles, "));
+    if (count)
+    {
+        Serial.print(count);
+        Serial.println(F(" per start"));
+    }
+    else
+    {
+        Serial.println(F("continuous"));
+    }
+
+    Serial.println(F("pulses,overruns"));
+    Serial.print(pulses);
+    Serial.write(',');
+    Serial.println(overruns);
+}
@@ -0,0 +1,77 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Pulse generator on OC1A (pin 9) with a width and period of its own, for the pulses the 50% DDS square cannot make.
+ *
+ *  Timer1 has to keep running free for Clock, the frequency counter and hopping, so there is no PWM mode with its own
+ *  TOP and prescaler.  Every edge is an output compare instead: the compare A interrupt moves OCR1A on by the next
+ *  interval, counted from the previous compare, and sets COM1A to set or clear the pin there.  The hardware moves the
+ *  pin, so edges land to the cycle (62.5 ns) whatever the interrupt latency, and each level can last anywhere from
+ *  PULSE_MIN_LEVEL_CYCLES to 2^32 cycles without choosing a prescaler.  Intervals longer than half of Timer1 are split
+ *  into several compares that keep the level.
+ *
+ *  The train runs while the output is on.  With a pulse count it stops after that many pulses, low; the next start
+ *  fires another burst, so a count of one gives single shot pulses.
+ *
+ *  Hardware: pin 9 into the amplifier input in place of the DDS output, like the AWG on pin 3 but without a filter.
+ *  The DDS is held in reset while pulsing.
+ */
+#ifndef Pulse_h
+#define Pulse_h
+
+#include "Arduino.h"
+
+#define PULSE_OUTPUT_PIN        9
+#define PULSE_MIN_LEVEL_CYCLES  256     ///< the handler must set up an edge before it is due, 16 us
+#define PULSE_MAX_FREQUENCY_HZ  (F_CPU / (2 * PULSE_MIN_LEVEL_CYCLES))
+
+class PulseClass
+{
+  public:
+    PulseClass();
+    void init();
+    /// Starts the train, or a burst when a count is set, with the first rising edge PULSE_MIN_LEVEL_CYCLES from now
+    void start();
+    /// Ends the train at once and parks the pin low
+    void stop();
+    bool isRunning();
+
+    /// Period from the channel frequency, 0 Hz keeps the last one.  The width shrinks if it no longer fits.
+    void setFrequency(uint32_t frequencyHz);
+    uint8_t setPeriodNs(uint32_t periodNs);
+    uint8_t setWidthNs(uint32_t widthNs);
+    /// Width as a share of the period, kept when the period changes until a width is set
+    uint8_t setDutyPercent(uint8_t dutyPercent);
+    /// Pulses per start, 0 runs until stopped
+    uint8_t setCount(uint16_t count);
+
+    void printStatus();
+
+  private:
+    uint8_t fit(uint32_t newPeriodCycles, uint32_t newWidthCycles);
+
+    uint32_t periodCycles;
+    uint32_t widthCycles;
+    uint8_t dutyPercent;    ///< 0 while the width was set directly
+    uint16_t count;
+};
+
+extern PulseClass Pulse;
+
+#endif
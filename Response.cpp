@@ -0,0 +1,138 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <avr/pgmspace.h>
+#include "Response.h"
+#include "Debug.h"
+#define DEBUG_OUTPUT 0
+
+ResponseClass Response;
+
+static const uint32_t powersOfTen[] PROGMEM =
+{
+    1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL, 10000UL, 1000UL, 100UL, 10UL
+};
+
+ResponseClass::ResponseClass()
+{
+    length = 0;
+    promptFormat = PROMPT_FORMAT_FULL;
+}
+
+void ResponseClass::add(char c)
+{
+    if (length >= RESPONSE_BUFFER_SIZE)
+    {
+        commit();
+    }
+
+    buffer[length++] = c;
+}
+
+void ResponseClass::add(const char* text)
+{
+    while (*text)
+    {
+        add(*text++);
+    }
+}
+
+void ResponseClass::add(const __FlashStringHelper* text)
+{
+    PGM_P p = reinterpret_cast<PGM_P>(text);
+    char c;
+
+    while ((c = pgm_read_byte(p++)) != '\0')
+    {
+        add(c);
+    }
+}
+
+void ResponseClass::addNumber(uint32_t value)
+{
+    bool leading = true;
+
+    for (uint8_t i = 0; i < sizeof(powersOfTen) / sizeof(powersOfTen[0]); i++)
+    {
+        uint32_t power = pgm_read_dword(&powersOfTen[i]);
+        char digit = '0';
+
+        while (value >= power)
+        {
+            value -= power;
+            digit++;
+        }
+
+        if ((digit != '0') || !leading)
+        {
+            add(digit);
+            leading = false;
+        }
+    }
+
+    add((char) ('0' + value));
+}
+
+void ResponseClass::addLine()
+{
+    add('\r');
+    add('\n');
+}
+
+void ResponseClass::format(const __FlashStringHelper* layout, const uint32_t* values)
+{
+    PGM_P p = reinterpret_cast<PGM_P>(layout);
+    char c;
+
+    while ((c = pgm_read_byte(p++)) != '\0')
+    {
+        if (c == '%')
+        {
+            addNumber(*values++);
+        }
+        else
+        {
+            add(c);
+        }
+    }
+}
+
+void ResponseClass::commit()
+{
+    if (length)
+    {
+        Serial.write((const uint8_t*) buffer, length);
+        length = 0;
+    }
+}
+
+uint8_t ResponseClass::setPromptFormat(PROMPT_FORMAT_T format)
+{
+    if (format >= PROMPT_FORMAT_COUNT)
+    {
+        return 1;
+    }
+
+    promptFormat = format;
+    return 0;
+}
+
+PROMPT_FORMAT_T ResponseClass::getPromptFormat()
+{
+    return promptFormat;
+}
@@ -0,0 +1,76 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Builds a response in RAM and hands it to the serial port in one write.
+ *
+ *  Numbers are converted by subtracting powers of ten instead of the core's print(), which divides by 10 once per
+ *  digit (a 32-bit division is several hundred cycles on the AVR).  Fixed text comes from flash, either one piece at a
+ *  time or as a template where every '%' is replaced by the next value of an array.  A response that fits the core's
+ *  64 byte TX ring and finds room in it is queued in a single call without waiting for the UART, a longer one is
+ *  committed in buffer sized pieces.
+ *
+ *  The prompt after every command has three formats:
+ *    full      SIN_F1000_A500_P90_ON>   Q_ in front while quick commands only is on
+ *    compact   0,1000,500,90,1>         waveform number, frequency, amplitude, phase, output
+ *    none      nothing, for hosts that stream commands and read back only what they ask for
+ *    dashboard "> " after the changed fields of the VT100 dashboard, see DisplayClass
+ */
+#ifndef Response_h
+#define Response_h
+
+#include "Arduino.h"
+
+#define RESPONSE_BUFFER_SIZE  64    ///< the core's TX ring, a larger response cannot be queued in one go anyway
+
+typedef enum
+{
+    PROMPT_FORMAT_FULL = 0,
+    PROMPT_FORMAT_COMPACT,
+    PROMPT_FORMAT_NONE,
+    PROMPT_FORMAT_DASHBOARD,
+    PROMPT_FORMAT_COUNT
+} PROMPT_FORMAT_T;
+
+class ResponseClass
+{
+  public:
+    ResponseClass();
+
+    void add(char c);
+    void add(const char* text);
+    void add(const __FlashStringHelper* text);
+    void addNumber(uint32_t value);
+    void addLine();
+    /// Appends the flash template with every '%' replaced by the next entry of values
+    void format(const __FlashStringHelper* layout, const uint32_t* values);
+    /// Queues what has been built and starts over
+    void commit();
+
+    uint8_t setPromptFormat(PROMPT_FORMAT_T format);
+    PROMPT_FORMAT_T getPromptFormat();
+
+  private:
+    char buffer[RESPONSE_BUFFER_SIZE];
+    uint8_t length;
+    PROMPT_FORMAT_T promptFormat;
+};
+
+extern ResponseClass Response;
+
+#endif
@@ -0,0 +1,415 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <avr/interrupt.h>
+#include "Schedule.h"
+#include "DDS.h"
+#include "Hop.h"
+#include "Clock.h"
+#include "Sync.h"
+#include "Debug.h"
+#define DEBUG_OUTPUT 0
+
+// A compare this close could pass before the handler has written it, the command runs right away instead
+#define SCHEDULE_ARM_MARGIN_CYCLES  64
+// One 16-bit frame at SPI clk/32, until a handler has timed one
+#define SCHEDULE_FRAME_CYCLES       512
+#define SCHEDULE_MIN_LEAD_CYCLES    (SCHEDULE_MIN_LEAD_US * (F_CPU / 1000000UL))
+// FREQ0 address bits, the channel frequency is always in FREQ0
+#define SCHEDULE_FREQ0              0x4000
+// Limits of the int16_t error statistics, the C++ limit macros are not always there on AVR
+#define SCHEDULE_ERROR_MAX          32767
+#define SCHEDULE_ERROR_MIN          (-32767 - 1)
+
+// Settings the handler wrote, for service()
+#define SCHEDULE_APPLIED_FREQUENCY  0x01
+#define SCHEDULE_APPLIED_PHASE      0x02
+#define SCHEDULE_APPLIED_OUTPUT     0x04
+
+ScheduleClass Schedule;
+
+struct ScheduleEntry
+{
+    uint32_t tick;
+    uint32_t value;         // Hz or degrees
+    uint16_t words[2];      // frequency LSB and MSB, the phase word, or the control bits of the output off
+    uint8_t action;         // SCHEDULE_ACTION_T
+};
+
+// Min-heap on the tick, shared with the compare interrupt
+static ScheduleEntry scheduleHeap[SCHEDULE_MAX_ENTRIES];
+static volatile uint8_t scheduleCount;
+
+// Learned by the handler: compare match to its first instruction (the shortest seen) and the time of one frame
+static uint16_t scheduleEntryCycles = 0xFFFF;
+static uint16_t scheduleFrameCycles = SCHEDULE_FRAME_CYCLES;
+
+// What the handler wrote to the DDS since the last service()
+static volatile uint8_t scheduleApplied;
+static uint32_t scheduleAppliedFrequencyHz;
+static uint16_t scheduleAppliedPhase;
+static uint8_t scheduleAppliedOutput;
+
+// Instrumentation, written by the handler only.  The error is from the tick to chip select rising on the last frame.
+static volatile uint16_t scheduleRun;
+static volatile uint16_t scheduleLate;
+static volatile int16_t scheduleMinError;
+static volatile int16_t scheduleMaxError;
+static volatile int32_t scheduleTotalError;
+
+static inline bool scheduleBefore(const ScheduleEntry& a, const ScheduleEntry& b)
+{
+    return (int32_t) (a.tick - b.tick) < 0;
+}
+
+/// Cycle at which the handler has to begin for the change to land on the tick
+static inline uint32_t scheduleStart(const ScheduleEntry& entry)
+{
+    uint8_t frames = (entry.action == SCHEDULE_ACTION_FREQUENCY) ? 2 : 1;
+    uint16_t entryCycles = (scheduleEntryCycles == 0xFFFF) ? 0 : scheduleEntryCycles;
+
+    return entry.tick - entryCycles - (uint32_t) frames * scheduleFrameCycles;
+}
+
+/// With interrupts disabled
+static void schedulePush(const ScheduleEntry& entry)
+{
+    uint8_t i = scheduleCount++;
+
+    while (i)
+    {
+        uint8_t parent = (i - 1) / 2;
+        if (!scheduleBefore(entry, scheduleHeap[parent]))
+        {
+            break;
+        }
+        scheduleHeap[i] = scheduleHeap[parent];
+        i = parent;
+    }
+
+    scheduleHeap[i] = entry;
+}
+
+/// With interrupts disabled
+static void schedulePop()
+{
+    uint8_t count = --scheduleCount;
+    const ScheduleEntry& last = scheduleHeap[count];
+    uint8_t i = 0;
+
+    while (true)
+    {
+        uint8_t child = 2 * i + 1;
+        if (child >= count)
+        {
+            break;
+        }
+        if ((child + 1 < count) && scheduleBefore(scheduleHeap[child + 1], scheduleHeap[child]))
+        {
+            child++;
+        }
+        if (!scheduleBefore(scheduleHeap[child], last))
+        {
+            break;
+        }
+        scheduleHeap[i] = scheduleHeap[child];
+        i = child;
+    }
+
+    scheduleHeap[i] = last;
+}
+
+/// Sets compare B up for the first command, or for a step towards it.  With interrupts disabled.
+/// @returns false if the command is due within the margin and has to run now
+static bool scheduleArm(uint32_t now)
+{
+    int32_t remaining = (int32_t) (scheduleStart(scheduleHeap[0]) - now);
+
+    if (remaining < SCHEDULE_ARM_MARGIN_CYCLES)
+    {
+        return false;
+    }
+
+    OCR1B = (uint16_t) now + clockCompareStep((uint32_t) remaining);
+    return true;
+}
+
+void scheduleCompareMatch(uint16_t entry)
+{
+    uint16_t matched = OCR1B;
+
+    if (!SCHEDULE_ENABLED)
+    {
+        return;
+    }
+
+    if ((scheduleCount == 0) || scheduleArm(Clock.extend(entry)))
+    {
+        // Nothing left, or part way to a command far ahead
+        if (scheduleCount == 0)
+        {
+            TIMSK1 &= ~_BV(OCIE1B);
+        }
+        return;
+    }
+
+    // Never shorter than the real entry, other handlers and a held DDS only add to it
+    if ((uint16_t) (entry - matched) < scheduleEntryCycles)
+    {
+        scheduleEntryCycles = entry - matched;
+    }
+
+    do
+    {
+        const ScheduleEntry& next = scheduleHeap[0];
+        uint16_t begin = TCNT1;
+
+        switch (next.action)
+        {
+            case SCHEDULE_ACTION_FREQUENCY:
+                DDS.writeFromInterrupt(next.words[0]);
+                DDS.writeFromInterrupt(next.words[1]);
+                scheduleAppliedFrequencyHz = next.value;
+                scheduleApplied |= SCHEDULE_APPLIED_FREQUENCY;
+            break;
+            case SCHEDULE_ACTION_PHASE:
+                DDS.writeFromInterrupt(next.words[0]);
+                scheduleAppliedPhase = (uint16_t) next.value;
+                scheduleApplied |= SCHEDULE_APPLIED_PHASE;
+            break;
+            case SCHEDULE_ACTION_OUTPUT_ON:
+                DDS.writeControlFromInterrupt(DDS.getControlRegister() & ~DDS_CONTROL_POWER);
+                scheduleAppliedOutput = ON;
+                scheduleApplied |= SCHEDULE_APPLIED_OUTPUT;
+            break;
+            default:
+                DDS.writeControlFromInterrupt((DDS.getControlRegister() & ~DDS_CONTROL_POWER) | next.words[0]);
+                scheduleAppliedOutput = OFF;
+                scheduleApplied |= SCHEDULE_APPLIED_OUTPUT;
+            break;
+        }
+
+        uint16_t done = TCNT1;
+        int32_t error = (int32_t) (Clock.extend(done) - next.tick);
+
+        // Frames from an interrupt handler are never interrupted, every one takes the same time
+        scheduleFrameCycles = (next.action == SCHEDULE_ACTION_FREQUENCY) ? (uint16_t) (done - begin) / 2 : done - begin;
+
+        if (error > SCHEDULE_ERROR_MAX) error = SCHEDULE_ERROR_MAX;
+        if (error < SCHEDULE_ERROR_MIN) error = SCHEDULE_ERROR_MIN;
+        scheduleRun++;
+        scheduleLate += (error > SCHEDULE_LATE_CYCLES);
+        scheduleTotalError += error;
+        if (error < scheduleMinError) scheduleMinError = (int16_t) error;
+        if (error > scheduleMaxError) scheduleMaxError = (int16_t) error;
+
+        schedulePop();
+    } while (scheduleCount && !scheduleArm(Clock.extend(TCNT1)));
+
+    if (scheduleCount == 0)
+    {
+        TIMSK1 &= ~_BV(OCIE1B);
+    }
+}
+
+ScheduleClass::ScheduleClass()
+{
+    tick = 0;
+    scheduleMinError = SCHEDULE_ERROR_MAX;
+    scheduleMaxError = SCHEDULE_ERROR_MIN;
+}
+
+void ScheduleClass::setTick(uint32_t newTick)
+{
+    tick = newTick;
+}
+
+void ScheduleClass::setDelayUs(uint32_t delayUs)
+{
+    tick = Clock.cycles() + delayUs * (F_CPU / 1000000UL);
+}
+
+uint8_t ScheduleClass::add(const char* command, OutputChannelClass& channel)
+{
+    if (!SCHEDULE_ENABLED)
+    {
+        return 1;
+    }
+
+    ScheduleEntry entry;
+    entry.tick = tick;
+    entry.value = strtoul(&command[1], NULL, 10);
+    entry.words[0] = 0;
+    entry.words[1] = 0;
+
+    switch (command[0])
+    {
+        case 'f':
+        {
+            if (entry.value > 8000000)
+            {
+                return 1;
+            }
+            uint32_t word = DDSClass::tuningWord(entry.value);
+            entry.action = SCHEDULE_ACTION_FREQUENCY;
+            entry.words[0] = (uint16_t) (word & 0x3FFF) | SCHEDULE_FREQ0;
+            entry.words[1] = (uint16_t) ((word >> 14) & 0x3FFF) | SCHEDULE_FREQ0;
+        }
+        break;
+        case 'p':
+            if (entry.value > 360)
+            {
+                return 1;
+            }
+            entry.action = SCHEDULE_ACTION_PHASE;
+            entry.words[0] = DDSClass::phaseWord((uint16_t) entry.value);
+        break;
+        case 'O':
+            entry.action = SCHEDULE_ACTION_OUTPUT_ON;
+        break;
+        case 'o':
+            entry.action = SCHEDULE_ACTION_OUTPUT_OFF;
+            entry.words[0] = DDS.getOffBits();
+        break;
+        default:
+            return 1;
+    }
+
+    // The AWG and the pulses are not started from an interrupt, hopping has compare B and a commit would land on top
+    if ((channel.getWaveformType() >= WAVEFORM_ARBITRARY) || Hop.isRunning() || Sync.pending() ||
+        (scheduleCount >= SCHEDULE_MAX_ENTRIES))
+    {
+        return 1;
+    }
+
+    uint8_t oldSREG = SREG;
+    cli();
+
+    // Too close to be set up in time, already past, or more than half of the clock ahead
+    uint32_t now = Clock.extend(TCNT1);
+    if ((int32_t) (entry.tick - now) < (int32_t) SCHEDULE_MIN_LEAD_CYCLES)
+    {
+        SREG = oldSREG;
+        return 1;
+    }
+
+    bool first = (scheduleCount == 0);
+    bool earliest = first || scheduleBefore(entry, scheduleHeap[0]);
+    schedulePush(entry);
+
+    if (earliest)
+    {
+        scheduleArm(now);
+    }
+    if (first)
+    {
+        TIFR1 = _BV(OCF1B);
+        TIMSK1 |= _BV(OCIE1B);
+    }
+    SREG = oldSREG;
+
+    DEBUGLN(F("Command scheduled"));
+    return 0;
+}
+
+void ScheduleClass::clear()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    if (scheduleCount)
+    {
+        // Compare B is only ours while something is queued
+        scheduleCount = 0;
+        TIMSK1 &= ~_BV(OCIE1B);
+    }
+    SREG = oldSREG;
+}
+
+uint8_t ScheduleClass::pending()
+{
+    return scheduleCount;
+}
+
+bool ScheduleClass::service(OutputChannelClass& channel)
+{
+    if (scheduleApplied == 0)
+    {
+        return false;
+    }
+
+    // Held, so a command that comes due now is not undone by the older setting written here
+    uint8_t held = ddsHold();
+    uint8_t applied = scheduleApplied;
+    scheduleApplied = 0;
+
+    if (applied & SCHEDULE_APPLIED_FREQUENCY)
+    {
+        channel.setFrequencyHz(scheduleAppliedFrequencyHz);
+    }
+    if (applied & SCHEDULE_APPLIED_PHASE)
+    {
+        channel.setPhaseDegrees(scheduleAppliedPhase);
+    }
+    if (applied & SCHEDULE_APPLIED_OUTPUT)
+    {
+        channel.setOutputStatus((OUTPUT_STATUS_T) scheduleAppliedOutput);
+    }
+    ddsRelease(held);
+
+    return true;
+}
+
+void ScheduleClass::printStatus()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    uint8_t queued = scheduleCount;
+    uint32_t next = (SCHEDULE_ENABLED && queued) ? scheduleHeap[0].tick : tick;
+    uint16_t run = scheduleRun;
+    uint16_t late = scheduleLate;
+    int16_t minError = scheduleMinError;
+    int16_t maxError = scheduleMaxError;
+    int32_t totalError = scheduleTotalError;
+    uint16_t entryCycles = (scheduleEntryCycles == 0xFFFF) ? 0 : scheduleEntryCycles;
+    uint16_t frameCycles = scheduleFrameCycles;
+    SREG = oldSREG;
+
+    Serial.print(F("Schedule "));
+    Serial.print(queued);
+    Serial.print(F(" queued, next tick "));
+    Serial.print(next);
+    Serial.print(F(", clock "));
+    Serial.print(Clock.cycles());
+    Serial.print(F(", lead "));
+    Serial.print(entryCycles);
+    Serial.print(F(" + "));
+    Serial.print(frameCycles);
+    Serial.println(F(" per frame"));
+
+    // Cycles from the tick to chip select rising on the frame that made the change
+    Serial.println(F("run,late,min,avg,max"));
+    Serial.print(run);
+    Serial.write(',');
+    Serial.print(late);
+    Serial.write(',');
+    Serial.print(run ? minError : 0);
+    Serial.write(',');
+    Serial.print(run ? totalError / run : 0);
+    Serial.write(',');
+    Serial.println(run ? maxError : 0);
+}
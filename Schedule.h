@@ -0,0 +1,93 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Commands that take effect at a given Clock.cycles() tick rather than whenever loop() gets to them.
+ *
+ *  A host sends the tick first (ct#) and then the commands for it (cqf#, cqp#, cqo, cqO).  add() turns each into the
+ *  DDS words it needs and keeps it in a min-heap ordered by tick.  The Timer1 compare B interrupt is set up for the
+ *  earliest one, far enough ahead of its tick for the interrupt entry and the SPI frames, so chip select rises on the
+ *  frame that makes the change at the tick itself.  Both lead times are learned from the interrupts that ran, and
+ *  every command records its error from the tick.  Ticks more than half of Timer1 away are reached through
+ *  intermediate compares like a long hop dwell.
+ *
+ *  The interrupt only writes the DDS.  The main loop then hands the channel the new settings (service()), which also
+ *  moves the filter, checks the frequency and updates the prompt.  Amplitude (I2C) and waveform changes can not be
+ *  scheduled, and a waveform change drops everything queued.
+ *
+ *  Clock sync: cs prints the tick at which serialEvent() read the line end of cs itself.  The host sends it a few
+ *  times, keeps the exchanges with the shortest round trip and fits offset and drift of the two clocks, see
+ *  ChirpClockSync in host/client.  Ticks wrap every 268 s, a command can be queued up to half of that ahead.
+ *
+ *  Compare B is shared with hopping: hopping does not start while commands are queued, and any command stops it.
+ */
+#ifndef Schedule_h
+#define Schedule_h
+
+#include "Arduino.h"
+#include "OutputChannel.h"
+
+/// Set to 1 (or build with -DSCHEDULE_ENABLED=1) for scheduled commands.  Left out by default, the queue does not fit
+/// the Uno's SRAM next to the other engines (see Memory in the README).  add() then refuses every command, cs still
+/// answers.
+#ifndef SCHEDULE_ENABLED
+#define SCHEDULE_ENABLED 0
+#endif
+
+#define SCHEDULE_MAX_ENTRIES        8           ///< 13 bytes of SRAM each
+#define SCHEDULE_MIN_LEAD_US        1000        ///< how far ahead of its tick a command has to be queued
+#define SCHEDULE_LATE_CYCLES        160         ///< more than 10 us after the tick counts as late
+
+typedef enum
+{
+    SCHEDULE_ACTION_FREQUENCY = 0,
+    SCHEDULE_ACTION_PHASE,
+    SCHEDULE_ACTION_OUTPUT_ON,
+    SCHEDULE_ACTION_OUTPUT_OFF
+} SCHEDULE_ACTION_T;
+
+class ScheduleClass
+{
+  public:
+    ScheduleClass();
+
+    /// Tick of the commands queued after this, in Clock.cycles()
+    void setTick(uint32_t tick);
+    /// Tick a number of microseconds from now, for terminals
+    void setDelayUs(uint32_t delayUs);
+    /// Queues f#, p#, o or O for the tick.  @returns 0 on success, 1 if the command can not be scheduled, the tick
+    /// is less than SCHEDULE_MIN_LEAD_US ahead (or behind) or the queue is full.
+    uint8_t add(const char* command, OutputChannelClass& channel);
+    void clear();
+    uint8_t pending();
+
+    /// Called from every pass of the main loop, gives the channel what the interrupt wrote to the DDS.
+    /// @returns true if the channel changed
+    bool service(OutputChannelClass& channel);
+    void printStatus();
+
+  private:
+    uint32_t tick;
+};
+
+extern ScheduleClass Schedule;
+
+/// The compare B interrupt while no hop is running, entry is TCNT1 at its first instruction
+void scheduleCompareMatch(uint16_t entry);
+
+#endif
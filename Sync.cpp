@@ -0,0 +1,357 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <avr/interrupt.h>
+#include "Sync.h"
+#include "DDS.h"
+#include "Hop.h"
+#include "Schedule.h"
+#include "Trigger.h"
+#include "Debug.h"
+#define DEBUG_OUTPUT 0
+
+// Address bits of the registers, the channel is always in FREQ0 and PHASE0.  Writes of nothing staged go to FREQ1
+// and PHASE1, which the output does not use, so every commit takes the same frames.
+#define SYNC_FREQ0          0x4000
+#define SYNC_FREQ1          0x8000
+#define SYNC_PHASE1         0xE000
+
+// What is staged, and what the handler wrote to the DDS since the last service()
+#define SYNC_FREQUENCY      0x01
+#define SYNC_PHASE          0x02
+#define SYNC_OUTPUT         0x04
+
+SyncClass Sync;
+
+// Staged by the main loop with interrupts disabled, the handler sends control | restart, the three words and then
+// (control & keep) | set
+static volatile uint8_t syncStaged;
+static volatile uint16_t syncWords[3];
+static volatile uint16_t syncRestartBits;
+static volatile uint16_t syncKeepMask;
+static volatile uint16_t syncSetBits;
+static uint32_t syncStagedFrequencyHz;
+static uint16_t syncStagedPhase;
+static uint8_t syncStagedOutput;
+
+static volatile uint8_t syncApplied;
+static uint32_t syncAppliedFrequencyHz;
+static uint16_t syncAppliedPhase;
+static uint8_t syncAppliedOutput;
+
+// Instrumentation, written by the handler only
+static volatile uint16_t syncCommits;
+static volatile uint16_t syncIdleEdges;
+static volatile uint16_t syncMinCycles = 0xFFFF;
+static volatile uint16_t syncMaxCycles;
+static volatile uint32_t syncTotalCycles;
+
+/// With interrupts disabled
+static void syncUnstage()
+{
+    syncStaged = 0;
+    syncWords[0] = SYNC_FREQ1;
+    syncWords[1] = SYNC_FREQ1;
+    syncWords[2] = SYNC_PHASE1;
+    syncRestartBits = 0;
+    syncKeepMask = 0xFFFF;
+    syncSetBits = 0;
+}
+
+/** Pin change on port C, only the strobe is enabled in PCMSK1.  Everything from the first instruction to chip select
+ *  rising on the last frame takes the same path for every commit, on every board.
+ */
+ISR(PCINT1_vect)
+{
+    uint16_t entry = TCNT1;
+
+    if (PINC & _BV(PC1))
+    {
+        // The strobe going back up
+        return;
+    }
+
+    uint8_t staged = syncStaged;
+    if (staged == 0)
+    {
+        syncIdleEdges++;
+        return;
+    }
+
+    uint16_t control = DDS.getControlRegister();
+    DDS.writeControlFromInterrupt(control | syncRestartBits);
+    DDS.writeFromInterrupt(syncWords[0]);
+    DDS.writeFromInterrupt(syncWords[1]);
+    DDS.writeFromInterrupt(syncWords[2]);
+    DDS.writeControlFromInterrupt((control & syncKeepMask) | syncSetBits);
+
+    uint16_t latency = TCNT1 - entry;
+
+    syncAppliedFrequencyHz = syncStagedFrequencyHz;
+    syncAppliedPhase = syncStagedPhase;
+    syncAppliedOutput = syncStagedOutput;
+    syncApplied |= staged;
+    syncUnstage();
+
+    syncCommits++;
+    syncTotalCycles += latency;
+    if (latency < syncMinCycles) syncMinCycles = latency;
+    if (latency > syncMaxCycles) syncMaxCycles = latency;
+}
+
+SyncClass::SyncClass()
+{
+    role = SYNC_ROLE_OFF;
+    group = 1;
+    address = 0;
+    syncUnstage();
+}
+
+void SyncClass::init()
+{
+    pinMode(SYNC_STROBE_PIN, INPUT_PULLUP);
+    PCMSK1 = 0;
+    PCIFR = _BV(PCIF1);
+    PCICR |= _BV(PCIE1);
+}
+
+uint8_t SyncClass::setRole(SYNC_ROLE_T newRole)
+{
+    if (newRole >= SYNC_ROLE_COUNT)
+    {
+        return 1;
+    }
+
+    role = newRole;
+
+    if (role == SYNC_ROLE_OFF)
+    {
+        PCMSK1 &= ~_BV(PCINT9);
+        drop();
+    }
+    else if (!(PCMSK1 & _BV(PCINT9)))
+    {
+        // Discard a change that happened while off
+        PCIFR = _BV(PCIF1);
+        PCMSK1 |= _BV(PCINT9);
+    }
+
+    return 0;
+}
+
+SYNC_ROLE_T SyncClass::getRole()
+{
+    return role;
+}
+
+uint8_t SyncClass::setGroup(uint8_t newGroup)
+{
+    if ((newGroup == 0) || (newGroup > SYNC_MAX_GROUP))
+    {
+        return 1;
+    }
+
+    group = newGroup;
+    return 0;
+}
+
+uint8_t SyncClass::setAddress(uint8_t newAddress)
+{
+    if (newAddress > SYNC_MAX_GROUP)
+    {
+        return 1;
+    }
+
+    address = newAddress;
+    return 0;
+}
+
+uint8_t SyncClass::stage(const char* command, OutputChannelClass& channel)
+{
+    uint32_t value = strtoul(&command[1], NULL, 10);
+
+    if (role == SYNC_ROLE_OFF)
+    {
+        return 1;
+    }
+
+    // The AWG and the pulses are not started from an interrupt, and the others write the DDS from their own
+    if ((channel.getWaveformType() >= WAVEFORM_ARBITRARY) || Hop.isRunning() || Schedule.pending() ||
+        Trigger.isArmed())
+    {
+        return 1;
+    }
+
+    if ((address != 0) && (address != group))
+    {
+        return 0;
+    }
+
+    uint8_t oldSREG = SREG;
+
+    switch (command[0])
+    {
+        case 'f':
+        {
+            if (value > 8000000)
+            {
+                return 1;
+            }
+            uint32_t word = DDSClass::tuningWord(value);
+            cli();
+            syncWords[0] = (uint16_t) (word & 0x3FFF) | SYNC_FREQ0;
+            syncWords[1] = (uint16_t) ((word >> 14) & 0x3FFF) | SYNC_FREQ0;
+            syncStagedFrequencyHz = value;
+            syncStaged |= SYNC_FREQUENCY;
+        }
+        break;
+        case 'p':
+            if (value > 360)
+            {
+                return 1;
+            }
+            cli();
+            syncWords[2] = DDSClass::phaseWord((uint16_t) value);
+            syncStagedPhase = (uint16_t) value;
+            syncStaged |= SYNC_PHASE;
+        break;
+        case 'O':
+            // RESET on the first frame and off on the last, every output restarts from phase zero together
+            cli();
+            syncRestartBits = DDS_CONTROL_RESET;
+            syncKeepMask = ~DDS_CONTROL_POWER;
+            syncSetBits = 0;
+            syncStagedOutput = ON;
+            syncStaged |= SYNC_OUTPUT;
+        break;
+        case 'o':
+            cli();
+            syncRestartBits = 0;
+            syncKeepMask = ~DDS_CONTROL_POWER;
+            syncSetBits = DDS.getOffBits();
+            syncStagedOutput = OFF;
+            syncStaged |= SYNC_OUTPUT;
+        break;
+        default:
+            return 1;
+    }
+    SREG = oldSREG;
+
+    DEBUGLN(F("Command staged"));
+    return 0;
+}
+
+void SyncClass::drop()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    syncUnstage();
+    SREG = oldSREG;
+}
+
+bool SyncClass::pending()
+{
+    return syncStaged != 0;
+}
+
+uint8_t SyncClass::commit()
+{
+    if (role != SYNC_ROLE_MASTER)
+    {
+        return 1;
+    }
+
+    // Open collector: the pull-up off and then driven low, the pin change interrupt of this board commits it too
+    PORTC &= ~_BV(PC1);
+    DDRC |= _BV(PC1);
+    delayMicroseconds(SYNC_STROBE_US);
+    DDRC &= ~_BV(PC1);
+    PORTC |= _BV(PC1);
+
+    return 0;
+}
+
+bool SyncClass::service(OutputChannelClass& channel)
+{
+    if (syncApplied == 0)
+    {
+        return false;
+    }
+
+    // The channel writes the settings the DDS already has, held so a commit does not land in between
+    uint8_t held = ddsHold();
+    uint8_t applied = syncApplied;
+    syncApplied = 0;
+
+    if (applied & SYNC_FREQUENCY)
+    {
+        channel.setFrequencyHz(syncAppliedFrequencyHz);
+    }
+    if (applied & SYNC_PHASE)
+    {
+        channel.setPhaseDegrees(syncAppliedPhase);
+    }
+    if (applied & SYNC_OUTPUT)
+    {
+        channel.setOutputStatus((OUTPUT_STATUS_T) syncAppliedOutput);
+    }
+    ddsRelease(held);
+
+    return true;
+}
+
+void SyncClass::printStatus()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    uint8_t staged = syncStaged;
+    uint8_t output = syncStagedOutput;
+    uint16_t commits = syncCommits;
+    uint16_t idleEdges = syncIdleEdges;
+    uint16_t minCycles = syncMinCycles;
+    uint16_t maxCycles = syncMaxCycles;
+    uint32_t totalCycles = syncTotalCycles;
+    SREG = oldSREG;
+
+    Serial.print(F("Sync "));
+    if (role == SYNC_ROLE_MASTER) Serial.print(F("master"));
+    else if (role == SYNC_ROLE_SLAVE) Serial.print(F("slave"));
+    else Serial.print(F("off"));
+    Serial.print(F(", group "));
+    Serial.print(group);
+    Serial.print(F(", address "));
+    Serial.print(address);
+    Serial.print(F(", staged "));
+    if (staged & SYNC_FREQUENCY) Serial.write('f');
+    if (staged & SYNC_PHASE) Serial.write('p');
+    if (staged & SYNC_OUTPUT) Serial.write(output ? 'O' : 'o');
+    if (staged == 0) Serial.print(F("none"));
+    Serial.println();
+
+    // Cycles from the strobe to chip select rising on the last frame, the entry part is the fixed estimate
+    Serial.println(F("commits,idle,min,avg,max"));
+    Serial.print(commits);
+    Serial.write(',');
+    Serial.print(idleEdges);
+    Serial.write(',');
+    Serial.print(commits ? minCycles + SYNC_ENTRY_CYCLES : 0);
+    Serial.write(',');
+    Serial.print(commits ? totalCycles / commits + SYNC_ENTRY_CYCLES : 0);
+    Serial.write(',');
+    Serial.println(commits ? maxCycles + SYNC_ENTRY_CYCLES : 0);
+}
@@ -0,0 +1,99 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Several boards that start and retune together on a shared commit strobe.
+ *
+ *  The strobe is pin A1 of every board wired together, idle high through the pull-ups, with a common ground.  The
+ *  master pulls it low for SYNC_STROBE_US (yc), slaves only listen; a commit can also come from any open collector
+ *  output.  Each board stages its changes first (yf#, yp#, yo, yO), nothing reaches the DDS until the falling edge.
+ *  Its pin change interrupt then writes the same five frames on every board, whatever was staged:
+ *
+ *    control     RESET set when the output is staged on, the current control word otherwise
+ *    FREQ0       LSB and MSB of the staged frequency, or the same writes to the unused FREQ1
+ *    PHASE0      the staged phase, or PHASE1
+ *    control     RESET released (output on), the off bits set (output off), or the current control word
+ *
+ *  so every change lands the same number of cycles after the edge on every board and a staged O restarts all phase
+ *  accumulators on the same frame.  The master commits through its own pin change interrupt, the same path as the
+ *  slaves.  What is left between boards is the interrupt response, up to the longest handler another interrupt is
+ *  in (Timer0 and the serial port, a few us), and a DDS write of the main loop, which holds the strobe off for its
+ *  frame: stage everything, then commit while the boards are idle.
+ *
+ *  Phase coherence after the start also needs one MCLK: the DDS modules of all boards have to run from the same
+ *  oscillator, wired to their MCLK inputs.  With an oscillator each the outputs start together and then drift apart
+ *  by the difference of the oscillators.
+ *
+ *  Group addressing is for hosts that send the same lines to every board: yg# puts a board in a group and ya# makes
+ *  the staging commands after it apply only to that group, ya0 to every board.
+ */
+#ifndef Sync_h
+#define Sync_h
+
+#include "Arduino.h"
+#include "OutputChannel.h"
+
+#define SYNC_STROBE_PIN     A1
+#define SYNC_STROBE_US      200     ///< longer than the longest handler, the hop interrupt, so no slave misses the edge
+#define SYNC_MAX_GROUP      15
+#define SYNC_ENTRY_CYCLES   14      ///< synchronizer, interrupt response, vector jump and the start of the prologue
+
+typedef enum
+{
+    SYNC_ROLE_OFF = 0,
+    SYNC_ROLE_SLAVE,
+    SYNC_ROLE_MASTER,
+    SYNC_ROLE_COUNT
+} SYNC_ROLE_T;
+
+class SyncClass
+{
+  public:
+    SyncClass();
+    void init();
+
+    /// Off drops what is staged and ignores the strobe
+    uint8_t setRole(SYNC_ROLE_T newRole);
+    SYNC_ROLE_T getRole();
+    uint8_t setGroup(uint8_t newGroup);
+    /// Group the staging commands after this are for, 0 for every board
+    uint8_t setAddress(uint8_t newAddress);
+
+    /// Stages f#, p#, o or O for the next strobe.  A command for another group is accepted and ignored.
+    /// @returns 0 on success, 1 if the command can not be staged, the board is off or another interrupt owns the DDS
+    uint8_t stage(const char* command, OutputChannelClass& channel);
+    void drop();
+    /// @returns true while something waits for the strobe
+    bool pending();
+    /// Pulses the strobe, on the master only
+    uint8_t commit();
+
+    /// Called from every pass of the main loop, gives the channel what the interrupt wrote to the DDS.
+    /// @returns true if the channel changed
+    bool service(OutputChannelClass& channel);
+    void printStatus();
+
+  private:
+    SYNC_ROLE_T role;
+    uint8_t group;
+    uint8_t address;
+};
+
+extern SyncClass Sync;
+
+#endif
@@ -0,0 +1,199 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Drained frame format (all multi-byte values little endian)
+ *  -Sync byte TRACE_FRAME_SYNC
+ *  -Record count (1 byte)
+ *  -Number of records dropped because the buffer was full since the last frame (2 bytes)
+ *  -Time of the drain in microseconds (4 bytes, wraps with the Timer1 cycle counter every 2^28 us)
+ *  -Records, 6 bytes each: event, arg (2 bytes), timestamp in microseconds (3 bytes)
+ *  -XOR of every byte after the sync byte
+ */
+
+#include "Trace.h"
+#include "Clock.h"
+
+#define TRACE_FRAME_OVERHEAD  9    // Sync, count, dropped, time and checksum
+
+TraceClass Trace;
+
+TraceClass::TraceClass()
+{
+    enabledCategories = 0;
+    head = 0;
+    tail = 0;
+    droppedRecords = 0;
+    idleDrain = false;
+    drainRequested = false;
+}
+
+TraceClass::~TraceClass()
+{
+}
+
+void TraceClass::setCategories(uint8_t categories)
+{
+    enabledCategories = categories;
+}
+
+uint8_t TraceClass::getCategories(void)
+{
+    return enabledCategories;
+}
+
+void TraceClass::setIdleDrain(boolean enabled)
+{
+    idleDrain = enabled;
+}
+
+boolean TraceClass::getIdleDrain(void)
+{
+    return idleDrain;
+}
+
+/** @brief Adds an event to the ring buffer, safe to call from interrupts
+ *
+ *  @details Use the TRACE() macro instead so disabled categories only cost a load and a branch.  When the buffer is
+ *  full the new record is dropped and counted rather than blocking.
+ */
+void TraceClass::record(uint8_t event, uint16_t arg)
+{
+    uint32_t timeUs = Clock.cycles() / (F_CPU / 1000000UL);
+
+    uint8_t oldSREG = SREG;
+    cli();
+
+    uint8_t next = (head + 1) & (TRACE_BUFFER_SIZE - 1);
+
+    if (next == tail)
+    {
+        if (droppedRecords < 0xFFFF)
+        {
+            droppedRecords++;
+        }
+    }
+    else
+    {
+        TRACE_RECORD_T* pRecord = &buffer[head];
+        pRecord->event = event;
+        pRecord->arg = arg;
+        pRecord->timeUs[0] = (uint8_t) timeUs;
+        pRecord->timeUs[1] = (uint8_t) (timeUs >> 8);
+        pRecord->timeUs[2] = (uint8_t) (timeUs >> 16);
+        head = next;
+    }
+
+    SREG = oldSREG;
+}
+
+uint8_t TraceClass::pending(void)
+{
+    return (head - tail) & (TRACE_BUFFER_SIZE - 1);
+}
+
+/** @brief Writes up to maxRecords of the oldest records to the serial port as a single frame, never more than the TX
+ *  buffer takes without blocking
+ *  @returns false if nothing was written, the TX buffer has no room for the frame or for any of the pending records
+ */
+bool TraceClass::drain(uint8_t maxRecords)
+{
+    uint8_t count = pending();
+    uint8_t checksum = 0;
+    uint16_t dropped;
+    uint32_t timeUs = Clock.cycles() / (F_CPU / 1000000UL);
+    int space = Serial.availableForWrite() - TRACE_FRAME_OVERHEAD;
+
+    if (space < 0)
+    {
+        return false;
+    }
+    if (count > maxRecords)
+    {
+        count = maxRecords;
+    }
+    if (count > space / (int) sizeof(TRACE_RECORD_T))
+    {
+        // Wait for room for a record rather than sending empty frames
+        if (space < (int) sizeof(TRACE_RECORD_T))
+        {
+            return false;
+        }
+        count = space / sizeof(TRACE_RECORD_T);
+    }
+
+    uint8_t oldSREG = SREG;
+    cli();
+    dropped = droppedRecords;
+    droppedRecords = 0;
+    SREG = oldSREG;
+
+    uint8_t header[] =
+    {
+        count,
+        (uint8_t) dropped,
+        (uint8_t) (dropped >> 8),
+        (uint8_t) timeUs,
+        (uint8_t) (timeUs >> 8),
+        (uint8_t) (timeUs >> 16),
+        (uint8_t) (timeUs >> 24)
+    };
+
+    Serial.write(TRACE_FRAME_SYNC);
+
+    for (uint8_t i = 0; i < sizeof(header); i++)
+    {
+        checksum ^= header[i];
+        Serial.write(header[i]);
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        // Records are only consumed here, the producer never touches buffer[tail]
+        const uint8_t* pBytes = (const uint8_t*) &buffer[tail];
+
+        for (uint8_t j = 0; j < sizeof(TRACE_RECORD_T); j++)
+        {
+            checksum ^= pBytes[j];
+            Serial.write(pBytes[j]);
+        }
+
+        tail = (tail + 1) & (TRACE_BUFFER_SIZE - 1);
+    }
+
+    Serial.write(checksum);
+    return true;
+}
+
+/// @brief Drains everything recorded from idle(), after the prompt and as fast as the TX buffer empties
+void TraceClass::requestDrain(void)
+{
+    drainRequested = true;
+}
+
+/// @brief Called from loop() when no command is being processed, drains only what fits in the TX buffer without blocking
+void TraceClass::idle(void)
+{
+    if (drainRequested || (idleDrain && (pending() || droppedRecords)))
+    {
+        if (drain(TRACE_BUFFER_SIZE) && (pending() == 0))
+        {
+            drainRequested = false;
+        }
+    }
+}
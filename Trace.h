@@ -0,0 +1,113 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#ifndef Trace_h
+#define Trace_h
+
+#include "Arduino.h"
+
+/// Set to 0 to compile all TRACE() calls out of the firmware
+#define TRACE_ENABLED 1
+
+/// Number of records held in RAM (6 bytes each), must be a power of 2
+#define TRACE_BUFFER_SIZE  16
+
+/// Marks the start of a drained frame on the serial port, never sent as part of the ASCII interface
+#define TRACE_FRAME_SYNC   0xA5
+
+/// @brief Categories that can be enabled at runtime, one bit each
+typedef enum
+{
+    TRACE_CATEGORY_DDS       = 0x01,
+    TRACE_CATEGORY_AMPLIFIER = 0x02,
+    TRACE_CATEGORY_CHANNEL   = 0x04,
+    TRACE_CATEGORY_COMMAND   = 0x08,
+    TRACE_CATEGORY_FILTER    = 0x10,
+    TRACE_CATEGORY_ALL       = 0xFF
+} TRACE_CATEGORY_T;
+
+/// @brief Event identifiers, decoded on the host by host/chirp_trace.py which reads this enum
+typedef enum
+{
+    TRACE_EVENT_DDS_RESET = 0,
+    TRACE_EVENT_DDS_FREQUENCY_LSB,      ///< arg: LSB word written to FREQ0
+    TRACE_EVENT_DDS_FREQUENCY_MSB,      ///< arg: MSB word written to FREQ0
+    TRACE_EVENT_DDS_PHASE,              ///< arg: word written to PHASE0
+    TRACE_EVENT_DDS_MODE,               ///< arg: WAVEFORM_T
+    TRACE_EVENT_DDS_OUTPUT,             ///< arg: ddsOutput_t
+    TRACE_EVENT_AMPLIFIER_SET,          ///< arg: requested mV RMS
+    TRACE_EVENT_AMPLIFIER_R0_TAPS,      ///< arg: R0 wiper value
+    TRACE_EVENT_AMPLIFIER_R1_TAPS,      ///< arg: R1 wiper value
+    TRACE_EVENT_AMPLIFIER_LIMIT,        ///< arg: wiper value that was clamped
+    TRACE_EVENT_AMPLIFIER_INVALID,      ///< arg: memory address or command that was rejected
+    TRACE_EVENT_CHANNEL_FREQUENCY,      ///< arg: frequency in Hz / 256
+    TRACE_EVENT_CHANNEL_AMPLITUDE,      ///< arg: amplitude in mV
+    TRACE_EVENT_CHANNEL_PHASE,          ///< arg: phase in degrees
+    TRACE_EVENT_CHANNEL_WAVEFORM,       ///< arg: WAVEFORM_T
+    TRACE_EVENT_CHANNEL_OUTPUT,         ///< arg: OUTPUT_STATUS_T
+    TRACE_EVENT_CHANNEL_RANGE_ERROR,    ///< arg: rejected value (truncated to 16 bits)
+    TRACE_EVENT_COMMAND,                ///< arg: first character of the command | menu state << 8
+    TRACE_EVENT_FILTER,                 ///< arg: 1 if the filter was enabled
+    TRACE_EVENT_AMPLIFIER_BUS_ERROR,    ///< arg: Wire status of the failed attempt, 6 for a short read
+    TRACE_EVENT_COUNT
+} TRACE_EVENT_T;
+
+/// @brief One trace entry, the timestamp is in microseconds and wraps every 16.7 seconds
+typedef struct __attribute__ ((packed))
+{
+    uint8_t event;
+    uint16_t arg;
+    uint8_t timeUs[3];
+} TRACE_RECORD_T;
+
+/// @brief Records events into a RAM ring buffer and writes them out as binary frames on request
+class TraceClass
+{
+  public:
+    TraceClass();
+    ~TraceClass();
+    void setCategories(uint8_t categories);
+    uint8_t getCategories(void);
+    void setIdleDrain(boolean enabled);
+    boolean getIdleDrain(void);
+    void record(uint8_t event, uint16_t arg);
+    uint8_t pending(void);
+    bool drain(uint8_t maxRecords);
+    void requestDrain(void);
+    void idle(void);
+
+    volatile uint8_t enabledCategories;   //!< public so TRACE() can test it inline before calling record()
+  private:
+    TRACE_RECORD_T buffer[TRACE_BUFFER_SIZE];
+    volatile uint8_t head;
+    volatile uint8_t tail;
+    volatile uint16_t droppedRecords;
+    boolean idleDrain;
+    boolean drainRequested;
+};
+
+extern TraceClass Trace;
+
+#if TRACE_ENABLED
+#define TRACE(category, event, arg)  \
+      do { if (Trace.enabledCategories & (category)) Trace.record((event), (arg)); } while (0)
+#else
+#define TRACE(category, event, arg)  do {} while (0)
+#endif // TRACE_ENABLED
+
+#endif
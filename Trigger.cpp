@@ -0,0 +1,307 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <avr/interrupt.h>
+#include "Trigger.h"
+#include "DDS.h"
+#include "AWG.h"
+#include "Pulse.h"
+#include "Clock.h"
+#include "Sync.h"
+#include "Debug.h"
+#define DEBUG_OUTPUT 0
+
+TriggerClass Trigger;
+
+// Precomputed by arm(), the handler sends (control register & keep) ^ flip
+static volatile uint16_t triggerKeepMask;
+static volatile uint16_t triggerFlipMask;
+static volatile bool triggerRising;
+static volatile bool triggerSingleShot;
+static volatile uint32_t triggerHoldoffCycles;
+
+// Instrumentation, written by the handler only
+static volatile uint32_t triggerLastFire;
+static volatile uint16_t triggerFires;
+static volatile uint16_t triggerIgnored;
+static volatile uint16_t triggerMinCycles;
+static volatile uint16_t triggerMaxCycles;
+static volatile uint32_t triggerTotalCycles;
+static uint16_t triggerStepOverruns;
+
+/** Pin change on port D, only the trigger pin is enabled in PCMSK2.  Everything from the first instruction to chip
+ *  select rising takes the same path for every accepted edge.
+ */
+ISR(PCINT2_vect)
+{
+    uint16_t entry = TCNT1;
+
+    if (((PIND & _BV(PD4)) != 0) != triggerRising)
+    {
+        // The other edge
+        return;
+    }
+
+    uint32_t now = Clock.extend(entry);
+
+    if (triggerFires && (now - triggerLastFire < triggerHoldoffCycles))
+    {
+        triggerIgnored++;
+        return;
+    }
+
+    DDS.writeControlFromInterrupt((DDS.getControlRegister() & triggerKeepMask) ^ triggerFlipMask);
+
+    uint16_t latency = TCNT1 - entry;
+
+    if (triggerSingleShot)
+    {
+        PCMSK2 &= ~_BV(PCINT20);
+    }
+
+    triggerLastFire = now;
+    triggerFires++;
+    triggerTotalCycles += latency;
+    if (latency < triggerMinCycles) triggerMinCycles = latency;
+    if (latency > triggerMaxCycles) triggerMaxCycles = latency;
+}
+
+TriggerClass::TriggerClass()
+{
+    action = TRIGGER_ACTION_OUTPUT_ON;
+    edge = TRIGGER_EDGE_RISING;
+    holdoffUs = 0;
+    alternateFrequencyHz = 0;
+    stepCount = 0;
+    nextStep = 0;
+    servicedFires = 0;
+}
+
+void TriggerClass::init()
+{
+    pinMode(TRIGGER_INPUT_PIN, INPUT_PULLUP);
+    PCMSK2 = 0;
+    PCIFR = _BV(PCIF2);
+    PCICR |= _BV(PCIE2);
+}
+
+uint8_t TriggerClass::setAction(TRIGGER_ACTION_T newAction)
+{
+    if ((newAction >= TRIGGER_ACTION_COUNT) || isArmed())
+    {
+        return 1;
+    }
+
+    action = newAction;
+    return 0;
+}
+
+TRIGGER_ACTION_T TriggerClass::getAction()
+{
+    return action;
+}
+
+uint8_t TriggerClass::setEdge(TRIGGER_EDGE_T newEdge)
+{
+    if ((newEdge > TRIGGER_EDGE_RISING) || isArmed())
+    {
+        return 1;
+    }
+
+    edge = newEdge;
+    return 0;
+}
+
+TRIGGER_EDGE_T TriggerClass::getEdge()
+{
+    return edge;
+}
+
+uint8_t TriggerClass::setHoldoffUs(uint32_t newHoldoffUs)
+{
+    if ((newHoldoffUs > TRIGGER_MAX_HOLDOFF_US) || isArmed())
+    {
+        return 1;
+    }
+
+    holdoffUs = newHoldoffUs;
+    return 0;
+}
+
+uint32_t TriggerClass::getHoldoffUs()
+{
+    return holdoffUs;
+}
+
+void TriggerClass::setAlternateFrequency(uint32_t frequencyHz)
+{
+    alternateFrequencyHz = frequencyHz;
+}
+
+uint8_t TriggerClass::addStep(uint32_t frequencyHz)
+{
+    if ((stepCount >= TRIGGER_MAX_STEPS) || isArmed())
+    {
+        return 1;
+    }
+
+    steps[stepCount++] = frequencyHz;
+    return 0;
+}
+
+void TriggerClass::clearSteps()
+{
+    if (!isArmed())
+    {
+        stepCount = 0;
+    }
+}
+
+uint8_t TriggerClass::arm(bool singleShot)
+{
+    // The AWG and the pulses hold the DDS in reset, a commit writes FREQ1 and a step sequence needs somewhere to go
+    if (AWG.isRunning() || Pulse.isRunning() || Sync.pending() || ((action == TRIGGER_ACTION_STEP) && (stepCount < 2)))
+    {
+        return 1;
+    }
+
+    disarm();
+
+    switch (action)
+    {
+        case TRIGGER_ACTION_OUTPUT_ON:
+            triggerKeepMask = ~DDS_CONTROL_POWER;
+            triggerFlipMask = 0;
+        break;
+        case TRIGGER_ACTION_OUTPUT_OFF:
+            // Off the way setOutput() does it, with the sleep bits of the power mode
+            triggerKeepMask = ~DDS_CONTROL_POWER;
+            triggerFlipMask = DDS.getOffBits();
+        break;
+        case TRIGGER_ACTION_FSEL:
+            DDS.sendFrequency(alternateFrequencyHz, 1);
+            triggerKeepMask = 0xFFFF;
+            triggerFlipMask = DDS_CONTROL_FSEL;
+        break;
+        case TRIGGER_ACTION_STEP:
+            DDS.sendFrequency(steps[0], 0);
+            DDS.sendFrequency(steps[1], 1);
+            nextStep = 2 % stepCount;
+            triggerKeepMask = 0xFFFF;
+            triggerFlipMask = DDS_CONTROL_FSEL;
+        break;
+        default:
+        break;
+    }
+
+    triggerRising = (edge == TRIGGER_EDGE_RISING);
+    triggerSingleShot = singleShot;
+    triggerHoldoffCycles = holdoffUs * (F_CPU / 1000000UL);
+    triggerFires = 0;
+    triggerIgnored = 0;
+    triggerMinCycles = 0xFFFF;
+    triggerMaxCycles = 0;
+    triggerTotalCycles = 0;
+    triggerStepOverruns = 0;
+    servicedFires = 0;
+
+    // Discard a change that happened while disarmed
+    PCIFR = _BV(PCIF2);
+    PCMSK2 |= _BV(PCINT20);
+
+    DEBUGLN(F("Trigger armed"));
+    return 0;
+}
+
+/// @brief Stops reacting to the input, FREQ0 is selected again
+void TriggerClass::disarm()
+{
+    PCMSK2 &= ~_BV(PCINT20);
+    DDS.selectFrequencyRegister(0);
+}
+
+bool TriggerClass::isArmed()
+{
+    return (PCMSK2 & _BV(PCINT20)) != 0;
+}
+
+void TriggerClass::service()
+{
+    if ((action != TRIGGER_ACTION_STEP) || !isArmed())
+    {
+        return;
+    }
+
+    uint8_t oldSREG = SREG;
+    cli();
+    uint16_t fires = triggerFires;
+    SREG = oldSREG;
+
+    if (fires == servicedFires)
+    {
+        return;
+    }
+
+    if ((uint16_t) (fires - servicedFires) > 1)
+    {
+        // Triggers came faster than the main loop, the output repeated an old step
+        triggerStepOverruns += fires - servicedFires - 1;
+    }
+
+    // Load the register the output just left, with no trigger in between the check and the write
+    uint8_t held = ddsHold();
+    uint8_t idleRegister = (DDS.getControlRegister() & DDS_CONTROL_FSEL) ? 0 : 1;
+    DDS.sendFrequency(steps[nextStep], idleRegister);
+    ddsRelease(held);
+
+    nextStep = (nextStep + 1) % stepCount;
+    servicedFires = fires;
+}
+
+void TriggerClass::printStatus()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    uint16_t fires = triggerFires;
+    uint16_t ignored = triggerIgnored;
+    uint16_t minCycles = triggerMinCycles;
+    uint16_t maxCycles = triggerMaxCycles;
+    uint32_t totalCycles = triggerTotalCycles;
+    SREG = oldSREG;
+
+    isArmed() ? Serial.print(F("Trigger armed, action ")) : Serial.print(F("Trigger disarmed, action "));
+    Serial.print(action);
+    (edge == TRIGGER_EDGE_RISING) ? Serial.print(F(", rising, holdoff ")) : Serial.print(F(", falling, holdoff "));
+    Serial.print(holdoffUs);
+    Serial.print(F(" us, steps "));
+    Serial.println(stepCount);
+
+    // Cycles from the pin to chip select rising, the entry part is the fixed estimate
+    Serial.println(F("fires,ignored,overruns,min,avg,max"));
+    Serial.print(fires);
+    Serial.write(',');
+    Serial.print(ignored);
+    Serial.write(',');
+    Serial.print(triggerStepOverruns);
+    Serial.write(',');
+    Serial.print(fires ? minCycles + TRIGGER_ENTRY_CYCLES : 0);
+    Serial.write(',');
+    Serial.print(fires ? totalCycles / fires + TRIGGER_ENTRY_CYCLES : 0);
+    Serial.write(',');
+    Serial.println(fires ? maxCycles + TRIGGER_ENTRY_CYCLES : 0);
+}
@@ -0,0 +1,103 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** External trigger input that changes the DDS output straight from its interrupt.
+ *
+ *  INT0 (pin 2) drives the filter mux and INT1 (pin 3) is the AWG output, so the trigger is the pin change interrupt
+ *  of pin 4.  The handler reads the pin to keep only the selected edge (pulses must be longer than about 2 us), checks
+ *  the holdoff and writes a single DDS control word with direct register access, so every trigger costs the same
+ *  number of cycles.  Each action is one control word:
+ *
+ *    output on/off   clears or sets RESET (and the sleep bits of the DDS power mode), the phase accumulator
+ *                    restarts from zero on every on
+ *    FSEL flip       toggles between FREQ0 (the channel frequency) and FREQ1 (the alternate frequency)
+ *    step            flips FSEL too, the main loop then loads the step after next into the register just left
+ *
+ *  DDS writes from the main loop hold the trigger off for the length of their frame, an edge in that time is latched
+ *  and handled right after.  Latency is measured from the first instruction of the handler to chip select rising,
+ *  the interrupt response before that is a fixed TRIGGER_ENTRY_CYCLES plus whatever other handler is running
+ *  (Timer0, serial, both well under 10 us).  While armed the DDS follows the trigger and the channel settings shown
+ *  in the prompt are restored on disarm.
+ */
+#ifndef Trigger_h
+#define Trigger_h
+
+#include "Arduino.h"
+
+#define TRIGGER_INPUT_PIN       4
+#define TRIGGER_MAX_STEPS       8
+#define TRIGGER_MAX_HOLDOFF_US  1000000
+#define TRIGGER_ENTRY_CYCLES    14      ///< synchronizer, interrupt response, vector jump and the start of the prologue
+
+typedef enum
+{
+    TRIGGER_ACTION_OUTPUT_ON = 0,
+    TRIGGER_ACTION_OUTPUT_OFF,
+    TRIGGER_ACTION_FSEL,
+    TRIGGER_ACTION_STEP,
+    TRIGGER_ACTION_COUNT
+} TRIGGER_ACTION_T;
+
+typedef enum
+{
+    TRIGGER_EDGE_FALLING = 0,
+    TRIGGER_EDGE_RISING
+} TRIGGER_EDGE_T;
+
+class TriggerClass
+{
+  public:
+    TriggerClass();
+    void init();
+
+    uint8_t setAction(TRIGGER_ACTION_T newAction);
+    TRIGGER_ACTION_T getAction();
+    uint8_t setEdge(TRIGGER_EDGE_T newEdge);
+    TRIGGER_EDGE_T getEdge();
+    uint8_t setHoldoffUs(uint32_t newHoldoffUs);
+    uint32_t getHoldoffUs();
+    /// FREQ1 for the FSEL action
+    void setAlternateFrequency(uint32_t frequencyHz);
+    uint8_t addStep(uint32_t frequencyHz);
+    void clearSteps();
+
+    /// @param singleShot disarm after the first trigger
+    uint8_t arm(bool singleShot);
+    /// Leaves FREQ0 selected, the caller restores the channel output
+    void disarm();
+    bool isArmed();
+
+    /// Called from every pass of the main loop, loads the next step after a step trigger
+    void service();
+    void printStatus();
+
+  private:
+    TRIGGER_ACTION_T action;
+    TRIGGER_EDGE_T edge;
+    uint32_t holdoffUs;
+    uint32_t alternateFrequencyHz;
+    uint32_t steps[TRIGGER_MAX_STEPS];
+    uint8_t stepCount;
+    uint8_t nextStep;
+    uint16_t servicedFires;
+};
+
+extern TriggerClass Trigger;
+
+#endif
@@ -0,0 +1,153 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <stddef.h>
+#include <avr/interrupt.h>
+#include <avr/wdt.h>
+#include "Watchdog.h"
+#include "Debug.h"
+#define DEBUG_OUTPUT 0
+
+#define WATCHDOG_TIMEOUT  WDTO_1S      ///< the longest pass of the main loop, the help menu at 57600 baud, is 180 ms
+#define WATCHDOG_FIRED    0xA5
+
+/// @brief Channel settings kept across a watchdog reset
+typedef struct
+{
+    uint32_t frequencyHz;
+    uint16_t amplitudeMV;
+    uint16_t phaseDegrees;
+    uint8_t waveform;
+    uint8_t outputStatus;
+    uint8_t restores;       ///< watchdog resets since a command last completed
+    uint16_t resets;        ///< watchdog resets since power up
+    uint16_t checksum;
+} WATCHDOG_STATE_T;
+
+WatchdogClass Watchdog;
+
+// Not cleared by the startup code, only power up leaves them random
+static WATCHDOG_STATE_T watchdogState __attribute__((section(".noinit")));
+static volatile uint8_t watchdogFired __attribute__((section(".noinit")));
+
+static uint16_t watchdogChecksum()
+{
+    const uint8_t* bytes = (const uint8_t*) &watchdogState;
+    uint16_t sum = 0x5A5A;
+
+    for (uint8_t i = 0; i < offsetof(WATCHDOG_STATE_T, checksum); i++)
+    {
+        sum = (sum << 1 | sum >> 15) ^ bytes[i];
+    }
+
+    return sum;
+}
+
+/// First time-out, the hardware clears WDIE and the next one resets
+ISR(WDT_vect)
+{
+    watchdogFired = WATCHDOG_FIRED;
+}
+
+WatchdogClass::WatchdogClass()
+{
+    watchdogReset = false;
+}
+
+void WatchdogClass::init()
+{
+    // The watchdog stays on through the reset it caused, with its shortest time-out
+    MCUSR = 0;
+    wdt_disable();
+
+    bool stateValid = (watchdogState.checksum == watchdogChecksum());
+
+    watchdogReset = (watchdogFired == WATCHDOG_FIRED) && stateValid;
+    watchdogFired = 0;
+
+    if (!stateValid)
+    {
+        // Power up
+        memset(&watchdogState, 0, sizeof(watchdogState));
+        watchdogState.checksum = watchdogChecksum();
+    }
+}
+
+void WatchdogClass::start()
+{
+    wdt_enable(WATCHDOG_TIMEOUT);
+    WDTCSR |= _BV(WDIE);
+}
+
+void WatchdogClass::kick()
+{
+    wdt_reset();
+    // A pass that came back after the first time-out was slow, not hung.  The vector clears WDIE, put it back.
+    watchdogFired = 0;
+    WDTCSR |= _BV(WDIE);
+}
+
+void WatchdogClass::saveState(OutputChannelClass& channel)
+{
+    watchdogState.frequencyHz = channel.getFrequencyHz();
+    watchdogState.amplitudeMV = channel.getAmplitudeMV();
+    watchdogState.phaseDegrees = channel.getPhaseDegrees();
+    watchdogState.waveform = channel.getWaveformType();
+    watchdogState.outputStatus = channel.getOutputStatus();
+    watchdogState.restores = 0;
+    watchdogState.checksum = watchdogChecksum();
+}
+
+bool WatchdogClass::restoreState(OutputChannelClass& channel)
+{
+    if (!watchdogReset)
+    {
+        return false;
+    }
+
+    watchdogState.resets++;
+
+    if (watchdogState.restores >= WATCHDOG_MAX_RESTORES)
+    {
+        // The state itself keeps hanging the firmware
+        watchdogState.checksum = watchdogChecksum();
+        return false;
+    }
+
+    watchdogState.restores++;
+    watchdogState.checksum = watchdogChecksum();
+
+    // An uploaded wavetable is gone, arbitrary mode comes back as a sine with the output off
+    bool arbitrary = (watchdogState.waveform == WAVEFORM_ARBITRARY);
+
+    channel.setFrequencyHz(watchdogState.frequencyHz);
+    channel.setPhaseDegrees(watchdogState.phaseDegrees);
+    channel.setWaveform(arbitrary ? WAVEFORM_SINE : (WAVEFORM_T) watchdogState.waveform);
+    channel.setAmplitudeMV(watchdogState.amplitudeMV);
+    channel.setOutputStatus(arbitrary ? OFF : (OUTPUT_STATUS_T) watchdogState.outputStatus);
+
+    DEBUGLN(F("Watchdog: state restored"));
+    return true;
+}
+
+void WatchdogClass::printStatus()
+{
+    Serial.print(F("Watchdog resets "));
+    Serial.print(watchdogState.resets);
+    watchdogReset ? Serial.println(F(", last reset was the watchdog")) : Serial.println();
+}
@@ -0,0 +1,64 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Hardware watchdog that brings the output back to its last good settings.
+ *
+ *  The main loop kicks the watchdog on every pass.  The first time-out runs WDT_vect, which marks the snapshot, the
+ *  second one resets the chip.  The snapshot lives in .noinit RAM, which a reset leaves alone, and holds the channel
+ *  settings as they were after the last command that completed.  After a watchdog reset setup() applies it again,
+ *  unless it already did so WATCHDOG_MAX_RESTORES times in a row without a command completing in between, in which
+ *  case the defaults stay.  The mark does not rely on MCUSR, which the bootloader clears before the sketch runs.
+ *
+ *  A hang with interrupts disabled never runs the vector, the chip then stays in interrupt mode and does not reset.
+ *  Every cli() section in the firmware is a few microseconds long and the I2C transfers are bounded by the Wire timeout.
+ */
+#ifndef Watchdog_h
+#define Watchdog_h
+
+#include "Arduino.h"
+#include "OutputChannel.h"
+
+#define WATCHDOG_MAX_RESTORES  3
+
+class WatchdogClass
+{
+  public:
+    WatchdogClass();
+
+    /// Call first in setup(), stops a watchdog that survived the reset and reads the mark
+    void init();
+    /// Call at the end of setup()
+    void start();
+    /// Call on every pass of the main loop
+    void kick();
+
+    /// Records the settings of the channel as the last good state
+    void saveState(OutputChannelClass& channel);
+    /// @returns true if the last reset was the watchdog and the snapshot was applied to the channel
+    bool restoreState(OutputChannelClass& channel);
+
+    void printStatus();
+
+  private:
+    bool watchdogReset;
+};
+
+extern WatchdogClass Watchdog;
+
+#endif
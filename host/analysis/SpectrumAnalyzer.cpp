@@ -0,0 +1,270 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <math.h>
+#include <string.h>
+#include "SpectrumAnalyzer.h"
+
+/// Four floats, one SSE or NEON register
+typedef float float4 __attribute__((vector_size(16)));
+
+static const size_t VECTOR_WIDTH = 4;
+
+static inline float4 load4(const float* p)
+{
+    float4 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void store4(float* p, float4 v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline float4 splat4(float x)
+{
+    float4 v = { x, x, x, x };
+    return v;
+}
+
+SpectrumAnalyzer::SpectrumAnalyzer(size_t points)
+    : n(points), stages(0), window(points), twiddleRe(points / 2), twiddleIm(points / 2), re(points), im(points),
+      scratchRe(points), scratchIm(points), power(points / 2 + 1), resultRe(NULL), resultIm(NULL)
+{
+    while (((size_t) 1 << stages) < n)
+    {
+        stages++;
+    }
+
+    // 4-term Blackman-Harris
+    windowPowerSum = 0.0;
+    for (size_t i = 0; i < n; i++)
+    {
+        double x = 2.0 * M_PI * i / n;
+        double w = 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2 * x) - 0.01168 * cos(3 * x);
+        window[i] = (float) w;
+        windowPowerSum += w * w;
+    }
+
+    for (size_t k = 0; k < n / 2; k++)
+    {
+        twiddleRe[k] = (float) cos(2.0 * M_PI * k / n);
+        twiddleIm[k] = (float) -sin(2.0 * M_PI * k / n);
+    }
+}
+
+/** Radix-2 Stockham, out of place between the data and scratch arrays.  Stage with span s reads pairs s * m apart
+ *  and writes them next to each other, the q loop runs over s consecutive elements and is vectorized once s reaches
+ *  the vector width, which is every stage but the first two.
+ */
+void SpectrumAnalyzer::fft()
+{
+    float* xr = &re[0];
+    float* xi = &im[0];
+    float* yr = &scratchRe[0];
+    float* yi = &scratchIm[0];
+    size_t s = 1;
+
+    for (size_t span = n; span > 1; span /= 2)
+    {
+        size_t m = span / 2;
+        size_t twiddleStride = n / span;
+
+        for (size_t p = 0; p < m; p++)
+        {
+            float wr = twiddleRe[p * twiddleStride];
+            float wi = twiddleIm[p * twiddleStride];
+            const float* ar = xr + s * p;
+            const float* ai = xi + s * p;
+            const float* br = xr + s * (p + m);
+            const float* bi = xi + s * (p + m);
+            float* sumR = yr + s * 2 * p;
+            float* sumI = yi + s * 2 * p;
+            float* difR = yr + s * (2 * p + 1);
+            float* difI = yi + s * (2 * p + 1);
+
+            if (s >= VECTOR_WIDTH)
+            {
+                float4 vwr = splat4(wr);
+                float4 vwi = splat4(wi);
+
+                for (size_t q = 0; q < s; q += VECTOR_WIDTH)
+                {
+                    float4 var = load4(ar + q);
+                    float4 vai = load4(ai + q);
+                    float4 vbr = load4(br + q);
+                    float4 vbi = load4(bi + q);
+                    float4 dr = var - vbr;
+                    float4 di = vai - vbi;
+
+                    store4(sumR + q, var + vbr);
+                    store4(sumI + q, vai + vbi);
+                    store4(difR + q, dr * vwr - di * vwi);
+                    store4(difI + q, dr * vwi + di * vwr);
+                }
+            }
+            else
+            {
+                for (size_t q = 0; q < s; q++)
+                {
+                    float dr = ar[q] - br[q];
+                    float di = ai[q] - bi[q];
+
+                    sumR[q] = ar[q] + br[q];
+                    sumI[q] = ai[q] + bi[q];
+                    difR[q] = dr * wr - di * wi;
+                    difI[q] = dr * wi + di * wr;
+                }
+            }
+        }
+
+        float* swap;
+        swap = xr; xr = yr; yr = swap;
+        swap = xi; xi = yi; yi = swap;
+        s *= 2;
+    }
+
+    resultRe = xr;
+    resultIm = xi;
+}
+
+const std::vector<float>& SpectrumAnalyzer::analyze(const float* samples)
+{
+    size_t i;
+
+    for (i = 0; i < n; i += VECTOR_WIDTH)
+    {
+        store4(&re[i], load4(samples + i) * load4(&window[i]));
+        store4(&im[i], splat4(0.0f));
+    }
+
+    fft();
+
+    // Bins above Nyquist mirror the ones below for a real record
+    size_t half = n / 2;
+    for (i = 0; i + VECTOR_WIDTH <= half; i += VECTOR_WIDTH)
+    {
+        float4 r = load4(resultRe + i);
+        float4 m = load4(resultIm + i);
+        store4(&power[i], r * r + m * m);
+    }
+    power[half] = resultRe[half] * resultRe[half] + resultIm[half] * resultIm[half];
+
+    return power;
+}
+
+double SpectrumAnalyzer::lobePower(size_t bin) const
+{
+    size_t first = (bin > LOBE_BINS) ? bin - LOBE_BINS : 0;
+    size_t last = (bin + LOBE_BINS < power.size()) ? bin + LOBE_BINS : power.size() - 1;
+    double sum = 0.0;
+
+    for (size_t k = first; k <= last; k++)
+    {
+        sum += power[k];
+    }
+
+    return sum;
+}
+
+size_t SpectrumAnalyzer::foldedBin(double hz, double sampleRateHz) const
+{
+    double folded = fmod(hz, sampleRateHz);
+
+    if (folded > sampleRateHz / 2)
+    {
+        folded = sampleRateHz - folded;
+    }
+
+    return (size_t) floor(folded * n / sampleRateHz + 0.5);
+}
+
+SpectrumMetrics SpectrumAnalyzer::metrics(const float* samples, double sampleRateHz, double expectedHz,
+                                          unsigned harmonics)
+{
+    SpectrumMetrics result;
+    size_t half = n / 2;
+    size_t expected = foldedBin(expectedHz, sampleRateHz);
+
+    memset(&result, 0, sizeof(result));
+    result.valid = (expected > 2 * LOBE_BINS) && (expected + 2 * LOBE_BINS < half);
+
+    if (!result.valid)
+    {
+        return result;
+    }
+
+    analyze(samples);
+
+    // Peak of the fundamental within its main lobe, interpolated on the log magnitude
+    size_t peak = expected;
+    for (size_t k = expected - LOBE_BINS; k <= expected + LOBE_BINS; k++)
+    {
+        if (power[k] > power[peak])
+        {
+            peak = k;
+        }
+    }
+
+    double left = log(power[peak - 1] + 1e-30);
+    double centre = log(power[peak] + 1e-30);
+    double right = log(power[peak + 1] + 1e-30);
+    double denominator = left - 2 * centre + right;
+    double offset = (denominator != 0.0) ? 0.5 * (left - right) / denominator : 0.0;
+    result.fundamentalHz = (peak + offset) * sampleRateHz / n;
+
+    double fundamental = lobePower(peak);
+    result.fundamentalDbfs = 10.0 * log10(4.0 * fundamental / (n * windowPowerSum) + 1e-30);
+
+    // Largest tone outside DC and the fundamental lobe
+    size_t spur = 0;
+    float spurPeak = -1.0f;
+    for (size_t k = LOBE_BINS + 1; k <= half; k++)
+    {
+        if ((k + 2 * LOBE_BINS >= peak) && (k <= peak + 2 * LOBE_BINS))
+        {
+            continue;
+        }
+
+        if (power[k] > spurPeak)
+        {
+            spurPeak = power[k];
+            spur = k;
+        }
+    }
+
+    double spurPower = (spur != 0) ? lobePower(spur) : 0.0;
+    result.spurHz = spur * sampleRateHz / n;
+    result.sfdrDbc = 10.0 * log10(fundamental / (spurPower + 1e-30));
+
+    double harmonicPower = 0.0;
+    for (unsigned h = 2; h <= harmonics; h++)
+    {
+        size_t bin = foldedBin(h * expectedHz, sampleRateHz);
+
+        // A harmonic that aliases onto DC or the fundamental cannot be told apart from them
+        if ((bin > LOBE_BINS) && ((bin + 2 * LOBE_BINS < peak) || (bin > peak + 2 * LOBE_BINS)))
+        {
+            harmonicPower += lobePower(bin);
+        }
+    }
+    result.thdDb = 10.0 * log10(harmonicPower / fundamental + 1e-30);
+
+    return result;
+}
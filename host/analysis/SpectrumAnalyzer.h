@@ -0,0 +1,85 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Windowed FFT and spectral purity figures of a real sample record.
+ *
+ *  The record is multiplied by a 4-term Blackman-Harris window (sidelobes below -92 dB, well under the spurs of a
+ *  10-bit DAC) and transformed by a radix-2 Stockham FFT.  The data is kept as separate real and imaginary arrays so
+ *  the butterflies, the window and the power spectrum run on 4-wide float vectors (GCC/Clang vector extensions, SSE
+ *  on x86 and NEON on ARM without any intrinsics).
+ *
+ *  Tone powers are summed over the window main lobe so leakage does not depend on where a tone falls between bins.
+ *  One analyzer owns its buffers and is not thread safe, give every worker thread its own.
+ */
+#ifndef SpectrumAnalyzer_h
+#define SpectrumAnalyzer_h
+
+#include <stddef.h>
+#include <vector>
+
+struct SpectrumMetrics
+{
+    bool valid;                  //!< false when the fundamental is too close to DC or Nyquist for this record
+    double fundamentalHz;        //!< measured, interpolated between bins
+    double fundamentalDbfs;      //!< relative to a full scale sine
+    double sfdrDbc;              //!< fundamental to the largest other tone
+    double spurHz;               //!< frequency of that tone
+    double thdDb;                //!< harmonics 2..N, aliases folded back into the first Nyquist zone
+};
+
+class SpectrumAnalyzer
+{
+  public:
+    /// @param points record length, a power of two of at least 64
+    explicit SpectrumAnalyzer(size_t points);
+
+    size_t points() const { return n; }
+
+    /// Power spectrum of the windowed record, points / 2 + 1 bins from DC to Nyquist
+    const std::vector<float>& analyze(const float* samples);
+
+    /** @param expectedHz where the fundamental should be, it is searched for within the main lobe around it
+     *  @param harmonics highest harmonic included in THD
+     */
+    SpectrumMetrics metrics(const float* samples, double sampleRateHz, double expectedHz, unsigned harmonics);
+
+    /// Half width of the window main lobe in bins
+    static const size_t LOBE_BINS = 4;
+
+  private:
+    void fft();
+    double lobePower(size_t bin) const;
+    size_t foldedBin(double hz, double sampleRateHz) const;
+
+    size_t n;
+    unsigned stages;
+    double windowPowerSum;
+    std::vector<float> window;
+    std::vector<float> twiddleRe;
+    std::vector<float> twiddleIm;
+    std::vector<float> re;
+    std::vector<float> im;
+    std::vector<float> scratchRe;
+    std::vector<float> scratchIm;
+    std::vector<float> power;
+    const float* resultRe;
+    const float* resultIm;
+};
+
+#endif
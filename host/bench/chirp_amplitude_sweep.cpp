@@ -0,0 +1,260 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Sets every amplitude from 0 to 4000 mV on every waveform through the serial interface, with the RPOT emulator on
+ *  the I2C bus, and compares the level the output model predicts from the resulting wipers with the one requested.
+ *
+ *  chirp_amplitude_sweep [--step mV] [--max mV] [--dither bits] [--csv]
+ *
+ *  --dither turns on the sub-tap dither (rd#) and averages the prediction over four frames after each setting, the
+ *  summary then adds the I2C load and the dither interrupts of those frames.  Afterwards the wiper reads, bus stats
+ *  and settings of a run with the dither going have to come through without a NACK or a fault.  --csv prints one row
+ *  per setting instead of the per waveform summary.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ChirpSim.h"
+#include "OutputLevelModel.h"
+#include "RpotEmulator.h"
+
+struct SweepWaveform
+{
+    const char* command;
+    const char* name;
+    WAVEFORM_T waveform;
+};
+
+static const SweepWaveform sweepWaveforms[] =
+{
+    { "wsine", "sine", WAVEFORM_SINE },
+    { "wtri", "triangle", WAVEFORM_TRIANGLE },
+    { "wsq", "square", WAVEFORM_SQUARE },
+    { "wsq2", "square/2", WAVEFORM_SQUARE_DIV_2 },
+};
+
+struct SweepSummary
+{
+    unsigned settings;
+    double sumAbsError;
+    double sumSquareError;
+    double maxAbsError;
+    unsigned worstMv;
+    uint32_t i2cBytes;
+    uint32_t maxI2cBytes;
+    uint32_t incompleteCommands;
+    uint32_t nacks;
+    uint32_t redundantWrites;
+    uint64_t i2cBits;            //!< bit times on the bus while averaging
+    uint32_t interrupts;
+    uint64_t averagingCycles;
+};
+
+static const uint64_t SWEEP_SAMPLE_CYCLES = 64;
+
+static const unsigned SWEEP_MAX_MV = 4000;
+
+int main(int argc, char** argv)
+{
+    unsigned step = 1;
+    unsigned maxMv = SWEEP_MAX_MV;
+    unsigned ditherBits = 0;
+    bool csv = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--step") == 0 && i + 1 < argc)
+        {
+            step = (unsigned) atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max") == 0 && i + 1 < argc)
+        {
+            maxMv = (unsigned) atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dither") == 0 && i + 1 < argc)
+        {
+            ditherBits = (unsigned) atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--csv") == 0)
+        {
+            csv = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: chirp_amplitude_sweep [--step mV] [--max mV] [--dither bits] [--csv]\n");
+            return 1;
+        }
+    }
+
+    if (step == 0)
+    {
+        step = 1;
+    }
+
+    RpotEmulator rpot;
+    OutputLevelModel model;
+    ChirpSim sim;
+
+    sim.attachAmplifierDevice(&rpot);
+    sim.boot();
+
+    // Four frames of 4 << bits ticks of 32 us
+    uint64_t averagingCycles = 0;
+    if (ditherBits)
+    {
+        char command[16];
+        snprintf(command, sizeof(command), "rd%u", ditherBits);
+        sim.command(command);
+        averagingCycles = 4 * (4ULL << ditherBits) * 32 * (MockHalClass::F_CPU_HZ / 1000000);
+    }
+
+    if (csv)
+    {
+        printf("waveform,requested_mv,predicted_mv,error_mv,r0_taps,r1_taps,i2c_bytes,incomplete,nacks\n");
+    }
+    else
+    {
+        printf("%-9s %8s %12s %12s %12s %9s %11s %14s %10s %9s", "waveform", "settings", "mean_abs_mv", "rms_err_mv",
+               "max_abs_mv", "worst_at", "i2c_bytes", "max_i2c_bytes", "incomplete", "redundant");
+        ditherBits ? printf(" %8s %10s\n", "bus_pct", "irq_per_s") : printf("\n");
+    }
+
+    for (size_t w = 0; w < sizeof(sweepWaveforms) / sizeof(sweepWaveforms[0]); w++)
+    {
+        const SweepWaveform& sweep = sweepWaveforms[w];
+        SweepSummary summary;
+        memset(&summary, 0, sizeof(summary));
+
+        sim.command(sweep.command);
+
+        for (unsigned mv = 0; mv <= maxMv; mv += step)
+        {
+            char command[16];
+            snprintf(command, sizeof(command), "a%u", mv);
+
+            rpot.resetCounters();
+            ChirpCommandCost cost = sim.command(command);
+
+            double predictedMv = model.predictMv(rpot, sweep.waveform);
+
+            if (averagingCycles)
+            {
+                // The dither moves the wiper on its own, the level is the average over whole frames
+                uint64_t end = MockHal.cycles() + averagingCycles;
+                unsigned samples = 0;
+
+                MockHal.resetCounters();
+                predictedMv = 0.0;
+                while (MockHal.cycles() < end)
+                {
+                    MockHal.advance(SWEEP_SAMPLE_CYCLES);
+                    predictedMv += model.predictMv(rpot, sweep.waveform);
+                    samples++;
+                }
+                predictedMv /= samples;
+
+                const MockCounters& bus = MockHal.counters();
+                uint64_t bitCycles = MockHalClass::F_CPU_HZ / 400000;
+                summary.i2cBits += (uint64_t) bus.i2cBytes * 9 + (uint64_t) bus.i2cTransactions * 2;
+                summary.interrupts += bus.interrupts;
+                summary.averagingCycles += averagingCycles / bitCycles;
+            }
+
+            double error = predictedMv - mv;
+            const RpotCounters& rpotCount = rpot.counters();
+
+            summary.settings++;
+            summary.sumAbsError += fabs(error);
+            summary.sumSquareError += error * error;
+            summary.i2cBytes += cost.counters.i2cBytes;
+            summary.incompleteCommands += rpotCount.incompleteCommands;
+            summary.nacks += rpotCount.nacks;
+            summary.redundantWrites += rpotCount.redundantWrites;
+
+            if (cost.counters.i2cBytes > summary.maxI2cBytes)
+            {
+                summary.maxI2cBytes = cost.counters.i2cBytes;
+            }
+
+            if (fabs(error) > summary.maxAbsError)
+            {
+                summary.maxAbsError = fabs(error);
+                summary.worstMv = mv;
+            }
+
+            if (csv)
+            {
+                printf("%s,%u,%.1f,%.1f,%u,%u,%u,%u,%u\n", sweep.name, mv, predictedMv, error, rpot.wiper(0),
+                       rpot.wiper(1), cost.counters.i2cBytes, rpotCount.incompleteCommands, rpotCount.nacks);
+            }
+        }
+
+        if (!csv)
+        {
+            printf("%-9s %8u %12.1f %12.1f %12.1f %9u %11.1f %14u %10u %9u", sweep.name, summary.settings,
+                   summary.sumAbsError / summary.settings, sqrt(summary.sumSquareError / summary.settings),
+                   summary.maxAbsError, summary.worstMv, (double) summary.i2cBytes / summary.settings,
+                   summary.maxI2cBytes, summary.incompleteCommands, summary.redundantWrites);
+            if (ditherBits)
+            {
+                // averagingCycles is in bit times here
+                double seconds = (double) summary.averagingCycles / 400000;
+                printf(" %8.1f %10.0f", 100.0 * summary.i2cBits / summary.averagingCycles, summary.interrupts / seconds);
+            }
+            printf("\n");
+        }
+    }
+
+    if (!ditherBits)
+    {
+        return 0;
+    }
+
+    // With the dither going, the commands that talk to the RPOT wait for its step and it picks up after them
+    sim.command("wsine");
+    sim.command("a101");
+    sim.command("rd");
+    rpot.resetCounters();
+    unsigned readsWrong = 0;
+    for (int i = 0; i < 50; i++)
+    {
+        readsWrong += sim.command("r1").output.find("failed") != std::string::npos;
+        readsWrong += sim.command("re").output.find("transactions") == std::string::npos;
+        readsWrong += sim.command((i & 1) ? "a101" : "a102").output.find("rror") != std::string::npos;
+        MockHal.advance(MockHalClass::F_CPU_HZ / 1000);
+    }
+
+    std::string status = sim.command("rd").output;
+    unsigned long ms = 0, interrupts = 0, steps = 0, held = 0, errors = 1, timeouts = 1;
+    double busPct = 0.0;
+    const char* values = strstr(status.c_str(), "ms,interrupts");
+    bool statusRead = values && strchr(values, '\n') &&
+                      sscanf(strchr(values, '\n') + 1, "%lu,%lu,%lu,%lf,%lu,%lu,%lu", &ms, &interrupts, &steps, &busPct,
+                             &held, &errors, &timeouts) == 7;
+    const RpotCounters& rpotCount = rpot.counters();
+
+    printf("\n%6s %10s %7s %8s %11s %6s %9s %6s %11s\n", "ms", "interrupts", "steps", "bus_pct", "held_ticks", "errors",
+           "timeouts", "nacks", "reads_wrong");
+    printf("%6lu %10lu %7lu %8.1f %11lu %6lu %9lu %6u %11u\n", ms, interrupts, steps, busPct, held, errors, timeouts,
+           rpotCount.nacks + rpotCount.incompleteCommands, readsWrong);
+
+    return (!statusRead || errors || timeouts || rpotCount.nacks || rpotCount.incompleteCommands || readsWrong ||
+            (steps == 0)) ? 1 : 0;
+}
@@ -0,0 +1,157 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Drives command sequences through the real firmware on the mock HAL and reports, per command, the host CPU time,
+ *  the simulated device time and the SPI/I2C/serial traffic it caused.
+ *
+ *  chirp_bench [--iterations N] [--csv] [--file commands.txt] [--i2c-stuck CLOCKS] [command ...]
+ *
+ *  --i2c-stuck has a slave hold SDA low before every command until it has seen CLOCKS clocks on SCL, more than 9 is
+ *  a dead bus.  The device time then shows the worst case latency the I2C timeouts and retries allow.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "ChirpSim.h"
+
+static const char* const defaultCommands[] =
+{
+    "f1000", "f8000000", "a500", "a2000", "p90", "wsine", "wtri", "wsq", "wsq2", "O", "o", "v", "?", "@", "d", "D",
+    "rs", "r0", "#",
+};
+
+struct BenchResult
+{
+    std::string command;
+    uint64_t hostNanoseconds;
+    uint64_t deviceCycles;
+    MockCounters counters;
+};
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: chirp_bench [--iterations N] [--csv] [--file commands.txt] [--i2c-stuck CLOCKS] [command ...]\n");
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> commands;
+    unsigned iterations = 100;
+    bool csv = false;
+    unsigned stuckClocks = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+        {
+            iterations = (unsigned) atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--csv") == 0)
+        {
+            csv = true;
+        }
+        else if (strcmp(argv[i], "--i2c-stuck") == 0 && i + 1 < argc)
+        {
+            stuckClocks = (unsigned) atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc)
+        {
+            std::ifstream file(argv[++i]);
+            std::string line;
+            while (std::getline(file, line))
+            {
+                if (!line.empty() && line[0] != ';')
+                {
+                    commands.push_back(line);
+                }
+            }
+        }
+        else if (argv[i][0] == '-' && argv[i][1] == '-')
+        {
+            usage();
+        }
+        else
+        {
+            commands.push_back(argv[i]);
+        }
+    }
+
+    if (commands.empty())
+    {
+        commands.assign(defaultCommands, defaultCommands + sizeof(defaultCommands) / sizeof(defaultCommands[0]));
+    }
+
+    if (iterations == 0)
+    {
+        iterations = 1;
+    }
+
+    ChirpSim sim;
+    sim.boot();
+
+    std::vector<BenchResult> results;
+
+    for (size_t c = 0; c < commands.size(); c++)
+    {
+        BenchResult result;
+        result.command = commands[c];
+        result.hostNanoseconds = 0;
+
+        for (unsigned i = 0; i < iterations; i++)
+        {
+            MockHal.setI2cStuck((uint8_t) (stuckClocks > 255 ? 255 : stuckClocks));
+            ChirpCommandCost cost = sim.command(commands[c]);
+            result.hostNanoseconds += cost.hostNanoseconds;
+            // The firmware is deterministic, the device side cost of the last run stands for all of them
+            result.deviceCycles = cost.deviceCycles;
+            result.counters = cost.counters;
+        }
+
+        result.hostNanoseconds /= iterations;
+        results.push_back(result);
+    }
+
+    if (csv)
+    {
+        printf("command,host_cpu_ns,device_us,spi_frames,spi_bytes,i2c_bytes,serial_tx,serial_rx,tx_stall_us\n");
+    }
+    else
+    {
+        printf("%-12s %12s %11s %10s %9s %9s %9s %9s %11s\n", "command", "host_cpu_ns", "device_us", "spi_frames",
+               "spi_bytes", "i2c_bytes", "serial_tx", "serial_rx", "tx_stall_us");
+    }
+
+    for (size_t r = 0; r < results.size(); r++)
+    {
+        const BenchResult& result = results[r];
+        const MockCounters& counters = result.counters;
+        double deviceUs = (double) result.deviceCycles / (MockHalClass::F_CPU_HZ / 1000000.0);
+        double stallUs = (double) counters.serialTxStallCycles / (MockHalClass::F_CPU_HZ / 1000000.0);
+
+        printf(csv ? "%s,%llu,%.1f,%u,%u,%u,%u,%u,%.1f\n" : "%-12s %12llu %11.1f %10u %9u %9u %9u %9u %11.1f\n",
+               result.command.c_str(), (unsigned long long) result.hostNanoseconds, deviceUs, counters.spiFrames,
+               counters.spiBytes, counters.i2cBytes, counters.serialTxBytes, counters.serialRxBytes, stallUs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,251 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Runs a Bode sweep of the firmware into an RC low pass, with the AD983x and RPOT emulators on the buses and the
+ *  filter output biased to mid supply on A0.  Decodes the records from the serial stream and compares the magnitude
+ *  the firmware measured with the one the filter really has at that frequency and output level.
+ *
+ *  chirp_bode [--start Hz] [--stop Hz] [--points N] [--linear] [--samples N] [--settle ms] [--corner Hz]
+ *             [--amplitude mV] [--csv]
+ *
+ *  The filter is an ideal first order section, so every point has settled by the time the capture starts; the settle
+ *  time only costs sweep time here.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "ChirpSim.h"
+#include "Ad983xEmulator.h"
+#include "RpotEmulator.h"
+#include "OutputLevelModel.h"
+#include "Bode.h"
+
+/// @brief The device under test, what the ADC sees on A0
+struct LowPass
+{
+    const Ad983xEmulator* dds;
+    const RpotEmulator* rpot;
+    OutputLevelModel level;
+    double cornerHz;
+
+    /// Filter output in mV RMS for the output level the amplifier has now
+    double responseMv(double hz) const
+    {
+        return level.predictMv(*rpot, WAVEFORM_SINE) / sqrt(1.0 + (hz / cornerHz) * (hz / cornerHz));
+    }
+
+    static double volts(uint8_t channel, uint64_t cycle, void* context)
+    {
+        const LowPass* dut = (const LowPass*) context;
+        const Ad983xState& state = dut->dds->state();
+
+        if ((channel != BODE_INPUT_CHANNEL) || (state.control & Ad983xState::AD983X_RESET))
+        {
+            return 2.5;
+        }
+
+        double hz = state.outputHz(Ad983xEmulator::MCLK_HZ);
+        double t = (double) cycle / MockHalClass::F_CPU_HZ;
+        double peak = sqrt(2.0) * dut->responseMv(hz) / 1000.0;
+
+        return 2.5 + peak * sin(2.0 * M_PI * hz * t - atan(hz / dut->cornerHz));
+    }
+};
+
+struct BodeRecord
+{
+    uint16_t point;
+    uint32_t frequencyHz;
+    uint16_t rmsTenthMv;
+    uint16_t peakToPeakMv;
+    uint8_t flags;
+};
+
+/// Splits the serial stream into records and text, bad checksums are counted and dropped
+static void decode(const std::string& stream, std::vector<BodeRecord>& records, std::string& text, unsigned& bad)
+{
+    for (size_t i = 0; i < stream.size(); i++)
+    {
+        const uint8_t* b = (const uint8_t*) stream.data() + i;
+
+        if ((b[0] != BODE_RECORD_SYNC) || (i + BODE_RECORD_SIZE > stream.size()))
+        {
+            text += (char) b[0];
+            continue;
+        }
+
+        uint8_t sum = 0;
+        for (size_t j = 0; j < BODE_RECORD_SIZE - 1; j++)
+        {
+            sum += b[j];
+        }
+
+        if (sum != b[BODE_RECORD_SIZE - 1])
+        {
+            bad++;
+        }
+        else
+        {
+            BodeRecord record;
+            record.point = (uint16_t) (b[1] | (b[2] << 8));
+            record.frequencyHz = (uint32_t) b[3] | ((uint32_t) b[4] << 8) | ((uint32_t) b[5] << 16) | ((uint32_t) b[6] << 24);
+            record.rmsTenthMv = (uint16_t) (b[7] | (b[8] << 8));
+            record.peakToPeakMv = (uint16_t) (b[9] | (b[10] << 8));
+            record.flags = b[11];
+            records.push_back(record);
+        }
+
+        i += BODE_RECORD_SIZE - 1;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long startHz = 10;
+    unsigned long stopHz = 100000;
+    unsigned points = 200;
+    bool logarithmic = true;
+    unsigned samples = BODE_DEFAULT_SAMPLES;
+    unsigned settleMs = BODE_DEFAULT_SETTLE_MS;
+    double cornerHz = 1000.0;
+    unsigned amplitudeMv = 1000;
+    bool csv = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--start") == 0 && i + 1 < argc) startHz = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--stop") == 0 && i + 1 < argc) stopHz = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--points") == 0 && i + 1 < argc) points = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--linear") == 0) logarithmic = false;
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) samples = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--settle") == 0 && i + 1 < argc) settleMs = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--corner") == 0 && i + 1 < argc) cornerHz = atof(argv[++i]);
+        else if (strcmp(argv[i], "--amplitude") == 0 && i + 1 < argc) amplitudeMv = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0) csv = true;
+        else
+        {
+            fprintf(stderr, "usage: chirp_bode [--start Hz] [--stop Hz] [--points N] [--linear] [--samples N] "
+                            "[--settle ms] [--corner Hz] [--amplitude mV] [--csv]\n");
+            return 1;
+        }
+    }
+
+    Ad983xEmulator dds;
+    RpotEmulator rpot;
+    LowPass dut = { &dds, &rpot, OutputLevelModel(), cornerHz };
+    ChirpSim sim;
+
+    sim.attachDdsDevice(&dds);
+    sim.attachAmplifierDevice(&rpot);
+    MockHal.setAnalogSource(LowPass::volts, &dut);
+    sim.boot();
+
+    char command[16];
+    snprintf(command, sizeof(command), "a%u", amplitudeMv);
+    sim.command(command);
+    snprintf(command, sizeof(command), "bs%lu", startHz);
+    sim.command(command);
+    snprintf(command, sizeof(command), "be%lu", stopHz);
+    sim.command(command);
+    snprintf(command, sizeof(command), "bn%u", points);
+    sim.command(command);
+    snprintf(command, sizeof(command), "bl%d", logarithmic ? 1 : 0);
+    sim.command(command);
+    snprintf(command, sizeof(command), "bc%u", samples);
+    sim.command(command);
+    snprintf(command, sizeof(command), "bt%u", settleMs);
+    sim.command(command);
+
+    MockHal.resetCounters();
+    uint64_t start = MockHal.cycles();
+    uint64_t hostStart = ChirpSim::threadCpuNanoseconds();
+    std::string stream = sim.command("b1").output;
+    uint64_t limit = start + 600ULL * MockHalClass::F_CPU_HZ;
+
+    while ((stream.find("Bode done") == std::string::npos) && (MockHal.cycles() < limit))
+    {
+        MockHal.runLoopOnce();
+        stream += MockHal.takeSerialOutput();
+    }
+
+    double sweepSeconds = (double) (MockHal.cycles() - start) / MockHalClass::F_CPU_HZ;
+    double hostMs = (ChirpSim::threadCpuNanoseconds() - hostStart) / 1e6;
+
+    std::vector<BodeRecord> records;
+    std::string text;
+    unsigned bad = 0;
+    decode(stream, records, text, bad);
+
+    if (text.find("Bode done") == std::string::npos)
+    {
+        fprintf(stderr, "sweep did not finish: %s\n", text.c_str());
+        return 1;
+    }
+
+    if (csv)
+    {
+        printf("point,frequency_hz,rms_mv,expected_mv,error_db,pp_mv,flags\n");
+    }
+
+    unsigned flagged = 0;
+    double maxErrorDb = 0.0;
+    double sumErrorDb = 0.0;
+    unsigned measured = 0;
+
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const BodeRecord& record = records[i];
+        double rmsMv = record.rmsTenthMv / 10.0;
+        double expectedMv = dut.responseMv(record.frequencyHz);
+        double errorDb = (rmsMv > 0.0) ? 20.0 * log10(rmsMv / expectedMv) : -99.0;
+
+        if (csv)
+        {
+            printf("%u,%u,%.1f,%.1f,%.2f,%u,%u\n", record.point, record.frequencyHz, rmsMv, expectedMv, errorDb,
+                   record.peakToPeakMv, record.flags);
+        }
+
+        if (record.flags)
+        {
+            flagged++;
+            continue;
+        }
+
+        measured++;
+        sumErrorDb += fabs(errorDb);
+        if (fabs(errorDb) > maxErrorDb)
+        {
+            maxErrorDb = fabs(errorDb);
+        }
+    }
+
+    if (!csv)
+    {
+        printf("%8s %8s %8s %9s %13s %12s %12s %13s %10s\n", "points", "records", "flagged", "bad_sums", "mean_abs_db",
+               "max_abs_db", "sweep_s", "adc_samples", "host_ms");
+        printf("%8u %8zu %8u %9u %13.3f %12.3f %12.3f %13u %10.1f\n", points, records.size(), flagged, bad,
+               measured ? sumErrorDb / measured : 0.0, maxErrorDb, sweepSeconds, MockHal.counters().adcConversions,
+               hostMs);
+    }
+
+    return 0;
+}
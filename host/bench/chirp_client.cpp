@@ -0,0 +1,274 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Drives the firmware through ChirpClient over a pty, the simulated sketch on one end and the client on the other,
+ *  and reports throughput, latency and retries with and without writing ahead.
+ *
+ *  chirp_client [--commands N] [--threads T] [--window B] [--loss P] [--seed S] [--full]
+ *
+ *  Every command is a typed setter with a random value, so each reply is checked against the prompt.  The threads
+ *  share one client.  --loss drops each byte on its way to the sketch with probability P to exercise the resync, the
+ *  sketch then sees merged or truncated lines.  Without --window both a window of one command and the default are run.
+ *
+ *  The pty has no baud rate; the device time is the simulated one, with every byte taking its 57600 baud line time.
+ */
+#include <atomic>
+#include <algorithm>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "ChirpSim.h"
+#include "ChirpClient.h"
+
+struct PumpStats
+{
+    uint32_t received;
+    uint32_t dropped;
+};
+
+/// Runs the sketch on the master side of the pty until stopped
+static void pump(int master, ChirpSim* sim, double loss, unsigned seed, std::atomic<bool>* running, PumpStats* stats)
+{
+    uint8_t buffer[256];
+
+    while (running->load())
+    {
+        struct pollfd fds = { master, POLLIN, 0 };
+        if (poll(&fds, 1, 5) <= 0)
+        {
+            continue;
+        }
+
+        ssize_t length = read(master, buffer, sizeof(buffer));
+        if (length <= 0)
+        {
+            continue;
+        }
+
+        size_t kept = 0;
+        for (ssize_t i = 0; i < length; i++)
+        {
+            if ((loss > 0.0) && ((double) rand_r(&seed) / RAND_MAX < loss))
+            {
+                stats->dropped++;
+                continue;
+            }
+            buffer[kept++] = buffer[i];
+        }
+
+        stats->received += length;
+        MockHal.serialInject(buffer, kept, MockHal.cycles());
+        sim->runUntilIdle();
+        MockHal.drainSerialTx();
+
+        std::string output = MockHal.takeSerialOutput();
+        for (size_t done = 0; done < output.size(); )
+        {
+            ssize_t written = write(master, output.data() + done, output.size() - done);
+            if (written <= 0)
+            {
+                break;
+            }
+            done += written;
+        }
+    }
+}
+
+struct RunResult
+{
+    unsigned ok;
+    unsigned rejected;
+    unsigned timeouts;
+    unsigned retried;
+    double wallMs;
+    double deviceMs;
+    std::vector<double> latencies;
+};
+
+static std::future<ChirpReply> randomCommand(ChirpClient& client, unsigned& seed)
+{
+    switch (rand_r(&seed) % 5)
+    {
+        case 0: return client.setFrequencyHz(1 + rand_r(&seed) % 1000000);
+        case 1: return client.setAmplitudeMv(rand_r(&seed) % 4001);
+        case 2: return client.setPhaseDegrees(rand_r(&seed) % 361);
+        case 3: return client.setWaveform((ChirpWaveform) (rand_r(&seed) % CHIRP_ARBITRARY));
+        default: return client.setOutput(rand_r(&seed) & 1);
+    }
+}
+
+static RunResult run(ChirpClient& client, unsigned commands, unsigned threads, unsigned seed)
+{
+    RunResult result = RunResult();
+    std::vector<std::vector<ChirpReply> > replies(threads);
+    std::vector<std::thread> workers;
+
+    uint64_t deviceStart = MockHal.cycles();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (unsigned t = 0; t < threads; t++)
+    {
+        workers.push_back(std::thread([&client, &replies, commands, threads, seed, t]()
+        {
+            unsigned threadSeed = seed + t;
+            std::vector<std::future<ChirpReply> > futures;
+
+            for (unsigned i = t; i < commands; i += threads)
+            {
+                futures.push_back(randomCommand(client, threadSeed));
+            }
+
+            for (size_t i = 0; i < futures.size(); i++)
+            {
+                replies[t].push_back(futures[i].get());
+            }
+        }));
+    }
+
+    for (size_t t = 0; t < workers.size(); t++)
+    {
+        workers[t].join();
+    }
+
+    result.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    result.deviceMs = (MockHal.cycles() - deviceStart) / (MockHalClass::F_CPU_HZ / 1000.0);
+
+    for (size_t t = 0; t < replies.size(); t++)
+    {
+        for (size_t i = 0; i < replies[t].size(); i++)
+        {
+            const ChirpReply& reply = replies[t][i];
+
+            result.ok += (reply.status == CHIRP_REPLY_OK);
+            result.rejected += (reply.status == CHIRP_REPLY_REJECTED);
+            result.timeouts += (reply.status == CHIRP_REPLY_TIMEOUT);
+            result.retried += (reply.attempts > 1);
+            result.latencies.push_back(reply.latencyMs);
+        }
+    }
+
+    std::sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned commands = 2000;
+    unsigned threads = 1;
+    long window = -1;
+    double loss = 0.0;
+    unsigned seed = 1;
+    bool full = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--commands") == 0 && i + 1 < argc) commands = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) window = atol(argv[++i]);
+        else if (strcmp(argv[i], "--loss") == 0 && i + 1 < argc) loss = atof(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--full") == 0) full = true;
+        else
+        {
+            fprintf(stderr, "usage: chirp_client [--commands N] [--threads T] [--window B] [--loss P] [--seed S] "
+                            "[--full]\n");
+            return 1;
+        }
+    }
+
+    if (threads == 0)
+    {
+        threads = 1;
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0))
+    {
+        perror("posix_openpt");
+        return 1;
+    }
+
+    ChirpSim sim;
+    sim.boot();
+
+    std::atomic<bool> running(true);
+    PumpStats stats = { 0, 0 };
+    std::thread device(pump, master, &sim, loss, seed, &running, &stats);
+
+    std::vector<size_t> windows;
+    if (window >= 0)
+    {
+        windows.push_back((size_t) window);
+    }
+    else
+    {
+        windows.push_back(0);
+        windows.push_back(ChirpClientOptions().windowBytes);
+    }
+
+    printf("%8s %8s %6s %8s %8s %8s %9s %10s %11s %10s %10s\n", "window", "commands", "ok", "rejected", "timeouts",
+           "retried", "wall_ms", "cmds_per_s", "device_ms", "p50_ms", "p99_ms");
+
+    int status = 0;
+
+    for (size_t w = 0; w < windows.size(); w++)
+    {
+        ChirpClientOptions options;
+        options.windowBytes = windows[w];
+        options.compactPrompt = !full;
+
+        ChirpClient client;
+        if (!client.open(ptsname(master), options))
+        {
+            fprintf(stderr, "open: %s\n", client.lastError().c_str());
+            status = 1;
+            break;
+        }
+
+        RunResult result = run(client, commands, threads, seed + 100 * w);
+        size_t n = result.latencies.size();
+
+        printf("%8zu %8u %6u %8u %8u %8u %9.1f %10.0f %11.1f %10.3f %10.3f\n", windows[w], commands, result.ok,
+               result.rejected, result.timeouts, result.retried, result.wallMs, commands * 1000.0 / result.wallMs,
+               result.deviceMs, n ? result.latencies[n / 2] : 0.0, n ? result.latencies[n * 99 / 100] : 0.0);
+
+        if ((loss == 0.0) && (result.ok != commands))
+        {
+            status = 1;
+        }
+
+        client.close();
+    }
+
+    running = false;
+    device.join();
+    ::close(master);
+
+    if (loss > 0.0)
+    {
+        printf("bytes to the sketch %u, dropped %u\n", stats.received, stats.dropped);
+    }
+
+    return status;
+}
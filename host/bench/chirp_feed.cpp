@@ -0,0 +1,349 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Streams a sine FM profile of tuning words into the firmware the way a host would: packets at the baud rate, never
+ *  more words in flight than the last answer allowed.  Times every word at the AD983x emulator and checks its value,
+ *  that the updates sit on the period grid, the underruns against the gaps in the grid and that the channel gets
+ *  its settings back.  Also sends one corrupted packet, which has to be rejected and sent again, and lets a second
+ *  stream time out.
+ *
+ *  chirp_feed [--rate Hz] [--words N] [--lsb] [--frequency Hz] [--deviation Hz] [--stall-ms N] [--csv]
+ *
+ *  --stall-ms stops the host for that long half way through, the FIFO runs dry and the answers have to say so.  A
+ *  rate above what the link carries (about 1320 words/s for e1 and 2480 for e2 at 57600 baud) does the same.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include "ChirpSim.h"
+#include "Ad983xEmulator.h"
+#include "DDS.h"
+#include "Feed.h"
+
+#define FEED_BENCH_POWER_BITS   (Ad983xState::AD983X_RESET | Ad983xState::AD983X_SLEEP1 | Ad983xState::AD983X_SLEEP12)
+
+struct FrameEvent
+{
+    uint64_t cycle;
+    Ad983xState state;
+};
+
+/// Notes the registers every time chip select rises
+class FrameRecorder : public Ad983xEmulator
+{
+  public:
+    virtual void deselect()
+    {
+        Ad983xEmulator::deselect();
+
+        FrameEvent event = { MockHal.cycles(), state() };
+        events.push_back(event);
+    }
+
+    std::vector<FrameEvent> events;
+};
+
+static void collectTx(uint8_t data, uint64_t, void* context)
+{
+    ((std::vector<uint8_t>*) context)->push_back(data);
+}
+
+/// Sync, count, the words little endian and the sum
+static std::vector<uint8_t> packet(const std::vector<uint32_t>& words, size_t first, size_t count, bool lsb)
+{
+    std::vector<uint8_t> bytes;
+
+    bytes.push_back(FEED_PACKET_SYNC);
+    bytes.push_back((uint8_t) count);
+    for (size_t i = first; i < first + count; i++)
+    {
+        for (unsigned b = 0; b < (lsb ? 2u : 4u); b++)
+        {
+            bytes.push_back((uint8_t) (words[i] >> (8 * b)));
+        }
+    }
+
+    uint8_t sum = 0;
+    for (size_t i = 0; i < bytes.size(); i++)
+    {
+        sum += bytes[i];
+    }
+    bytes.push_back(sum);
+    return bytes;
+}
+
+static bool contains(const std::vector<uint8_t>& bytes, const char* text)
+{
+    return std::string(bytes.begin(), bytes.end()).find(text) != std::string::npos;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned rateHz = 1000, wordCount = 2000, stallMs = 0;
+    uint32_t frequencyHz = 10000, deviationHz = 150;
+    bool lsb = false, csv = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) rateHz = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--words") == 0 && i + 1 < argc) wordCount = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--lsb") == 0) lsb = true;
+        else if (strcmp(argv[i], "--frequency") == 0 && i + 1 < argc) frequencyHz = (uint32_t) atol(argv[++i]);
+        else if (strcmp(argv[i], "--deviation") == 0 && i + 1 < argc) deviationHz = (uint32_t) atol(argv[++i]);
+        else if (strcmp(argv[i], "--stall-ms") == 0 && i + 1 < argc) stallMs = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0) csv = true;
+        else
+        {
+            fprintf(stderr, "usage: chirp_feed [--rate Hz] [--words N] [--lsb] [--frequency Hz] [--deviation Hz] "
+                            "[--stall-ms N] [--csv]\n");
+            return 1;
+        }
+    }
+
+    // One period of the sine every 100 words, around the tuning word of the channel
+    uint32_t center = DDSClass::tuningWord(frequencyHz);
+    double deviation = deviationHz * (268435456.0 / Ad983xEmulator::MCLK_HZ);
+    std::vector<uint32_t> words(wordCount);
+    std::vector<uint32_t> expected(wordCount);
+
+    for (unsigned i = 0; i < wordCount; i++)
+    {
+        expected[i] = (uint32_t) lround(center + deviation * sin(2.0 * M_PI * i / 100.0));
+        words[i] = lsb ? (expected[i] & 0x3FFF) : expected[i];
+        if (lsb && ((expected[i] >> 14) != (center >> 14)))
+        {
+            fprintf(stderr, "the deviation carries out of the 14 LSBs of %lu Hz\n", (unsigned long) frequencyHz);
+            return 1;
+        }
+    }
+
+    FrameRecorder dds;
+    ChirpSim sim;
+    std::vector<uint8_t> tx;
+
+    sim.attachDdsDevice(&dds);
+    sim.boot();
+    sim.command("f" + std::to_string(frequencyHz));
+
+    // Refused: rates out of range, a rate too fast for 28-bit words
+    unsigned refusedWrong = 0;
+    refusedWrong += sim.command("er100").output.find("error") == std::string::npos;
+    refusedWrong += sim.command("er20000").output.find("error") == std::string::npos;
+    sim.command("er10000");
+    refusedWrong += sim.command("e1").output.find("error") == std::string::npos;
+    refusedWrong += sim.command("e3").output.find("error") == std::string::npos;
+
+    if (sim.command("er" + std::to_string(rateHz)).output.find("error") != std::string::npos)
+    {
+        fprintf(stderr, "rate %u Hz refused\n", rateHz);
+        return 1;
+    }
+
+    uint16_t controlBefore = dds.state().control;
+    if (sim.command(lsb ? "e2" : "e1").output.find("error") != std::string::npos)
+    {
+        fprintf(stderr, "stream refused\n");
+        return 1;
+    }
+
+    dds.events.clear();
+    MockHal.setSerialTxListener(collectTx, &tx);
+
+    uint64_t byteCycles = MockHal.serialByteCycles();
+    uint64_t lineFree = MockHal.cycles();
+    uint64_t firstByte = lineFree;
+    uint64_t stallUntil = 0;
+    bool stalled = (stallMs == 0), corrupted = false, ended = false;
+    size_t nextWord = 0, replies = 0;
+    long credit = std::min<long>(FEED_FIFO_FRAMES / (lsb ? 1 : 2), FEED_REPLY_MAX_FREE);
+    std::deque<size_t> outstanding;
+    unsigned flaggedReplies = 0, rejectedReplies = 0;
+    uint64_t timeout = MockHal.cycles() + 60ULL * MockHalClass::F_CPU_HZ;
+
+    while (!contains(tx, "Feed done") && (MockHal.cycles() < timeout))
+    {
+        // The answers, one per packet in order
+        while ((replies < tx.size()) && !outstanding.empty())
+        {
+            uint8_t reply = tx[replies++];
+            size_t count = outstanding.front();
+            outstanding.pop_front();
+
+            if (reply == FEED_REPLY_REJECTED)
+            {
+                rejectedReplies++;
+                credit += count;
+                continue;
+            }
+
+            long inFlight = 0;
+            for (size_t i = 0; i < outstanding.size(); i++)
+            {
+                inFlight += outstanding[i];
+            }
+            credit = (reply & ~FEED_REPLY_UNDERRUN) - inFlight;
+            flaggedReplies += (reply & FEED_REPLY_UNDERRUN) != 0;
+        }
+
+        uint64_t now = MockHal.cycles();
+
+        if (!stalled && (nextWord >= wordCount / 2))
+        {
+            stalled = true;
+            stallUntil = now + (uint64_t) stallMs * (MockHalClass::F_CPU_HZ / 1000);
+        }
+
+        size_t count = std::min<size_t>(FEED_PACKET_WORDS, wordCount - nextWord);
+
+        if ((lineFree <= now) && (now >= stallUntil) && !ended)
+        {
+            std::vector<uint8_t> bytes;
+
+            if (count == 0)
+            {
+                // Everything sent, the end packet
+                bytes = packet(words, 0, 0, lsb);
+                outstanding.push_back(0);
+                ended = true;
+            }
+            else if ((long) count <= credit)
+            {
+                bytes = packet(words, nextWord, count, lsb);
+
+                // Once, half way: the same packet with a bad sum first
+                if (!corrupted && (nextWord >= wordCount / 2))
+                {
+                    std::vector<uint8_t> bad = bytes;
+                    bad.back() ^= 0x5A;
+                    lineFree = MockHal.serialInject(bad.data(), bad.size(), now) + byteCycles;
+                    outstanding.push_back(count);
+                    credit -= count;
+                    corrupted = true;
+                    now = lineFree;
+                }
+
+                outstanding.push_back(count);
+                credit -= count;
+                nextWord += count;
+            }
+
+            if (!bytes.empty())
+            {
+                lineFree = MockHal.serialInject(bytes.data(), bytes.size(), now) + byteCycles;
+            }
+        }
+
+        MockHal.runLoopOnce();
+    }
+
+    MockHal.setSerialTxListener(NULL, NULL);
+    std::string status = sim.command("e").output;
+    bool done = contains(tx, "Feed done");
+
+    // Every word, 2 frames each for e1
+    unsigned framesPerWord = lsb ? 1 : 2;
+    uint64_t period = MockHalClass::F_CPU_HZ / rateHz;
+    unsigned wrongWords = 0, gaps = 0;
+    uint64_t minOffset = UINT64_MAX, maxOffset = 0, first = 0, last = 0;
+
+    if (csv)
+    {
+        printf("word,cycle,tick,expected,written\n");
+    }
+
+    if (dds.events.size() < (size_t) wordCount * framesPerWord)
+    {
+        wrongWords = wordCount;
+    }
+    else
+    {
+        first = dds.events[framesPerWord - 1].cycle;
+        uint64_t previousTick = 0;
+
+        for (unsigned i = 0; i < wordCount; i++)
+        {
+            const FrameEvent& event = dds.events[(size_t) i * framesPerWord + framesPerWord - 1];
+            uint64_t tick = (event.cycle - first + period / 2) / period;
+            uint64_t offset = event.cycle - first - tick * period + period / 2;
+
+            wrongWords += event.state.frequency[0] != expected[i];
+            if (i && (tick > previousTick + 1)) gaps += (unsigned) (tick - previousTick - 1);
+            if (offset < minOffset) minOffset = offset;
+            if (offset > maxOffset) maxOffset = offset;
+            previousTick = tick;
+            last = event.cycle;
+
+            if (csv)
+            {
+                printf("%u,%llu,%llu,%lu,%lu\n", i, (unsigned long long) event.cycle, (unsigned long long) tick,
+                       (unsigned long) expected[i], (unsigned long) event.state.frequency[0]);
+            }
+        }
+    }
+
+    // The firmware's own figures: words, underruns, overruns, packets, rejected, skipped, min, avg, max
+    unsigned long stats[9] = { 0 };
+    const char* values = strstr(status.c_str(), "words,underruns");
+    bool statsRead = values && strchr(values, '\n') &&
+                     (sscanf(strchr(values, '\n') + 1, "%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu", &stats[0], &stats[1],
+                             &stats[2], &stats[3], &stats[4], &stats[5], &stats[6], &stats[7], &stats[8]) == 9);
+
+    // The channel has its frequency back, B28 is on again and the output as it was
+    const Ad983xState& after = dds.state();
+    bool restoreWrong = (after.frequency[0] != center) || !(after.control & Ad983xState::AD983X_B28) ||
+                        ((after.control & FEED_BENCH_POWER_BITS) != (controlBefore & FEED_BENCH_POWER_BITS));
+
+    // A stream that stops sending ends by itself
+    sim.command(lsb ? "e2" : "e1");
+    std::vector<uint8_t> one = packet(words, 0, std::min<size_t>(FEED_PACKET_WORDS, wordCount), lsb);
+    MockHal.serialInject(one.data(), one.size(), MockHal.cycles());
+    uint64_t quiet = MockHal.cycles() + (uint64_t) (FEED_TIMEOUT_MS + 100) * (MockHalClass::F_CPU_HZ / 1000);
+    while (MockHal.cycles() < quiet)
+    {
+        MockHal.runLoopOnce();
+    }
+    bool timeoutWrong = MockHal.takeSerialOutput().find("Feed timed out") == std::string::npos ||
+                        (dds.state().frequency[0] != center);
+
+    if (csv)
+    {
+        return 0;
+    }
+
+    double seconds = (double) (last - firstByte) / MockHalClass::F_CPU_HZ;
+    printf("%6s %6s %6s %9s %6s %6s %7s %6s %7s %8s %6s %6s %6s %6s\n", "mode", "rate", "words", "words/s", "wrong",
+           "gaps", "underr", "flag", "jitter", "rejected", "min", "avg", "max", "cpu%");
+    printf("%6s %6u %6lu %9.0f %6u %6u %7lu %6u %7llu %8lu %6lu %6lu %6lu %6.1f\n", lsb ? "lsb" : "word", rateHz,
+           stats[0], seconds > 0 ? wordCount / seconds : 0.0, wrongWords, gaps, stats[1], flaggedReplies,
+           (unsigned long long) (maxOffset >= minOffset ? maxOffset - minOffset : 0), stats[4], stats[6], stats[7],
+           stats[8], 100.0 * stats[7] * rateHz / MockHalClass::F_CPU_HZ);
+    printf("%8s %9s %8s %7s\n", "refused", "restored", "timeout", "stats");
+    printf("%8s %9s %8s %7s\n", refusedWrong ? "wrong" : "ok", restoreWrong ? "wrong" : "ok",
+           timeoutWrong ? "wrong" : "ok", statsRead ? "ok" : "wrong");
+
+    // Underruns the grid shows were counted and flagged to the host.  Rates above what the link carries have them.
+    bool underrunWrong = (stats[1] < gaps) || ((gaps > 0) && (flaggedReplies == 0));
+    bool statsWrong = !statsRead || (stats[0] != wordCount) || (stats[4] != 1) || (rejectedReplies != 1);
+
+    return (!done || wrongWords || underrunWrong || statsWrong || refusedWrong || restoreWrong || timeoutWrong) ? 1 : 0;
+}
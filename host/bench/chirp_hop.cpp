@@ -0,0 +1,256 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Lets the firmware hop against an AD983x emulator and checks every hop: the register FSEL switches to holds the
+ *  channel the LFSR (or the sequence) picks, the spacing between hops is the dwell to the cycle and RESET never
+ *  interrupts the phase accumulator.  Reports the handler cost the firmware measured and the share of the CPU it takes.
+ *
+ *  chirp_hop [--base Hz] [--spacing Hz] [--channels N] [--dwell us] [--seed S] [--sequence a,b,c] [--ms N] [--csv]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "ChirpSim.h"
+#include "Ad983xEmulator.h"
+
+struct HopEvent
+{
+    uint64_t cycle;
+    uint32_t tuningWord;
+    bool reset;
+};
+
+/// Notes the active tuning word every time FSEL changes
+class HopRecorder : public Ad983xEmulator
+{
+  public:
+    HopRecorder() : lastControl(0) {}
+
+    virtual void deselect()
+    {
+        Ad983xEmulator::deselect();
+
+        uint16_t control = state().control;
+        if ((control ^ lastControl) & Ad983xState::AD983X_FSEL)
+        {
+            HopEvent event = { MockHal.cycles(), state().tuningWord(), (control & Ad983xState::AD983X_RESET) != 0 };
+            events.push_back(event);
+        }
+        lastControl = control;
+    }
+
+    std::vector<HopEvent> events;
+
+  private:
+    uint16_t lastControl;
+};
+
+/// The firmware's choice of channels, see Hop.cpp
+class ReferenceSequence
+{
+  public:
+    ReferenceSequence(uint8_t channels, uint16_t seed, const std::vector<uint8_t>& sequence) :
+        channels(channels), lfsr(seed), sequence(sequence), index(sequence.size() - 1), last(0xFF)
+    {
+        for (mask = 1; mask < channels - 1; mask = (mask << 1) | 1)
+        {
+        }
+    }
+
+    uint8_t next()
+    {
+        if (!sequence.empty())
+        {
+            index = (index + 1) % sequence.size();
+            return last = sequence[index];
+        }
+
+        uint8_t channel;
+        do
+        {
+            lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xB400);
+            channel = lfsr & mask;
+        } while ((channel >= channels) || (channel == last));
+
+        return last = channel;
+    }
+
+  private:
+    uint8_t channels;
+    uint8_t mask;
+    uint16_t lfsr;
+    std::vector<uint8_t> sequence;
+    size_t index;
+    uint8_t last;
+};
+
+static uint32_t tuningWord(uint32_t hz)
+{
+    return (uint32_t) (hz * (float) (268435456.0 / Ad983xEmulator::MCLK_HZ));
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long baseHz = 1000000;
+    unsigned long spacingHz = 100000;
+    unsigned channels = 16;
+    unsigned long dwellUs = 1000;
+    unsigned seed = 0xACE1;
+    std::vector<uint8_t> sequence;
+    unsigned ms = 100;
+    bool csv = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--base") == 0 && i + 1 < argc) baseHz = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--spacing") == 0 && i + 1 < argc) spacingHz = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--channels") == 0 && i + 1 < argc) channels = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--dwell") == 0 && i + 1 < argc) dwellUs = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = (unsigned) strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--sequence") == 0 && i + 1 < argc)
+        {
+            for (char* item = strtok(argv[++i], ","); item; item = strtok(NULL, ","))
+            {
+                sequence.push_back((uint8_t) atoi(item));
+            }
+        }
+        else if (strcmp(argv[i], "--ms") == 0 && i + 1 < argc) ms = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0) csv = true;
+        else
+        {
+            fprintf(stderr, "usage: chirp_hop [--base Hz] [--spacing Hz] [--channels N] [--dwell us] [--seed S] "
+                            "[--sequence a,b,c] [--ms N] [--csv]\n");
+            return 1;
+        }
+    }
+
+    HopRecorder dds;
+    ChirpSim sim;
+
+    sim.attachDdsDevice(&dds);
+    sim.boot();
+
+    char command[16];
+    snprintf(command, sizeof(command), "hb%lu", baseHz);
+    sim.command(command);
+    snprintf(command, sizeof(command), "hw%lu", spacingHz);
+    sim.command(command);
+    snprintf(command, sizeof(command), "hn%u", channels);
+    sim.command(command);
+    snprintf(command, sizeof(command), "hd%lu", dwellUs);
+    sim.command(command);
+    snprintf(command, sizeof(command), "hr%u", seed);
+    sim.command(command);
+    sim.command("hc");
+    for (size_t i = 0; i < sequence.size(); i++)
+    {
+        snprintf(command, sizeof(command), "hq%u", sequence[i]);
+        sim.command(command);
+    }
+
+    std::string started = sim.command("h1").output;
+    if (started.find("error") != std::string::npos)
+    {
+        fprintf(stderr, "h1 failed: %s\n", started.c_str());
+        return 1;
+    }
+
+    uint64_t end = MockHal.cycles() + (uint64_t) ms * (MockHalClass::F_CPU_HZ / 1000);
+    while (MockHal.cycles() < end)
+    {
+        MockHal.runLoopOnce();
+    }
+
+    std::string status = sim.command("h").output;
+    size_t count = dds.events.size();   // stop() selecting FREQ0 again is not a hop
+    sim.command("h0");
+
+    // start() puts the first pick on FREQ0, so every hop selects the pick after the one before
+    ReferenceSequence reference(channels, seed, sequence);
+    reference.next();
+
+    uint64_t dwellCycles = (uint64_t) dwellUs * (MockHalClass::F_CPU_HZ / 1000000);
+    unsigned hops = 0, wrongChannel = 0, resets = 0;
+    uint64_t minInterval = UINT64_MAX, maxInterval = 0;
+    uint64_t previousCycle = 0;
+    std::vector<unsigned> visits(channels, 0);
+
+    if (csv)
+    {
+        printf("hop,cycle,interval,tuning_word,expected_channel\n");
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const HopEvent& event = dds.events[i];
+        uint8_t expected = reference.next();
+
+        if (event.tuningWord != tuningWord(baseHz + expected * spacingHz))
+        {
+            wrongChannel++;
+        }
+        resets += event.reset;
+        visits[expected]++;
+
+        if (i > 0)
+        {
+            uint64_t interval = event.cycle - previousCycle;
+            if (interval < minInterval) minInterval = interval;
+            if (interval > maxInterval) maxInterval = interval;
+        }
+
+        if (csv)
+        {
+            printf("%zu,%llu,%llu,%u,%u\n", i, (unsigned long long) event.cycle,
+                   (unsigned long long) (i ? event.cycle - previousCycle : 0), event.tuningWord, expected);
+        }
+
+        previousCycle = event.cycle;
+        hops++;
+    }
+
+    // Last line of the status is the CSV row hops,overruns,min,avg,max
+    unsigned long firmwareHops = 0, overruns = 0, minCycles = 0, avgCycles = 0, maxCycles = 0;
+    const char* row = strstr(status.c_str(), "hops,overruns");
+    if (row == NULL || sscanf(strchr(row, '\n') + 1, "%lu,%lu,%lu,%lu,%lu", &firmwareHops, &overruns, &minCycles,
+                              &avgCycles, &maxCycles) != 5)
+    {
+        fprintf(stderr, "unexpected status: %s\n", status.c_str());
+        return 1;
+    }
+
+    unsigned unvisited = 0;
+    for (size_t i = 0; i < visits.size(); i++)
+    {
+        unvisited += (visits[i] == 0);
+    }
+
+    if (!csv)
+    {
+        printf("%6s %9s %6s %7s %12s %12s %9s %9s %9s %8s %9s\n", "hops", "wrong_ch", "resets", "unused",
+               "min_interval", "max_interval", "isr_min", "isr_avg", "isr_max", "overrun", "cpu_pct");
+        printf("%6u %9u %6u %7u %12llu %12llu %9lu %9lu %9lu %8lu %9.1f\n", hops, wrongChannel,
+               resets, unvisited, (unsigned long long) (hops > 1 ? minInterval : 0),
+               (unsigned long long) maxInterval, minCycles, avgCycles, maxCycles, overruns,
+               100.0 * avgCycles / dwellCycles);
+    }
+
+    return (wrongChannel || resets || (hops > 1 && (minInterval != dwellCycles || maxInterval != dwellCycles))) ? 1 : 0;
+}
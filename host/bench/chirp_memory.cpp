@@ -0,0 +1,146 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Runs commands with per-command tracking on (j1) and prints what j reports: the SRAM split, the high-water marks
+ *  and the stack depth of every command.  Checks that the split adds up to the SRAM, that the marks are no shallower
+ *  than the stack now, that every command got a depth and that jr empties the table and j0 notes nothing.
+ *
+ *  chirp_memory [--commands a,b,c]
+ *
+ *  The host build models SRAM and the stack pointer (see MockHalClass::stackPointer()), the depths rank the commands
+ *  against each other.  static is the modeled MockHalClass::HEAP_START, so free is modeled too, and the output says
+ *  so.  The board's own figures come from the same j on the board.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "ChirpSim.h"
+#include "Ad983xEmulator.h"
+
+/// static, heap, stack, stack_max, free, free_min
+static bool memoryStats(const std::string& status, unsigned long stats[6])
+{
+    const char* values = strstr(status.c_str(), "static,heap");
+
+    if ((values == NULL) || (strchr(values, '\n') == NULL))
+    {
+        return false;
+    }
+    return sscanf(strchr(values, '\n') + 1, "%lu,%lu,%lu,%lu,%lu,%lu", &stats[0], &stats[1], &stats[2], &stats[3],
+                  &stats[4], &stats[5]) == 6;
+}
+
+/// The rows after the command header, one letter and its depth each, up to the prompt
+static std::map<char, unsigned long> commandDepths(const std::string& status)
+{
+    std::map<char, unsigned long> depths;
+    const char* line = strstr(status.c_str(), "command,stack_max");
+    char command;
+    unsigned long depth;
+
+    while ((line != NULL) && ((line = strchr(line, '\n')) != NULL) &&
+           (sscanf(++line, "%c,%lu", &command, &depth) == 2))
+    {
+        depths[command] = depth;
+    }
+    return depths;
+}
+
+int main(int argc, char** argv)
+{
+    std::string list = "f1000,p90,a50,o,O,h,m,P,g,c,y,u,v,k,j";
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--commands") == 0 && i + 1 < argc) list = argv[++i];
+        else
+        {
+            fprintf(stderr, "usage: chirp_memory [--commands a,b,c]\n");
+            return 1;
+        }
+    }
+
+    std::vector<std::string> commands;
+    for (size_t start = 0; start < list.size();)
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        if (end > start) commands.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+
+    Ad983xEmulator dds;
+    ChirpSim sim;
+
+    sim.attachDdsDevice(&dds);
+    sim.boot();
+
+    unsigned long boot[6], stats[6];
+    bool bootRead = memoryStats(sim.command("j").output, boot);
+
+    sim.command("j1");
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+        sim.command(commands[i]);
+    }
+
+    std::string status = sim.command("j").output;
+    bool statsRead = memoryStats(status, stats);
+    std::map<char, unsigned long> depths = commandDepths(status);
+
+    printf("%8s %6s %6s %10s %6s %9s\n", "static", "heap", "stack", "stack_max", "free", "free_min");
+    printf("%8lu %6lu %6lu %10lu %6lu %9lu\n", stats[0], stats[1], stats[2], stats[3], stats[4], stats[5]);
+    printf("static and free are modeled, not the link's: run j on the board\n");
+    printf("\n%-8s %10s\n", "command", "stack_max");
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+        if (depths.count(commands[i][0]))
+        {
+            printf("%-8s %10lu\n", commands[i].c_str(), depths[commands[i][0]]);
+        }
+    }
+
+    // The split covers the SRAM, the marks are at least where the stack is now
+    unsigned splitWrong = !bootRead || !statsRead ||
+                          (stats[0] + stats[1] + stats[2] + stats[4] != RAMEND - RAMSTART) ||
+                          (stats[3] < stats[2]) || (stats[5] > stats[4]) || (stats[3] < boot[2]);
+
+    unsigned missing = 0;
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+        missing += depths.count(commands[i][0]) == 0;
+    }
+
+    // Reset forgets the depths, jr itself is the first one noted again.  Commands with tracking off note none.
+    sim.command("jr");
+    depths = commandDepths(sim.command("j").output);
+    bool resetWrong = (depths.size() != 1) || (depths.count('j') == 0);
+    sim.command("j0");
+    sim.command("f1000");
+    bool offWrong = commandDepths(sim.command("j").output).count('f') != 0;
+
+    printf("\n%6s %8s %6s %4s\n", "split", "missing", "reset", "off");
+    printf("%6s %8u %6s %4s\n", splitWrong ? "wrong" : "ok", missing, resetWrong ? "wrong" : "ok",
+           offWrong ? "wrong" : "ok");
+
+    return (splitWrong || missing || resetWrong || offWrong) ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Turns the output off in every DDS power mode, lets the firmware idle and turns it back on, with an AD983x
+ *  emulator on the SPI bus.  Reports the control bits the DDS saw while off, the share of the idle time the CPU
+ *  spent asleep and the wake-to-output latency the firmware measured.
+ *
+ *  chirp_power [--idle-ms N] [--no-sleep]
+ *
+ *  The latency is firmware time only, the DDS latency of 7 or 8 MCLK cycles and the DAC power-up after SLEEP12 come
+ *  on top.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ChirpSim.h"
+#include "Ad983xEmulator.h"
+
+static const char* const powerModeNames[] = { "reset", "dac_off", "mclk_off", "all_off" };
+
+/// Runs the main loop for the given time with nothing on the serial line
+static void idleFor(uint64_t cycles)
+{
+    uint64_t end = MockHal.cycles() + cycles;
+
+    while (MockHal.cycles() < end)
+    {
+        MockHal.runLoopOnce();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned idleMs = 100;
+    bool sleep = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--idle-ms") == 0 && i + 1 < argc)
+        {
+            idleMs = (unsigned) atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-sleep") == 0)
+        {
+            sleep = false;
+        }
+        else
+        {
+            fprintf(stderr, "usage: chirp_power [--idle-ms N] [--no-sleep]\n");
+            return 1;
+        }
+    }
+
+    Ad983xEmulator dds;
+    ChirpSim sim;
+
+    sim.attachDdsDevice(&dds);
+    sim.boot();
+    sim.command(sleep ? "Ps1" : "Ps0");
+    sim.command("f1000");
+
+    printf("%-9s %10s %8s %11s %10s %13s %12s\n", "mode", "off_ctrl", "sleeps", "asleep_pct", "on_ctrl",
+           "wake_to_out", "wake_to_out");
+    printf("%-9s %10s %8s %11s %10s %13s %12s\n", "", "", "", "", "", "cycles", "us");
+
+    for (unsigned mode = 0; mode < sizeof(powerModeNames) / sizeof(powerModeNames[0]); mode++)
+    {
+        char command[8];
+        snprintf(command, sizeof(command), "Pd%u", mode);
+        sim.command(command);
+        sim.command("o");
+        uint16_t offControl = dds.state().control;
+
+        // Stats cover the idle time and the command that turns the output back on
+        sim.command("P");
+        uint64_t sleepStart = MockHal.counters().sleepCycles;
+        uint64_t start = MockHal.cycles();
+        idleFor((uint64_t) idleMs * (MockHalClass::F_CPU_HZ / 1000));
+        double asleepPct = 100.0 * (MockHal.counters().sleepCycles - sleepStart) / (MockHal.cycles() - start);
+
+        sim.command("O");
+        uint16_t onControl = dds.state().control;
+        std::string status = sim.command("P").output;
+
+        // Last line of the status is the CSV row, its fields are sleeps,asleep_us,elapsed_ms,asleep_pct,wake
+        unsigned long sleeps = 0, asleepUs = 0, elapsedMs = 0, firmwarePct = 0, wakeCycles = 0;
+        const char* row = strstr(status.c_str(), "wake_to_output_cycles");
+        if (row == NULL || sscanf(strchr(row, '\n') + 1, "%lu,%lu,%lu,%lu,%lu", &sleeps, &asleepUs, &elapsedMs,
+                                  &firmwarePct, &wakeCycles) != 5)
+        {
+            fprintf(stderr, "unexpected status: %s\n", status.c_str());
+            return 1;
+        }
+
+        printf("%-9s %#10x %8lu %11.1f %#10x %13lu %12.1f\n", powerModeNames[mode], offControl, sleeps, asleepPct,
+               onControl, wakeCycles, wakeCycles / (MockHalClass::F_CPU_HZ / 1e6));
+    }
+
+    return 0;
+}
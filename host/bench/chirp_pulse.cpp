@@ -0,0 +1,192 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Runs the pulse mode and times every edge on pin 9 from the mock Timer1 output compare: width and period against
+ *  the settings to the cycle, pulses per fire and the pin left low after a burst or a stop.
+ *
+ *  chirp_pulse [--frequency Hz | --period ns] [--width ns | --duty %] [--count N] [--fires N] [--ms N] [--csv]
+ *
+ *  Without --count the train runs for --ms (default 100).  With it, u1 fires --fires bursts (default 3) one --ms
+ *  apart, so --count 1 checks single shots.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "ChirpSim.h"
+
+struct Edge
+{
+    uint8_t level;
+    uint64_t cycle;
+};
+
+static void recordEdge(uint8_t level, uint64_t cycle, void* context)
+{
+    Edge edge = { level, cycle };
+    ((std::vector<Edge>*) context)->push_back(edge);
+}
+
+static void runFor(unsigned ms)
+{
+    uint64_t end = MockHal.cycles() + (uint64_t) ms * (MockHalClass::F_CPU_HZ / 1000);
+    while (MockHal.cycles() < end)
+    {
+        MockHal.runLoopOnce();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long frequencyHz = 0, periodNs = 0, widthNs = 0, duty = 0, count = 0;
+    unsigned fires = 3, ms = 100;
+    bool csv = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--frequency") == 0 && i + 1 < argc) frequencyHz = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--period") == 0 && i + 1 < argc) periodNs = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) widthNs = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--duty") == 0 && i + 1 < argc) duty = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) count = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--fires") == 0 && i + 1 < argc) fires = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--ms") == 0 && i + 1 < argc) ms = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0) csv = true;
+        else
+        {
+            fprintf(stderr, "usage: chirp_pulse [--frequency Hz | --period ns] [--width ns | --duty %%] [--count N] "
+                            "[--fires N] [--ms N] [--csv]\n");
+            return 1;
+        }
+    }
+
+    std::vector<Edge> edges;
+    ChirpSim sim;
+
+    sim.boot();
+    MockHal.setCompareOutputListener(recordEdge, &edges);
+
+    std::vector<std::string> commands;
+    commands.push_back("wpulse");
+    if (frequencyHz) commands.push_back("f" + std::to_string(frequencyHz));
+    if (periodNs) commands.push_back("up" + std::to_string(periodNs));
+    if (widthNs) commands.push_back("uw" + std::to_string(widthNs));
+    if (duty) commands.push_back("ud" + std::to_string(duty));
+    commands.push_back("un" + std::to_string(count));
+
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+        std::string output = sim.command(commands[i]).output;
+        if (output.find("error") != std::string::npos)
+        {
+            fprintf(stderr, "%s failed: %s\n", commands[i].c_str(), output.c_str());
+            return 1;
+        }
+    }
+
+    // The settled timing, in cycles
+    std::string status = sim.command("u").output;
+    unsigned long periodCycles = 0, widthCycles = 0;
+    const char* line = strstr(status.c_str(), "period ");
+    if ((line == NULL) || (sscanf(line, "period %lu cycles, width %lu cycles", &periodCycles, &widthCycles) != 2))
+    {
+        fprintf(stderr, "unexpected status: %s\n", status.c_str());
+        return 1;
+    }
+
+    unsigned bursts = count ? fires : 1;
+    std::vector<size_t> burstStart;
+    for (unsigned b = 0; b < bursts; b++)
+    {
+        burstStart.push_back(edges.size());
+        sim.command((b == 0) ? "O" : "u1");
+        runFor(ms);
+    }
+    burstStart.push_back(edges.size());
+
+    status = sim.command("u").output;
+    sim.command("o");
+    bool lowAfterStop = (MockHal.getPinOutput(9) == 0);
+
+    unsigned long pulses = 0, overruns = 0;
+    line = strstr(status.c_str(), "pulses,overruns");
+    if ((line == NULL) || (sscanf(strchr(line, '\n') + 1, "%lu,%lu", &pulses, &overruns) != 2))
+    {
+        fprintf(stderr, "unexpected status: %s\n", status.c_str());
+        return 1;
+    }
+
+    if (csv)
+    {
+        printf("edge,level,cycle,since_previous\n");
+        for (size_t i = 0; i < edges.size(); i++)
+        {
+            printf("%zu,%u,%llu,%llu\n", i, edges[i].level, (unsigned long long) edges[i].cycle,
+                   (unsigned long long) (i ? edges[i].cycle - edges[i - 1].cycle : 0));
+        }
+        return 0;
+    }
+
+    unsigned wrongWidth = 0, wrongPeriod = 0, wrongCount = 0, badLevels = 0, measured = 0;
+
+    for (unsigned b = 0; b < bursts; b++)
+    {
+        unsigned highs = 0;
+        uint64_t lastRise = 0;
+
+        for (size_t i = burstStart[b]; i < burstStart[b + 1]; i++)
+        {
+            const Edge& edge = edges[i];
+
+            // Edges alternate and every burst begins with a rising one
+            if (edge.level != (((i - burstStart[b]) & 1) == 0))
+            {
+                badLevels++;
+                continue;
+            }
+
+            if (edge.level)
+            {
+                if (highs && (edge.cycle - lastRise != periodCycles))
+                {
+                    wrongPeriod++;
+                }
+                lastRise = edge.cycle;
+                highs++;
+            }
+            else
+            {
+                wrongWidth += (edge.cycle - edges[i - 1].cycle != widthCycles);
+                measured++;
+            }
+        }
+
+        if (count && (highs != count))
+        {
+            wrongCount++;
+        }
+    }
+
+    printf("%10s %8s %8s %8s %10s %11s %11s %9s %8s %10s\n", "period", "width", "bursts", "pulses", "fw_last",
+           "wrong_width", "wrong_period", "bad_edges", "overrun", "low_after");
+    printf("%10lu %8lu %8u %8u %10lu %11u %11u %9u %8lu %10s\n", periodCycles, widthCycles, bursts, measured, pulses,
+           wrongWidth, wrongPeriod, badLevels, overruns, lowAfterStop ? "yes" : "no");
+
+    return (wrongWidth || wrongPeriod || wrongCount || badLevels || overruns || !lowAfterStop || (measured == 0)) ? 1 : 0;
+}
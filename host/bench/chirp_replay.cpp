@@ -0,0 +1,374 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Replays a command stream into serialEvent() and loop() and reports throughput, end to end latency and the
+ *  commands that were lost or mangled on the way.
+ *
+ *  chirp_replay [--file stream.txt | --synthetic N] [--seed S] [--baud B] [--gap-us G] [--burst N] [--burst-gap-ms M]
+ *               [--closed-loop] [--quick]
+ *
+ *  Stream files hold one command per line, optionally preceded by "+<us> " to wait that long after the previous
+ *  command finished sending.  Lines starting with ';' are comments.
+ *
+ *  Open loop (the default) sends on a fixed schedule the way a script or a fast GUI does.  --closed-loop waits for
+ *  each prompt before sending the next command, the way a careful host does.  --quick sends % first so the sketch
+ *  suppresses its menus, as ChirpUI does.
+ *
+ *  A command counts as completed when the line the sketch dispatched equals the line that was sent, latency runs from
+ *  the first bit of the command on the RX line to the stop bit of the prompt that follows it.  A command the sketch
+ *  never dispatched on its own (lost bytes, merged with a neighbour) is dropped, one it dispatched with different
+ *  text (truncated at 12 characters, partly lost) is corrupted.
+ */
+#include <algorithm>
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "ChirpSim.h"
+
+struct ReplayCommand
+{
+    std::string text;
+    uint64_t gapCycles;          //!< idle line time before this command
+    uint64_t start;              //!< first bit on the RX line
+};
+
+struct DispatchedLine
+{
+    std::string text;
+    uint32_t txStart;            //!< TX bytes written before the sketch started on it
+};
+
+struct ReplayCapture
+{
+    std::vector<DispatchedLine> dispatched;
+    std::string txData;
+    std::vector<uint64_t> txDone;          //!< stop bit cycle of every TX byte
+    uint32_t bells;
+};
+
+static void onDispatch(const char* line, void* context)
+{
+    ReplayCapture* capture = (ReplayCapture*) context;
+    DispatchedLine dispatched = { line, MockHal.counters().serialTxBytes };
+    capture->dispatched.push_back(dispatched);
+}
+
+static void onTx(uint8_t data, uint64_t cycle, void* context)
+{
+    ReplayCapture* capture = (ReplayCapture*) context;
+    capture->txData.push_back((char) data);
+    capture->txDone.push_back(cycle);
+    capture->bells += (data == 0x07);
+}
+
+/// ChirpUI style traffic, mostly frequency and amplitude updates
+static std::string syntheticCommand(uint32_t& seed)
+{
+    static const char* const waveforms[] = { "wsine", "wtri", "wsq", "wsq2" };
+    char command[16];
+
+    seed = seed * 1103515245UL + 12345UL;
+    uint32_t random = seed >> 8;
+
+    switch (random % 10)
+    {
+        case 0: case 1: case 2: case 3:
+            snprintf(command, sizeof(command), "f%lu", (unsigned long) (random % 12500000UL));
+        break;
+        case 4: case 5: case 6:
+            snprintf(command, sizeof(command), "a%lu", (unsigned long) (random % 4001));
+        break;
+        case 7:
+            snprintf(command, sizeof(command), "p%lu", (unsigned long) (random % 360));
+        break;
+        case 8:
+            snprintf(command, sizeof(command), "%s", waveforms[random % 4]);
+        break;
+        default:
+            snprintf(command, sizeof(command), "%s", (random & 0x100) ? "O" : "o");
+        break;
+    }
+
+    return command;
+}
+
+static double percentile(std::vector<uint64_t>& sorted, double fraction)
+{
+    if (sorted.empty())
+    {
+        return 0.0;
+    }
+
+    size_t index = (size_t) (fraction * (sorted.size() - 1) + 0.5);
+    return sorted[index] * 1000.0 / MockHalClass::F_CPU_HZ;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: chirp_replay [--file stream.txt | --synthetic N] [--seed S] [--baud B] [--gap-us G]\n"
+                    "                    [--burst N] [--burst-gap-ms M] [--closed-loop] [--quick]\n");
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<ReplayCommand> commands;
+    const char* fileName = NULL;
+    unsigned synthetic = 1000;
+    uint32_t seed = 1;
+    unsigned long baud = 0;
+    double gapUs = 0;
+    unsigned burst = 0;
+    double burstGapMs = 0;
+    bool closedLoop = false;
+    bool quick = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+
+        if (strcmp(argv[i], "--file") == 0 && hasValue)
+        {
+            fileName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--synthetic") == 0 && hasValue)
+        {
+            synthetic = (unsigned) atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+        {
+            seed = (uint32_t) strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--baud") == 0 && hasValue)
+        {
+            baud = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--gap-us") == 0 && hasValue)
+        {
+            gapUs = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--burst") == 0 && hasValue)
+        {
+            burst = (unsigned) atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--burst-gap-ms") == 0 && hasValue)
+        {
+            burstGapMs = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--closed-loop") == 0)
+        {
+            closedLoop = true;
+        }
+        else if (strcmp(argv[i], "--quick") == 0)
+        {
+            quick = true;
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    const double cyclesPerUs = MockHalClass::F_CPU_HZ / 1000000.0;
+
+    if (fileName)
+    {
+        std::ifstream file(fileName);
+        std::string line;
+
+        if (!file)
+        {
+            fprintf(stderr, "chirp_replay: cannot open %s\n", fileName);
+            return 1;
+        }
+
+        while (std::getline(file, line))
+        {
+            ReplayCommand command = { line, (uint64_t) (gapUs * cyclesPerUs), 0 };
+
+            if (!line.empty() && line[line.size() - 1] == '\r')
+            {
+                line.erase(line.size() - 1);
+            }
+
+            if (line.empty() || line[0] == ';')
+            {
+                continue;
+            }
+
+            if (line[0] == '+')
+            {
+                size_t space = line.find(' ');
+                command.gapCycles = (uint64_t) (atof(line.c_str() + 1) * cyclesPerUs);
+                line = (space == std::string::npos) ? std::string() : line.substr(space + 1);
+            }
+
+            command.text = line;
+            commands.push_back(command);
+        }
+    }
+    else
+    {
+        for (unsigned i = 0; i < synthetic; i++)
+        {
+            ReplayCommand command = { syntheticCommand(seed), (uint64_t) (gapUs * cyclesPerUs), 0 };
+            commands.push_back(command);
+        }
+    }
+
+    for (size_t i = 0; burst && i < commands.size(); i += burst)
+    {
+        // The pause comes ahead of the first command of every burst after the first one
+        if (i)
+        {
+            commands[i].gapCycles += (uint64_t) (burstGapMs * 1000.0 * cyclesPerUs);
+        }
+    }
+
+    ChirpSim sim;
+    ReplayCapture capture;
+    capture.bells = 0;
+
+    sim.boot();
+
+    if (baud)
+    {
+        // As if setup() had opened the port at this rate
+        Serial.begin(baud);
+    }
+
+    if (quick)
+    {
+        sim.command("%");
+    }
+
+    MockHal.resetCounters();
+    sim.setDispatchListener(onDispatch, &capture);
+    MockHal.setSerialTxListener(onTx, &capture);
+
+    uint64_t byteCycles = MockHal.serialByteCycles();
+    uint64_t firstStart = MockHal.cycles() + (commands.empty() ? 0 : commands[0].gapCycles);
+    uint64_t hostStart = ChirpSim::threadCpuNanoseconds();
+
+    if (closedLoop)
+    {
+        for (size_t i = 0; i < commands.size(); i++)
+        {
+            std::string line = commands[i].text + "\r";
+            commands[i].start = MockHal.cycles() + commands[i].gapCycles;
+            MockHal.serialInject((const uint8_t*) line.data(), line.size(), commands[i].start + byteCycles);
+            sim.runUntilIdle();
+            MockHal.drainSerialTx();
+        }
+    }
+    else
+    {
+        uint64_t start = firstStart;
+
+        for (size_t i = 0; i < commands.size(); i++)
+        {
+            std::string line = commands[i].text + "\r";
+
+            if (i)
+            {
+                start += commands[i].gapCycles;
+            }
+
+            commands[i].start = start;
+            MockHal.serialInject((const uint8_t*) line.data(), line.size(), start + byteCycles);
+            start += line.size() * byteCycles;
+        }
+
+        sim.runUntilIdle();
+        MockHal.drainSerialTx();
+    }
+
+    uint64_t hostNs = ChirpSim::threadCpuNanoseconds() - hostStart;
+    MockHal.setSerialTxListener(NULL, NULL);
+    sim.setDispatchListener(NULL, NULL);
+
+    // Line the dispatched commands up with the ones that were sent
+    std::vector<uint64_t> latencies;
+    size_t sent = 0;
+    unsigned completed = 0;
+    unsigned dropped = 0;
+    unsigned corrupted = 0;
+    static const size_t RESYNC_WINDOW = 8;
+
+    for (size_t d = 0; d < capture.dispatched.size() && sent < commands.size(); d++)
+    {
+        const DispatchedLine& line = capture.dispatched[d];
+        size_t match = sent;
+
+        while (match < commands.size() && match < sent + RESYNC_WINDOW && commands[match].text != line.text)
+        {
+            match++;
+        }
+
+        if (match < commands.size() && commands[match].text == line.text)
+        {
+            dropped += (unsigned) (match - sent);
+            sent = match;
+
+            // The status line is the only output that contains '>', and it ends with it
+            size_t prompt = capture.txData.find('>', line.txStart);
+            uint64_t promptDone = (prompt == std::string::npos) ? capture.txDone.back() : capture.txDone[prompt];
+            latencies.push_back(promptDone - commands[sent].start);
+            completed++;
+        }
+        else
+        {
+            corrupted++;
+        }
+
+        sent++;
+    }
+
+    if (sent < commands.size())
+    {
+        dropped += (unsigned) (commands.size() - sent);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    const MockCounters& counters = MockHal.counters();
+    // From the first bit sent to the last bit of output
+    double seconds = (double) (MockHal.cycles() - firstStart) / MockHalClass::F_CPU_HZ;
+
+    printf("mode            %s%s\n", closedLoop ? "closed loop" : "open loop", quick ? ", quick commands" : "");
+    printf("baud            %lu\n", (unsigned long) MockHal.serialBaud());
+    printf("commands        %u\n", (unsigned) commands.size());
+    printf("completed       %u\n", completed);
+    printf("dropped         %u\n", dropped);
+    printf("corrupted       %u\n", corrupted);
+    printf("rx_overruns     %u bytes\n", counters.serialRxDropped);
+    printf("bells           %u\n", capture.bells);
+    printf("tx_stall        %.1f ms\n", counters.serialTxStallCycles / (cyclesPerUs * 1000.0));
+    printf("throughput      %.1f commands/s\n", seconds > 0 ? completed / seconds : 0.0);
+    printf("latency_p50     %.3f ms\n", percentile(latencies, 0.50));
+    printf("latency_p90     %.3f ms\n", percentile(latencies, 0.90));
+    printf("latency_p99     %.3f ms\n", percentile(latencies, 0.99));
+    printf("latency_max     %.3f ms\n", percentile(latencies, 1.0));
+    printf("host_cpu        %.1f ms\n", hostNs / 1e6);
+
+    return 0;
+}
@@ -0,0 +1,403 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Queues random f, p, o and O commands for ticks out of order and times when each one reaches the AD983x emulator:
+ *  chip select rising on the frame that makes the change, against its tick.  Checks that commands for the past, too
+ *  close or out of range are refused and that the firmware's own statistics agree.
+ *
+ *  chirp_schedule [--commands N] [--lead-ms N] [--span-ms N] [--seed S] [--sync] [--samples N] [--interval-ms N]
+ *                 [--drift ppm] [--latency-us N] [--jitter-us N] [--csv]
+ *
+ *  --sync first runs cs exchanges through ChirpClockSync against a host clock with an offset, a drift and a latency
+ *  that varies by up to --jitter-us each way (USB polls every 1000 us), then picks the commands' times on the host
+ *  clock and converts them.  That adds the sync error to the landing error.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "ChirpSim.h"
+#include "Ad983xEmulator.h"
+#include "ChirpClient.h"
+#include "Clock.h"
+#include "DDS.h"
+#include "Schedule.h"
+
+// Apart in ticks, so no command can make the next one late
+#define SCHEDULE_BENCH_SEPARATION   4000
+#define SCHEDULE_BENCH_POWER_BITS   (Ad983xState::AD983X_RESET | Ad983xState::AD983X_SLEEP1 | Ad983xState::AD983X_SLEEP12)
+
+struct FrameEvent
+{
+    uint64_t cycle;
+    Ad983xState state;
+};
+
+/// Notes the registers every time chip select rises
+class FrameRecorder : public Ad983xEmulator
+{
+  public:
+    virtual void deselect()
+    {
+        Ad983xEmulator::deselect();
+
+        FrameEvent event = { MockHal.cycles(), state() };
+        events.push_back(event);
+    }
+
+    std::vector<FrameEvent> events;
+};
+
+struct Planned
+{
+    uint32_t tick;
+    double hostNs;          //!< with --sync, the time the host wanted
+    std::string command;
+    char action;
+    uint32_t expected;      //!< tuning word or 12-bit phase
+    int64_t error;
+    bool landed;
+};
+
+/// The host's clock in the --sync run
+struct HostClock
+{
+    double offsetNs;
+    double drift;
+    double latencyNs;
+    double jitterNs;
+    std::mt19937* random;
+
+    double at(uint64_t cycle) const { return offsetNs + cycle * (1e9 / MockHalClass::F_CPU_HZ) * (1.0 + drift); }
+    double latency() const { return latencyNs + std::uniform_real_distribution<double>(0.0, jitterNs)(*random); }
+};
+
+static void recordTx(uint8_t, uint64_t cycle, void* context)
+{
+    *(uint64_t*) context = cycle;
+}
+
+static void runFor(unsigned ms)
+{
+    uint64_t end = MockHal.cycles() + (uint64_t) ms * (MockHalClass::F_CPU_HZ / 1000);
+    while (MockHal.cycles() < end)
+    {
+        MockHal.runLoopOnce();
+    }
+}
+
+static bool rejected(ChirpSim& sim, const std::string& command)
+{
+    return sim.command(command).output.find("error") != std::string::npos;
+}
+
+static bool landed(const Planned& planned, const Ad983xState& state)
+{
+    switch (planned.action)
+    {
+        case 'f': return state.frequency[0] == planned.expected;
+        case 'p': return state.phase[0] == planned.expected;
+        case 'O': return (state.control & SCHEDULE_BENCH_POWER_BITS) == 0;
+        default:  return (state.control & SCHEDULE_BENCH_POWER_BITS) != 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned commands = SCHEDULE_MAX_ENTRIES, leadMs = 400, spanMs = 100, seed = 1, samples = 32, intervalMs = 50;
+    double driftPpm = 300.0, latencyUs = 125.0, jitterUs = 1000.0;
+    bool sync = false, csv = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--commands") == 0 && i + 1 < argc) commands = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--lead-ms") == 0 && i + 1 < argc) leadMs = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--span-ms") == 0 && i + 1 < argc) spanMs = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--sync") == 0) sync = true;
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) samples = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--interval-ms") == 0 && i + 1 < argc) intervalMs = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--drift") == 0 && i + 1 < argc) driftPpm = atof(argv[++i]);
+        else if (strcmp(argv[i], "--latency-us") == 0 && i + 1 < argc) latencyUs = atof(argv[++i]);
+        else if (strcmp(argv[i], "--jitter-us") == 0 && i + 1 < argc) jitterUs = atof(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0) csv = true;
+        else
+        {
+            fprintf(stderr, "usage: chirp_schedule [--commands N] [--lead-ms N] [--span-ms N] [--seed S] [--sync] "
+                            "[--samples N] [--interval-ms N] [--drift ppm] [--latency-us N] [--jitter-us N] [--csv]\n");
+            return 1;
+        }
+    }
+
+    if ((commands == 0) || (commands > SCHEDULE_MAX_ENTRIES) ||
+        ((uint64_t) commands * SCHEDULE_BENCH_SEPARATION > (uint64_t) spanMs * (F_CPU / 1000) / 2))
+    {
+        fprintf(stderr, "--commands is 1 to %u and needs a longer --span-ms\n", SCHEDULE_MAX_ENTRIES);
+        return 1;
+    }
+
+    std::mt19937 random(seed);
+    FrameRecorder dds;
+    ChirpSim sim;
+
+    sim.attachDdsDevice(&dds);
+    sim.boot();
+
+    // Ticks are the low 32 bits of the cycle count since Timer1 started
+    uint32_t tickOffset = (uint32_t) MockHal.cycles() - Clock.cycles();
+
+    // Refused: out of range, for the past and less than the minimum lead ahead
+    unsigned refusedWrong = 0;
+    refusedWrong += !rejected(sim, "cqf9000000");
+    refusedWrong += !rejected(sim, "cqp400");
+    refusedWrong += !rejected(sim, "cqa500");
+    sim.command("ct" + std::to_string(Clock.cycles() - F_CPU / 1000));
+    refusedWrong += !rejected(sim, "cqf1000");
+    sim.command("cd" + std::to_string(SCHEDULE_MIN_LEAD_US / 2));
+    refusedWrong += !rejected(sim, "cqp90");
+
+    // The host's view of the device clock
+    HostClock host = { 1.5e12, driftPpm * 1e-6, latencyUs * 1000.0, jitterUs * 1000.0, &random };
+    ChirpClockSync clockSync;
+    double syncErrorUs = 0.0, syncBoundUs = 0.0;
+
+    if (sync)
+    {
+        const double byteNs = 10e9 / 57600;
+        uint64_t lastTx = 0;
+
+        // The mock moves a byte at its start bit both ways, on the wire it is complete a frame later
+        const uint64_t frameCycles = (uint64_t) (byteNs * MockHalClass::F_CPU_HZ / 1e9);
+        MockHal.setSerialTxListener(recordTx, &lastTx);
+
+        for (unsigned i = 0; i < samples; i++)
+        {
+            uint64_t start = MockHal.cycles();
+            ChirpCommandCost cost = sim.command("cs");
+            const char* line = strstr(cost.output.c_str(), "Sync ");
+
+            if (line)
+            {
+                // Brackets as ChirpClient::syncClock() does
+                clockSync.addSample((int64_t) (host.at(start - frameCycles) - host.latency()),
+                                    (int64_t) (host.at(lastTx + frameCycles) + host.latency()),
+                                    (uint32_t) strtoul(line + 5, NULL, 10), (int64_t) (3 * byteNs),
+                                    (int64_t) ((cost.output.size() - 1) * byteNs));
+            }
+            runFor(intervalMs);
+        }
+
+        MockHal.setSerialTxListener(NULL, NULL);
+
+        if (!clockSync.fit())
+        {
+            fprintf(stderr, "no cs answered\n");
+            return 1;
+        }
+
+        // How far the fit is off now, and a second later
+        for (unsigned ms = 0; ms <= 1000; ms += 1000)
+        {
+            uint64_t cycle = MockHal.cycles() + (uint64_t) ms * (F_CPU / 1000);
+            double error = (int32_t) (clockSync.toDeviceTick((int64_t) host.at(cycle)) - (uint32_t) (cycle - tickOffset));
+            syncErrorUs = std::max(syncErrorUs, fabs(error) / ChirpClockSync::TICKS_PER_US);
+            syncBoundUs = clockSync.uncertaintyUs((int64_t) host.at(cycle));
+        }
+    }
+
+    // Settings to change, in tick order, each one different from what the DDS has then
+    std::vector<Planned> plan;
+    std::vector<uint32_t> ticks;
+    uint32_t base = Clock.cycles() + leadMs * (F_CPU / 1000);
+    std::uniform_int_distribution<uint32_t> offset(0, spanMs * (F_CPU / 1000));
+
+    while (ticks.size() < commands)
+    {
+        uint32_t tick = base + offset(random);
+        bool apart = true;
+        for (size_t i = 0; i < ticks.size(); i++)
+        {
+            apart = apart && (abs((int32_t) (tick - ticks[i])) >= SCHEDULE_BENCH_SEPARATION);
+        }
+        if (apart)
+        {
+            ticks.push_back(tick);
+        }
+    }
+    std::sort(ticks.begin(), ticks.end());
+
+    Ad983xState state = dds.state();
+    bool on = (state.control & SCHEDULE_BENCH_POWER_BITS) == 0;
+    uint32_t word = state.frequency[0];
+    uint16_t phase = state.phase[0];
+
+    for (size_t i = 0; i < ticks.size(); i++)
+    {
+        Planned planned = Planned();
+        planned.tick = ticks[i];
+
+        if (sync)
+        {
+            // The host picks the time, the sync says which tick that is
+            planned.hostNs = host.at((uint32_t) (ticks[i] + tickOffset));
+            planned.tick = clockSync.toDeviceTick((int64_t) planned.hostNs);
+        }
+
+        switch (random() % 3)
+        {
+            case 0:
+            {
+                uint32_t hz;
+                do
+                {
+                    hz = 100 + random() % 5000000;
+                } while (DDSClass::tuningWord(hz) == word);
+                planned.command = "f" + std::to_string(hz);
+                planned.action = 'f';
+                planned.expected = word = DDSClass::tuningWord(hz);
+            }
+            break;
+            case 1:
+            {
+                uint16_t degrees;
+                do
+                {
+                    degrees = random() % 360;
+                } while ((DDSClass::phaseWord(degrees) & 0x0FFF) == phase);
+                planned.command = "p" + std::to_string(degrees);
+                planned.action = 'p';
+                planned.expected = phase = DDSClass::phaseWord(degrees) & 0x0FFF;
+            }
+            break;
+            default:
+                on = !on;
+                planned.command = on ? "O" : "o";
+                planned.action = on ? 'O' : 'o';
+            break;
+        }
+
+        plan.push_back(planned);
+    }
+
+    // Sent out of order, the heap sorts them
+    std::vector<size_t> order(plan.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), random);
+
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const Planned& planned = plan[order[i]];
+        sim.command("ct" + std::to_string(planned.tick));
+        if (rejected(sim, "cq" + planned.command))
+        {
+            fprintf(stderr, "cq%s for %u refused, raise --lead-ms\n", planned.command.c_str(), planned.tick);
+            return 1;
+        }
+    }
+
+    if ((int32_t) (plan.front().tick - Clock.cycles()) < 0)
+    {
+        fprintf(stderr, "queueing took longer than --lead-ms\n");
+        return 1;
+    }
+
+    dds.events.clear();
+    runFor((unsigned) ((plan.back().tick - Clock.cycles()) / (F_CPU / 1000)) + 20);
+
+    // Each change is the first frame after the one before it that shows the new setting
+    size_t next = 0;
+    unsigned missing = 0, late = 0;
+    int64_t minError = INT64_MAX, maxError = INT64_MIN, maxHostError = 0;
+
+    for (size_t i = 0; i < plan.size(); i++)
+    {
+        Planned& planned = plan[i];
+
+        while ((next < dds.events.size()) && !landed(planned, dds.events[next].state))
+        {
+            next++;
+        }
+        if (next == dds.events.size())
+        {
+            missing++;
+            break;
+        }
+
+        uint64_t cycle = dds.events[next].cycle;
+        planned.landed = true;
+        planned.error = (int32_t) ((uint32_t) (cycle - tickOffset) - planned.tick);
+        late += (planned.error > SCHEDULE_LATE_CYCLES) || (planned.error < -SCHEDULE_LATE_CYCLES);
+        minError = std::min(minError, planned.error);
+        maxError = std::max(maxError, planned.error);
+
+        if (sync)
+        {
+            int64_t hostError = (int64_t) llround((host.at(cycle) - planned.hostNs) / 1000.0);
+            maxHostError = std::max(maxHostError, std::abs(hostError));
+        }
+    }
+
+    // The firmware's statistics and what is left queued
+    std::string status = sim.command("c").output;
+    unsigned queued = 0, run = 0, firmwareLate = 0;
+    const char* line = strstr(status.c_str(), "Schedule ");
+    const char* row = strstr(status.c_str(), "run,late");
+    if ((line == NULL) || (row == NULL) || (sscanf(line, "Schedule %u queued", &queued) != 1) ||
+        (sscanf(strchr(row, '\n') + 1, "%u,%u", &run, &firmwareLate) != 2))
+    {
+        fprintf(stderr, "unexpected status: %s\n", status.c_str());
+        return 1;
+    }
+
+    if (csv)
+    {
+        printf("tick,command,landed,error_cycles\n");
+        for (size_t i = 0; i < plan.size(); i++)
+        {
+            printf("%u,%s,%u,%lld\n", plan[i].tick, plan[i].command.c_str(), plan[i].landed,
+                   (long long) plan[i].error);
+        }
+        return 0;
+    }
+
+    printf("%8s %8s %8s %10s %10s %8s %8s %8s %9s", "commands", "missing", "late", "min_err", "max_err", "fw_run",
+           "fw_late", "queued", "refused");
+    if (sync)
+    {
+        printf(" %10s %10s %10s %12s", "sync_us", "bound_us", "drift_ppm", "host_err_us");
+    }
+    printf("\n");
+    printf("%8u %8u %8u %10lld %10lld %8u %8u %8u %9s", commands, missing, late, (long long) minError,
+           (long long) maxError, run, firmwareLate, queued, refusedWrong ? "no" : "yes");
+    if (sync)
+    {
+        printf(" %10.1f %10.1f %10.1f %12lld", syncErrorUs, syncBoundUs, clockSync.driftPpm(),
+               (long long) maxHostError);
+    }
+    printf("\n");
+
+    return (missing || late || firmwareLate || queued || refusedWrong || (run != commands)) ? 1 : 0;
+}
@@ -0,0 +1,334 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Spectral purity of the DDS output for a sweep of frequency settings.
+ *
+ *  Every setting goes through the real firmware (command parsing, the tuning word math in sendFrequency(), the phase
+ *  math in sendPhase()) into the AD983x emulator.  The captured register states are then rendered, windowed and
+ *  transformed on all cores, and SFDR, THD and the frequency error are reported per setting.
+ *
+ *  chirp_spectrum [--start Hz] [--stop Hz] [--count N] [--log] [--file frequencies.txt] [--waveform sine|tri|sq|sq2]
+ *                 [--phase deg] [--points N] [--decimate D] [--harmonics H] [--mclk Hz] [--threads T] [--csv]
+ *
+ *  The record is points samples taken every decimate MCLK periods, frequencies that land within a few bins of DC or
+ *  Nyquist of that record are reported as not analyzable.
+ */
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <vector>
+#include "Ad983xEmulator.h"
+#include "ChirpSim.h"
+#include "SpectrumAnalyzer.h"
+
+struct SpectrumSetting
+{
+    uint32_t requestedHz;
+    Ad983xState state;
+    SpectrumMetrics metrics;
+};
+
+struct SpectrumJob
+{
+    std::vector<SpectrumSetting>* settings;
+    std::atomic<size_t> next;
+    size_t points;
+    uint32_t decimate;
+    unsigned harmonics;
+    double mclkHz;
+};
+
+static void analyzeSettings(SpectrumJob* job)
+{
+    SpectrumAnalyzer analyzer(job->points);
+    std::vector<float> samples(job->points);
+    double sampleRateHz = job->mclkHz / job->decimate;
+
+    for (;;)
+    {
+        size_t index = job->next.fetch_add(1);
+
+        if (index >= job->settings->size())
+        {
+            break;
+        }
+
+        SpectrumSetting& setting = (*job->settings)[index];
+        Ad983xEmulator::render(setting.state, &samples[0], samples.size(), job->decimate);
+        setting.metrics = analyzer.metrics(&samples[0], sampleRateHz, setting.state.outputHz(job->mclkHz),
+                                           job->harmonics);
+    }
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: chirp_spectrum [--start Hz] [--stop Hz] [--count N] [--log] [--file frequencies.txt]\n"
+                    "                      [--waveform sine|tri|sq|sq2] [--phase deg] [--points N] [--decimate D]\n"
+                    "                      [--harmonics H] [--mclk Hz] [--threads T] [--csv]\n");
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    double startHz = 1000;
+    double stopHz = 8000000;
+    unsigned count = 1000;
+    bool logSpacing = false;
+    const char* fileName = NULL;
+    std::string waveform = "sine";
+    unsigned phase = 0;
+    size_t points = 16384;
+    uint32_t decimate = 1;
+    unsigned harmonics = 9;
+    double mclkHz = 16000000;
+    unsigned threads = std::thread::hardware_concurrency();
+    bool csv = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+
+        if (strcmp(argv[i], "--start") == 0 && hasValue)
+        {
+            startHz = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--stop") == 0 && hasValue)
+        {
+            stopHz = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--count") == 0 && hasValue)
+        {
+            count = (unsigned) atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--log") == 0)
+        {
+            logSpacing = true;
+        }
+        else if (strcmp(argv[i], "--file") == 0 && hasValue)
+        {
+            fileName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--waveform") == 0 && hasValue)
+        {
+            waveform = argv[++i];
+        }
+        else if (strcmp(argv[i], "--phase") == 0 && hasValue)
+        {
+            phase = (unsigned) atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--points") == 0 && hasValue)
+        {
+            points = (size_t) atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--decimate") == 0 && hasValue)
+        {
+            decimate = (uint32_t) atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--harmonics") == 0 && hasValue)
+        {
+            harmonics = (unsigned) atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--mclk") == 0 && hasValue)
+        {
+            mclkHz = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+        {
+            threads = (unsigned) atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--csv") == 0)
+        {
+            csv = true;
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    if ((points < 64) || (points & (points - 1)) || (decimate == 0))
+    {
+        fprintf(stderr, "chirp_spectrum: --points must be a power of two of at least 64, --decimate at least 1\n");
+        return 1;
+    }
+
+    threads = std::max(threads, 1u);
+
+    std::vector<uint32_t> frequencies;
+
+    if (fileName)
+    {
+        std::ifstream file(fileName);
+        std::string line;
+
+        while (std::getline(file, line))
+        {
+            if (!line.empty() && line[0] != ';')
+            {
+                frequencies.push_back((uint32_t) strtoul(line.c_str(), NULL, 10));
+            }
+        }
+    }
+    else
+    {
+        for (unsigned i = 0; i < count; i++)
+        {
+            double fraction = (count > 1) ? (double) i / (count - 1) : 0.0;
+            double hz = logSpacing ? startHz * pow(stopHz / startHz, fraction) : startHz + (stopHz - startHz) * fraction;
+            frequencies.push_back((uint32_t) floor(hz + 0.5));
+        }
+    }
+
+    // Program every setting through the firmware and keep the register state it leaves behind
+    Ad983xEmulator dds;
+    ChirpSim sim;
+    std::vector<SpectrumSetting> settings(frequencies.size());
+    char command[24];
+
+    sim.attachDdsDevice(&dds);
+    sim.boot();
+    sim.command("w" + waveform);
+    snprintf(command, sizeof(command), "p%u", phase);
+    sim.command(command);
+    sim.command("O");
+
+    for (size_t i = 0; i < frequencies.size(); i++)
+    {
+        snprintf(command, sizeof(command), "f%lu", (unsigned long) frequencies[i]);
+        sim.command(command);
+        settings[i].requestedHz = frequencies[i];
+        settings[i].state = dds.state();
+    }
+
+    struct timespec wallStartTime;
+    clock_gettime(CLOCK_MONOTONIC, &wallStartTime);
+
+    SpectrumJob job;
+    job.settings = &settings;
+    job.next = 0;
+    job.points = points;
+    job.decimate = decimate;
+    job.harmonics = harmonics;
+    job.mclkHz = mclkHz;
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < threads; t++)
+    {
+        workers.push_back(std::thread(analyzeSettings, &job));
+    }
+    analyzeSettings(&job);
+    for (size_t t = 0; t < workers.size(); t++)
+    {
+        workers[t].join();
+    }
+
+    struct timespec wallEndTime;
+    clock_gettime(CLOCK_MONOTONIC, &wallEndTime);
+    double wallSeconds = (wallEndTime.tv_sec - wallStartTime.tv_sec) + (wallEndTime.tv_nsec - wallStartTime.tv_nsec) / 1e9;
+
+    if (csv)
+    {
+        printf("requested_hz,programmed_hz,error_hz,error_ppm,measured_hz,fundamental_dbfs,sfdr_dbc,spur_hz,thd_db\n");
+    }
+    else
+    {
+        printf("%12s %16s %10s %10s %9s %9s %12s %8s\n", "requested_hz", "programmed_hz", "error_hz", "error_ppm",
+               "fund_dbfs", "sfdr_dbc", "spur_hz", "thd_db");
+    }
+
+    unsigned analyzed = 0;
+    double sfdrSum = 0.0;
+    double worstSfdr = 1e9;
+    uint32_t worstSfdrHz = 0;
+    double worstErrorPpm = 0.0;
+    uint32_t worstErrorHz = 0;
+
+    for (size_t i = 0; i < settings.size(); i++)
+    {
+        const SpectrumSetting& setting = settings[i];
+        const SpectrumMetrics& metrics = setting.metrics;
+        double programmedHz = setting.state.outputHz(mclkHz);
+        double errorHz = programmedHz - setting.requestedHz;
+        double errorPpm = setting.requestedHz ? errorHz / setting.requestedHz * 1e6 : 0.0;
+
+        if (fabs(errorPpm) > fabs(worstErrorPpm))
+        {
+            worstErrorPpm = errorPpm;
+            worstErrorHz = setting.requestedHz;
+        }
+
+        if (metrics.valid)
+        {
+            analyzed++;
+            sfdrSum += metrics.sfdrDbc;
+
+            if (metrics.sfdrDbc < worstSfdr)
+            {
+                worstSfdr = metrics.sfdrDbc;
+                worstSfdrHz = setting.requestedHz;
+            }
+        }
+
+        if (csv)
+        {
+            if (metrics.valid)
+            {
+                printf("%lu,%.6f,%.6f,%.3f,%.3f,%.2f,%.2f,%.1f,%.2f\n", (unsigned long) setting.requestedHz,
+                       programmedHz, errorHz, errorPpm, metrics.fundamentalHz, metrics.fundamentalDbfs,
+                       metrics.sfdrDbc, metrics.spurHz, metrics.thdDb);
+            }
+            else
+            {
+                printf("%lu,%.6f,%.6f,%.3f,,,,,\n", (unsigned long) setting.requestedHz, programmedHz, errorHz,
+                       errorPpm);
+            }
+        }
+        else if (metrics.valid)
+        {
+            printf("%12lu %16.4f %10.4f %10.3f %9.2f %9.2f %12.1f %8.2f\n", (unsigned long) setting.requestedHz,
+                   programmedHz, errorHz, errorPpm, metrics.fundamentalDbfs, metrics.sfdrDbc, metrics.spurHz,
+                   metrics.thdDb);
+        }
+        else
+        {
+            printf("%12lu %16.4f %10.4f %10.3f %9s\n", (unsigned long) setting.requestedHz, programmedHz, errorHz,
+                   errorPpm, "n/a");
+        }
+    }
+
+    fprintf(stderr, "%u settings, %u analyzed with %u-point records on %u threads in %.3f s (%.0f settings/s)\n",
+            (unsigned) settings.size(), analyzed, (unsigned) points, threads, wallSeconds,
+            settings.size() / (wallSeconds > 0 ? wallSeconds : 1e-9));
+
+    if (analyzed)
+    {
+        fprintf(stderr, "SFDR mean %.2f dBc, worst %.2f dBc at %lu Hz; worst frequency error %.3f ppm at %lu Hz\n",
+                sfdrSum / analyzed, worstSfdr, (unsigned long) worstSfdrHz, worstErrorPpm,
+                (unsigned long) worstErrorHz);
+    }
+
+    return 0;
+}
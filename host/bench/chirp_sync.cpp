@@ -0,0 +1,286 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Stages random f, p, o and O combinations on a slave, drops the commit strobe on pin A1 at a random moment and
+ *  times the commit at the AD983x emulator: the cycles from the edge to chip select rising on the last frame, and the
+ *  registers it left.  The output is looped back to the frequency counter, so its capture interrupt is one of the
+ *  handlers the strobe has to wait for.  Every board runs the same frames, so the spread of that latency is what two
+ *  boards on one strobe can differ by.
+ *
+ *  chirp_sync [--commits N] [--seed S] [--csv]
+ *
+ *  Also checks group addressing, the refusals, an edge with nothing staged and a commit from the master's own yc.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "ChirpSim.h"
+#include "Ad983xEmulator.h"
+#include "DDS.h"
+#include "Sync.h"
+
+#define SYNC_BENCH_FRAMES       5
+#define SYNC_BENCH_POWER_BITS   (Ad983xState::AD983X_RESET | Ad983xState::AD983X_SLEEP1 | Ad983xState::AD983X_SLEEP12)
+
+struct FrameEvent
+{
+    uint64_t cycle;
+    Ad983xState state;
+};
+
+/// Notes the registers every time chip select rises
+class FrameRecorder : public Ad983xEmulator
+{
+  public:
+    virtual void deselect()
+    {
+        Ad983xEmulator::deselect();
+
+        FrameEvent event = { MockHal.cycles(), state() };
+        events.push_back(event);
+    }
+
+    std::vector<FrameEvent> events;
+};
+
+static void runFor(unsigned us)
+{
+    uint64_t end = MockHal.cycles() + (uint64_t) us * (MockHalClass::F_CPU_HZ / 1000000);
+    while (MockHal.cycles() < end)
+    {
+        MockHal.runLoopOnce();
+    }
+}
+
+static bool rejected(ChirpSim& sim, const std::string& command)
+{
+    return sim.command(command).output.find("error") != std::string::npos;
+}
+
+/// The line after the CSV header of y
+static bool syncStats(ChirpSim& sim, unsigned long stats[5], std::string& staged)
+{
+    std::string status = sim.command("y").output;
+    const char* line = strstr(status.c_str(), "staged ");
+    const char* values = strstr(status.c_str(), "commits,idle");
+
+    if ((line == NULL) || (values == NULL) || (strchr(values, '\n') == NULL))
+    {
+        return false;
+    }
+    staged = std::string(line + 7, strcspn(line + 7, "\r\n"));
+    return sscanf(strchr(values, '\n') + 1, "%lu,%lu,%lu,%lu,%lu", &stats[0], &stats[1], &stats[2], &stats[3],
+                  &stats[4]) == 5;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned commits = 200, seed = 1;
+    bool csv = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--commits") == 0 && i + 1 < argc) commits = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0) csv = true;
+        else
+        {
+            fprintf(stderr, "usage: chirp_sync [--commits N] [--seed S] [--csv]\n");
+            return 1;
+        }
+    }
+
+    std::mt19937 random(seed);
+    FrameRecorder dds;
+    ChirpSim sim;
+
+    sim.attachDdsDevice(&dds);
+    MockHal.setCaptureSource(Ad983xEmulator::captureHz, &dds);
+    sim.boot();
+
+    // The strobe idles high on the pull-ups of the boards
+    MockHal.setPinInput(SYNC_STROBE_PIN, HIGH);
+
+    // Refused: staging while off, out of range, groups past the limit
+    unsigned refusedWrong = 0;
+    refusedWrong += !rejected(sim, "yf1000");
+    sim.command("y1");
+    refusedWrong += !rejected(sim, "yf9000000");
+    refusedWrong += !rejected(sim, "yp400");
+    refusedWrong += !rejected(sim, "ya500");
+    refusedWrong += !rejected(sim, "yg0");
+    refusedWrong += !rejected(sim, "yg16");
+    refusedWrong += !rejected(sim, "yc");
+
+    // While staged nothing else may write the DDS from an interrupt.  Quick mode hides the errors of h1 and g1, the
+    // status tells.
+    sim.command("yf1000");
+    sim.command("h1");
+    refusedWrong += sim.command("h").output.find("Hop idle") == std::string::npos;
+    sim.command("g1");
+    refusedWrong += sim.command("g").output.find("Trigger disarmed") == std::string::npos;
+    sim.command("cd5000");
+    refusedWrong += !rejected(sim, "cqf100");
+    sim.command("yd");
+
+    // Group addressing: a command for another group is accepted and dropped
+    unsigned long stats[5];
+    std::string staged;
+    unsigned groupWrong = 0;
+    sim.command("yg2");
+    sim.command("ya3");
+    sim.command("yf1234");
+    groupWrong += !syncStats(sim, stats, staged) || (staged != "none");
+    sim.command("ya2");
+    sim.command("yf1234");
+    groupWrong += !syncStats(sim, stats, staged) || (staged != "f");
+    sim.command("ya0");
+    sim.command("yO");
+    groupWrong += !syncStats(sim, stats, staged) || (staged != "fO");
+    sim.command("yd");
+
+    // An edge with nothing staged only counts
+    MockHal.setPinInput(SYNC_STROBE_PIN, LOW);
+    runFor(100);
+    MockHal.setPinInput(SYNC_STROBE_PIN, HIGH);
+    runFor(100);
+    bool idleCounted = syncStats(sim, stats, staged) && (stats[0] == 0) && (stats[1] == 1);
+
+    // What the DDS holds outside the staged fields, from the last commit
+    uint32_t frequencyWord = dds.state().frequency[0];
+    uint16_t phase = dds.state().phase[0];
+    bool on = (dds.state().control & SYNC_BENCH_POWER_BITS) == 0;
+
+    unsigned wrongFrames = 0, wrongRegisters = 0, wrongChannel = 0;
+    uint64_t minLatency = UINT64_MAX, maxLatency = 0, totalLatency = 0;
+
+    if (csv)
+    {
+        printf("commit,staged,edge_cycle,latency\n");
+    }
+
+    for (unsigned i = 0; i < commits; i++)
+    {
+        std::string stagedText;
+        unsigned what = std::uniform_int_distribution<unsigned>(1, 7)(random);
+
+        if (what & 1)
+        {
+            uint32_t hz = std::uniform_int_distribution<uint32_t>(1000, 50000)(random);
+            sim.command("yf" + std::to_string(hz));
+            frequencyWord = DDSClass::tuningWord(hz);
+            stagedText += 'f';
+        }
+        if (what & 2)
+        {
+            unsigned degrees = std::uniform_int_distribution<unsigned>(0, 359)(random);
+            sim.command("yp" + std::to_string(degrees));
+            phase = DDSClass::phaseWord((uint16_t) degrees) & 0x0FFF;
+            stagedText += 'p';
+        }
+        if (what & 4)
+        {
+            // Mostly on, so the capture interrupt keeps running
+            on = std::uniform_int_distribution<unsigned>(0, 3)(random) != 0;
+            sim.command(on ? "yO" : "yo");
+            stagedText += on ? 'O' : 'o';
+        }
+
+        // Anywhere in the next 2 ms
+        MockHal.advance(std::uniform_int_distribution<uint64_t>(0, 2 * MockHalClass::F_CPU_HZ / 1000)(random));
+        size_t first = dds.events.size();
+        uint64_t edge = MockHal.cycles();
+        MockHal.setPinInput(SYNC_STROBE_PIN, LOW);
+        runFor(SYNC_STROBE_US);
+        MockHal.setPinInput(SYNC_STROBE_PIN, HIGH);
+        runFor(500);
+
+        if (dds.events.size() < first + SYNC_BENCH_FRAMES)
+        {
+            wrongFrames++;
+            continue;
+        }
+
+        const Ad983xState& committed = dds.events[first + SYNC_BENCH_FRAMES - 1].state;
+        uint64_t latency = dds.events[first + SYNC_BENCH_FRAMES - 1].cycle - edge;
+        bool committedOn = (committed.control & SYNC_BENCH_POWER_BITS) == 0;
+
+        wrongRegisters += (committed.frequency[0] != frequencyWord) || (committed.phase[0] != phase) ||
+                          (committedOn != on) || (committed.control & Ad983xState::AD983X_FSEL);
+
+        // A staged O restarts the output: RESET on the first frame
+        if ((what & 4) && on && !(dds.events[first].state.control & Ad983xState::AD983X_RESET))
+        {
+            wrongRegisters++;
+        }
+
+        // The channel caught up and wrote the same settings again
+        const Ad983xState& now = dds.state();
+        wrongChannel += (now.frequency[0] != frequencyWord) || (now.phase[0] != phase) ||
+                        (((now.control & SYNC_BENCH_POWER_BITS) == 0) != on);
+
+        if (latency < minLatency) minLatency = latency;
+        if (latency > maxLatency) maxLatency = latency;
+        totalLatency += latency;
+
+        if (csv)
+        {
+            printf("%u,%s,%llu,%llu\n", i, stagedText.c_str(), (unsigned long long) edge,
+                   (unsigned long long) latency);
+        }
+    }
+
+    unsigned long firmware[5] = { 0, 0, 0, 0, 0 };
+    bool statsRead = syncStats(sim, firmware, staged);
+
+    // The master drops the strobe itself and commits through its own pin change interrupt
+    sim.command("y2");
+    sim.command("yf4321");
+    size_t first = dds.events.size();
+    bool masterWrong = rejected(sim, "yc") || (dds.events.size() < first + SYNC_BENCH_FRAMES) ||
+                       (dds.events[first + SYNC_BENCH_FRAMES - 1].state.frequency[0] != DDSClass::tuningWord(4321)) ||
+                       MockHal.isPinOutput(SYNC_STROBE_PIN);
+    sim.command("y0");
+
+    if (csv)
+    {
+        return 0;
+    }
+
+    unsigned measured = commits - wrongFrames;
+    printf("%8s %8s %8s %8s %8s %8s %10s %10s %10s %7s %6s %6s\n", "commits", "min", "avg", "max", "spread",
+           "fw_min", "wrong_regs", "wrong_chan", "no_frames", "refused", "groups", "master");
+    printf("%8u %8llu %8llu %8llu %8llu %8lu %10u %10u %10u %7s %6s %6s\n", measured,
+           (unsigned long long) (measured ? minLatency : 0), (unsigned long long) (measured ? totalLatency / measured : 0),
+           (unsigned long long) maxLatency, (unsigned long long) (measured ? maxLatency - minLatency : 0), firmware[2],
+           wrongRegisters, wrongChannel, wrongFrames, refusedWrong ? "wrong" : "ok", groupWrong ? "wrong" : "ok",
+           masterWrong ? "wrong" : "ok");
+
+    bool statsWrong = !statsRead || (firmware[0] != measured) || !idleCounted;
+    if (statsWrong)
+    {
+        fprintf(stderr, "firmware statistics disagree: %lu commits, %lu idle edges\n", firmware[0], firmware[1]);
+    }
+
+    return (wrongRegisters || wrongChannel || wrongFrames || refusedWrong || groupWrong || masterWrong || statsWrong ||
+            (measured == 0)) ? 1 : 0;
+}
@@ -0,0 +1,377 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** A virtual Chirp: the whole firmware running against the AD983x and RPOT emulators behind a pty, for terminals,
+ *  scripts and ChirpClient to open in place of the board's USB serial port.
+ *
+ *  chirp_virtual [--instances N] [--link path] [--baud B] [--speed X] [--log file] [--log-ms N]
+ *
+ *  Prints one line per instance, the instance number and its /dev/pts path, then runs until SIGINT or SIGTERM.
+ *  Device time follows the wall clock (--speed 2 runs it twice as fast, --speed 0 as fast as the host can), so
+ *  timeouts, the millis() tick and the frequency counter behave as on the board.  Bytes cross the serial line at
+ *  the baud rate each way and the 64 byte RX buffer overflows the way the real one does.  --baud changes the line
+ *  rate the sketch opened the port with.  The DDS output is looped back to the frequency counter input.
+ *
+ *  --instances runs a fleet, one process per device because the firmware lives in globals.  --link makes a symlink
+ *  to each pty, with the instance number appended when there is more than one.  --log writes a CSV snapshot of the
+ *  device every --log-ms (default 1000), again one file per instance.
+ *
+ *  DTR does not reset the virtual device, it boots once when it starts.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "ChirpSim.h"
+#include "Ad983xEmulator.h"
+#include "RpotEmulator.h"
+
+// The longest stretch of device time run between two looks at the pty
+#define VIRTUAL_MAX_SLICE_MS        10
+
+struct VirtualOptions
+{
+    unsigned instances;
+    const char* link;
+    unsigned long baud;
+    double speed;
+    const char* log;
+    unsigned logMs;
+};
+
+/// What left the TX line, with the last prompt picked out of it for the log
+struct VirtualOutput
+{
+    std::string pending;
+    std::string line;
+    std::string prompt;
+    uint8_t escape;         //!< 1 after ESC, 2 inside a control sequence
+    uint64_t dropped;       //!< bytes nobody read
+};
+
+static volatile sig_atomic_t stopping = 0;
+
+static void onSignal(int)
+{
+    stopping = 1;
+}
+
+static double wallSeconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void collectOutput(uint8_t data, uint64_t, void* context)
+{
+    VirtualOutput* output = (VirtualOutput*) context;
+
+    output->pending.push_back((char) data);
+
+    // Skip the dashboard's escape sequences: ESC 7, ESC 8 and ESC [ ... up to a letter
+    if (output->escape == 1)
+    {
+        output->escape = (data == '[') ? 2 : 0;
+        return;
+    }
+    if (output->escape == 2)
+    {
+        output->escape = ((data >= '@') && (data <= '~')) ? 0 : 2;
+        return;
+    }
+
+    if (data == 0x1B)
+    {
+        output->escape = 1;
+    }
+    else if ((data == '\r') || (data == '\n'))
+    {
+        output->line.clear();
+    }
+    else if ((data >= ' ') && (data < 0x7F) && (output->line.size() < 80))
+    {
+        output->line.push_back((char) data);
+        if (data == '>')
+        {
+            output->prompt = output->line;
+        }
+    }
+}
+
+static void flushOutput(int master, int slave, VirtualOutput& output)
+{
+    while (!output.pending.empty())
+    {
+        ssize_t written = write(master, output.pending.data(), output.pending.size());
+        if (written <= 0)
+        {
+            // At the baud rate only a port nobody reads fills up.  Drop what waits in it, a client that opens the
+            // port later should not see old output, as with the board's USB serial.
+            output.dropped += output.pending.size();
+            output.pending.clear();
+            tcflush(slave, TCIFLUSH);
+            break;
+        }
+        output.pending.erase(0, (size_t) written);
+    }
+}
+
+static void logSnapshot(FILE* log, double wall, const Ad983xEmulator& dds, const RpotEmulator& rpot,
+                        const VirtualOutput& output)
+{
+    const Ad983xState& state = dds.state();
+    const MockCounters& counters = MockHal.counters();
+
+    fprintf(log, "%.3f,%.3f,%.3f,0x%04X,%u,%u,%u,%u,%u,%u,%u,%llu,\"%s\"\n", wall, MockHal.seconds(),
+            state.outputHz(Ad983xEmulator::MCLK_HZ), state.control, rpot.wiper(0), rpot.wiper(1),
+            MockHal.getPinOutput(9), counters.serialRxBytes, counters.serialRxDropped, counters.serialTxBytes,
+            counters.watchdogResets, (unsigned long long) output.dropped, output.prompt.c_str());
+    fflush(log);
+}
+
+/// Runs one device until a signal arrives
+static int runInstance(unsigned instance, const VirtualOptions& options)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if ((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0))
+    {
+        perror("posix_openpt");
+        return 1;
+    }
+
+    // Holding the slave open keeps the master readable while no client has the port, it would report a hang up
+    // otherwise.  Raw like the board's port, a client sets its own modes anyway.
+    std::string path = ptsname(master);
+    int slave = open(path.c_str(), O_RDWR | O_NOCTTY);
+    struct termios modes;
+    if ((slave < 0) || (tcgetattr(slave, &modes) != 0))
+    {
+        perror(path.c_str());
+        return 1;
+    }
+    cfmakeraw(&modes);
+    tcsetattr(slave, TCSANOW, &modes);
+
+    std::string link;
+    if (options.link)
+    {
+        link = options.link;
+        if (options.instances > 1)
+        {
+            link += std::to_string(instance);
+        }
+        unlink(link.c_str());
+        if (symlink(path.c_str(), link.c_str()) != 0)
+        {
+            perror(link.c_str());
+            return 1;
+        }
+    }
+
+    FILE* log = NULL;
+    if (options.log)
+    {
+        std::string logPath = options.log;
+        if (options.instances > 1)
+        {
+            logPath += "." + std::to_string(instance);
+        }
+        log = fopen(logPath.c_str(), "w");
+        if (log == NULL)
+        {
+            perror(logPath.c_str());
+            return 1;
+        }
+        fprintf(log, "wall_s,device_s,dds_hz,dds_control,wiper0,wiper1,pin9,rx_bytes,rx_dropped,tx_bytes,"
+                     "watchdog_resets,output_dropped,prompt\n");
+    }
+
+    Ad983xEmulator dds;
+    RpotEmulator rpot;
+    VirtualOutput output = VirtualOutput();
+    ChirpSim sim;
+
+    sim.attachDdsDevice(&dds);
+    sim.attachAmplifierDevice(&rpot);
+    MockHal.setCaptureSource(Ad983xEmulator::captureHz, &dds);
+    MockHal.setSerialTxListener(collectOutput, &output);
+    sim.boot();
+
+    if (options.baud)
+    {
+        // As if setup() had opened the port at this rate
+        Serial.begin(options.baud);
+    }
+
+    printf("%u %s\n", instance, path.c_str());
+    fflush(stdout);
+
+    const double cyclesPerMs = MockHalClass::F_CPU_HZ / 1000.0;
+    double wallStart = wallSeconds();
+    uint64_t deviceStart = MockHal.cycles();
+    double nextLog = 0.0;
+    uint8_t buffer[256];
+
+    while (!stopping)
+    {
+        double wall = wallSeconds() - wallStart;
+        uint64_t due = MockHal.cycles() + (uint64_t) (VIRTUAL_MAX_SLICE_MS * cyclesPerMs);
+
+        if (options.speed > 0.0)
+        {
+            uint64_t now = deviceStart + (uint64_t) (wall * options.speed * 1000.0 * cyclesPerMs);
+            if (now < due)
+            {
+                due = now;
+            }
+        }
+
+        // Wait for the client only while the device is ahead of the wall clock
+        int timeout = (MockHal.cycles() >= due) ? 1 : 0;
+        struct pollfd fds = { master, POLLIN, 0 };
+        if ((poll(&fds, 1, timeout) > 0) && (fds.revents & POLLIN))
+        {
+            ssize_t length = read(master, buffer, sizeof(buffer));
+            if (length > 0)
+            {
+                MockHal.serialInject(buffer, (size_t) length, MockHal.cycles());
+            }
+        }
+
+        while (MockHal.cycles() < due)
+        {
+            MockHal.runLoopOnce();
+        }
+
+        flushOutput(master, slave, output);
+
+        if (log && (wall >= nextLog))
+        {
+            logSnapshot(log, wall, dds, rpot, output);
+            nextLog = wall + options.logMs / 1000.0;
+        }
+    }
+
+    if (log)
+    {
+        logSnapshot(log, wallSeconds() - wallStart, dds, rpot, output);
+        fclose(log);
+    }
+    if (!link.empty())
+    {
+        unlink(link.c_str());
+    }
+    close(slave);
+    close(master);
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    VirtualOptions options = { 1, NULL, 0, 1.0, NULL, 1000 };
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) options.instances = (unsigned) atoi(argv[++i]);
+        else if (strcmp(argv[i], "--link") == 0 && i + 1 < argc) options.link = argv[++i];
+        else if (strcmp(argv[i], "--baud") == 0 && i + 1 < argc) options.baud = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) options.speed = atof(argv[++i]);
+        else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) options.log = argv[++i];
+        else if (strcmp(argv[i], "--log-ms") == 0 && i + 1 < argc) options.logMs = (unsigned) atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: chirp_virtual [--instances N] [--link path] [--baud B] [--speed X] [--log file] "
+                            "[--log-ms N]\n");
+            return 1;
+        }
+    }
+
+    if (options.instances == 0)
+    {
+        options.instances = 1;
+    }
+
+    struct sigaction action = {};
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    if (options.instances == 1)
+    {
+        return runInstance(0, options);
+    }
+
+    std::vector<pid_t> children;
+    for (unsigned i = 0; i < options.instances; i++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            return runInstance(i, options);
+        }
+        if (pid < 0)
+        {
+            perror("fork");
+            stopping = 1;
+            break;
+        }
+        children.push_back(pid);
+    }
+
+    // A terminal's Ctrl-C reaches the whole group, a SIGTERM only this process
+    int status = 0;
+    for (size_t remaining = children.size(); remaining; )
+    {
+        int childStatus;
+        pid_t pid = waitpid(-1, &childStatus, 0);
+
+        if (pid > 0)
+        {
+            remaining--;
+            if (!WIFEXITED(childStatus) || WEXITSTATUS(childStatus))
+            {
+                status = 1;
+            }
+        }
+        else if (errno == EINTR)
+        {
+            for (size_t i = 0; i < children.size(); i++)
+            {
+                kill(children[i], SIGTERM);
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+#
+#    This file is part of Chirp.
+#
+#    Chirp is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    any later version.
+#
+#    Chirp is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+#
+#    Copyright 2016 Mike Lemberger
+#
+"""Decodes the binary trace frames drained by the 't' command (see Trace.cpp).
+
+The event names are read from TRACE_EVENT_T in Trace.h so the decoder never
+falls out of step with the firmware.  ASCII output of the command line is
+skipped, only frames starting with the sync byte are decoded.
+
+    chirp_trace.py capture.bin
+    chirp_trace.py /dev/ttyACM0 --baud 57600 --drain
+"""
+
+import argparse
+import os
+import re
+import stat
+import struct
+import sys
+
+FRAME_SYNC = 0xA5
+HEADER_FORMAT = "<BHI"
+RECORD_FORMAT = "<BH3s"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+TIME_MASK = 0xFFFFFF
+
+
+def load_event_names(header_path):
+    """Returns {event id: name} parsed from the TRACE_EVENT_T enum"""
+    with open(header_path) as header:
+        text = header.read()
+
+    body = re.search(r"\{([^{}]*)\}\s*TRACE_EVENT_T;", text).group(1)
+    names = {}
+    value = 0
+
+    for line in body.splitlines():
+        line = line.split("//")[0].strip().rstrip(",")
+        if not line:
+            continue
+        if "=" in line:
+            name, number = [part.strip() for part in line.split("=")]
+            value = int(number, 0)
+        else:
+            name = line
+        names[value] = name.replace("TRACE_EVENT_", "")
+        value += 1
+
+    return names
+
+
+def decode_frames(data):
+    """Yields (drain time us, dropped, [(event, arg, time us)]) for every valid frame in data"""
+    index = 0
+
+    while True:
+        index = data.find(bytes([FRAME_SYNC]), index)
+        if index < 0 or index + 1 + HEADER_SIZE > len(data):
+            return
+
+        count, dropped, drain_us = struct.unpack_from(HEADER_FORMAT, data, index + 1)
+        end = index + 1 + HEADER_SIZE + count * RECORD_SIZE
+
+        if end >= len(data):
+            return
+
+        checksum = 0
+        for byte in data[index + 1:end]:
+            checksum ^= byte
+
+        if checksum != data[end]:
+            # Not a frame, the sync value appeared inside one
+            index += 1
+            continue
+
+        records = []
+        for n in range(count):
+            event, arg, time_bytes = struct.unpack_from(RECORD_FORMAT, data, index + 1 + HEADER_SIZE + n * RECORD_SIZE)
+            record_us = int.from_bytes(time_bytes, "little")
+            # Records carry the low 24 bits of the time, rebuild them relative to the drain time
+            age_us = (drain_us - record_us) & TIME_MASK
+            records.append((event, arg, drain_us - age_us))
+
+        yield drain_us, dropped, records
+        index = end + 1
+
+
+def read_input(path, baud, drain):
+    if path == "-" or not stat.S_ISCHR(os.stat(path).st_mode):
+        with (sys.stdin.buffer if path == "-" else open(path, "rb")) as source:
+            return source.read()
+
+    import serial  # pyserial is only needed when reading the device directly
+
+    with serial.Serial(path, baud, timeout=0.5) as port:
+        if drain:
+            port.write(b"t\r")
+        data = b""
+        while True:
+            chunk = port.read(4096)
+            if not chunk:
+                return data
+            data += chunk
+
+
+def main():
+    default_header = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Trace.h")
+
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="capture file, '-' for stdin, or a serial device")
+    parser.add_argument("--baud", type=int, default=57600)
+    parser.add_argument("--drain", action="store_true", help="send the 't' command before reading a serial device")
+    parser.add_argument("--header", default=default_header, help="path to Trace.h")
+    args = parser.parse_args()
+
+    names = load_event_names(args.header)
+    data = read_input(args.input, args.baud, args.drain)
+
+    for drain_us, dropped, records in decode_frames(data):
+        if dropped:
+            print("# {} records dropped before {} us".format(dropped, drain_us))
+        for event, arg, time_us in records:
+            name = names.get(event, "EVENT_{}".format(event))
+            print("{:>12} us  {:<24} {:5d}  0x{:04X}".format(time_us, name, arg, arg))
+
+
+if __name__ == "__main__":
+    main()
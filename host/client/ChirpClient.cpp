@@ -0,0 +1,875 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include "ChirpClient.h"
+
+// Bode records, see Bode.h
+#define RECORD_SYNC     '\xA5'
+#define RECORD_SIZE     13
+
+// Spread of the kept cs samples, in bracket widths, that a drift is fitted from
+#define SYNC_MIN_SPREAD             1000.0
+// How far an Uno's ceramic resonator can be from 16 MHz, for the error without a fitted drift
+#define SYNC_RESONATOR_TOLERANCE    0.005
+
+static const char errorText[] = "An error has occurred";
+static const char* const waveformNames[] = { "SIN", "TRI", "SQ", "SQ2", "ARB", "PUL" };
+static const char* const waveformCommands[] = { "wsin", "wtri", "wsq", "wsq2", "", "wpulse" };
+
+ChirpClient::ChirpClient()
+{
+    fd = -1;
+    wakePipe[0] = -1;
+    wakePipe[1] = -1;
+    stopping = false;
+    inFlightBytes = 0;
+    resyncing = false;
+    resyncFailures = 0;
+    scanned = 0;
+    memset(&current, 0, sizeof(current));
+    quick = false;
+}
+
+ChirpClient::~ChirpClient()
+{
+    close();
+}
+
+bool ChirpClient::open(const std::string& path, const ChirpClientOptions& newOptions)
+{
+    static const struct { unsigned baud; speed_t speed; } speeds[] =
+    {
+        { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 }, { 115200, B115200 }
+    };
+
+    int port = ::open(path.c_str(), O_RDWR | O_NOCTTY);
+    if (port < 0)
+    {
+        error = path + ": " + strerror(errno);
+        return false;
+    }
+
+    struct termios settings;
+    if (tcgetattr(port, &settings) == 0)
+    {
+        cfmakeraw(&settings);
+        settings.c_cflag |= CLOCAL | CREAD;
+        settings.c_cc[VMIN] = 1;
+        settings.c_cc[VTIME] = 0;
+
+        for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+        {
+            if (speeds[i].baud == newOptions.baud)
+            {
+                cfsetispeed(&settings, speeds[i].speed);
+                cfsetospeed(&settings, speeds[i].speed);
+            }
+        }
+
+        tcsetattr(port, TCSANOW, &settings);
+    }
+
+    if (newOptions.resetWaitMs)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(newOptions.resetWaitMs));
+    }
+
+    tcflush(port, TCIFLUSH);
+    return attach(port, newOptions);
+}
+
+bool ChirpClient::attach(int newFd, const ChirpClientOptions& newOptions)
+{
+    close();
+
+    if (pipe(wakePipe) != 0)
+    {
+        error = strerror(errno);
+        ::close(newFd);
+        return false;
+    }
+
+    options = newOptions;
+    fd = newFd;
+    stopping = false;
+    error.clear();
+    rx.clear();
+    scanned = 0;
+
+    // A CR ends whatever half line the sketch has, the prompt after it is where the client starts
+    resyncing = true;
+    resyncFailures = 0;
+    writeAll("\r", 1);
+    lastActivity = Clock::now();
+
+    ioThread = std::thread(&ChirpClient::run, this);
+
+    if (!configure())
+    {
+        std::string reason = lastError();
+        close();
+        error = reason;
+        return false;
+    }
+
+    return true;
+}
+
+void ChirpClient::close()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+
+    if (ioThread.joinable())
+    {
+        char wake = 0;
+        if (write(wakePipe[1], &wake, 1) < 0)
+        {
+            // The thread still sees stopping at its next timeout
+        }
+        ioThread.join();
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    failAll(CHIRP_REPLY_CLOSED);
+
+    if (fd >= 0)
+    {
+        ::close(fd);
+        ::close(wakePipe[0]);
+        ::close(wakePipe[1]);
+        fd = -1;
+        wakePipe[0] = -1;
+        wakePipe[1] = -1;
+    }
+}
+
+bool ChirpClient::isOpen() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return (fd >= 0) && !stopping;
+}
+
+std::string ChirpClient::lastError() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return error;
+}
+
+std::future<ChirpReply> ChirpClient::submit(const std::string& command)
+{
+    return enqueue(command, CHECK_NONE, 0);
+}
+
+ChirpReply ChirpClient::command(const std::string& command)
+{
+    return submit(command).get();
+}
+
+std::future<ChirpReply> ChirpClient::setFrequencyHz(uint32_t frequencyHz)
+{
+    return enqueue("f" + std::to_string(frequencyHz), CHECK_FREQUENCY, frequencyHz);
+}
+
+std::future<ChirpReply> ChirpClient::setAmplitudeMv(uint32_t amplitudeMv)
+{
+    return enqueue("a" + std::to_string(amplitudeMv), CHECK_AMPLITUDE, amplitudeMv);
+}
+
+std::future<ChirpReply> ChirpClient::setPhaseDegrees(uint32_t phaseDegrees)
+{
+    return enqueue("p" + std::to_string(phaseDegrees), CHECK_PHASE, phaseDegrees);
+}
+
+std::future<ChirpReply> ChirpClient::setWaveform(ChirpWaveform waveform)
+{
+    // The wavetables have their own names (wramp, wexp, wecg, wuser), submit() sends them
+    return enqueue((waveform <= CHIRP_PULSE) ? waveformCommands[waveform] : "", CHECK_WAVEFORM, waveform);
+}
+
+std::future<ChirpReply> ChirpClient::setOutput(bool on)
+{
+    return enqueue(on ? "O" : "o", CHECK_OUTPUT, on);
+}
+
+bool ChirpClient::syncClock(ChirpClockSync& sync, unsigned samples)
+{
+    const int64_t byteNs = 10000000000LL / options.baud;
+
+    sync.clear();
+
+    for (unsigned i = 0; i < samples; i++)
+    {
+        ChirpReply reply = command("cs");
+        const char* line = strstr(reply.text.c_str(), "Sync ");
+
+        // A resent line brackets the wrong write
+        if ((reply.status != CHIRP_REPLY_OK) || (reply.attempts != 1) || (line == NULL))
+        {
+            continue;
+        }
+
+        // The CR is the third byte on the wire.  The echo of the s is still going out when the sketch reads it,
+        // everything from the echo's line break on follows.
+        sync.addSample(reply.sentNs, reply.answeredNs, (uint32_t) strtoul(line + 5, NULL, 10), 3 * byteNs,
+                       (int64_t) (reply.bytes - reply.command.size() + 1) * byteNs);
+    }
+
+    return sync.fit();
+}
+
+std::vector<std::future<ChirpReply> > ChirpClient::scheduleAt(uint32_t tick, const std::vector<std::string>& commands)
+{
+    std::vector<std::future<ChirpReply> > replies;
+
+    replies.push_back(submit("ct" + std::to_string(tick)));
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+        replies.push_back(submit("cq" + commands[i]));
+    }
+
+    return replies;
+}
+
+ChirpState ChirpClient::state() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return current;
+}
+
+void ChirpClient::setUnsolicitedListener(std::function<void(const std::string&)> listener)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    unsolicited = listener;
+}
+
+bool ChirpClient::parsePrompt(const std::string& prompt, ChirpState& state, bool& quickMode)
+{
+    const char* p = prompt.c_str();
+    char* end;
+    ChirpState parsed;
+
+    if ((prompt.size() < 2) || (prompt[prompt.size() - 1] != '>'))
+    {
+        return false;
+    }
+
+    if ((*p >= '0') && (*p <= '9'))
+    {
+        // Compact: waveform,frequency,amplitude,phase,output>
+        uint32_t fields[5];
+
+        for (int i = 0; i < 5; i++)
+        {
+            if ((*p < '0') || (*p > '9'))
+            {
+                return false;
+            }
+
+            fields[i] = strtoul(p, &end, 10);
+            p = end;
+
+            if (*p++ != ((i < 4) ? ',' : '>'))
+            {
+                return false;
+            }
+        }
+
+        if ((*p != '\0') || (fields[0] > CHIRP_PULSE) || (fields[4] > 1))
+        {
+            return false;
+        }
+
+        parsed.waveform = (ChirpWaveform) fields[0];
+        parsed.frequencyHz = fields[1];
+        parsed.amplitudeMv = fields[2];
+        parsed.phaseDegrees = fields[3];
+        parsed.output = fields[4];
+        state = parsed;
+        return true;
+    }
+
+    // Full: [Q_]NAME_F#_A#_P#_ON> or _OFF>
+    bool isQuick = (strncmp(p, "Q_", 2) == 0);
+    if (isQuick)
+    {
+        p += 2;
+    }
+
+    const char* nameEnd = strchr(p, '_');
+    if (nameEnd == NULL)
+    {
+        return false;
+    }
+
+    size_t waveform = 0;
+    while ((waveform <= CHIRP_PULSE) &&
+           ((strlen(waveformNames[waveform]) != (size_t) (nameEnd - p)) ||
+            (strncmp(p, waveformNames[waveform], nameEnd - p) != 0)))
+    {
+        waveform++;
+    }
+
+    if (waveform > CHIRP_PULSE)
+    {
+        return false;
+    }
+
+    p = nameEnd;
+    const char* tags[3] = { "_F", "_A", "_P" };
+    uint32_t fields[3];
+
+    for (int i = 0; i < 3; i++)
+    {
+        if ((strncmp(p, tags[i], 2) != 0) || (p[2] < '0') || (p[2] > '9'))
+        {
+            return false;
+        }
+
+        fields[i] = strtoul(p + 2, &end, 10);
+        p = end;
+    }
+
+    if (strcmp(p, "_ON>") == 0)
+    {
+        parsed.output = true;
+    }
+    else if (strcmp(p, "_OFF>") == 0)
+    {
+        parsed.output = false;
+    }
+    else
+    {
+        return false;
+    }
+
+    parsed.waveform = (ChirpWaveform) waveform;
+    parsed.frequencyHz = fields[0];
+    parsed.amplitudeMv = fields[1];
+    parsed.phaseDegrees = fields[2];
+    state = parsed;
+    quickMode = isQuick;
+    return true;
+}
+
+// Private Functions_________________________________________________________________
+
+std::future<ChirpReply> ChirpClient::enqueue(const std::string& command, CHECK_T check, uint32_t expected)
+{
+    Request request;
+    request.command = command;
+    request.check = check;
+    request.expected = expected;
+    request.attempts = 0;
+    request.promise = std::make_shared<std::promise<ChirpReply> >();
+
+    std::future<ChirpReply> future = request.promise->get_future();
+    std::lock_guard<std::mutex> guard(lock);
+
+    if ((command.size() > MAX_COMMAND_LENGTH) || (command.find_first_of("\r\n") != std::string::npos) ||
+        ((check == CHECK_WAVEFORM) && ((expected == CHIRP_ARBITRARY) || (expected > CHIRP_PULSE))))
+    {
+        complete(request, CHIRP_REPLY_INVALID, "");
+    }
+    else if ((fd < 0) || stopping)
+    {
+        complete(request, CHIRP_REPLY_CLOSED, "");
+    }
+    else
+    {
+        queued.push_back(request);
+
+        char wake = 0;
+        if (write(wakePipe[1], &wake, 1) < 0)
+        {
+            // The pipe is full, the thread is awake already
+        }
+    }
+
+    return future;
+}
+
+bool ChirpClient::configure()
+{
+    // The full prompt is the only one that shows quick mode, % toggles it
+    ChirpReply reply = command("k0");
+
+    for (int i = 0; (i < 2) && (reply.status == CHIRP_REPLY_OK) && (quick != options.quick); i++)
+    {
+        reply = command("%");
+    }
+
+    if ((reply.status == CHIRP_REPLY_OK) && options.compactPrompt)
+    {
+        reply = command("k1");
+    }
+
+    if ((reply.status != CHIRP_REPLY_OK) || (quick != options.quick))
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (error.empty())
+        {
+            error = "no prompt from the device";
+        }
+        return false;
+    }
+
+    return true;
+}
+
+void ChirpClient::run()
+{
+    char buffer[256];
+
+    for (;;)
+    {
+        int waitMs = -1;
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+
+            if (stopping)
+            {
+                break;
+            }
+
+            writeAhead();
+
+            if (resyncing || !inFlight.empty())
+            {
+                Clock::time_point due = lastActivity + std::chrono::milliseconds(options.timeoutMs);
+                Clock::time_point now = Clock::now();
+
+                if (now >= due)
+                {
+                    resyncing ? resyncTimedOut() : lostSync();
+                    continue;
+                }
+
+                waitMs = (int) std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count() + 1;
+            }
+        }
+
+        struct pollfd fds[2] = { { fd, POLLIN, 0 }, { wakePipe[0], POLLIN, 0 } };
+        if (poll(fds, 2, waitMs) < 0)
+        {
+            continue;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            if (read(wakePipe[0], buffer, sizeof(buffer)) < 0)
+            {
+                // Nothing to drain
+            }
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            std::vector<std::string> pending;
+            std::function<void(const std::string&)> listener;
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+
+                if ((length == 0) || ((length < 0) && (errno != EINTR) && (errno != EAGAIN)))
+                {
+                    // Unplugged, or the other end of the pty went away
+                    error = "device closed";
+                    stopping = true;
+                    failAll(CHIRP_REPLY_CLOSED);
+                    break;
+                }
+
+                if (length > 0)
+                {
+                    rx.append(buffer, length);
+                    lastActivity = Clock::now();
+                    parse();
+                }
+
+                pending.swap(notices);
+                listener = unsolicited;
+            }
+
+            for (size_t i = 0; listener && (i < pending.size()); i++)
+            {
+                listener(pending[i]);
+            }
+        }
+    }
+}
+
+/// Writes queued commands while the window has room, the first one always goes
+void ChirpClient::writeAhead()
+{
+    while (!resyncing && !queued.empty() &&
+           (inFlight.empty() || (inFlightBytes + queued.front().command.size() + 1 <= options.windowBytes)))
+    {
+        Request& request = queued.front();
+        std::string line = request.command + "\r";
+
+        if (inFlight.empty())
+        {
+            lastActivity = Clock::now();
+        }
+
+        writeAll(line.data(), line.size());
+        request.attempts++;
+        request.sent = Clock::now();
+        inFlightBytes += line.size();
+        inFlight.push_back(request);
+        queued.pop_front();
+    }
+}
+
+void ChirpClient::writeAll(const char* data, size_t length)
+{
+    while (length)
+    {
+        ssize_t written = write(fd, data, length);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // A dead port shows up on the read side
+            return;
+        }
+
+        data += written;
+        length -= written;
+    }
+}
+
+/// Takes Bode records and complete replies off the front of what has been received
+void ChirpClient::parse()
+{
+    while (scanned < rx.size())
+    {
+        if (rx[scanned] == RECORD_SYNC)
+        {
+            if (rx.size() - scanned < RECORD_SIZE)
+            {
+                return;
+            }
+
+            notices.push_back(rx.substr(scanned, RECORD_SIZE));
+            rx.erase(scanned, RECORD_SIZE);
+            continue;
+        }
+
+        if (rx[scanned] == '>')
+        {
+            // A prompt is a whole line; a '>' inside a line (the profiler's header has one) is text
+            size_t start = rx.find_last_of("\r\n", scanned);
+            start = (start == std::string::npos) ? 0 : start + 1;
+
+            ChirpState state;
+            bool quickMode = quick;
+
+            if (parsePrompt(rx.substr(start, scanned + 1 - start), state, quickMode))
+            {
+                std::string segment = rx.substr(0, scanned + 1);
+                rx.erase(0, scanned + 1);
+                scanned = 0;
+                handleSegment(segment);
+                continue;
+            }
+        }
+
+        scanned++;
+    }
+}
+
+void ChirpClient::handleSegment(const std::string& segment)
+{
+    size_t promptStart = segment.find_last_of("\r\n");
+    promptStart = (promptStart == std::string::npos) ? 0 : promptStart + 1;
+    std::string body = segment.substr(0, promptStart);
+
+    parsePrompt(segment.substr(promptStart), current, quick);
+
+    if (resyncing)
+    {
+        // Replies to what was lost come first, the empty line's echo is the last one
+        if (body.compare(0, 2, "\n\r") == 0)
+        {
+            resyncing = false;
+            resyncFailures = 0;
+        }
+        return;
+    }
+
+    if (!inFlight.empty())
+    {
+        Request& request = inFlight.front();
+        std::string echo = request.command + "\n\r";
+
+        if (body.compare(0, echo.size(), echo) == 0)
+        {
+            std::string text = body.substr(echo.size());
+            bool applied = true;
+
+            switch (request.check)
+            {
+                case CHECK_FREQUENCY: applied = (current.frequencyHz == request.expected); break;
+                case CHECK_AMPLITUDE: applied = (current.amplitudeMv == request.expected); break;
+                case CHECK_PHASE:     applied = (current.phaseDegrees == request.expected); break;
+                case CHECK_WAVEFORM:  applied = ((uint32_t) current.waveform == request.expected); break;
+                case CHECK_OUTPUT:    applied = ((uint32_t) current.output == request.expected); break;
+                default: break;
+            }
+
+            bool rejected = !applied || (text.find(errorText) != std::string::npos);
+            inFlightBytes -= request.command.size() + 1;
+            complete(request, rejected ? CHIRP_REPLY_REJECTED : CHIRP_REPLY_OK, text, segment.size());
+            inFlight.pop_front();
+            return;
+        }
+    }
+
+    // The sketch ends an echo with \n\r and its own lines with \r\n, an echo that is not ours means lost bytes
+    size_t echoEnd = body.find("\n\r");
+    size_t lineEnd = body.find("\r\n");
+
+    if ((echoEnd != std::string::npos) && ((lineEnd == std::string::npos) || (echoEnd < lineEnd)))
+    {
+        lostSync();
+        return;
+    }
+
+    notices.push_back(segment);
+}
+
+void ChirpClient::complete(Request& request, ChirpReplyStatus status, const std::string& text, size_t bytes)
+{
+    ChirpReply reply;
+    reply.status = status;
+    reply.command = request.command;
+    reply.text = text;
+    reply.state = current;
+    reply.attempts = request.attempts;
+    reply.latencyMs = request.attempts ?
+        std::chrono::duration<double, std::milli>(Clock::now() - request.sent).count() : 0.0;
+    reply.sentNs = request.attempts ?
+        std::chrono::duration_cast<std::chrono::nanoseconds>(request.sent.time_since_epoch()).count() : 0;
+    reply.answeredNs = ChirpClockSync::nowNs();
+    reply.bytes = bytes;
+    request.promise->set_value(reply);
+}
+
+/// Resends what was in flight once the sketch answers a bare CR
+void ChirpClient::lostSync()
+{
+    while (!inFlight.empty())
+    {
+        Request& request = inFlight.back();
+
+        if (request.attempts > options.retries)
+        {
+            complete(request, CHIRP_REPLY_TIMEOUT, "");
+        }
+        else
+        {
+            queued.push_front(request);
+        }
+
+        inFlight.pop_back();
+    }
+
+    inFlightBytes = 0;
+    resyncing = true;
+    resyncFailures = 0;
+    writeAll("\r", 1);
+    lastActivity = Clock::now();
+}
+
+void ChirpClient::resyncTimedOut()
+{
+    // Nothing is in flight while resyncing, what waits in the queue gives up after as many tries as a command
+    if (++resyncFailures > options.retries)
+    {
+        failAll(CHIRP_REPLY_TIMEOUT);
+        resyncFailures = 0;
+    }
+
+    writeAll("\r", 1);
+    lastActivity = Clock::now();
+}
+
+void ChirpClient::failAll(ChirpReplyStatus status)
+{
+    for (size_t i = 0; i < inFlight.size(); i++)
+    {
+        complete(inFlight[i], status, "");
+    }
+
+    for (size_t i = 0; i < queued.size(); i++)
+    {
+        complete(queued[i], status, "");
+    }
+
+    inFlight.clear();
+    queued.clear();
+    inFlightBytes = 0;
+}
+
+ChirpClockSync::ChirpClockSync()
+{
+    clear();
+}
+
+void ChirpClockSync::clear()
+{
+    taken.clear();
+    lastTick = 0;
+    valid = false;
+    originNs = 0;
+    originTick = 0.0;
+    ticksPerNs = TICKS_PER_US / 1000.0;
+    uncertaintyNs = 0.0;
+    rateError = SYNC_RESONATOR_TOLERANCE;
+}
+
+void ChirpClockSync::addSample(int64_t sentNs, int64_t answeredNs, uint32_t tick, int64_t leadNs, int64_t trailNs)
+{
+    int64_t earliest = sentNs + leadNs;
+    int64_t latest = answeredNs - trailNs;
+
+    // Bounds that cross (a pty faster than its baud rate, the last byte still on its way out) still have the tick
+    // near their middle, how far they cross is as good an error as a width
+    Sample sample;
+    sample.hostNs = earliest + (latest - earliest) / 2;
+    sample.halfWidthNs = llabs(latest - earliest) / 2;
+    sample.tick = taken.empty() ? tick : taken.back().tick + (int32_t) (tick - lastTick);
+    lastTick = tick;
+    taken.push_back(sample);
+}
+
+bool ChirpClockSync::fit()
+{
+    valid = false;
+    if (taken.empty())
+    {
+        return false;
+    }
+
+    std::vector<Sample> kept(taken);
+    std::sort(kept.begin(), kept.end(),
+              [](const Sample& a, const Sample& b) { return a.halfWidthNs < b.halfWidthNs; });
+    kept.resize(std::max<size_t>(std::min<size_t>(2, kept.size()), kept.size() / 4));
+
+    // Least squares around the first kept sample
+    double meanNs = 0.0, meanTick = 0.0, halfWidth = 0.0;
+    for (size_t i = 0; i < kept.size(); i++)
+    {
+        meanNs += (double) (kept[i].hostNs - kept[0].hostNs);
+        meanTick += (double) (kept[i].tick - kept[0].tick);
+        halfWidth += (double) kept[i].halfWidthNs;
+    }
+    meanNs /= kept.size();
+    meanTick /= kept.size();
+    halfWidth /= kept.size();
+
+    double sxx = 0.0, sxy = 0.0;
+    for (size_t i = 0; i < kept.size(); i++)
+    {
+        double x = (double) (kept[i].hostNs - kept[0].hostNs) - meanNs;
+        sxx += x * x;
+        sxy += x * ((double) (kept[i].tick - kept[0].tick) - meanTick);
+    }
+
+    // The slope is only better than the nominal rate once the samples spread over a thousand bracket widths
+    originNs = kept[0].hostNs + (int64_t) meanNs;
+    originTick = (double) kept[0].tick + meanTick;
+    double spreadNs = sqrt(sxx / kept.size());
+    if (spreadNs > SYNC_MIN_SPREAD * halfWidth)
+    {
+        ticksPerNs = sxy / sxx;
+        rateError = halfWidth / spreadNs;
+    }
+    else
+    {
+        ticksPerNs = TICKS_PER_US / 1000.0;
+        rateError = SYNC_RESONATOR_TOLERANCE;
+    }
+
+    double scatter = 0.0;
+    for (size_t i = 0; i < kept.size(); i++)
+    {
+        double residual = (double) kept[i].tick - (originTick + ticksPerNs * (double) (kept[i].hostNs - originNs));
+        scatter += residual * residual;
+    }
+    uncertaintyNs = halfWidth + sqrt(scatter / kept.size()) / ticksPerNs;
+
+    valid = true;
+    return true;
+}
+
+bool ChirpClockSync::isValid() const
+{
+    return valid;
+}
+
+uint32_t ChirpClockSync::toDeviceTick(int64_t hostNs) const
+{
+    return (uint32_t) (int64_t) llround(originTick + ticksPerNs * (double) (hostNs - originNs));
+}
+
+int64_t ChirpClockSync::toHostNs(uint32_t tick) const
+{
+    // The tick nearest the fit, within half a wrap either way
+    int32_t ticks = (int32_t) (tick - (uint32_t) (int64_t) llround(originTick));
+    return originNs + (int64_t) llround(ticks / ticksPerNs);
+}
+
+double ChirpClockSync::uncertaintyUs(int64_t hostNs) const
+{
+    return (uncertaintyNs + rateError * (double) llabs(hostNs - originNs)) / 1000.0;
+}
+
+double ChirpClockSync::driftPpm() const
+{
+    return (ticksPerNs * 1000.0 / TICKS_PER_US - 1.0) * 1e6;
+}
+
+size_t ChirpClockSync::samples() const
+{
+    return taken.size();
+}
+
+int64_t ChirpClockSync::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,264 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Drives a Chirp from a Linux host over its serial port, with the same commands and prompts a terminal uses.
+ *
+ *  The sketch answers every line with its echo, "\n\r", whatever the command prints and the prompt.  The client queues
+ *  requests per device and writes them ahead of the replies for as long as they fit the sketch's 64 byte RX buffer,
+ *  then pairs each prompt with the oldest request whose echo it carries.  Text with no echo in front (a counter
+ *  result, "Bode done", a watchdog restore) is unsolicited: it updates the state and goes to the listener, and so do
+ *  Bode records, which are taken out whole so their bytes are never read as a prompt.
+ *
+ *  No prompt within the timeout, or a prompt behind somebody else's echo, means bytes were lost on the line.  The
+ *  client then sends a bare CR until the sketch answers it and resends everything that was in flight, up to the retry
+ *  count.  Commands that toggle (%, ti) can run twice that way.  A command the sketch rejects is not retried.
+ *
+ *  Every call is thread safe.  Each client owns one I/O thread, so one process drives several devices in parallel
+ *  with one client each.
+ *
+ *  syncClock() maps the host's steady clock to the sketch's Timer1 ticks for scheduleAt(), see Schedule.h.
+ */
+#ifndef ChirpClient_h
+#define ChirpClient_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Same numbers as WAVEFORM_T and the compact prompt
+typedef enum
+{
+    CHIRP_SINE = 0,
+    CHIRP_TRIANGLE,
+    CHIRP_SQUARE,
+    CHIRP_SQUARE_DIV_2,
+    CHIRP_ARBITRARY,
+    CHIRP_PULSE
+} ChirpWaveform;
+
+/// @brief What the last prompt reported
+struct ChirpState
+{
+    ChirpWaveform waveform;
+    uint32_t frequencyHz;
+    uint32_t amplitudeMv;
+    uint32_t phaseDegrees;
+    bool output;
+};
+
+typedef enum
+{
+    CHIRP_REPLY_OK = 0,
+    CHIRP_REPLY_REJECTED,        //!< the sketch printed an error, or the prompt does not show the new setting
+    CHIRP_REPLY_TIMEOUT,         //!< no matching prompt after every retry
+    CHIRP_REPLY_INVALID,         //!< not sent, longer than the sketch's line or with a line break in it
+    CHIRP_REPLY_CLOSED           //!< the client was closed before the reply came
+} ChirpReplyStatus;
+
+/// @brief The answer to one command
+struct ChirpReply
+{
+    ChirpReplyStatus status;
+    std::string command;
+    std::string text;            //!< what the sketch printed between the echo and the prompt
+    ChirpState state;            //!< from the prompt that ended the reply
+    unsigned attempts;
+    double latencyMs;            //!< from the last write of the command to its prompt
+    int64_t sentNs;              //!< ChirpClockSync::nowNs() after the last write of the command
+    int64_t answeredNs;          //!< and when its prompt had come
+    size_t bytes;                //!< of the reply, echo and prompt included
+};
+
+/// @brief Settings for open() and attach()
+struct ChirpClientOptions
+{
+    ChirpClientOptions() :
+        baud(57600), quick(true), compactPrompt(true), timeoutMs(500), retries(2), windowBytes(48), resetWaitMs(0)
+    {
+    }
+
+    unsigned baud;
+    bool quick;                  //!< % mode, a failed command never opens a sub-menu
+    bool compactPrompt;          //!< k1, about half the bytes of the full prompt
+    unsigned timeoutMs;          //!< without a byte from the sketch while a reply is due
+    unsigned retries;
+    size_t windowBytes;          //!< command bytes written ahead of their replies, below the 64 byte RX buffer
+    unsigned resetWaitMs;        //!< opening the port resets an Uno, its bootloader takes about 1.6 s
+};
+
+/** @brief Host steady clock to sketch ticks (Clock.cycles(), 16 per us), from cs exchanges.
+ *
+ *  Every exchange brackets the tick the sketch read the line end at: after the host wrote the line and its bytes were
+ *  on the wire, before the reply came in less the bytes that followed the line end.  The tick sits somewhere in the
+ *  bracket, the middle of it is the estimate and half its width the error bound.  USB adds a millisecond or so of
+ *  polling each way, so only the exchanges with the narrowest brackets are kept and a line through them gives offset
+ *  and drift.  A resonator is off by up to 0.5%, so the drift only comes out well from samples a second or more
+ *  apart, and the fit has to be redone within the 268 s a tick takes to wrap.
+ */
+class ChirpClockSync
+{
+  public:
+    ChirpClockSync();
+
+    void clear();
+    /// One exchange in host order: the write of cs, its prompt and the tick it printed.  leadNs and trailNs are the
+    /// line time of the bytes before the line end reached the sketch and after it, they narrow the bracket.
+    void addSample(int64_t sentNs, int64_t answeredNs, uint32_t tick, int64_t leadNs = 0, int64_t trailNs = 0);
+    /// Fits the narrowest quarter of the samples, at least two.  False without any sample.
+    bool fit();
+    bool isValid() const;
+
+    uint32_t toDeviceTick(int64_t hostNs) const;
+    int64_t toHostNs(uint32_t tick) const;
+    /// Error bound of toDeviceTick() at a host time: the brackets and the scatter of the kept samples, plus what the
+    /// rate can be off by since the samples
+    double uncertaintyUs(int64_t hostNs) const;
+    /// Device clock against its nominal 16 MHz, as seen by the host clock
+    double driftPpm() const;
+    size_t samples() const;
+
+    static int64_t nowNs();
+    static const uint32_t TICKS_PER_US = 16;
+
+  private:
+    struct Sample
+    {
+        int64_t hostNs;         //!< middle of the bracket
+        int64_t halfWidthNs;
+        int64_t tick;           //!< unwrapped from the first sample
+    };
+
+    std::vector<Sample> taken;
+    uint32_t lastTick;
+    bool valid;
+    int64_t originNs;           //!< host time of the fitted offset
+    double originTick;
+    double ticksPerNs;
+    double uncertaintyNs;
+    double rateError;           //!< of ticksPerNs, relative
+};
+
+class ChirpClient
+{
+  public:
+    ChirpClient();
+    ~ChirpClient();
+
+    /// Opens a serial port, syncs with the sketch and applies the options.  False with lastError() on failure.
+    bool open(const std::string& path, const ChirpClientOptions& options = ChirpClientOptions());
+    /// The same on a descriptor that is already connected, e.g. a pty.  The client closes it.
+    bool attach(int fd, const ChirpClientOptions& options = ChirpClientOptions());
+    /// Ends the I/O thread, requests still waiting get CHIRP_REPLY_CLOSED
+    void close();
+    bool isOpen() const;
+    std::string lastError() const;
+
+    /// Queues a command line without its CR, the future is ready when its prompt has come
+    std::future<ChirpReply> submit(const std::string& command);
+    ChirpReply command(const std::string& command);
+
+    /// Typed commands, REJECTED unless the prompt that answers them shows the new value
+    std::future<ChirpReply> setFrequencyHz(uint32_t frequencyHz);
+    std::future<ChirpReply> setAmplitudeMv(uint32_t amplitudeMv);
+    std::future<ChirpReply> setPhaseDegrees(uint32_t phaseDegrees);
+    std::future<ChirpReply> setWaveform(ChirpWaveform waveform);
+    std::future<ChirpReply> setOutput(bool on);
+
+    /// Sends cs samples times, one after the other, and fits sync.  False if no exchange was answered.
+    bool syncClock(ChirpClockSync& sync, unsigned samples = 16);
+    /// Sends ct with the tick and the commands (f#, p#, o, O) to be queued for it behind cq
+    std::vector<std::future<ChirpReply> > scheduleAt(uint32_t tick, const std::vector<std::string>& commands);
+
+    /// The state from the most recent prompt, solicited or not
+    ChirpState state() const;
+    /// Called on the I/O thread with unsolicited text (prompt included) and with every Bode record
+    void setUnsolicitedListener(std::function<void(const std::string&)> listener);
+
+    /// Reads a full (SIN_F1000_A500_P90_ON>) or compact (0,1000,500,90,1>) prompt.  quick is only known from the
+    /// full one and left alone otherwise.
+    static bool parsePrompt(const std::string& prompt, ChirpState& state, bool& quick);
+
+    static const size_t MAX_COMMAND_LENGTH = 12;     ///< the sketch's line buffer
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    typedef enum
+    {
+        CHECK_NONE = 0,
+        CHECK_FREQUENCY,
+        CHECK_AMPLITUDE,
+        CHECK_PHASE,
+        CHECK_WAVEFORM,
+        CHECK_OUTPUT
+    } CHECK_T;
+
+    struct Request
+    {
+        std::string command;
+        CHECK_T check;
+        uint32_t expected;
+        unsigned attempts;
+        Clock::time_point sent;
+        std::shared_ptr<std::promise<ChirpReply> > promise;
+    };
+
+    std::future<ChirpReply> enqueue(const std::string& command, CHECK_T check, uint32_t expected);
+    bool configure();
+    void run();
+    void writeAhead();
+    void writeAll(const char* data, size_t length);
+    void parse();
+    void handleSegment(const std::string& segment);
+    void complete(Request& request, ChirpReplyStatus status, const std::string& text, size_t bytes = 0);
+    void lostSync();
+    void resyncTimedOut();
+    void failAll(ChirpReplyStatus status);
+
+    ChirpClientOptions options;
+    int fd;
+    int wakePipe[2];
+    std::thread ioThread;
+    bool stopping;
+    std::string error;
+
+    mutable std::mutex lock;
+    std::deque<Request> queued;
+    std::deque<Request> inFlight;
+    size_t inFlightBytes;
+    bool resyncing;
+    unsigned resyncFailures;
+    Clock::time_point lastActivity;
+    std::string rx;
+    size_t scanned;
+    ChirpState current;
+    bool quick;
+    std::vector<std::string> notices;            //!< for the listener, handed over outside the lock
+    std::function<void(const std::string&)> unsolicited;
+};
+
+#endif
@@ -0,0 +1,160 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Host stand-in for the parts of the Arduino AVR core used by the firmware.  Behaviour (timing, buffer sizes,
+ *  dropped bytes) follows the Uno core closely enough for benchmarking, see MockHal.h for the simulation controls.
+ */
+#ifndef MOCK_ARDUINO_H
+#define MOCK_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "avr/io.h"
+#include "avr/interrupt.h"
+#include "avr/pgmspace.h"
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef bool boolean;
+typedef uint8_t byte;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+static const uint8_t SDA = 18;
+static const uint8_t SCL = 19;
+
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt(p)  ((p) == 2 ? 0 : ((p) == 3 ? 1 : NOT_AN_INTERRUPT))
+
+#define interrupts()    sei()
+#define noInterrupts()  cli()
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+
+#define clockCyclesPerMicrosecond() (F_CPU / 1000000L)
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+
+void setup(void);
+void loop(void);
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper*>(string_literal))
+
+/// @brief Formatting front end shared by the serial port, same overload set as the Arduino core
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* str) { return str ? write((const uint8_t*) str, strlen(str)) : 0; }
+    size_t write(const char* buffer, size_t size) { return write((const uint8_t*) buffer, size); }
+    virtual int availableForWrite() { return 0; }
+
+    size_t print(const __FlashStringHelper* str) { return write((const char*) str); }
+    size_t print(const char str[]) { return write(str); }
+    size_t print(char c) { return write((uint8_t) c); }
+    size_t print(unsigned char n, int base = DEC) { return printNumber(n, base); }
+    size_t print(int n, int base = DEC) { return printSigned(n, base); }
+    size_t print(unsigned int n, int base = DEC) { return printNumber(n, base); }
+    size_t print(long n, int base = DEC) { return printSigned(n, base); }
+    size_t print(unsigned long n, int base = DEC) { return printNumber(n, base); }
+    size_t print(double n, int digits = 2);
+
+    size_t println(void) { return write("\r\n"); }
+    template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+    template <typename T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+
+  private:
+    size_t printSigned(long n, int base);
+    size_t printNumber(unsigned long n, int base);
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+/// @brief USART0 with the core's 64 byte RX and TX ring buffers, paced at the configured baud rate
+class HardwareSerial : public Stream
+{
+  public:
+    void begin(unsigned long baud);
+    void end();
+    virtual int available();
+    virtual int peek();
+    virtual int read();
+    virtual int availableForWrite();
+    void flush();
+    virtual size_t write(uint8_t);
+    inline size_t write(unsigned long n) { return write((uint8_t) n); }
+    inline size_t write(long n) { return write((uint8_t) n); }
+    inline size_t write(unsigned int n) { return write((uint8_t) n); }
+    inline size_t write(int n) { return write((uint8_t) n); }
+    using Print::write;
+    operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
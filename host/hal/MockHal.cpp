@@ -0,0 +1,1626 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <math.h>
+#include <stdio.h>
+#include "Arduino.h"
+#include "SPI.h"
+#include "Wire.h"
+#include "avr/sleep.h"
+#include "avr/wdt.h"
+#include "MockHal.h"
+
+// Approximate cost of the Arduino core calls on an ATmega328P, in cycles
+#define DIGITAL_WRITE_CYCLES   54
+#define DIGITAL_READ_CYCLES    50
+#define PIN_MODE_CYCLES        60
+#define ANALOG_READ_CYCLES     1664   // 13 ADC clocks at clk/128
+#define INTERRUPT_CYCLES       10     // Vector, prologue and reti
+#define LOOP_CYCLES            64     // One empty pass of main(): loop(), serialEventRun()
+#define TIMER0_OVERFLOW_CYCLES 16384  // millis() tick of the core, clk/64 and 256 counts
+
+void serialEvent(void) __attribute__((weak));
+
+// Handlers the firmware does not define
+extern "C"
+{
+void __attribute__((weak)) INT0_vect(void) {}
+void __attribute__((weak)) INT1_vect(void) {}
+void __attribute__((weak)) PCINT0_vect(void) {}
+void __attribute__((weak)) PCINT1_vect(void) {}
+void __attribute__((weak)) PCINT2_vect(void) {}
+void __attribute__((weak)) WDT_vect(void) {}
+void __attribute__((weak)) TIMER2_COMPA_vect(void) {}
+void __attribute__((weak)) TIMER2_COMPB_vect(void) {}
+void __attribute__((weak)) TIMER2_OVF_vect(void) {}
+void __attribute__((weak)) TIMER1_CAPT_vect(void) {}
+void __attribute__((weak)) TIMER1_COMPA_vect(void) {}
+void __attribute__((weak)) TIMER1_COMPB_vect(void) {}
+void __attribute__((weak)) TIMER1_OVF_vect(void) {}
+void __attribute__((weak)) ADC_vect(void) {}
+}
+
+// Register hooks________________________________________________________________________
+
+static void sregWritten(MockRegister8&, uint8_t oldValue, uint8_t newValue)
+{
+    if (!(oldValue & _BV(SREG_I)) && (newValue & _BV(SREG_I)))
+    {
+        MockHal.dispatchInterrupts();
+    }
+}
+
+/// Interrupt flag registers are cleared by writing a one
+static void flagsWritten(MockRegister8& reg, uint8_t oldValue, uint8_t newValue)
+{
+    reg.value = oldValue & ~newValue;
+}
+
+/// Enabling an interrupt whose flag is already set runs it right away
+static void maskWritten(MockRegister8&, uint8_t, uint8_t)
+{
+    MockHal.dispatchInterrupts();
+}
+
+/// FOC1A applies the compare output action of OC1A at once, the bit always reads zero
+static void tccr1cWritten(MockRegister8& reg, uint8_t, uint8_t newValue)
+{
+    reg.value = 0;
+    if (newValue & _BV(FOC1A))
+    {
+        MockHal.forceCompareOutputA();
+    }
+}
+
+static void portBWritten(MockRegister8&, uint8_t oldValue, uint8_t newValue) { MockHal.portWritten(0, oldValue, newValue); }
+static void portCWritten(MockRegister8&, uint8_t oldValue, uint8_t newValue) { MockHal.portWritten(1, oldValue, newValue); }
+static void portDWritten(MockRegister8&, uint8_t oldValue, uint8_t newValue) { MockHal.portWritten(2, oldValue, newValue); }
+static void ddrBWritten(MockRegister8&, uint8_t oldValue, uint8_t newValue) { MockHal.ddrWritten(0, oldValue, newValue); }
+static void ddrCWritten(MockRegister8&, uint8_t oldValue, uint8_t newValue) { MockHal.ddrWritten(1, oldValue, newValue); }
+static void ddrDWritten(MockRegister8&, uint8_t oldValue, uint8_t newValue) { MockHal.ddrWritten(2, oldValue, newValue); }
+
+// Reading PINx returns driven outputs and external levels on inputs, writing a one toggles the PORTx bit
+static uint8_t pinBRead(const MockRegister8&) { return (PORTB.value & DDRB.value) | (MockHal.portInputs(0) & ~DDRB.value); }
+static uint8_t pinCRead(const MockRegister8&) { return (PORTC.value & DDRC.value) | (MockHal.portInputs(1) & ~DDRC.value); }
+static uint8_t pinDRead(const MockRegister8&) { return (PORTD.value & DDRD.value) | (MockHal.portInputs(2) & ~DDRD.value); }
+static void pinBWritten(MockRegister8& reg, uint8_t, uint8_t newValue) { reg.value = 0; PORTB ^= newValue; }
+static void pinCWritten(MockRegister8& reg, uint8_t, uint8_t newValue) { reg.value = 0; PORTC ^= newValue; }
+static void pinDWritten(MockRegister8& reg, uint8_t, uint8_t newValue) { reg.value = 0; PORTD ^= newValue; }
+
+/// Writing SPDR as master shifts the byte out and the slave's reply in
+static void spdrWritten(MockRegister8& reg, uint8_t, uint8_t newValue)
+{
+    if ((SPCR.value & (_BV(SPE) | _BV(MSTR))) == (_BV(SPE) | _BV(MSTR)))
+    {
+        SPSR.value &= ~_BV(SPIF);
+        reg.value = MockHal.spiTransfer(newValue);
+        SPSR.value |= _BV(SPIF);
+    }
+}
+
+/// Reading SPDR after SPSR clears SPIF
+static uint8_t spdrRead(const MockRegister8& reg)
+{
+    SPSR.value &= ~_BV(SPIF);
+    return reg.value;
+}
+
+/// ADIF is cleared by writing a one, everything else is control
+static void adcsraWritten(MockRegister8& reg, uint8_t oldValue, uint8_t newValue)
+{
+    reg.value = (newValue & ~_BV(ADIF)) | (oldValue & ~newValue & _BV(ADIF));
+    MockHal.adcControlWritten(oldValue, reg.value);
+    MockHal.dispatchInterrupts();
+}
+
+static uint8_t adclRead(const MockRegister8&) { return (uint8_t) ADCW.value; }
+static uint8_t adchRead(const MockRegister8&) { return (uint8_t) (ADCW.value >> 8); }
+
+static uint16_t spRead(const MockRegister16&) { return MockHal.stackPointer(); }
+
+// Register file, constant initialized so it is usable from any constructor
+MockRegister8 SREG(sregWritten, 0);
+MockRegister16 SP(0, spRead);
+
+uint8_t MockDataSpace[RAMEND + 1];
+char* __malloc_heap_start = (char*) (uintptr_t) MockHalClass::HEAP_START;
+char* __brkval = NULL;
+
+MockRegister8 PORTB(portBWritten, 0), DDRB(ddrBWritten, 0), PINB(pinBWritten, pinBRead);
+MockRegister8 PORTC(portCWritten, 0), DDRC(ddrCWritten, 0), PINC(pinCWritten, pinCRead);
+MockRegister8 PORTD(portDWritten, 0), DDRD(ddrDWritten, 0), PIND(pinDWritten, pinDRead);
+
+MockRegister8 TCCR1A, TCCR1B, TCCR1C(tccr1cWritten, 0), TIMSK1(maskWritten, 0), TIFR1(flagsWritten, 0);
+MockRegister16 TCNT1, OCR1A, OCR1B, ICR1;
+MockRegister8 TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2(maskWritten, 0), TIFR2(flagsWritten, 0), ASSR;
+MockRegister8 GTCCR;
+
+MockRegister8 SPCR, SPSR, SPDR(spdrWritten, spdrRead);
+
+MockRegister8 EICRA, EIMSK(maskWritten, 0), EIFR(flagsWritten, 0);
+MockRegister8 PCICR(maskWritten, 0), PCIFR(flagsWritten, 0), PCMSK0, PCMSK1, PCMSK2;
+
+MockRegister8 ADMUX, ADCSRA(adcsraWritten, 0), ADCSRB, ADCL(0, adclRead), ADCH(0, adchRead), DIDR0;
+MockRegister16 ADCW;
+MockRegister8 ACSR, DIDR1;
+
+MockRegister8 SMCR, MCUSR, WDTCSR, PRR;
+static void twcrWritten(MockRegister8&, uint8_t oldValue, uint8_t newValue) { MockHal.twiControlWritten(oldValue, newValue); }
+static uint8_t twcrRead(const MockRegister8& reg) { MockHal.twiUpdate(); return reg.value; }
+static uint8_t twsrRead(const MockRegister8& reg) { MockHal.twiUpdate(); return reg.value; }
+
+MockRegister8 TWBR, TWSR(0, twsrRead), TWCR(twcrWritten, twcrRead), TWDR, TWAR;
+
+// Timers________________________________________________________________________________
+
+/// @brief View of Timer1 or Timer2 registers so one model serves both
+struct MockTimer
+{
+    bool sixteenBit;
+    MockRegister8* tccrA;
+    MockRegister8* tccrB;
+    MockRegister8* tifr;
+    MockRegister16* count16;
+    MockRegister8* count8;
+    MockRegister16* ocrA16;
+    MockRegister8* ocrA8;
+    MockRegister16* ocrB16;
+    MockRegister8* ocrB8;
+    uint64_t prescaleRemainder;
+    bool countingDown;
+    uint8_t compareOutputA;         //!< OC1A, drives pin 9 while COM1A1:0 is not zero
+    bool compareOutputAChanged;
+
+    uint8_t mode() const
+    {
+        if (sixteenBit)
+        {
+            return (uint8_t) (((tccrB->value >> WGM12) & 0x03) << 2) | (tccrA->value & 0x03);
+        }
+        return (uint8_t) (((tccrB->value >> WGM22) & 0x01) << 2) | (tccrA->value & 0x03);
+    }
+
+    uint32_t prescale() const
+    {
+        static const uint32_t timer1Prescale[] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+        static const uint32_t timer2Prescale[] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+        return sixteenBit ? timer1Prescale[tccrB->value & 0x07] : timer2Prescale[tccrB->value & 0x07];
+    }
+
+    uint32_t count() const { return sixteenBit ? count16->value : count8->value; }
+    void setCount(uint32_t value) { if (sixteenBit) count16->value = (uint16_t) value; else count8->value = (uint8_t) value; }
+    uint32_t ocrA() const { return sixteenBit ? ocrA16->value : ocrA8->value; }
+    uint32_t ocrB() const { return sixteenBit ? ocrB16->value : ocrB8->value; }
+    uint32_t max() const { return sixteenBit ? 0xFFFF : 0xFF; }
+
+    bool phaseCorrect() const
+    {
+        uint8_t wgm = mode();
+        return sixteenBit ? ((wgm >= 1 && wgm <= 3) || (wgm >= 8 && wgm <= 11)) : (wgm == 1 || wgm == 5);
+    }
+
+    /// TOV is set at TOP in fast PWM modes, at MAX in normal and CTC modes, at BOTTOM in phase correct modes
+    bool overflowAtTop() const
+    {
+        uint8_t wgm = mode();
+        return sixteenBit ? (wgm == 5 || wgm == 6 || wgm == 7 || wgm == 14 || wgm == 15) : (wgm == 3 || wgm == 7);
+    }
+
+    uint32_t top() const
+    {
+        uint8_t wgm = mode();
+
+        if (sixteenBit)
+        {
+            switch (wgm)
+            {
+                case 1: case 5: return 0xFF;
+                case 2: case 6: return 0x1FF;
+                case 3: case 7: return 0x3FF;
+                case 4: case 9: case 11: case 15: return OCR1A.value;
+                case 8: case 10: case 12: case 14: return ICR1.value;
+                default: return 0xFFFF;
+            }
+        }
+
+        return (wgm == 2 || wgm == 5 || wgm == 7) ? OCR2A.value : 0xFF;
+    }
+
+    /// Timer clocks until the next compare match or TOP/BOTTOM event
+    uint64_t ticksToEvent() const
+    {
+        uint32_t c = count();
+        uint32_t t = top();
+        uint64_t best;
+
+        if (phaseCorrect())
+        {
+            best = countingDown ? c : (t - c);
+            if (best == 0) best = 1;
+            uint32_t matches[2] = { ocrA(), ocrB() };
+            for (int i = 0; i < 2; i++)
+            {
+                if (!countingDown && matches[i] > c && (matches[i] - c) < best) best = matches[i] - c;
+                if (countingDown && matches[i] < c && (c - matches[i]) < best) best = c - matches[i];
+            }
+            return best;
+        }
+
+        if (c > t)
+        {
+            // Above TOP after a register change, counts up to MAX before wrapping
+            t = max();
+        }
+
+        best = (uint64_t) t - c + 1;
+        uint32_t matches[2] = { ocrA(), ocrB() };
+        for (int i = 0; i < 2; i++)
+        {
+            if (matches[i] > c && (matches[i] - c) < best) best = matches[i] - c;
+        }
+        return best;
+    }
+
+    uint64_t cyclesToEvent() const
+    {
+        uint32_t p = prescale();
+        if (p == 0)
+        {
+            return UINT64_MAX;
+        }
+        return ticksToEvent() * p - prescaleRemainder;
+    }
+
+    /// Applies a single timer clock, setting flags the way the hardware does
+    void tick()
+    {
+        uint32_t c = count();
+        uint32_t t = top();
+        uint8_t tovBit = 0;   // TOV1/TOV2 are both bit 0
+        uint8_t ocfABit = 1;
+        uint8_t ocfBBit = 2;
+
+        if (phaseCorrect())
+        {
+            if (!countingDown)
+            {
+                if (c >= t) { countingDown = true; c = (t > 0) ? t - 1 : 0; }
+                else c++;
+            }
+            else
+            {
+                if (c == 0) { countingDown = false; c = 1; }
+                else c--;
+                if (c == 0) tifr->value |= _BV(tovBit);
+            }
+        }
+        else
+        {
+            uint32_t wrapAt = (c > t) ? max() : t;
+            if (c == wrapAt)
+            {
+                c = 0;
+                if ((wrapAt == max()) || overflowAtTop())
+                {
+                    tifr->value |= _BV(tovBit);
+                }
+                if (sixteenBit && overflowAtTop() && (mode() == 14))
+                {
+                    // ICR1 as TOP also raises ICF1
+                    tifr->value |= _BV(ICF1);
+                }
+            }
+            else
+            {
+                c++;
+            }
+        }
+
+        setCount(c);
+
+        if (c == ocrA())
+        {
+            tifr->value |= _BV(ocfABit);
+            if (sixteenBit)
+            {
+                applyCompareOutputA();
+            }
+        }
+        if (c == ocrB()) tifr->value |= _BV(ocfBBit);
+    }
+
+    /// Toggle, clear or set OC1A as COM1A1:0 say, in the non-PWM modes only
+    void applyCompareOutputA()
+    {
+        uint8_t wgm = mode();
+        if ((wgm != 0) && (wgm != 4) && (wgm != 12))
+        {
+            return;
+        }
+
+        uint8_t level = compareOutputA;
+        switch ((tccrA->value >> COM1A0) & 0x03)
+        {
+            case 1: level = !level; break;
+            case 2: level = 0; break;
+            case 3: level = 1; break;
+            default: break;
+        }
+
+        compareOutputAChanged |= (level != compareOutputA);
+        compareOutputA = level;
+    }
+
+    void step(uint64_t cycles)
+    {
+        uint32_t p = prescale();
+        if (p == 0)
+        {
+            return;
+        }
+
+        uint64_t total = prescaleRemainder + cycles;
+        uint64_t ticks = total / p;
+        prescaleRemainder = total % p;
+
+        // Callers never step past the next event, so all but the last clock only move the count
+        while (ticks > 0)
+        {
+            uint64_t toEvent = ticksToEvent();
+            uint64_t quiet = (ticks < toEvent ? ticks : toEvent) - 1;
+
+            if (quiet)
+            {
+                setCount(phaseCorrect() && countingDown ? count() - (uint32_t) quiet : count() + (uint32_t) quiet);
+            }
+
+            tick();
+            ticks -= quiet + 1;
+        }
+    }
+};
+
+static MockTimer timer1 = { true, &TCCR1A, &TCCR1B, &TIFR1, &TCNT1, 0, &OCR1A, 0, &OCR1B, 0, 0, false, 0, false };
+static MockTimer timer2 = { false, &TCCR2A, &TCCR2B, &TIFR2, 0, &TCNT2, 0, &OCR2A, 0, &OCR2B, 0, false, 0, false };
+
+/// @brief Interrupt sources in vector (priority) order
+struct MockVector
+{
+    MockRegister8* flagRegister;
+    uint8_t flagBit;
+    MockRegister8* enableRegister;
+    uint8_t enableBit;
+    void (*handler)(void);
+};
+
+static const MockVector vectors[] =
+{
+    { &EIFR, INTF0, &EIMSK, INT0, INT0_vect },
+    { &EIFR, INTF1, &EIMSK, INT1, INT1_vect },
+    { &PCIFR, PCIF0, &PCICR, PCIE0, PCINT0_vect },
+    { &PCIFR, PCIF1, &PCICR, PCIE1, PCINT1_vect },
+    { &PCIFR, PCIF2, &PCICR, PCIE2, PCINT2_vect },
+    { &WDTCSR, WDIF, &WDTCSR, WDIE, WDT_vect },
+    { &TIFR2, OCF2A, &TIMSK2, OCIE2A, TIMER2_COMPA_vect },
+    { &TIFR2, OCF2B, &TIMSK2, OCIE2B, TIMER2_COMPB_vect },
+    { &TIFR2, TOV2, &TIMSK2, TOIE2, TIMER2_OVF_vect },
+    { &TIFR1, ICF1, &TIMSK1, ICIE1, TIMER1_CAPT_vect },
+    { &TIFR1, OCF1A, &TIMSK1, OCIE1A, TIMER1_COMPA_vect },
+    { &TIFR1, OCF1B, &TIMSK1, OCIE1B, TIMER1_COMPB_vect },
+    { &TIFR1, TOV1, &TIMSK1, TOIE1, TIMER1_OVF_vect },
+    { &ADCSRA, ADIF, &ADCSRA, ADIE, ADC_vect },
+};
+
+// Simulation core_______________________________________________________________________
+
+MockHalClass MockHal __attribute__((init_priority(101)));
+
+MockHalClass::MockHalClass()
+{
+    now = 0;
+    servicingInterrupt = false;
+    stackBase = 0;
+    memset(spiDevices, 0, sizeof(spiDevices));
+    selectedSpi = NULL;
+    spiFrameHasData = false;
+    memset(i2cDevices, 0, sizeof(i2cDevices));
+    i2cClockHz = 100000;
+    i2cTimeoutUs = 0;
+    i2cStuckClocks = 0;
+    twiDone = UINT64_MAX;
+    twiStopDone = UINT64_MAX;
+    twiStatus = 0xF8;
+    twiStarted = false;
+    twiAddressed = false;
+    twiAddress = 0;
+    twiLength = 0;
+    watchdogTimeoutCycles = 0;
+    watchdogKick = 0;
+    baud = 57600;
+    txHeadDone = 0;
+    txListener = NULL;
+    txListenerContext = NULL;
+    compareOutputListener = NULL;
+    compareOutputListenerContext = NULL;
+    memset(inputLevels, 0, sizeof(inputLevels));
+    // Bus pull-ups on SDA and SCL
+    inputLevels[1] = _BV(4) | _BV(5);
+    captureSource = NULL;
+    captureSourceContext = NULL;
+    nextCaptureEdge = 0.0;
+    captureLevel = false;
+    analogSource = NULL;
+    analogSourceContext = NULL;
+    adcConverting = false;
+    adcFirst = true;
+    adcClockOrigin = 0;
+    adcSampleCycle = 0;
+    adcDoneCycle = 0;
+    memset(&count, 0, sizeof(count));
+
+    // The core enables interrupts in init() before setup() runs
+    SREG.value = _BV(SREG_I);
+}
+
+void MockHalClass::advance(uint64_t cycles)
+{
+    advanceTo(now + cycles);
+}
+
+void MockHalClass::advanceTo(uint64_t cycle)
+{
+    stackPointer();
+
+    do
+    {
+        uint64_t remaining = (cycle > now) ? (cycle - now) : 0;
+        uint64_t stepCycles = cyclesToNextTimerEvent();
+
+        if (remaining < stepCycles)
+        {
+            stepCycles = remaining;
+        }
+
+        step(stepCycles);
+        while (captureSource && (nextCaptureEdge <= (double) now))
+        {
+            captureEdge();
+        }
+        while (adcConverting && (adcDoneCycle <= now))
+        {
+            adcComplete();
+        }
+        deliverRx();
+        deliverTx();
+        checkWatchdog();
+        dispatchInterrupts();
+    } while (now < cycle);
+}
+
+uint64_t MockHalClass::cyclesToNextTimerEvent() const
+{
+    uint64_t t1 = timer1.cyclesToEvent();
+    uint64_t t2 = timer2.cyclesToEvent();
+    uint64_t next = (t1 < t2) ? t1 : t2;
+
+    if (captureSource)
+    {
+        uint64_t edge = (uint64_t) ceil(nextCaptureEdge);
+        uint64_t toEdge = (edge > now) ? (edge - now) : 0;
+        next = (toEdge < next) ? toEdge : next;
+    }
+
+    if (adcConverting)
+    {
+        uint64_t toDone = (adcDoneCycle > now) ? (adcDoneCycle - now) : 0;
+        next = (toDone < next) ? toDone : next;
+    }
+
+    return next;
+}
+
+void MockHalClass::step(uint64_t cycles)
+{
+    timer1.step(cycles);
+    timer2.step(cycles);
+    now += cycles;
+
+    // Steps end on timer events, so a compare that moved OC1A happened on the last cycle
+    notifyCompareOutputA();
+}
+
+void MockHalClass::setCompareOutputListener(void (*listener)(uint8_t level, uint64_t cycle, void* context),
+                                            void* context)
+{
+    compareOutputListener = listener;
+    compareOutputListenerContext = context;
+}
+
+void MockHalClass::forceCompareOutputA()
+{
+    timer1.applyCompareOutputA();
+    notifyCompareOutputA();
+}
+
+void MockHalClass::notifyCompareOutputA()
+{
+    if (timer1.compareOutputAChanged)
+    {
+        timer1.compareOutputAChanged = false;
+        if (compareOutputListener && (TCCR1A.value & (_BV(COM1A1) | _BV(COM1A0))))
+        {
+            compareOutputListener(timer1.compareOutputA, now, compareOutputListenerContext);
+        }
+    }
+}
+
+void MockHalClass::setCaptureSource(double (*frequencyHz)(void* context), void* context)
+{
+    captureSource = frequencyHz;
+    captureSourceContext = context;
+    nextCaptureEdge = (double) now;
+}
+
+void MockHalClass::captureEdge()
+{
+    double hz = captureSource(captureSourceContext);
+
+    if (hz <= 0.0)
+    {
+        // Line held, look again a millisecond later
+        nextCaptureEdge = (double) now + F_CPU_HZ / 1000.0;
+        return;
+    }
+
+    captureLevel = !captureLevel;
+    setPinInput(8, captureLevel ? 1 : 0);
+
+    // The noise canceler delay is left out, it is the same for every edge
+    if ((timer1.prescale() != 0) && (captureLevel == ((TCCR1B.value & _BV(ICES1)) != 0)))
+    {
+        ICR1.value = TCNT1.value;
+        TIFR1.value |= _BV(ICF1);
+    }
+
+    nextCaptureEdge += F_CPU_HZ / (2.0 * hz);
+}
+
+void MockHalClass::setAnalogSource(double (*volts)(uint8_t channel, uint64_t cycle, void* context), void* context)
+{
+    analogSource = volts;
+    analogSourceContext = context;
+}
+
+/// ADC clock periods in CPU cycles, ADPS2:0 = 0 and 1 both divide by 2
+static uint64_t adcPrescale()
+{
+    return (uint64_t) 1 << ((ADCSRA.value & 0x07) ? (ADCSRA.value & 0x07) : 1);
+}
+
+void MockHalClass::adcControlWritten(uint8_t oldValue, uint8_t newValue)
+{
+    if (!(newValue & _BV(ADEN)))
+    {
+        ADCSRA.value &= ~_BV(ADSC);
+        adcConverting = false;
+        adcFirst = true;
+        return;
+    }
+
+    if (!(oldValue & _BV(ADEN)))
+    {
+        adcClockOrigin = now;
+    }
+
+    if ((newValue & _BV(ADSC)) && !adcConverting)
+    {
+        // A conversion starts on the next rising edge of the ADC clock
+        uint64_t prescale = adcPrescale();
+        adcStart(adcClockOrigin + (now - adcClockOrigin + prescale - 1) / prescale * prescale);
+    }
+}
+
+void MockHalClass::adcStart(uint64_t startCycle)
+{
+    uint64_t prescale = adcPrescale();
+
+    adcConverting = true;
+    adcSampleCycle = startCycle + (adcFirst ? 27 : 3) * prescale / 2;
+    adcDoneCycle = startCycle + (adcFirst ? 25 : 13) * prescale;
+    adcFirst = false;
+}
+
+void MockHalClass::adcComplete()
+{
+    double volts = analogSource ? analogSource(ADMUX.value & 0x0F, adcSampleCycle, analogSourceContext) : 0.0;
+    double code = floor(volts * 1024.0 / 5.0);
+    uint16_t result = (uint16_t) (code < 0.0 ? 0.0 : (code > 1023.0 ? 1023.0 : code));
+
+    ADCW.value = (ADMUX.value & _BV(ADLAR)) ? (uint16_t) (result << 6) : result;
+    ADCSRA.value |= _BV(ADIF);
+    count.adcConversions++;
+
+    if ((ADCSRA.value & _BV(ADATE)) && ((ADCSRB.value & 0x07) == 0))
+    {
+        // Free running, the next conversion starts as this one ends
+        adcStart(adcDoneCycle);
+    }
+    else
+    {
+        ADCSRA.value &= ~_BV(ADSC);
+        adcConverting = false;
+    }
+}
+
+void MockHalClass::dispatchInterrupts()
+{
+    if (servicingInterrupt)
+    {
+        return;
+    }
+
+    while (SREG.value & _BV(SREG_I))
+    {
+        const MockVector* pending = NULL;
+
+        for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++)
+        {
+            if ((vectors[i].flagRegister->value & _BV(vectors[i].flagBit)) &&
+                (vectors[i].enableRegister->value & _BV(vectors[i].enableBit)))
+            {
+                pending = &vectors[i];
+                break;
+            }
+        }
+
+        if (pending == NULL)
+        {
+            return;
+        }
+
+        // Entering the vector clears the flag and the I bit, reti sets the I bit again
+        pending->flagRegister->value &= ~_BV(pending->flagBit);
+        if ((pending->handler == WDT_vect) && (WDTCSR.value & _BV(WDE)))
+        {
+            // Interrupt and system reset mode, the next time-out resets
+            WDTCSR.value &= ~_BV(WDIE);
+        }
+        servicingInterrupt = true;
+        SREG.value &= ~_BV(SREG_I);
+        count.interrupts++;
+
+        // The vector jump and prologue come before the body, edges in that time are seen by the handler
+        advance(INTERRUPT_CYCLES);
+        pending->handler();
+
+        SREG.value |= _BV(SREG_I);
+        servicingInterrupt = false;
+    }
+}
+
+void MockHalClass::runLoopOnce()
+{
+    setStackBase(__builtin_frame_address(0));
+    loop();
+
+    if (serialEvent && serialAvailable())
+    {
+        serialEvent();
+    }
+
+    advance(LOOP_CYCLES);
+}
+
+uint16_t MockHalClass::stackPointer()
+{
+    uintptr_t frame = (uintptr_t) __builtin_frame_address(0);
+    uintptr_t depth = ((stackBase > frame) ? stackBase - frame : 0) / STACK_SCALE;
+    uint16_t pointer = (depth < (uintptr_t) (LOOP_SP - HEAP_START)) ? (uint16_t) (LOOP_SP - depth) : HEAP_START;
+
+    // What the pushes down to here wrote
+    MockDataSpace[pointer + 1] = 0;
+    MockDataSpace[pointer + 2] = 0;
+    return pointer;
+}
+
+void MockHalClass::sleep()
+{
+    uint64_t start = now;
+    uint64_t timer0Overflow = (now / TIMER0_OVERFLOW_CYCLES + 1) * TIMER0_OVERFLOW_CYCLES;
+    uint32_t interrupts = count.interrupts;
+    size_t rxBytes = rxBuffer.size();
+    size_t txBytes = txBuffer.size();
+
+    // Timer0 is not modeled, its overflow interrupt is the wake up that always comes
+    while ((count.interrupts == interrupts) && (rxBuffer.size() == rxBytes) && (txBuffer.size() == txBytes) &&
+           (now < timer0Overflow))
+    {
+        uint64_t wake = timer0Overflow;
+        uint64_t timerEvent = now + cyclesToNextTimerEvent();
+
+        if (timerEvent < wake) wake = timerEvent;
+        if (serialNextArrival() < wake) wake = serialNextArrival();
+        if (!txBuffer.empty() && (txHeadDone < wake)) wake = txHeadDone;
+
+        advanceTo((wake > now) ? wake : now + 1);
+    }
+
+    count.sleepCycles += now - start;
+}
+
+void sleep_cpu(void)
+{
+    if (SMCR.value & _BV(SE))
+    {
+        MockHal.sleep();
+    }
+}
+
+void MockHalClass::watchdogEnable(uint8_t timeout)
+{
+    // 2048 cycles of the 128 kHz watchdog oscillator for WDTO_15MS, doubling with each step
+    watchdogTimeoutCycles = ((uint64_t) F_CPU_HZ * 16 / 1000) << timeout;
+    watchdogKick = now;
+}
+
+void MockHalClass::watchdogReset()
+{
+    if (now - watchdogKick > count.watchdogMaxGapCycles)
+    {
+        count.watchdogMaxGapCycles = now - watchdogKick;
+    }
+    watchdogKick = now;
+}
+
+void MockHalClass::watchdogDisable()
+{
+    watchdogTimeoutCycles = 0;
+}
+
+void MockHalClass::checkWatchdog()
+{
+    if ((watchdogTimeoutCycles == 0) || (now - watchdogKick < watchdogTimeoutCycles))
+    {
+        return;
+    }
+
+    watchdogKick = now;
+
+    if (WDTCSR.value & _BV(WDIE))
+    {
+        WDTCSR.value |= _BV(WDIF);
+    }
+    else if (WDTCSR.value & _BV(WDE))
+    {
+        count.watchdogResets++;
+    }
+}
+
+void wdt_enable(uint8_t timeout)
+{
+    WDTCSR = (uint8_t) (_BV(WDE) | ((timeout & 0x08) ? _BV(WDP3) : 0) | (timeout & 0x07));
+    MockHal.watchdogEnable(timeout);
+}
+
+void wdt_reset(void)
+{
+    MockHal.watchdogReset();
+}
+
+void wdt_disable(void)
+{
+    WDTCSR = 0;
+    MockHal.watchdogDisable();
+}
+
+void MockHalClass::resetCounters()
+{
+    memset(&count, 0, sizeof(count));
+}
+
+// Pins__________________________________________________________________________________
+
+/// Uno pin numbering: 0-7 PORTD, 8-13 PORTB, 14-19 (A0-A5) PORTC
+static bool pinToPort(uint8_t pin, uint8_t* port, uint8_t* bit)
+{
+    if (pin < 8) { *port = 2; *bit = pin; }
+    else if (pin < 14) { *port = 0; *bit = pin - 8; }
+    else if (pin < 20) { *port = 1; *bit = pin - 14; }
+    else return false;
+    return true;
+}
+
+static uint8_t portToPin(uint8_t port, uint8_t bit)
+{
+    static const uint8_t firstPin[3] = { 8, 14, 0 };
+    return firstPin[port] + bit;
+}
+
+static MockRegister8* const portRegisters[3] = { &PORTB, &PORTC, &PORTD };
+static MockRegister8* const ddrRegisters[3] = { &DDRB, &DDRC, &DDRD };
+static MockRegister8* const pinRegisters[3] = { &PINB, &PINC, &PIND };
+
+/// A pin change interrupt also fires for a pin the firmware drives itself, as on the part
+void MockHalClass::pinLevelsChanged(uint8_t port, uint8_t changed)
+{
+    static MockRegister8* const pcmskRegisters[3] = { &PCMSK0, &PCMSK1, &PCMSK2 };
+
+    if (pcmskRegisters[port]->value & changed)
+    {
+        PCIFR.value |= _BV(port);
+    }
+}
+
+void MockHalClass::ddrWritten(uint8_t port, uint8_t oldValue, uint8_t newValue)
+{
+    uint8_t outputs = portRegisters[port]->value;
+    uint8_t before = (outputs & oldValue) | (inputLevels[port] & ~oldValue);
+    uint8_t after = (outputs & newValue) | (inputLevels[port] & ~newValue);
+
+    pinLevelsChanged(port, before ^ after);
+}
+
+void MockHalClass::portWritten(uint8_t port, uint8_t oldValue, uint8_t newValue)
+{
+    uint8_t changed = oldValue ^ newValue;
+
+    pinLevelsChanged(port, changed & ddrRegisters[port]->value);
+
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+        if (changed & _BV(bit))
+        {
+            uint8_t pin = portToPin(port, bit);
+
+            if ((pin < 20) && spiDevices[pin] && (ddrRegisters[port]->value & _BV(bit)))
+            {
+                spiSelect(pin, (newValue & _BV(bit)) == 0);
+            }
+
+            if ((pin == SCL) && (newValue & _BV(bit)) && i2cStuckClocks && (--i2cStuckClocks == 0))
+            {
+                // The slave has clocked out what it was sending and lets go of SDA
+                inputLevels[1] |= _BV(4);
+            }
+        }
+    }
+}
+
+void MockHalClass::setPinInput(uint8_t pin, uint8_t level)
+{
+    uint8_t port, bit;
+    if (pinToPort(pin, &port, &bit))
+    {
+        bool wasHigh = (inputLevels[port] & _BV(bit)) != 0;
+
+        if (level) inputLevels[port] |= _BV(bit);
+        else inputLevels[port] &= ~_BV(bit);
+
+        if (wasHigh == (level != 0) || (ddrRegisters[port]->value & _BV(bit)))
+        {
+            return;
+        }
+
+        // Flags are raised here, the handlers run at the next advance
+        pinLevelsChanged(port, _BV(bit));
+
+        if ((port == 2) && ((bit == 2) || (bit == 3)))
+        {
+            // ISCn1:ISCn0 01 any change, 10 falling, 11 rising; low level sensing is not modeled
+            uint8_t interrupt = bit - 2;
+            uint8_t sense = (EICRA.value >> (2 * interrupt)) & 0x03;
+
+            if ((sense == 1) || (sense == 2 && !level) || (sense == 3 && level))
+            {
+                EIFR.value |= _BV(interrupt);
+            }
+        }
+    }
+}
+
+uint8_t MockHalClass::getPinOutput(uint8_t pin) const
+{
+    uint8_t port, bit;
+
+    if ((pin == 9) && (TCCR1A.value & (_BV(COM1A1) | _BV(COM1A0))))
+    {
+        // OC1A overrides PORTB1
+        return timer1.compareOutputA ? HIGH : LOW;
+    }
+
+    if (pinToPort(pin, &port, &bit))
+    {
+        return (portRegisters[port]->value & _BV(bit)) ? HIGH : LOW;
+    }
+    return LOW;
+}
+
+bool MockHalClass::isPinOutput(uint8_t pin) const
+{
+    uint8_t port, bit;
+    return pinToPort(pin, &port, &bit) && (ddrRegisters[port]->value & _BV(bit));
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    uint8_t port, bit;
+    if (!pinToPort(pin, &port, &bit))
+    {
+        return;
+    }
+
+    if (mode == OUTPUT)
+    {
+        *ddrRegisters[port] |= (uint8_t) _BV(bit);
+    }
+    else
+    {
+        *ddrRegisters[port] &= (uint8_t) ~_BV(bit);
+        if (mode == INPUT_PULLUP) *portRegisters[port] |= (uint8_t) _BV(bit);
+        else *portRegisters[port] &= (uint8_t) ~_BV(bit);
+    }
+
+    MockHal.advance(PIN_MODE_CYCLES);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    uint8_t port, bit;
+    if (!pinToPort(pin, &port, &bit))
+    {
+        return;
+    }
+
+    uint8_t oldSREG = SREG.value;
+    SREG.value &= ~_BV(SREG_I);
+    if (value == LOW) *portRegisters[port] &= (uint8_t) ~_BV(bit);
+    else *portRegisters[port] |= (uint8_t) _BV(bit);
+    SREG = oldSREG;
+
+    MockHal.advance(DIGITAL_WRITE_CYCLES);
+}
+
+int digitalRead(uint8_t pin)
+{
+    uint8_t port, bit;
+    MockHal.advance(DIGITAL_READ_CYCLES);
+    if (!pinToPort(pin, &port, &bit))
+    {
+        return LOW;
+    }
+    return (*pinRegisters[port] & _BV(bit)) ? HIGH : LOW;
+}
+
+int analogRead(uint8_t)
+{
+    MockHal.advance(ANALOG_READ_CYCLES);
+    return ADCW.value;
+}
+
+void analogWrite(uint8_t pin, int value)
+{
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, value > 127 ? HIGH : LOW);
+}
+
+unsigned long millis(void)
+{
+    return (unsigned long) (MockHal.cycles() / (F_CPU / 1000UL));
+}
+
+unsigned long micros(void)
+{
+    return (unsigned long) (MockHal.cycles() / (F_CPU / 1000000UL));
+}
+
+void delay(unsigned long ms)
+{
+    MockHal.advance((uint64_t) ms * (F_CPU / 1000UL));
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    MockHal.advance((uint64_t) us * (F_CPU / 1000000UL));
+}
+
+void yield(void)
+{
+}
+
+// SPI___________________________________________________________________________________
+
+SPIClass SPI __attribute__((init_priority(102)));
+
+void MockHalClass::attachSpiDevice(uint8_t chipSelectPin, MockSpiDevice* device)
+{
+    if (chipSelectPin < 20)
+    {
+        spiDevices[chipSelectPin] = device;
+    }
+}
+
+void MockHalClass::spiSelect(uint8_t pin, bool selected)
+{
+    if (selected)
+    {
+        selectedSpi = spiDevices[pin];
+        spiFrameHasData = false;
+        selectedSpi->select();
+    }
+    else if (selectedSpi == spiDevices[pin])
+    {
+        selectedSpi->deselect();
+        selectedSpi = NULL;
+        if (spiFrameHasData)
+        {
+            count.spiFrames++;
+        }
+    }
+}
+
+uint64_t MockHalClass::spiByteCycles() const
+{
+    static const uint8_t divider[4] = { 4, 16, 64, 128 };
+    uint64_t sckCycles = divider[SPCR.value & 0x03];
+    if (SPSR.value & _BV(SPI2X))
+    {
+        sckCycles /= 2;
+    }
+    return 8 * sckCycles;
+}
+
+uint8_t MockHalClass::spiTransfer(uint8_t data)
+{
+    advance(spiByteCycles());
+    count.spiBytes++;
+    spiFrameHasData = true;
+    return selectedSpi ? selectedSpi->transfer(data) : 0xFF;
+}
+
+void SPIClass::begin()
+{
+    // Same order as the AVR library: SS high before it becomes an output so no slave is selected by accident
+    digitalWrite(10, HIGH);
+    pinMode(10, OUTPUT);
+    SPCR |= (uint8_t) (_BV(MSTR) | _BV(SPE));
+    pinMode(13, OUTPUT);
+    pinMode(11, OUTPUT);
+}
+
+void SPIClass::end()
+{
+    SPCR &= (uint8_t) ~_BV(SPE);
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+    SPDR = data;
+    while (!(SPSR & _BV(SPIF)))
+    {
+    }
+    return SPDR;
+}
+
+void SPIClass::setBitOrder(uint8_t bitOrder)
+{
+    if (bitOrder == LSBFIRST) SPCR |= (uint8_t) _BV(DORD);
+    else SPCR &= (uint8_t) ~_BV(DORD);
+}
+
+void SPIClass::setDataMode(uint8_t dataMode)
+{
+    SPCR = (uint8_t) ((SPCR & ~0x0C) | dataMode);
+}
+
+void SPIClass::setClockDivider(uint8_t clockDiv)
+{
+    SPCR = (uint8_t) ((SPCR & ~0x03) | (clockDiv & 0x03));
+    SPSR = (uint8_t) ((SPSR & ~0x01) | ((clockDiv >> 2) & 0x01));
+}
+
+// I2C___________________________________________________________________________________
+
+TwoWire Wire __attribute__((init_priority(102)));
+
+static uint8_t wireTxAddress;
+static uint8_t wireTxBuffer[BUFFER_LENGTH];
+static uint8_t wireTxLength;
+static uint8_t wireRxBuffer[BUFFER_LENGTH];
+static uint8_t wireRxLength;
+static uint8_t wireRxIndex;
+static bool wireTimeoutFlag;
+
+void MockHalClass::attachI2cDevice(uint8_t address, MockI2cDevice* device)
+{
+    i2cDevices[address & 0x7F] = device;
+}
+
+void MockHalClass::detachI2cDevice(uint8_t address)
+{
+    i2cDevices[address & 0x7F] = NULL;
+}
+
+void MockHalClass::setI2cStuck(uint8_t sclClocks)
+{
+    i2cStuckClocks = sclClocks;
+
+    if (sclClocks) inputLevels[1] &= ~_BV(4);
+    else inputLevels[1] |= _BV(4);
+}
+
+/// @returns cycles spent waiting for a bus a slave is holding, 0 when it is free
+uint64_t MockHalClass::i2cStall()
+{
+    if (i2cStuckClocks == 0)
+    {
+        return 0;
+    }
+
+    uint64_t stall = i2cTimeoutUs ? (uint64_t) i2cTimeoutUs * (F_CPU_HZ / 1000000) : F_CPU_HZ;
+    advance(stall);
+    count.i2cTimeouts++;
+    return stall;
+}
+
+/// @returns the Wire.endTransmission() status: 0 success, 2 address NACK, 3 data NACK, 5 timeout
+uint8_t MockHalClass::i2cWrite(uint8_t address, const uint8_t* data, size_t length)
+{
+    MockI2cDevice* device = i2cDevices[address & 0x7F];
+    uint64_t bitCycles = F_CPU / i2cClockHz;
+
+    count.i2cTransactions++;
+
+    if (i2cStall())
+    {
+        return 5;
+    }
+
+    if (device == NULL)
+    {
+        // Start, address byte, NACK, stop
+        advance((2 + 9) * bitCycles);
+        count.i2cBytes++;
+        count.i2cNacks++;
+        return 2;
+    }
+
+    advance((2 + 9 * (1 + length)) * bitCycles);
+    count.i2cBytes += 1 + length;
+
+    if (!device->write(data, length))
+    {
+        count.i2cNacks++;
+        return 3;
+    }
+
+    return 0;
+}
+
+size_t MockHalClass::i2cRead(uint8_t address, uint8_t* data, size_t length)
+{
+    MockI2cDevice* device = i2cDevices[address & 0x7F];
+    uint64_t bitCycles = F_CPU / i2cClockHz;
+
+    count.i2cTransactions++;
+
+    if (i2cStall())
+    {
+        return 0;
+    }
+
+    if (device == NULL)
+    {
+        advance((2 + 9) * bitCycles);
+        count.i2cBytes++;
+        count.i2cNacks++;
+        return 0;
+    }
+
+    memset(data, 0xFF, length);
+    device->read(data, length);
+    advance((2 + 9 * (1 + length)) * bitCycles);
+    count.i2cBytes += 1 + length;
+
+    return length;
+}
+
+void MockHalClass::twiControlWritten(uint8_t oldValue, uint8_t newValue)
+{
+    // TWINT is cleared by writing a one, which starts the operation the other bits ask for
+    TWCR.value = (uint8_t) ((newValue & ~_BV(TWINT)) | (oldValue & ~newValue & _BV(TWINT)));
+
+    if ((newValue & _BV(TWEN)) == 0)
+    {
+        twiDone = UINT64_MAX;
+        twiStopDone = UINT64_MAX;
+        twiStarted = false;
+        TWCR.value &= (uint8_t) ~_BV(TWSTO);
+        return;
+    }
+
+    if ((newValue & _BV(TWINT)) == 0)
+    {
+        return;
+    }
+
+    uint64_t bitCycles = F_CPU / i2cClockHz;
+
+    if (newValue & _BV(TWSTO))
+    {
+        MockI2cDevice* device = i2cDevices[twiAddress & 0x7F];
+
+        if (twiStarted && twiAddressed && twiLength && !device->write(twiData, twiLength))
+        {
+            count.i2cNacks++;
+        }
+        twiStarted = false;
+        twiDone = UINT64_MAX;
+        twiStopDone = now + bitCycles;
+    }
+    else if (newValue & _BV(TWSTA))
+    {
+        count.i2cTransactions++;
+        twiStatus = twiStarted ? 0x10 : 0x08;
+        twiStarted = true;
+        twiAddressed = false;
+        twiLength = 0;
+        twiDone = i2cStuckClocks ? UINT64_MAX : now + bitCycles;
+    }
+    else if (twiStarted && !twiAddressed && (twiStatus == 0x08 || twiStatus == 0x10))
+    {
+        // Address byte, reads are not modeled and get no answer
+        twiAddress = TWDR.value >> 1;
+        twiAddressed = ((TWDR.value & 1) == 0) && (i2cDevices[twiAddress & 0x7F] != NULL);
+        twiStatus = twiAddressed ? 0x18 : 0x20;
+        count.i2cBytes++;
+        if (!twiAddressed) count.i2cNacks++;
+        twiDone = now + 9 * bitCycles;
+    }
+    else if (twiStarted)
+    {
+        // Data byte, nobody answers it after a refused address
+        if (twiAddressed && (twiLength < sizeof(twiData)))
+        {
+            twiData[twiLength++] = TWDR.value;
+        }
+        twiStatus = twiAddressed ? 0x28 : 0x30;
+        count.i2cBytes++;
+        twiDone = now + 9 * bitCycles;
+    }
+}
+
+void MockHalClass::twiUpdate()
+{
+    if (now >= twiDone)
+    {
+        twiDone = UINT64_MAX;
+        TWSR.value = (uint8_t) ((TWSR.value & 0x03) | twiStatus);
+        TWCR.value |= _BV(TWINT);
+    }
+    if (now >= twiStopDone)
+    {
+        twiStopDone = UINT64_MAX;
+        TWCR.value &= (uint8_t) ~_BV(TWSTO);
+    }
+}
+
+void TwoWire::begin()
+{
+    wireTxLength = 0;
+    wireRxLength = 0;
+    wireRxIndex = 0;
+    MockHal.setI2cClock(100000);
+}
+
+void TwoWire::end()
+{
+}
+
+void TwoWire::setWireTimeout(uint32_t timeout, bool)
+{
+    MockHal.setI2cTimeout(timeout);
+}
+
+bool TwoWire::getWireTimeoutFlag()
+{
+    return wireTimeoutFlag;
+}
+
+void TwoWire::clearWireTimeoutFlag()
+{
+    wireTimeoutFlag = false;
+}
+
+void TwoWire::setClock(uint32_t clock)
+{
+    MockHal.setI2cClock(clock);
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+    wireTxAddress = address;
+    wireTxLength = 0;
+}
+
+uint8_t TwoWire::endTransmission(uint8_t)
+{
+    uint8_t status = MockHal.i2cWrite(wireTxAddress, wireTxBuffer, wireTxLength);
+    wireTxLength = 0;
+    if (status == 5) wireTimeoutFlag = true;
+    return status;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t)
+{
+    if (quantity > BUFFER_LENGTH)
+    {
+        quantity = BUFFER_LENGTH;
+    }
+
+    if (MockHal.i2cStuck()) wireTimeoutFlag = true;
+    wireRxLength = (uint8_t) MockHal.i2cRead(address, wireRxBuffer, quantity);
+    wireRxIndex = 0;
+    return wireRxLength;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+    if (wireTxLength >= BUFFER_LENGTH)
+    {
+        return 0;
+    }
+    wireTxBuffer[wireTxLength++] = data;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t quantity)
+{
+    size_t written = 0;
+    while (written < quantity && write(data[written]))
+    {
+        written++;
+    }
+    return written;
+}
+
+int TwoWire::available()
+{
+    return wireRxLength - wireRxIndex;
+}
+
+int TwoWire::read()
+{
+    return (wireRxIndex < wireRxLength) ? wireRxBuffer[wireRxIndex++] : -1;
+}
+
+int TwoWire::peek()
+{
+    return (wireRxIndex < wireRxLength) ? wireRxBuffer[wireRxIndex] : -1;
+}
+
+// Serial________________________________________________________________________________
+
+HardwareSerial Serial __attribute__((init_priority(102)));
+
+uint64_t MockHalClass::serialByteCycles() const
+{
+    return (F_CPU * 10ULL) / baud;
+}
+
+void MockHalClass::serialBegin(unsigned long baudRate)
+{
+    baud = (uint32_t) baudRate;
+}
+
+uint64_t MockHalClass::serialInject(const uint8_t* data, size_t length, uint64_t startCycle)
+{
+    uint64_t arrival = startCycle;
+
+    if (!rxLine.empty() && (rxLine.back().arrival + serialByteCycles() > arrival))
+    {
+        arrival = rxLine.back().arrival + serialByteCycles();
+    }
+
+    for (size_t i = 0; i < length; i++)
+    {
+        PendingByte pending = { arrival, data[i] };
+        rxLine.push_back(pending);
+        if (i + 1 < length)
+        {
+            arrival += serialByteCycles();
+        }
+    }
+
+    return arrival;
+}
+
+bool MockHalClass::serialRxPending() const
+{
+    return !rxLine.empty() || !rxBuffer.empty();
+}
+
+void MockHalClass::deliverRx()
+{
+    while (!rxLine.empty() && rxLine.front().arrival <= now)
+    {
+        // The core's ring buffer keeps one slot free
+        if (rxBuffer.size() < MOCK_SERIAL_BUFFER_SIZE - 1)
+        {
+            rxBuffer.push_back(rxLine.front().data);
+        }
+        else
+        {
+            count.serialRxDropped++;
+        }
+        rxLine.pop_front();
+    }
+}
+
+void MockHalClass::deliverTx()
+{
+    while (!txBuffer.empty() && txHeadDone <= now)
+    {
+        uint8_t data = txBuffer.front();
+        txBuffer.pop_front();
+
+        if (txListener)
+        {
+            txListener(data, txHeadDone, txListenerContext);
+        }
+
+        if (!txBuffer.empty())
+        {
+            txHeadDone += serialByteCycles();
+        }
+    }
+}
+
+int MockHalClass::serialAvailable()
+{
+    deliverRx();
+    return (int) rxBuffer.size();
+}
+
+int MockHalClass::serialPeek()
+{
+    deliverRx();
+    return rxBuffer.empty() ? -1 : rxBuffer.front();
+}
+
+int MockHalClass::serialRead()
+{
+    deliverRx();
+    if (rxBuffer.empty())
+    {
+        return -1;
+    }
+    uint8_t data = rxBuffer.front();
+    rxBuffer.pop_front();
+    count.serialRxBytes++;
+    return data;
+}
+
+int MockHalClass::serialAvailableForWrite()
+{
+    deliverTx();
+    // One byte can be in the shift register, the ring keeps one slot free
+    size_t queued = txBuffer.empty() ? 0 : txBuffer.size() - 1;
+    return (int) (MOCK_SERIAL_BUFFER_SIZE - 1 - queued);
+}
+
+void MockHalClass::serialWrite(uint8_t data)
+{
+    deliverTx();
+
+    while (txBuffer.size() >= MOCK_SERIAL_BUFFER_SIZE)
+    {
+        // Buffer full, Serial.write() spins until the next byte leaves
+        uint64_t stallStart = now;
+        advanceTo(txHeadDone);
+        count.serialTxStallCycles += (uint32_t) (now - stallStart);
+    }
+
+    if (txBuffer.empty())
+    {
+        txHeadDone = now + serialByteCycles();
+    }
+
+    txBuffer.push_back(data);
+    txCapture.push_back((char) data);
+    count.serialTxBytes++;
+}
+
+void MockHalClass::drainSerialTx()
+{
+    while (!txBuffer.empty())
+    {
+        advanceTo(txHeadDone);
+    }
+}
+
+std::string MockHalClass::takeSerialOutput()
+{
+    std::string output;
+    output.swap(txCapture);
+    return output;
+}
+
+void MockHalClass::setSerialTxListener(void (*listener)(uint8_t data, uint64_t cycle, void* context), void* context)
+{
+    txListener = listener;
+    txListenerContext = context;
+}
+
+void HardwareSerial::begin(unsigned long baud) { MockHal.serialBegin(baud); }
+void HardwareSerial::end() {}
+int HardwareSerial::available() { return MockHal.serialAvailable(); }
+int HardwareSerial::peek() { return MockHal.serialPeek(); }
+int HardwareSerial::read() { return MockHal.serialRead(); }
+int HardwareSerial::availableForWrite() { return MockHal.serialAvailableForWrite(); }
+void HardwareSerial::flush() { MockHal.drainSerialTx(); }
+size_t HardwareSerial::write(uint8_t data) { MockHal.serialWrite(data); return 1; }
+
+// Print_________________________________________________________________________________
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--)
+    {
+        n += write(*buffer++);
+    }
+    return n;
+}
+
+size_t Print::printSigned(long n, int base)
+{
+    if (base == DEC && n < 0)
+    {
+        return print('-') + printNumber((unsigned long) -n, base);
+    }
+    return printNumber((unsigned long) n, base);
+}
+
+size_t Print::printNumber(unsigned long n, int base)
+{
+    char buffer[8 * sizeof(long) + 1];
+    char* str = &buffer[sizeof(buffer) - 1];
+
+    *str = '\0';
+
+    if (base < 2)
+    {
+        base = 10;
+    }
+
+    do
+    {
+        char digit = (char) (n % base);
+        n /= base;
+        *--str = digit < 10 ? digit + '0' : digit + 'A' - 10;
+    } while (n);
+
+    return write(str);
+}
+
+size_t Print::print(double number, int digits)
+{
+    char buffer[48];
+    snprintf(buffer, sizeof(buffer), "%.*f", digits, number);
+    return write(buffer);
+}
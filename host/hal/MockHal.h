@@ -0,0 +1,269 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Simulation controls of the host HAL.
+ *
+ *  Time only moves when the firmware touches the HAL (bus transfers, delays, blocking serial writes) or when a host
+ *  tool calls MockHal.advance().  Costs are those of an ATmega328P at F_CPU: SPI bytes take 8 SCK periods, I2C bytes
+ *  9 SCL periods, serial bytes 10 bit times at the configured baud.  Timer1 and Timer2 count with those cycles and
+ *  their interrupt handlers run as soon as the flag, enable and global interrupt bits allow.  ADC conversions take 13
+ *  ADC clocks (25 for the first after ADEN) and can run free.
+ */
+#ifndef MOCK_HAL_H
+#define MOCK_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+/// @brief SPI slave selected by a chip select pin
+class MockSpiDevice
+{
+  public:
+    virtual ~MockSpiDevice() {}
+    virtual void select() {}
+    virtual uint8_t transfer(uint8_t mosi) = 0;
+    virtual void deselect() {}
+};
+
+/// @brief I2C slave at a 7-bit address
+class MockI2cDevice
+{
+  public:
+    virtual ~MockI2cDevice() {}
+    /// @returns true if every byte was acknowledged
+    virtual bool write(const uint8_t* data, size_t length) = 0;
+    /// @returns number of bytes supplied, the rest read as 0xFF
+    virtual size_t read(uint8_t* data, size_t length) = 0;
+};
+
+/// @brief Totals since the last resetCounters()
+struct MockCounters
+{
+    uint32_t spiFrames;          //!< chip select low to high periods with at least one byte
+    uint32_t spiBytes;
+    uint32_t i2cTransactions;
+    uint32_t i2cBytes;           //!< address bytes included
+    uint32_t i2cNacks;
+    uint32_t serialTxBytes;
+    uint32_t serialRxBytes;      //!< bytes read by the firmware
+    uint32_t serialRxDropped;    //!< bytes lost because the 64 byte RX buffer was full
+    uint32_t serialTxStallCycles;//!< cycles spent blocked in Serial.write with a full TX buffer
+    uint32_t interrupts;
+    uint64_t sleepCycles;        //!< cycles spent in sleep_cpu()
+    uint32_t i2cTimeouts;        //!< transactions given up by the Wire timeout while a slave held SDA low
+    uint32_t watchdogResets;     //!< watchdog time-outs in system reset mode, the mock keeps running through them
+    uint64_t watchdogMaxGapCycles;//!< longest time between two wdt_reset() calls
+    uint32_t adcConversions;
+};
+
+class MockHalClass
+{
+  public:
+    MockHalClass();
+
+    uint64_t cycles() const { return now; }
+    double seconds() const { return (double) now / F_CPU_HZ; }
+    void advance(uint64_t cycles);
+    void advanceTo(uint64_t cycle);
+
+    /// Runs one pass of the Arduino main loop: loop() followed by serialEvent() when bytes are waiting
+    void runLoopOnce();
+
+    /** SRAM is modeled for code that reads it by address, with the heap at HEAP_START in place of the AVR build's
+     *  .data and .bss, which the host build can not know.  HEAP_START is an estimate, not a measurement: RAMSTART
+     *  plus the 1580 bytes the README's Memory section gives for the default Uno build, whichever engines the host
+     *  build has in.  The stack pointer follows the host's stack: the depth
+     *  below the frame that called setup() or loop(), divided by STACK_SCALE, down from LOOP_SP.  Every advance and
+     *  read of SP writes the bytes just above it, so painted SRAM shows how deep the firmware went.  The figures
+     *  rank the paths through the firmware, the AVR's own frame sizes are not modeled.
+     */
+    void setStackBase(const void* frame) { stackBase = (uintptr_t) frame; }
+    uint16_t stackPointer();
+    static const uint16_t HEAP_START = 0x72C;
+    static const uint16_t LOOP_SP = 0x8FB;         //!< RAMEND less main() and the call of loop()
+    static const uint16_t STACK_SCALE = 4;
+
+    /// Idle sleep, called by sleep_cpu()
+    void sleep();
+
+    void attachSpiDevice(uint8_t chipSelectPin, MockSpiDevice* device);
+    void attachI2cDevice(uint8_t address, MockI2cDevice* device);
+    void detachI2cDevice(uint8_t address);
+
+    /// Queues bytes on the RX line, the first one arriving at startCycle and the rest back to back at the baud rate
+    /// @returns cycle at which the last byte has arrived
+    uint64_t serialInject(const uint8_t* data, size_t length, uint64_t startCycle);
+    uint64_t serialInject(const std::string& text) { return serialInject((const uint8_t*) text.data(), text.size(), now); }
+    bool serialRxPending() const;
+    /// Cycle at which the next injected byte reaches the RX buffer, UINT64_MAX if none is on the line
+    uint64_t serialNextArrival() const { return rxLine.empty() ? UINT64_MAX : rxLine.front().arrival; }
+    uint32_t serialBaud() const { return baud; }
+    uint64_t serialByteCycles() const;
+
+    /// Everything the firmware wrote to the serial port since the last call
+    std::string takeSerialOutput();
+    /// Called for every byte as it leaves the TX shift register, with the cycle its stop bit ended
+    void setSerialTxListener(void (*listener)(uint8_t data, uint64_t cycle, void* context), void* context);
+    /// Blocks until the TX buffer is empty, advancing time
+    void drainSerialTx();
+
+    /// Level driven onto an input pin by the outside world, edges raise the pin change and INT0/INT1 flags
+    void setPinInput(uint8_t pin, uint8_t level);
+    uint8_t getPinOutput(uint8_t pin) const;
+    bool isPinOutput(uint8_t pin) const;
+
+    /** Called when Timer1 moves OC1A (pin 9) in a non-PWM mode, on a compare match or FOC1A, with the new level and
+     *  the cycle.  Only while COM1A1:0 connect OC1A to the pin.
+     */
+    void setCompareOutputListener(void (*listener)(uint8_t level, uint64_t cycle, void* context), void* context);
+
+    /** Drives the Timer1 capture input (ICP1, or the comparator output with ACIC set) with a square wave.  The
+     *  frequency is asked for at every edge so it follows whatever the source models, 0 Hz holds the line.  Edges
+     *  that match ICES1 latch TCNT1 into ICR1 and set ICF1.  NULL disconnects the source.
+     */
+    void setCaptureSource(double (*frequencyHz)(void* context), void* context);
+
+    /** Drives the analog inputs.  The source is asked for the voltage on an ADC channel (ADMUX MUX3:0) at the cycle
+     *  the sample and hold closes, 1.5 ADC clocks into the conversion (13.5 for the first).  The reference is AVCC at
+     *  5 V.  NULL reads 0 V.
+     */
+    void setAnalogSource(double (*volts)(uint8_t channel, uint64_t cycle, void* context), void* context);
+
+    /** A slave holds SDA low until it has seen sclClocks rising edges on SCL (pin A5 released with its pull-up),
+     *  0 lets go of the bus.  Transactions stall for the Wire timeout while SDA is held, or for a second when no
+     *  timeout is set, where the real library would spin for ever.
+     */
+    void setI2cStuck(uint8_t sclClocks);
+    bool i2cStuck() const { return i2cStuckClocks != 0; }
+
+    /** The TWI registers for firmware that drives the bus itself, next to Wire: master transmitter, polled, no TWI
+     *  interrupt.  TWINT and the TWSR status come one bit time after a start and nine after a byte, at the Wire
+     *  clock.  Data bytes are acknowledged as they go, the device sees the transaction at the stop and a refusal
+     *  only shows in the counters.  A start on a bus a slave holds never completes.
+     */
+    void twiControlWritten(uint8_t oldValue, uint8_t newValue);
+    void twiUpdate();
+
+    const MockCounters& counters() const { return count; }
+    void resetCounters();
+
+    static const uint32_t F_CPU_HZ = 16000000UL;
+
+    // Used by the HAL implementation
+    void spiSelect(uint8_t pin, bool selected);
+    uint8_t spiTransfer(uint8_t data);
+    uint64_t spiByteCycles() const;
+    uint8_t i2cWrite(uint8_t address, const uint8_t* data, size_t length);
+    size_t i2cRead(uint8_t address, uint8_t* data, size_t length);
+    void setI2cClock(uint32_t clock) { i2cClockHz = clock; }
+    void setI2cTimeout(uint32_t timeoutUs) { i2cTimeoutUs = timeoutUs; }
+    void adcControlWritten(uint8_t oldValue, uint8_t newValue);
+    void watchdogEnable(uint8_t timeout);
+    void watchdogReset();
+    void watchdogDisable();
+    void serialBegin(unsigned long baudRate);
+    int serialAvailable();
+    int serialPeek();
+    int serialRead();
+    int serialAvailableForWrite();
+    void serialWrite(uint8_t data);
+    void dispatchInterrupts();
+    void portWritten(uint8_t port, uint8_t oldValue, uint8_t newValue);
+    void ddrWritten(uint8_t port, uint8_t oldValue, uint8_t newValue);
+    void forceCompareOutputA();
+    uint8_t portInputs(uint8_t port) const { return inputLevels[port]; }
+    bool inInterrupt() const { return servicingInterrupt; }
+
+  private:
+    struct PendingByte
+    {
+        uint64_t arrival;
+        uint8_t data;
+    };
+
+    void step(uint64_t cycles);
+    uint64_t cyclesToNextTimerEvent() const;
+    void deliverRx();
+    void deliverTx();
+    void captureEdge();
+    void adcStart(uint64_t startCycle);
+    void adcComplete();
+    uint64_t i2cStall();
+    void checkWatchdog();
+    void notifyCompareOutputA();
+    void pinLevelsChanged(uint8_t port, uint8_t changed);
+
+    uint64_t now;
+    bool servicingInterrupt;
+    uintptr_t stackBase;
+
+    MockSpiDevice* spiDevices[20];
+    MockSpiDevice* selectedSpi;
+    bool spiFrameHasData;
+    MockI2cDevice* i2cDevices[128];
+    uint32_t i2cClockHz;
+    uint32_t i2cTimeoutUs;
+    uint8_t i2cStuckClocks;
+    uint64_t twiDone;             //!< cycle at which TWINT sets, UINT64_MAX while nothing is under way
+    uint64_t twiStopDone;
+    uint8_t twiStatus;            //!< TWSR once TWINT sets
+    bool twiStarted;
+    bool twiAddressed;            //!< the address byte was acknowledged
+    uint8_t twiAddress;
+    uint8_t twiData[32];
+    uint8_t twiLength;
+
+    uint64_t watchdogTimeoutCycles;   //!< 0 while the watchdog is off
+    uint64_t watchdogKick;
+
+    uint32_t baud;
+    std::deque<PendingByte> rxLine;
+    std::deque<uint8_t> rxBuffer;
+    std::deque<uint8_t> txBuffer;
+    uint64_t txHeadDone;          //!< cycle at which the byte at the front of txBuffer has been shifted out
+    std::string txCapture;
+    void (*txListener)(uint8_t, uint64_t, void*);
+    void* txListenerContext;
+    void (*compareOutputListener)(uint8_t, uint64_t, void*);
+    void* compareOutputListenerContext;
+
+    uint8_t inputLevels[3];   //!< B, C, D
+    double (*captureSource)(void*);
+    void* captureSourceContext;
+    double nextCaptureEdge;   //!< cycle of the next edge, fractional so periods do not drift
+    bool captureLevel;
+    double (*analogSource)(uint8_t, uint64_t, void*);
+    void* analogSourceContext;
+    bool adcConverting;
+    bool adcFirst;            //!< the next conversion is the first since ADEN, 25 ADC clocks
+    uint64_t adcClockOrigin;  //!< cycle ADEN was set, the ADC clock prescaler starts there
+    uint64_t adcSampleCycle;
+    uint64_t adcDoneCycle;
+    MockCounters count;
+};
+
+extern MockHalClass MockHal;
+
+/// Bytes the core keeps in each serial ring buffer
+#define MOCK_SERIAL_BUFFER_SIZE 64
+
+#endif
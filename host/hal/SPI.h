@@ -0,0 +1,52 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#ifndef MOCK_SPI_H
+#define MOCK_SPI_H
+
+#include "Arduino.h"
+
+// Same encodings as the AVR SPI library: SPR1:SPR0 in the low bits, SPI2X in bit 2
+#define SPI_CLOCK_DIV4   0x00
+#define SPI_CLOCK_DIV16  0x01
+#define SPI_CLOCK_DIV64  0x02
+#define SPI_CLOCK_DIV128 0x03
+#define SPI_CLOCK_DIV2   0x04
+#define SPI_CLOCK_DIV8   0x05
+#define SPI_CLOCK_DIV32  0x06
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+/// @brief Drives the mocked SPCR/SPSR/SPDR registers exactly like the AVR library does
+class SPIClass
+{
+  public:
+    static void begin();
+    static void end();
+    static uint8_t transfer(uint8_t data);
+    static void setBitOrder(uint8_t bitOrder);
+    static void setDataMode(uint8_t dataMode);
+    static void setClockDivider(uint8_t clockDiv);
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,56 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#ifndef MOCK_WIRE_H
+#define MOCK_WIRE_H
+
+#include "Arduino.h"
+
+#define BUFFER_LENGTH 32
+
+/// @brief Blocking I2C master with the same return codes as the AVR Wire library (1.8.13 and later, with the timeout
+/// API), transactions go to MockI2cDevice objects
+class TwoWire : public Stream
+{
+  public:
+    void begin();
+    void end();
+    void setClock(uint32_t clock);
+    /// Gives up on a transaction after timeout us, endTransmission() then returns 5 and requestFrom() 0
+    void setWireTimeout(uint32_t timeout = 25000, bool reset_with_timeout = false);
+    bool getWireTimeoutFlag();
+    void clearWireTimeoutFlag();
+    void beginTransmission(uint8_t address);
+    void beginTransmission(int address) { beginTransmission((uint8_t) address); }
+    uint8_t endTransmission(uint8_t sendStop);
+    uint8_t endTransmission(void) { return endTransmission(true); }
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity) { return requestFrom(address, quantity, (uint8_t) true); }
+    uint8_t requestFrom(int address, int quantity, int sendStop) { return requestFrom((uint8_t) address, (uint8_t) quantity, (uint8_t) sendStop); }
+    uint8_t requestFrom(int address, int quantity) { return requestFrom((uint8_t) address, (uint8_t) quantity, (uint8_t) true); }
+    virtual size_t write(uint8_t data);
+    virtual size_t write(const uint8_t* data, size_t quantity);
+    virtual int available();
+    virtual int read();
+    virtual int peek();
+    using Print::write;
+};
+
+extern TwoWire Wire;
+
+#endif
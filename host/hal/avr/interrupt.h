@@ -0,0 +1,53 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#ifndef MOCK_AVR_INTERRUPT_H
+#define MOCK_AVR_INTERRUPT_H
+
+#include "avr/io.h"
+
+/// Interrupt handlers become plain C functions that the mock HAL calls when the matching flag and enable bits are set
+#define ISR(vector, ...)  extern "C" void vector(void)
+
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+#define reti()  return
+
+#define cli()  (SREG &= (uint8_t) ~_BV(SREG_I))
+#define sei()  (SREG |= (uint8_t) _BV(SREG_I))
+
+extern "C"
+{
+void INT0_vect(void);
+void INT1_vect(void);
+void PCINT0_vect(void);
+void PCINT1_vect(void);
+void PCINT2_vect(void);
+void WDT_vect(void);
+void TIMER2_COMPA_vect(void);
+void TIMER2_COMPB_vect(void);
+void TIMER2_OVF_vect(void);
+void TIMER1_CAPT_vect(void);
+void TIMER1_COMPA_vect(void);
+void TIMER1_COMPB_vect(void);
+void TIMER1_OVF_vect(void);
+void ADC_vect(void);
+}
+
+#endif
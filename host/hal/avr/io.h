@@ -0,0 +1,283 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Host stand-in for the ATmega328P register file.
+ *
+ *  Every register is a MockRegister object so the mock HAL can react to writes (write-one-to-clear flags, port pins
+ *  driving chip selects, SPI data register) and compute values on reads (PINx).  Only the registers the firmware
+ *  uses are listed, with the bit positions from the datasheet.
+ */
+#ifndef MOCK_AVR_IO_H
+#define MOCK_AVR_IO_H
+
+#include <stdint.h>
+
+template <typename T>
+class MockRegister
+{
+  public:
+    typedef void (*WriteHook)(MockRegister<T>& reg, T oldValue, T newValue);
+    typedef T (*ReadHook)(const MockRegister<T>& reg);
+
+    // constexpr so registers are constant initialized, before any firmware constructor touches them
+    constexpr MockRegister() : value(0), onWrite(0), onRead(0) {}
+    constexpr MockRegister(WriteHook writeHook, ReadHook readHook) : value(0), onWrite(writeHook), onRead(readHook) {}
+
+    operator T() const { return onRead ? onRead(*this) : value; }
+
+    MockRegister& operator=(T newValue) { store(newValue); return *this; }
+    MockRegister& operator=(const MockRegister& other) { store((T) other); return *this; }
+    MockRegister& operator|=(T bits) { store((T) ((T) *this | bits)); return *this; }
+    MockRegister& operator&=(T bits) { store((T) ((T) *this & bits)); return *this; }
+    MockRegister& operator^=(T bits) { store((T) ((T) *this ^ bits)); return *this; }
+    MockRegister& operator+=(T amount) { store((T) ((T) *this + amount)); return *this; }
+    MockRegister& operator-=(T amount) { store((T) ((T) *this - amount)); return *this; }
+
+    void store(T newValue)
+    {
+        T oldValue = value;
+        value = newValue;
+
+        if (onWrite)
+        {
+            onWrite(*this, oldValue, newValue);
+        }
+    }
+
+    T value;            //!< raw storage, the mock HAL accesses this directly to bypass the hooks
+    WriteHook onWrite;
+    ReadHook onRead;
+};
+
+typedef MockRegister<uint8_t> MockRegister8;
+typedef MockRegister<uint16_t> MockRegister16;
+
+#define _BV(bit) (1 << (bit))
+
+#define RAMSTART  0x100
+#define RAMEND    0x8FF
+#define E2END     0x3FF
+#define FLASHEND  0x7FFF
+
+// Status register and stack pointer, SP follows the host's stack (see MockHalClass::stackPointer())
+extern MockRegister8 SREG;
+extern MockRegister16 SP;
+#define SREG_I  7
+
+// SRAM by address as avr-libc's _SFR_MEM8 reads it, and the heap symbols of its malloc()
+extern uint8_t MockDataSpace[RAMEND + 1];
+#define _SFR_MEM8(address)  (MockDataSpace[(address)])
+extern char* __malloc_heap_start;
+extern char* __brkval;
+
+// Ports
+extern MockRegister8 PORTB, DDRB, PINB;
+extern MockRegister8 PORTC, DDRC, PINC;
+extern MockRegister8 PORTD, DDRD, PIND;
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+// Timer/Counter1
+extern MockRegister8 TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1;
+extern MockRegister16 TCNT1, OCR1A, OCR1B, ICR1;
+#define COM1A1 7
+#define COM1A0 6
+#define COM1B1 5
+#define COM1B0 4
+#define WGM11  1
+#define WGM10  0
+#define ICNC1  7
+#define ICES1  6
+#define WGM13  4
+#define WGM12  3
+#define CS12   2
+#define CS11   1
+#define CS10   0
+#define FOC1A  7
+#define FOC1B  6
+#define ICIE1  5
+#define OCIE1B 2
+#define OCIE1A 1
+#define TOIE1  0
+#define ICF1   5
+#define OCF1B  2
+#define OCF1A  1
+#define TOV1   0
+
+// Timer/Counter2
+extern MockRegister8 TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2, TIFR2, ASSR;
+#define COM2A1 7
+#define COM2A0 6
+#define COM2B1 5
+#define COM2B0 4
+#define WGM21  1
+#define WGM20  0
+#define FOC2A  7
+#define FOC2B  6
+#define WGM22  3
+#define CS22   2
+#define CS21   1
+#define CS20   0
+#define OCIE2B 2
+#define OCIE2A 1
+#define TOIE2  0
+#define OCF2B  2
+#define OCF2A  1
+#define TOV2   0
+
+// General timer control
+extern MockRegister8 GTCCR;
+#define TSM     7
+#define PSRASY  1
+#define PSRSYNC 0
+
+// SPI
+extern MockRegister8 SPCR, SPSR, SPDR;
+#define SPIE  7
+#define SPE   6
+#define DORD  5
+#define MSTR  4
+#define CPOL  3
+#define CPHA  2
+#define SPR1  1
+#define SPR0  0
+#define SPIF  7
+#define WCOL  6
+#define SPI2X 0
+
+// External and pin change interrupts
+extern MockRegister8 EICRA, EIMSK, EIFR, PCICR, PCIFR, PCMSK0, PCMSK1, PCMSK2;
+#define ISC11 3
+#define ISC10 2
+#define ISC01 1
+#define ISC00 0
+#define INT1  1
+#define INT0  0
+#define INTF1 1
+#define INTF0 0
+#define PCIE2 2
+#define PCIE1 1
+#define PCIE0 0
+#define PCIF2 2
+#define PCIF1 1
+#define PCIF0 0
+#define PCINT20 4
+#define PCINT9 1
+
+// ADC
+extern MockRegister8 ADMUX, ADCSRA, ADCSRB, ADCL, ADCH, DIDR0;
+extern MockRegister16 ADCW;
+#define ADC    ADCW
+#define REFS1  7
+#define REFS0  6
+#define ADLAR  5
+#define MUX3   3
+#define MUX2   2
+#define MUX1   1
+#define MUX0   0
+#define ADEN   7
+#define ADSC   6
+#define ADATE  5
+#define ADIF   4
+#define ADIE   3
+#define ADPS2  2
+#define ADPS1  1
+#define ADPS0  0
+#define ACME   6
+#define ADTS2  2
+#define ADTS1  1
+#define ADTS0  0
+#define ADC5D  5
+#define ADC4D  4
+#define ADC3D  3
+#define ADC2D  2
+#define ADC1D  1
+#define ADC0D  0
+
+// Analog comparator
+extern MockRegister8 ACSR, DIDR1;
+#define ACD   7
+#define ACBG  6
+#define ACO   5
+#define ACI   4
+#define ACIE  3
+#define ACIC  2
+#define ACIS1 1
+#define ACIS0 0
+#define AIN1D 1
+#define AIN0D 0
+
+// Power management, reset and watchdog
+extern MockRegister8 SMCR, MCUSR, WDTCSR, PRR;
+#define SM2      3
+#define SM1      2
+#define SM0      1
+#define SE       0
+#define WDRF     3
+#define BORF     2
+#define EXTRF    1
+#define PORF     0
+#define WDIF     7
+#define WDIE     6
+#define WDP3     5
+#define WDCE     4
+#define WDE      3
+#define WDP2     2
+#define WDP1     1
+#define WDP0     0
+#define PRTWI    7
+#define PRTIM2   6
+#define PRTIM0   5
+#define PRTIM1   3
+#define PRSPI    2
+#define PRUSART0 1
+#define PRADC    0
+
+// Two wire interface
+extern MockRegister8 TWBR, TWSR, TWCR, TWDR, TWAR;
+#define TWINT 7
+#define TWEA  6
+#define TWSTA 5
+#define TWSTO 4
+#define TWWC  3
+#define TWEN  2
+#define TWIE  0
+
+#endif
@@ -0,0 +1,46 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#ifndef MOCK_AVR_PGMSPACE_H
+#define MOCK_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+/// On the host flash and RAM share one address space, so PROGMEM data is read in place
+#define PROGMEM
+#define PGM_P  const char*
+#define PSTR(s)  (s)
+
+// pgm_read_word() is used on tables of pointers, which are wider than 16 bits on the host.  Returning the element
+// type keeps both pointer tables and uint16_t tables working.
+template <typename T> inline T mockPgmRead(const T* address) { return *address; }
+
+#define pgm_read_byte(address)   (*(const uint8_t*) (address))
+#define pgm_read_word(address)   mockPgmRead(address)
+#define pgm_read_dword(address)  mockPgmRead(address)
+#define pgm_read_ptr(address)    mockPgmRead(address)
+
+#define strcpy_P(dest, src)          strcpy((dest), (src))
+#define strncpy_P(dest, src, n)      strncpy((dest), (src), (n))
+#define strlen_P(s)                  strlen(s)
+#define strcmp_P(a, b)               strcmp((a), (b))
+#define strchr_P(s, c)               strchr((s), (c))
+#define memcpy_P(dest, src, n)       memcpy((dest), (src), (n))
+
+#endif
@@ -0,0 +1,38 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#ifndef MOCK_AVR_SLEEP_H
+#define MOCK_AVR_SLEEP_H
+
+#include "avr/io.h"
+
+#define SLEEP_MODE_IDLE         0
+#define SLEEP_MODE_ADC          _BV(SM0)
+#define SLEEP_MODE_PWR_DOWN     _BV(SM1)
+#define SLEEP_MODE_PWR_SAVE     (_BV(SM0) | _BV(SM1))
+#define SLEEP_MODE_STANDBY      (_BV(SM1) | _BV(SM2))
+#define SLEEP_MODE_EXT_STANDBY  (_BV(SM0) | _BV(SM1) | _BV(SM2))
+
+#define set_sleep_mode(mode)  (SMCR = (uint8_t) ((SMCR & ~(_BV(SM0) | _BV(SM1) | _BV(SM2))) | (mode)))
+#define sleep_enable()        (SMCR |= (uint8_t) _BV(SE))
+#define sleep_disable()       (SMCR &= (uint8_t) ~_BV(SE))
+
+/// Idle sleep only: time passes until an interrupt handler runs, a serial byte moves or Timer0 overflows
+void sleep_cpu(void);
+
+#endif
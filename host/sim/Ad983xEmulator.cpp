@@ -0,0 +1,214 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <math.h>
+#include <string.h>
+#include "Ad983xEmulator.h"
+
+static const uint32_t PHASE_ROM_BITS = 12;
+static const uint32_t PHASE_ROM_SIZE = 1 << PHASE_ROM_BITS;
+static const uint32_t ACCUMULATOR_MASK = 0x0FFFFFFF;
+
+double Ad983xState::outputHz(double mclkHz) const
+{
+    double hz = tuningWord() * mclkHz / (double) (1UL << 28);
+
+    if ((control & AD983X_OPBITEN) && !(control & AD983X_DIV2))
+    {
+        hz /= 2;
+    }
+
+    return hz;
+}
+
+Ad983xEmulator::Ad983xEmulator()
+{
+    memset(&registers, 0, sizeof(registers));
+    shift = 0;
+    bitsInFrame = 0;
+    b28LsbLoaded[0] = false;
+    b28LsbLoaded[1] = false;
+    wordCount = 0;
+    partialFrameCount = 0;
+}
+
+void Ad983xEmulator::select()
+{
+    bitsInFrame = 0;
+}
+
+uint8_t Ad983xEmulator::transfer(uint8_t mosi)
+{
+    shift = (uint16_t) ((shift << 8) | mosi);
+    bitsInFrame += 8;
+
+    if ((bitsInFrame % 16) == 0)
+    {
+        word(shift);
+    }
+
+    // SDATA is input only
+    return 0;
+}
+
+void Ad983xEmulator::deselect()
+{
+    if (bitsInFrame % 16)
+    {
+        partialFrameCount++;
+    }
+}
+
+void Ad983xEmulator::word(uint16_t data)
+{
+    uint16_t payload = data & 0x3FFF;
+
+    wordCount++;
+
+    switch (data >> 14)
+    {
+        case 0:
+            registers.control = payload;
+        break;
+        case 1:
+        case 2:
+        {
+            uint8_t number = (data >> 14) - 1;
+            uint32_t& frequency = registers.frequency[number];
+
+            if (registers.control & Ad983xState::AD983X_B28)
+            {
+                // Two consecutive writes, LSBs first
+                if (!b28LsbLoaded[number])
+                {
+                    frequency = (frequency & 0x0FFFC000) | payload;
+                }
+                else
+                {
+                    frequency = (frequency & 0x3FFF) | ((uint32_t) payload << 14);
+                }
+                b28LsbLoaded[number] = !b28LsbLoaded[number];
+            }
+            else if (registers.control & Ad983xState::AD983X_HLB)
+            {
+                frequency = (frequency & 0x3FFF) | ((uint32_t) payload << 14);
+            }
+            else
+            {
+                frequency = (frequency & 0x0FFFC000) | payload;
+            }
+        }
+        break;
+        default:
+            registers.phase[(data >> 13) & 1] = data & 0x0FFF;
+        break;
+    }
+}
+
+double Ad983xEmulator::captureHz(void* emulator)
+{
+    const Ad983xState& state = ((Ad983xEmulator*) emulator)->state();
+
+    if (state.control & (Ad983xState::AD983X_RESET | Ad983xState::AD983X_SLEEP1))
+    {
+        return 0.0;
+    }
+
+    return state.outputHz(MCLK_HZ);
+}
+
+/// 10-bit sine ROM addressed by 12 bits of phase, normalized to +-1
+struct SineRom
+{
+    float value[PHASE_ROM_SIZE];
+
+    SineRom()
+    {
+        const double fullScale = (1 << Ad983xEmulator::DAC_BITS) - 1;
+
+        for (uint32_t i = 0; i < PHASE_ROM_SIZE; i++)
+        {
+            double code = floor(fullScale / 2 * (1.0 + sin(2.0 * M_PI * i / PHASE_ROM_SIZE)) + 0.5);
+            value[i] = (float) (code / fullScale * 2.0 - 1.0);
+        }
+    }
+};
+
+static const float* sineRom()
+{
+    // Built once, on first use, by whichever thread gets there first
+    static const SineRom rom;
+    return rom.value;
+}
+
+void Ad983xEmulator::render(const Ad983xState& state, float* samples, size_t count, uint32_t decimate)
+{
+    const float* rom = sineRom();
+    const double fullScale = (1 << DAC_BITS) - 1;
+    uint32_t step = (state.tuningWord() * decimate) & ACCUMULATOR_MASK;
+    uint32_t offset = (uint32_t) state.phaseOffset() << (28 - PHASE_ROM_BITS);
+    uint32_t accumulator = 0;
+    uint16_t control = state.control;
+    bool msbDivided = false;
+    bool lastMsb = false;
+
+    if (control & (Ad983xState::AD983X_RESET | Ad983xState::AD983X_SLEEP1))
+    {
+        // Accumulator held at zero or MCLK stopped, the DAC sits at the current code
+        step = 0;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t phase = ((accumulator + offset) & ACCUMULATOR_MASK) >> (28 - PHASE_ROM_BITS);
+
+        if (control & Ad983xState::AD983X_OPBITEN)
+        {
+            bool msb = (phase >> (PHASE_ROM_BITS - 1)) & 1;
+
+            if (control & Ad983xState::AD983X_DIV2)
+            {
+                samples[i] = msb ? 1.0f : -1.0f;
+            }
+            else
+            {
+                // MSB/2 toggles on every rising edge of the MSB
+                msbDivided ^= (msb && !lastMsb);
+                samples[i] = msbDivided ? 1.0f : -1.0f;
+            }
+
+            lastMsb = msb;
+        }
+        else if (control & Ad983xState::AD983X_SLEEP12)
+        {
+            samples[i] = 0.0f;
+        }
+        else if (control & Ad983xState::AD983X_MODE)
+        {
+            // Triangle, the ROM is bypassed and the phase folded into a 10-bit ramp up and down
+            uint32_t code = (phase < PHASE_ROM_SIZE / 2) ? (phase >> 1) : ((PHASE_ROM_SIZE - 1 - phase) >> 1);
+            samples[i] = (float) (code / fullScale * 2.0 - 1.0);
+        }
+        else
+        {
+            samples[i] = rom[phase];
+        }
+
+        accumulator = (accumulator + step) & ACCUMULATOR_MASK;
+    }
+}
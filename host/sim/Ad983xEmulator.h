@@ -0,0 +1,98 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Emulates the AD983x DDS on the SPI bus and renders the samples its DAC would produce.
+ *
+ *  Frames are decoded as 16-bit words, MSB first: D15:D14 = 00 control, 01 FREQ0, 10 FREQ1, 11 PHASE0/1 (D13).
+ *  With B28 set two consecutive frequency writes load the LSB then the MSB 14 bits, without it HLB picks the half.
+ *
+ *  The output model is the one in the datasheet: a 28-bit phase accumulator clocked by MCLK, its 12 MSBs plus the
+ *  phase register address a sine ROM feeding a 10-bit DAC, MODE turns the ROM into a triangle, OPBITEN outputs the
+ *  MSB (DIV2 = 1) or MSB/2 (DIV2 = 0) as a square, RESET holds the accumulator at zero and SLEEP1 stops MCLK.
+ */
+#ifndef Ad983xEmulator_h
+#define Ad983xEmulator_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include "MockHal.h"
+
+/// @brief Register contents, copyable so renders can run on other threads
+struct Ad983xState
+{
+    uint16_t control;        //!< D13:D0 of the last control write
+    uint32_t frequency[2];   //!< 28-bit tuning words
+    uint16_t phase[2];       //!< 12-bit phase offsets
+
+    uint32_t tuningWord() const { return frequency[(control & AD983X_FSEL) ? 1 : 0]; }
+    uint16_t phaseOffset() const { return phase[(control & AD983X_PSEL) ? 1 : 0]; }
+    /// Frequency of the DAC output, half of it for the MSB/2 square
+    double outputHz(double mclkHz) const;
+
+    static const uint16_t AD983X_B28 = 1 << 13;
+    static const uint16_t AD983X_HLB = 1 << 12;
+    static const uint16_t AD983X_FSEL = 1 << 11;
+    static const uint16_t AD983X_PSEL = 1 << 10;
+    static const uint16_t AD983X_RESET = 1 << 8;
+    static const uint16_t AD983X_SLEEP1 = 1 << 7;
+    static const uint16_t AD983X_SLEEP12 = 1 << 6;
+    static const uint16_t AD983X_OPBITEN = 1 << 5;
+    static const uint16_t AD983X_DIV2 = 1 << 3;
+    static const uint16_t AD983X_MODE = 1 << 1;
+};
+
+class Ad983xEmulator : public MockSpiDevice
+{
+  public:
+    Ad983xEmulator();
+
+    virtual void select();
+    virtual uint8_t transfer(uint8_t mosi);
+    virtual void deselect();
+
+    const Ad983xState& state() const { return registers; }
+    uint32_t words() const { return wordCount; }
+    /// Frames that ended part way through a 16-bit word
+    uint32_t partialFrames() const { return partialFrameCount; }
+
+    /** Renders DAC samples normalized to +-1, one every decimate MCLK periods starting with the accumulator at zero.
+     *  Safe to call from several threads with different states.
+     */
+    static void render(const Ad983xState& state, float* samples, size_t count, uint32_t decimate);
+
+    /** MockHal capture source for the output squared up by a comparator (or the MSB output itself), context is the
+     *  emulator.  0 Hz while RESET or SLEEP1 stop the accumulator.
+     */
+    static double captureHz(void* emulator);
+
+    static const uint32_t DAC_BITS = 10;
+    static const uint32_t MCLK_HZ = 16000000;   //!< the oscillator on the usual AD9833 modules
+
+  private:
+    void word(uint16_t data);
+
+    Ad983xState registers;
+    uint16_t shift;
+    uint8_t bitsInFrame;
+    bool b28LsbLoaded[2];
+    uint32_t wordCount;
+    uint32_t partialFrameCount;
+};
+
+#endif
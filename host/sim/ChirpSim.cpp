@@ -0,0 +1,120 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <string.h>
+#include <time.h>
+#include "Arduino.h"
+#include "ChirpSim.h"
+
+static NullSpiDevice defaultDds;
+static AckI2cDevice defaultAmplifier;
+
+ChirpSim::ChirpSim()
+{
+    booted = false;
+    dispatchListener = NULL;
+    dispatchListenerContext = NULL;
+    MockHal.attachSpiDevice(DDS_CHIP_SELECT_PIN, &defaultDds);
+    MockHal.attachI2cDevice(RPOT_I2C_ADDRESS, &defaultAmplifier);
+}
+
+void ChirpSim::attachDdsDevice(MockSpiDevice* device)
+{
+    MockHal.attachSpiDevice(DDS_CHIP_SELECT_PIN, device);
+}
+
+void ChirpSim::attachAmplifierDevice(MockI2cDevice* device)
+{
+    MockHal.attachI2cDevice(RPOT_I2C_ADDRESS, device);
+}
+
+void ChirpSim::boot()
+{
+    if (!booted)
+    {
+        booted = true;
+        MockHal.setStackBase(__builtin_frame_address(0));
+        setup();
+        runUntilIdle();
+        MockHal.drainSerialTx();
+        MockHal.takeSerialOutput();
+    }
+}
+
+void ChirpSim::runUntilIdle()
+{
+    while (MockHal.serialRxPending() || stringComplete)
+    {
+        if (!stringComplete && !Serial.available())
+        {
+            // Nothing to do until the next byte arrives, skip the idle passes of loop()
+            MockHal.advanceTo(MockHal.serialNextArrival());
+        }
+
+        if (stringComplete && dispatchListener)
+        {
+            char line[CHIRP_INPUT_STRING_LENGTH + 1];
+            memcpy(line, inputString, CHIRP_INPUT_STRING_LENGTH);
+            line[CHIRP_INPUT_STRING_LENGTH] = '\0';
+            dispatchListener(line, dispatchListenerContext);
+        }
+
+        MockHal.runLoopOnce();
+    }
+
+    // The sketch may still act on what serialEvent() consumed last, give it the pass it would get on the board
+    MockHal.runLoopOnce();
+}
+
+ChirpCommandCost ChirpSim::command(const std::string& text)
+{
+    ChirpCommandCost cost;
+    std::string line = text + "\r";
+
+    MockHal.drainSerialTx();
+    MockHal.takeSerialOutput();
+    MockHal.resetCounters();
+
+    uint64_t startCycles = MockHal.cycles();
+    uint64_t startNs = threadCpuNanoseconds();
+
+    MockHal.serialInject(line);
+    runUntilIdle();
+
+    cost.hostNanoseconds = threadCpuNanoseconds() - startNs;
+
+    MockHal.drainSerialTx();
+    cost.deviceCycles = MockHal.cycles() - startCycles;
+    cost.counters = MockHal.counters();
+    cost.output = MockHal.takeSerialOutput();
+
+    return cost;
+}
+
+void ChirpSim::setDispatchListener(void (*listener)(const char* line, void* context), void* context)
+{
+    dispatchListener = listener;
+    dispatchListenerContext = context;
+}
+
+uint64_t ChirpSim::threadCpuNanoseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
@@ -0,0 +1,91 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#ifndef ChirpSim_h
+#define ChirpSim_h
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include "Arduino.h"
+#include "MockHal.h"
+
+/// @brief Host CPU time and device side cost of one command
+struct ChirpCommandCost
+{
+    uint64_t hostNanoseconds;    //!< thread CPU time spent inside the firmware and the mock HAL
+    uint64_t deviceCycles;       //!< simulated time from the first byte on the RX line to the last byte out of TX
+    MockCounters counters;
+    std::string output;
+};
+
+/// @brief Boots the real firmware on the mock HAL and feeds it commands the way a terminal would
+class ChirpSim
+{
+  public:
+    ChirpSim();
+
+    /// Runs setup(), only once per process because the firmware lives in globals
+    void boot();
+
+    /// Runs the main loop until every injected byte has been consumed and no command is pending
+    void runUntilIdle();
+
+    /// Sends text + CR, runs until idle and waits for the TX buffer to drain
+    ChirpCommandCost command(const std::string& text);
+
+    /// Replaces the stand-in devices with an emulator
+    void attachDdsDevice(MockSpiDevice* device);
+    void attachAmplifierDevice(MockI2cDevice* device);
+
+    /// Called by runUntilIdle() with every line the sketch is about to dispatch, as the parser assembled it
+    void setDispatchListener(void (*listener)(const char* line, void* context), void* context);
+
+    static uint64_t threadCpuNanoseconds();
+
+    static const uint8_t DDS_CHIP_SELECT_PIN = 10;
+    static const uint8_t RPOT_I2C_ADDRESS = 0x28;
+
+  private:
+    bool booted;
+    void (*dispatchListener)(const char*, void*);
+    void* dispatchListenerContext;
+};
+
+/// @brief SPI slave that accepts everything, used when no emulator is attached
+class NullSpiDevice : public MockSpiDevice
+{
+  public:
+    virtual uint8_t transfer(uint8_t) { return 0; }
+};
+
+/// @brief I2C slave that acknowledges everything and reads back zeros
+class AckI2cDevice : public MockI2cDevice
+{
+  public:
+    virtual bool write(const uint8_t*, size_t) { return true; }
+    virtual size_t read(uint8_t* data, size_t length) { memset(data, 0, length); return length; }
+};
+
+/// True while the sketch has a complete line it has not processed yet (global in Chirp.ino)
+extern boolean stringComplete;
+/// Line assembled by serialEvent(), up to MAX_STRING_LENGTH characters and always terminated
+extern char inputString[];
+static const size_t CHIRP_INPUT_STRING_LENGTH = 12;
+
+#endif
@@ -0,0 +1,88 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include "OutputLevelModel.h"
+
+OutputLevelModel::OutputLevelModel()
+{
+    param = defaults();
+}
+
+OutputLevelModel::OutputLevelModel(const OutputLevelParameters& parameters)
+{
+    param = parameters;
+}
+
+OutputLevelParameters OutputLevelModel::defaults()
+{
+    OutputLevelParameters defaults;
+
+    // Calibration lines from AmplifierClass::set()
+    defaults.rabOhms = 10000.0;
+    defaults.sineOffsetOhms = 270.0;
+    defaults.sineOhmsPerMv = 27.732;
+    defaults.squareOffsetOhms = 23.25;
+    defaults.squareOhmsPerMv = 2.3046875;
+    defaults.gainInterceptOhms = 12000.0;
+    defaults.triangleRmsRatio = 0.8165;
+    defaults.railMv = 4500.0;
+
+    return defaults;
+}
+
+double OutputLevelModel::wiperOhms(uint16_t wiper) const
+{
+    return (double) wiper * param.rabOhms / RpotEmulator::FULL_SCALE;
+}
+
+double OutputLevelModel::predictMv(const RpotEmulator& rpot, WAVEFORM_T waveform) const
+{
+    double r0 = wiperOhms(rpot.wiper(0));
+    double r1 = wiperOhms(rpot.wiper(1));
+    double inputMv;
+
+    if ((rpot.tcon() & RpotEmulator::TCON_R1W) == 0)
+    {
+        // Wiper of the input pot disconnected, nothing reaches the amplifier
+        return 0.0;
+    }
+
+    if ((waveform == WAVEFORM_SQUARE) || (waveform == WAVEFORM_SQUARE_DIV_2))
+    {
+        inputMv = (r1 - param.squareOffsetOhms) / param.squareOhmsPerMv;
+    }
+    else
+    {
+        inputMv = (r1 - param.sineOffsetOhms) / param.sineOhmsPerMv;
+    }
+
+    if (inputMv < 0.0)
+    {
+        inputMv = 0.0;
+    }
+
+    double gain = (param.gainInterceptOhms - r0) / (param.gainInterceptOhms - param.rabOhms);
+    double outputMv = inputMv * gain;
+
+    if (waveform == WAVEFORM_TRIANGLE)
+    {
+        outputMv *= param.triangleRmsRatio;
+    }
+
+    return (outputMv > param.railMv) ? param.railMv : outputMv;
+}
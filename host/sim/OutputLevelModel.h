@@ -0,0 +1,67 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Predicts the output level of the amplifier stage from the RPOT state.
+ *
+ *  R1 is the potentiometer ahead of the non-inverting amplifier and sets how much of the DDS output reaches it, R0 is
+ *  the rheostat that sets the gain.  The transfer curves are the bench calibrations recorded in Amplifier.cpp, used
+ *  here in the forward direction and with the resistances the wipers really give rather than the ones the firmware
+ *  asked for, so the prediction shows truncation, clamping and any command the part never received.
+ *
+ *  The calibrations were taken with a sine wave.  The DDS triangle has the same peak to peak swing, so its RMS level
+ *  is sqrt(2/3) of the sine level at the same settings.
+ */
+#ifndef OutputLevelModel_h
+#define OutputLevelModel_h
+
+#include "OutputChannel.h"
+#include "RpotEmulator.h"
+
+struct OutputLevelParameters
+{
+    double rabOhms;                  //!< end to end resistance of both pots
+    double sineOffsetOhms;           //!< sine attenuator: mV = (R1 - offset) / slope
+    double sineOhmsPerMv;
+    double squareOffsetOhms;         //!< square attenuator: mV = (R1 - offset) / slope
+    double squareOhmsPerMv;
+    double gainInterceptOhms;        //!< gain = (intercept - R0) / (intercept - Rab), 1 with R0 at full scale
+    double triangleRmsRatio;
+    double railMv;                   //!< op-amp output limit
+};
+
+class OutputLevelModel
+{
+  public:
+    OutputLevelModel();
+    explicit OutputLevelModel(const OutputLevelParameters& parameters);
+
+    static OutputLevelParameters defaults();
+
+    /// @returns the predicted output in mV RMS
+    double predictMv(const RpotEmulator& rpot, WAVEFORM_T waveform) const;
+
+    const OutputLevelParameters& parameters() const { return param; }
+
+  private:
+    double wiperOhms(uint16_t wiper) const;
+
+    OutputLevelParameters param;
+};
+
+#endif
@@ -0,0 +1,219 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+#include <string.h>
+#include "Amplifier.h"
+#include "RpotEmulator.h"
+
+RpotEmulator::RpotEmulator()
+{
+    nvWiper[0] = FULL_SCALE / 2;
+    nvWiper[1] = FULL_SCALE / 2;
+    logging = false;
+    powerOn();
+    resetCounters();
+}
+
+void RpotEmulator::powerOn()
+{
+    volatileWiper[0] = nvWiper[0];
+    volatileWiper[1] = nvWiper[1];
+    tconRegister = TCON_DEFAULT;
+    readAddress = RPOT_MEMORY_MAP_VOLATILE_WIPER_0;
+    eepromBusyUntil = 0;
+}
+
+void RpotEmulator::resetCounters()
+{
+    memset(&count, 0, sizeof(count));
+}
+
+uint16_t RpotEmulator::status() const
+{
+    return eepromBusy() ? STATUS_EEWA : 0;
+}
+
+bool RpotEmulator::eepromBusy() const
+{
+    return MockHal.cycles() < eepromBusyUntil;
+}
+
+void RpotEmulator::record(uint8_t address, uint8_t command, uint16_t data, bool accepted)
+{
+    if (!accepted)
+    {
+        count.nacks++;
+    }
+
+    if (logging)
+    {
+        RpotOperation operation = { MockHal.cycles(), address, command, data, accepted };
+        log.push_back(operation);
+    }
+}
+
+bool RpotEmulator::write(const uint8_t* data, size_t length)
+{
+    size_t i = 0;
+
+    count.transactions++;
+
+    while (i < length)
+    {
+        uint8_t address = data[i] >> 4;
+        uint8_t command = (data[i] >> 2) & 0x03;
+        uint16_t value = (uint16_t) (data[i] & 0x03) << 8;
+        i++;
+
+        if (command == RPOT_CMD_WRITE_DATA)
+        {
+            if (i == length)
+            {
+                // Stop condition in the middle of a 16-bit command, the part discards it
+                count.incompleteCommands++;
+                record(address, command, value, false);
+                return true;
+            }
+
+            value |= data[i];
+            i++;
+        }
+
+        if (!execute(address, command, value))
+        {
+            // The master stops after a NACK, nothing later in the transaction reaches the part
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool RpotEmulator::execute(uint8_t address, uint8_t command, uint16_t data)
+{
+    bool nonVolatile = (address == RPOT_MEMORY_MAP_NON_VOLATILE_WIPER_0) ||
+                       (address == RPOT_MEMORY_MAP_NON_VOLATILE_WIPER_1);
+
+    if ((address >= RPOT_MEMORY_MAP_INVALID_VALUE) || (nonVolatile && eepromBusy()))
+    {
+        // Reserved address, or EEPROM still busy with the previous write
+        record(address, command, data, false);
+        return false;
+    }
+
+    switch (command)
+    {
+        case RPOT_CMD_WRITE_DATA:
+            count.writes++;
+
+            if (address == RPOT_MEMORY_MAP_STATUS_REGISTER)
+            {
+                record(address, command, data, false);
+                return false;
+            }
+
+            if ((address != RPOT_MEMORY_MAP_VOLATILE_TCON) && (data > FULL_SCALE))
+            {
+                count.dataOverRange++;
+                data = FULL_SCALE;
+            }
+
+            if (address == RPOT_MEMORY_MAP_VOLATILE_WIPER_0 || address == RPOT_MEMORY_MAP_VOLATILE_WIPER_1)
+            {
+                uint16_t* wiper = &volatileWiper[address - RPOT_MEMORY_MAP_VOLATILE_WIPER_0];
+                count.redundantWrites += (*wiper == data);
+                *wiper = data;
+            }
+            else if (nonVolatile)
+            {
+                nvWiper[address - RPOT_MEMORY_MAP_NON_VOLATILE_WIPER_0] = data;
+                eepromBusyUntil = MockHal.cycles() + EEPROM_WRITE_CYCLES;
+            }
+            else
+            {
+                tconRegister = data & 0x1FF;
+            }
+        break;
+        case RPOT_CMD_INCREMENT:
+        case RPOT_CMD_DECREMENT:
+        {
+            if (address > RPOT_MEMORY_MAP_VOLATILE_WIPER_1)
+            {
+                // Increment and decrement only apply to the volatile wipers
+                record(address, command, data, false);
+                return false;
+            }
+
+            uint16_t* wiper = &volatileWiper[address];
+
+            if (command == RPOT_CMD_INCREMENT)
+            {
+                count.increments++;
+                *wiper += (*wiper < FULL_SCALE);
+            }
+            else
+            {
+                count.decrements++;
+                *wiper -= (*wiper > 0);
+            }
+
+            data = *wiper;
+        }
+        break;
+        default:
+            count.reads++;
+            readAddress = address;
+        break;
+    }
+
+    record(address, command, data, true);
+    return true;
+}
+
+size_t RpotEmulator::read(uint8_t* data, size_t length)
+{
+    uint16_t value;
+
+    count.transactions++;
+
+    switch (readAddress)
+    {
+        case RPOT_MEMORY_MAP_VOLATILE_WIPER_0:
+        case RPOT_MEMORY_MAP_VOLATILE_WIPER_1:
+            value = volatileWiper[readAddress];
+        break;
+        case RPOT_MEMORY_MAP_NON_VOLATILE_WIPER_0:
+        case RPOT_MEMORY_MAP_NON_VOLATILE_WIPER_1:
+            value = nvWiper[readAddress - RPOT_MEMORY_MAP_NON_VOLATILE_WIPER_0];
+        break;
+        case RPOT_MEMORY_MAP_VOLATILE_TCON:
+            value = tconRegister;
+        break;
+        default:
+            value = status();
+        break;
+    }
+
+    // The part repeats the 16-bit value for as long as the master keeps clocking
+    for (size_t i = 0; i < length; i++)
+    {
+        data[i] = (i & 1) ? (uint8_t) value : (uint8_t) (value >> 8);
+    }
+
+    return length;
+}
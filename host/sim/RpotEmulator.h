@@ -0,0 +1,115 @@
+/*
+    This file is part of Chirp.
+
+    Chirp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    Chirp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Chirp.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2016 Mike Lemberger
+*/
+
+/** Emulates the dual 8-bit MCP46x1 digital pot on the Chirp shield at the I2C byte level.
+ *
+ *  Every transaction is decoded the way the part does it: a command byte A3A2A1A0C1C0D9D8, followed by a data byte
+ *  for write commands.  Increment and decrement are single byte commands and may be repeated within a transaction.
+ *  A read command sets the address that the next read transaction returns.  Writes to the non-volatile wipers start
+ *  a 5 ms EEPROM cycle during which the EEWA status bit is set and further non-volatile commands are NACKed.
+ *  Commands the part would reject are NACKed and counted, a transaction that ends half way through a write command
+ *  is ignored by the part and counted as incomplete.
+ */
+#ifndef RpotEmulator_h
+#define RpotEmulator_h
+
+#include <stdint.h>
+#include <vector>
+#include "MockHal.h"
+
+/// @brief One command as the RPOT decoded it
+struct RpotOperation
+{
+    uint64_t cycle;
+    uint8_t address;     //!< RPOT_MEMORY_MAP_T
+    uint8_t command;     //!< RPOT_CMD_T
+    uint16_t data;       //!< data written, or the value after an increment/decrement
+    bool accepted;       //!< false when the part NACKed or ignored it
+};
+
+/// @brief Totals since the last resetCounters()
+struct RpotCounters
+{
+    uint32_t transactions;
+    uint32_t writes;
+    uint32_t increments;
+    uint32_t decrements;
+    uint32_t reads;
+    uint32_t nacks;              //!< invalid address, invalid command or EEPROM busy
+    uint32_t incompleteCommands; //!< write commands without their data byte
+    uint32_t dataOverRange;      //!< write data above full scale, clamped to full scale
+    uint32_t redundantWrites;    //!< wiper writes that did not change the wiper
+};
+
+class RpotEmulator : public MockI2cDevice
+{
+  public:
+    RpotEmulator();
+
+    /// Power on state: volatile wipers loaded from the non-volatile ones, TCON all connected
+    void powerOn();
+
+    virtual bool write(const uint8_t* data, size_t length);
+    virtual size_t read(uint8_t* data, size_t length);
+
+    uint16_t wiper(uint8_t number) const { return volatileWiper[number & 1]; }
+    uint16_t nonVolatileWiper(uint8_t number) const { return nvWiper[number & 1]; }
+    uint16_t tcon() const { return tconRegister; }
+    uint16_t status() const;
+
+    const RpotCounters& counters() const { return count; }
+    void resetCounters();
+
+    /// Keeps every decoded command, off by default because sweeps produce many of them
+    void setLogging(bool enabled) { logging = enabled; }
+    const std::vector<RpotOperation>& operations() const { return log; }
+    void clearOperations() { log.clear(); }
+
+    static const uint16_t FULL_SCALE = 0x100;           //!< 257 taps, 0x000..0x100
+    static const uint16_t TCON_DEFAULT = 0x1FF;
+    static const uint64_t EEPROM_WRITE_CYCLES = MockHalClass::F_CPU_HZ / 200;   //!< 5 ms tWC
+
+    // TCON bits, <b8> GCEN, <b7:b4> R1HW R1A R1W R1B, <b3:b0> R0HW R0A R0W R0B
+    static const uint16_t TCON_R0B = 0x001;
+    static const uint16_t TCON_R0W = 0x002;
+    static const uint16_t TCON_R0A = 0x004;
+    static const uint16_t TCON_R0HW = 0x008;
+    static const uint16_t TCON_R1B = 0x010;
+    static const uint16_t TCON_R1W = 0x020;
+    static const uint16_t TCON_R1A = 0x040;
+    static const uint16_t TCON_R1HW = 0x080;
+
+    static const uint16_t STATUS_EEWA = 0x008;
+
+  private:
+    bool execute(uint8_t address, uint8_t command, uint16_t data);
+    bool eepromBusy() const;
+    void record(uint8_t address, uint8_t command, uint16_t data, bool accepted);
+
+    uint16_t volatileWiper[2];
+    uint16_t nvWiper[2];
+    uint16_t tconRegister;
+    uint8_t readAddress;
+    uint64_t eepromBusyUntil;
+    bool logging;
+    RpotCounters count;
+    std::vector<RpotOperation> log;
+};
+
+#endif